@@ -40,6 +40,7 @@
 **  Private Constants
 **  -----------------
 */
+#define CaptureBufSize          65536
 
 /*
 **  -----------------------
@@ -58,6 +59,9 @@
 **  Private Function Prototypes
 **  ---------------------------
 */
+static void channelDelayedDisconnect(void *param);
+static void channelCaptureRecord(u8 type, PpWord word);
+static void channelCaptureStop(void);
 
 /*
 **  ----------------
@@ -75,6 +79,11 @@ u8 channelCount;
 **  -----------------
 */
 static u8 ch = 0;
+static ChEvent *eventQueue = NULL;
+static bool eventDispatch = FALSE;
+static ChSlot *captureChannel = NULL;
+static FILE *captureFcb = NULL;
+static long captureRecords;
 
 /*
 **--------------------------------------------------------------------------
@@ -157,6 +166,11 @@ void channelTerminate(void)
                 mt679Terminate(dp);
                 }
 
+            if (dp->devType == DtLp1612)
+                {
+                lp1612Terminate(dp);
+                }
+
             /*
             **  Free all unit contexts and close all open files.
             */
@@ -185,9 +199,15 @@ void channelTerminate(void)
             }
         }
 
+    /*
+    **  Finish any traffic capture.
+    */
+    channelCaptureStop();
+
     /*
     **  Free all channel control blocks.
     */
+    eventQueue = NULL;
     free(channel);
     }
 
@@ -302,6 +322,7 @@ void channelFunction(PpWord funcCode)
             **  Device has claimed function code - select it for I/O.
             */
             activeChannel->ioDevice = activeDevice;
+            activeDevice->stats.functions += 1;
             break;
             }
 
@@ -311,6 +332,7 @@ void channelFunction(PpWord funcCode)
             **  Device has processed function code - no need for I/O.
             */
             activeChannel->ioDevice = NULL;
+            activeDevice->stats.functions += 1;
             break;
             }
         }
@@ -325,6 +347,12 @@ void channelFunction(PpWord funcCode)
         activeChannel->full = TRUE;
         activeChannel->active = TRUE;
         }
+
+    if (activeChannel == captureChannel)
+        {
+        channelCaptureRecord(CapFunction, funcCode);
+        putc(status, captureFcb);
+        }
     }
 
 /*--------------------------------------------------------------------------
@@ -339,6 +367,11 @@ void channelActivate(void)
     {
     activeChannel->active = TRUE;
 
+    if (activeChannel == captureChannel)
+        {
+        channelCaptureRecord(CapActivate, 0);
+        }
+
     if (activeChannel->ioDevice != NULL)
         {
         activeDevice = activeChannel->ioDevice;
@@ -358,6 +391,11 @@ void channelDisconnect(void)
     {
     activeChannel->active = FALSE;
 
+    if (activeChannel == captureChannel)
+        {
+        channelCaptureRecord(CapDisconnect, 0);
+        }
+
     if (activeChannel->ioDevice != NULL)
         {
         activeDevice = activeChannel->ioDevice;
@@ -379,6 +417,9 @@ void channelDisconnect(void)
 **------------------------------------------------------------------------*/
 void channelIo(void)
     {
+    PpWord data;
+    bool full;
+
     /*
     **  Perform request.
     */
@@ -386,7 +427,27 @@ void channelIo(void)
         && activeChannel->ioDevice != NULL)
         {
         activeDevice = activeChannel->ioDevice;
+        if (activeChannel != captureChannel)
+            {
+            activeDevice->io();
+            return;
+            }
+
+        /*
+        **  Only calls which move a word are recorded, polls which find
+        **  nothing to do are not.
+        */
+        data = activeChannel->data;
+        full = activeChannel->full;
         activeDevice->io();
+        if (full && !activeChannel->full)
+            {
+            channelCaptureRecord(CapOutput, data);
+            }
+        else if (!full && activeChannel->full)
+            {
+            channelCaptureRecord(CapInput, activeChannel->data);
+            }
         }
     }
 
@@ -487,6 +548,7 @@ void channelSetFull(void)
     if (activeChannel->ioDevice != NULL)
         {
         activeDevice = activeChannel->ioDevice;
+        activeDevice->stats.wordsOut += 1;
         if (activeDevice->devType == DtPciChannel)
             {
             activeDevice->full();
@@ -509,6 +571,7 @@ void channelSetEmpty(void)
     if (activeChannel->ioDevice != NULL)
         {
         activeDevice = activeChannel->ioDevice;
+        activeDevice->stats.wordsIn += 1;
         if (activeDevice->devType == DtPciChannel)
             {
             activeDevice->empty();
@@ -519,7 +582,7 @@ void channelSetEmpty(void)
     }
 
 /*--------------------------------------------------------------------------
-**  Purpose:        Handle delayed channel disconnect.
+**  Purpose:        Process channel events which have become due.
 **
 **  Parameters:     Name        Description.
 **
@@ -528,29 +591,277 @@ void channelSetEmpty(void)
 **------------------------------------------------------------------------*/
 void channelStep(void)
     {
-    ChSlot *cc;
+    ChEvent *ep;
 
     /*
-    **  Process any delayed disconnects.
+    **  Events are kept in order of due cycle, so usually this is just a
+    **  single test of the queue head.
     */
-    for (ch = 0; ch < channelCount; ch++)
+    eventDispatch = TRUE;
+    while ((ep = eventQueue) != NULL && (i32)(cycles - ep->due) >= 0)
         {
-        cc = &channel[ch];
-        if (cc->delayDisconnect != 0)
+        eventQueue = ep->next;
+        ep->next = NULL;
+        ep->pending = FALSE;
+        if (ep->handler != NULL)
             {
-            cc->delayDisconnect -= 1;
-            if (cc->delayDisconnect == 0)
-                {
-                cc->active = FALSE;
-                cc->discAfterInput = FALSE;
-                }
+            ep->handler(ep->param);
+            }
+        }
+
+    eventDispatch = FALSE;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Schedule (or reschedule) a channel event. The handler
+**                  is called from the delay'th channelStep from now, where
+**                  the step of the current major cycle counts if it has
+**                  not yet happened. A handler may reschedule its own event
+**                  to get periodic service.
+**
+**  Parameters:     Name        Description.
+**                  ep          pointer to event
+**                  delay       delay in major cycles (at least 1)
+**                  handler     handler called when due (may be NULL)
+**                  param       parameter passed to handler
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void channelSchedule(ChEvent *ep, u32 delay, void (*handler)(void *param), void *param)
+    {
+    ChEvent **link;
+
+    channelCancel(ep);
+
+    ep->handler = handler;
+    ep->param = param;
+    ep->due = cycles + delay;
+    if (!eventDispatch)
+        {
+        ep->due -= 1;
+        }
+
+    /*
+    **  Insert behind all events due at the same cycle or earlier.
+    */
+    for (link = &eventQueue; *link != NULL; link = &(*link)->next)
+        {
+        if ((i32)((*link)->due - ep->due) > 0)
+            {
+            break;
             }
+        }
+
+    ep->next = *link;
+    *link = ep;
+    ep->pending = TRUE;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Cancel a channel event.
+**
+**  Parameters:     Name        Description.
+**                  ep          pointer to event
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void channelCancel(ChEvent *ep)
+    {
+    ChEvent **link;
+
+    if (!ep->pending)
+        {
+        return;
+        }
 
-        if (cc->delayStatus != 0)
+    for (link = &eventQueue; *link != NULL; link = &(*link)->next)
+        {
+        if (*link == ep)
             {
-            cc->delayStatus -= 1;
+            *link = ep->next;
+            break;
             }
         }
+
+    ep->next = NULL;
+    ep->pending = FALSE;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Delay changes of the empty/full status of the active
+**                  channel.
+**
+**  Parameters:     Name        Description.
+**                  delay       delay in major cycles (0 cancels the delay)
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void channelDelayStatus(u8 delay)
+    {
+    if (delay == 0)
+        {
+        channelCancel(&activeChannel->delayStatus);
+        }
+    else
+        {
+        channelSchedule(&activeChannel->delayStatus, delay, NULL, NULL);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Disconnect the active channel after a delay.
+**
+**  Parameters:     Name        Description.
+**                  delay       delay in major cycles (0 cancels the disconnect)
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void channelDelayDisconnect(u8 delay)
+    {
+    if (delay == 0)
+        {
+        channelCancel(&activeChannel->delayDisconnect);
+        }
+    else
+        {
+        channelSchedule(&activeChannel->delayDisconnect, delay, channelDelayedDisconnect, activeChannel);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Start or stop recording the traffic between the PPs
+**                  and the devices on a channel for later replay by
+**                  dtreplay.
+**
+**  Parameters:     Name        Description.
+**                  params      "<channel>,<filename>" or "off"
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void channelCapture(char *params)
+    {
+    int numParam;
+    int channelNo;
+    char fileName[256];
+    FILE *fcb;
+
+    if (strcmp(params, "off") == 0)
+        {
+        if (captureFcb == NULL)
+            {
+            printf("No channel capture active\n");
+            return;
+            }
+
+        channelCaptureStop();
+        return;
+        }
+
+    numParam = sscanf(params, "%o,%255s", &channelNo, fileName);
+    if (numParam != 2)
+        {
+        printf("Not enough or invalid parameters\n");
+        return;
+        }
+
+    if (channelNo < 0 || channelNo >= channelCount || channelNo == ChClock)
+        {
+        printf("Invalid channel no\n");
+        return;
+        }
+
+    fcb = fopen(fileName, "wb");
+    if (fcb == NULL)
+        {
+        printf("Failed to open %s\n", fileName);
+        return;
+        }
+
+    /*
+    **  Only one channel is captured at a time.
+    */
+    channelCaptureStop();
+    setvbuf(fcb, NULL, _IOFBF, CaptureBufSize);
+    fwrite(CapMagic, 1, CapMagicSize, fcb);
+    putc(channelNo, fcb);
+
+    captureFcb = fcb;
+    captureRecords = 0;
+    captureChannel = channel + channelNo;
+    printf("Capturing channel %o to %s\n", channelNo, fileName);
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Append a record to the channel capture file.
+**
+**  Parameters:     Name        Description.
+**                  type        record type (CapXxx)
+**                  word        word carried by the record
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void channelCaptureRecord(u8 type, PpWord word)
+    {
+    putc(type, captureFcb);
+    if (type != CapActivate && type != CapDisconnect)
+        {
+        putc(word & 0xFF, captureFcb);
+        putc((word >> 8) & 0x0F, captureFcb);
+        }
+
+    captureRecords += 1;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Finish the channel capture file.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void channelCaptureStop(void)
+    {
+    if (captureFcb == NULL)
+        {
+        return;
+        }
+
+    printf("Channel %o capture finished, %ld records\n", captureChannel->id, captureRecords);
+    fclose(captureFcb);
+    captureFcb = NULL;
+    captureChannel = NULL;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Handle delayed channel disconnect.
+**
+**  Parameters:     Name        Description.
+**                  param       pointer to channel
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void channelDelayedDisconnect(void *param)
+    {
+    ChSlot *cc = param;
+
+    cc->active = FALSE;
+    cc->discAfterInput = FALSE;
     }
 
 /*---------------------------  End Of File  ------------------------------*/
@@ -35,6 +35,54 @@
 #include "types.h"
 #include "proto.h"
 
+/*
+**  Run time selected SIMD kernels need GCC 5 or clang on x86.
+*/
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define CharsetSimd             1
+#include <immintrin.h>
+#else
+#define CharsetSimd             0
+#endif
+
+/*
+**  -----------------
+**  Private Constants
+**  -----------------
+*/
+
+/*
+**  -----------------------
+**  Private Macro Functions
+**  -----------------------
+*/
+
+/*
+**  -----------------------------------------
+**  Private Typedef and Structure Definitions
+**  -----------------------------------------
+*/
+
+/*
+**  ---------------------------
+**  Private Function Prototypes
+**  ---------------------------
+*/
+#if CharsetSimd
+static bool charsetHasSsse3(void);
+static u32 charsetToAsciiSsse3(const u8 *in, u32 count, char *out, const char *table);
+static u32 charsetPpToAsciiSsse3(const PpWord *in, u32 wordCount, char *out, const char *table);
+#endif
+
+/*
+**  -----------------
+**  Private Variables
+**  -----------------
+*/
+#if CharsetSimd
+static int ssse3 = -1;
+#endif
+
 /*
 **  --------------------------------------
 **  Public character set conversion tables
@@ -318,5 +366,238 @@ const i8 altKeyToPlato[128] =
  /* 170- */ -1,     -1,     -1,     -1,     -1,     -1,     -1,     -1
 };
 
+/*
+**--------------------------------------------------------------------------
+**
+**  Public Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Convert a buffer of 6 bit characters to ASCII.
+**
+**  Parameters:     Name        Description.
+**                  in          6 bit characters (upper bits are ignored)
+**                  count       number of characters
+**                  out         ASCII output (may be the same as in)
+**                  table       64 entry table, e.g. cdcToAscii or bcdToAscii
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void charsetToAscii(const u8 *in, u32 count, char *out, const char *table)
+    {
+    u32 i = 0;
+
+#if CharsetSimd
+    if (charsetHasSsse3())
+        {
+        i = charsetToAsciiSsse3(in, count, out, table);
+        }
+#endif
+
+    for (; i < count; i++)
+        {
+        out[i] = table[in[i] & Mask6];
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Convert PP words holding two 6 bit characters each
+**                  to ASCII.
+**
+**  Parameters:     Name        Description.
+**                  in          PP words
+**                  wordCount   number of words
+**                  out         ASCII output (2 * wordCount characters)
+**                  table       64 entry table, e.g. cdcToAscii or bcdToAscii
+**
+**  Returns:        Number of characters stored.
+**
+**------------------------------------------------------------------------*/
+u32 charsetPpToAscii(const PpWord *in, u32 wordCount, char *out, const char *table)
+    {
+    u32 i = 0;
+
+#if CharsetSimd
+    if (charsetHasSsse3())
+        {
+        i = charsetPpToAsciiSsse3(in, wordCount, out, table);
+        }
+#endif
+
+    for (; i < wordCount; i++)
+        {
+        out[i * 2 + 0] = table[(in[i] >> 6) & Mask6];
+        out[i * 2 + 1] = table[(in[i] >> 0) & Mask6];
+        }
+
+    return(wordCount * 2);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Convert CM words holding ten 6 bit characters each
+**                  to ASCII.
+**
+**  Parameters:     Name        Description.
+**                  in          CM words
+**                  wordCount   number of words
+**                  out         ASCII output (10 * wordCount characters)
+**                  table       64 entry table, e.g. cdcToAscii
+**
+**  Returns:        Number of characters stored.
+**
+**------------------------------------------------------------------------*/
+u32 charsetCmToAscii(const CpWord *in, u32 wordCount, char *out, const char *table)
+    {
+    u8 *op = (u8 *)out;
+    CpWord data;
+    u32 i;
+    int shift;
+
+    /*
+    **  Unpack the display codes first and translate them in place.
+    */
+    for (i = 0; i < wordCount; i++)
+        {
+        data = in[i];
+        for (shift = 54; shift >= 0; shift -= 6)
+            {
+            *op++ = (u8)((data >> shift) & Mask6);
+            }
+        }
+
+    charsetToAscii((u8 *)out, wordCount * 10, out, table);
+
+    return(wordCount * 10);
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+#if CharsetSimd
+/*--------------------------------------------------------------------------
+**  Purpose:        Determine if the host CPU supports SSSE3.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        TRUE if the SSSE3 kernels may be used.
+**
+**------------------------------------------------------------------------*/
+static bool charsetHasSsse3(void)
+    {
+    if (ssse3 < 0)
+        {
+        __builtin_cpu_init();
+        ssse3 = __builtin_cpu_supports("ssse3") ? 1 : 0;
+        }
+
+    return(ssse3 != 0);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Translate 16 6 bit characters via a 64 entry table
+**                  held as four 16 byte shuffle tables.
+**
+**  Parameters:     Name        Description.
+**                  idx         6 bit characters
+**                  tab         shuffle tables
+**
+**  Returns:        Translated characters.
+**
+**------------------------------------------------------------------------*/
+__attribute__((target("ssse3")))
+static inline __m128i charsetLookup64(__m128i idx, const __m128i *tab)
+    {
+    __m128i lo = _mm_and_si128(idx, _mm_set1_epi8(0x0F));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(idx, 4), _mm_set1_epi8(0x03));
+    __m128i res;
+
+    res =                    _mm_and_si128(_mm_cmpeq_epi8(hi, _mm_set1_epi8(0)), _mm_shuffle_epi8(tab[0], lo));
+    res = _mm_or_si128(res, _mm_and_si128(_mm_cmpeq_epi8(hi, _mm_set1_epi8(1)), _mm_shuffle_epi8(tab[1], lo)));
+    res = _mm_or_si128(res, _mm_and_si128(_mm_cmpeq_epi8(hi, _mm_set1_epi8(2)), _mm_shuffle_epi8(tab[2], lo)));
+    res = _mm_or_si128(res, _mm_and_si128(_mm_cmpeq_epi8(hi, _mm_set1_epi8(3)), _mm_shuffle_epi8(tab[3], lo)));
+
+    return(res);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        SSSE3 kernel for charsetToAscii.
+**
+**  Parameters:     Name        Description.
+**                  in          6 bit characters
+**                  count       number of characters
+**                  out         ASCII output
+**                  table       64 entry table
+**
+**  Returns:        Number of characters converted.
+**
+**------------------------------------------------------------------------*/
+__attribute__((target("ssse3")))
+static u32 charsetToAsciiSsse3(const u8 *in, u32 count, char *out, const char *table)
+    {
+    __m128i tab[4];
+    __m128i idx;
+    u32 i;
+
+    for (i = 0; i < 4; i++)
+        {
+        tab[i] = _mm_loadu_si128((const __m128i *)(table + i * 16));
+        }
+
+    for (i = 0; i + 16 <= count; i += 16)
+        {
+        idx = _mm_and_si128(_mm_loadu_si128((const __m128i *)(in + i)), _mm_set1_epi8(Mask6));
+        _mm_storeu_si128((__m128i *)(out + i), charsetLookup64(idx, tab));
+        }
+
+    return(i);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        SSSE3 kernel for charsetPpToAscii. Eight PP words are
+**                  split into 16 characters with the upper half of each
+**                  word first.
+**
+**  Parameters:     Name        Description.
+**                  in          PP words
+**                  wordCount   number of words
+**                  out         ASCII output
+**                  table       64 entry table
+**
+**  Returns:        Number of words converted.
+**
+**------------------------------------------------------------------------*/
+__attribute__((target("ssse3")))
+static u32 charsetPpToAsciiSsse3(const PpWord *in, u32 wordCount, char *out, const char *table)
+    {
+    __m128i tab[4];
+    __m128i w;
+    __m128i idx;
+    u32 i;
+
+    for (i = 0; i < 4; i++)
+        {
+        tab[i] = _mm_loadu_si128((const __m128i *)(table + i * 16));
+        }
+
+    for (i = 0; i + 8 <= wordCount; i += 8)
+        {
+        w = _mm_loadu_si128((const __m128i *)(in + i));
+        idx = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(w, 6), _mm_set1_epi16(Mask6)),
+                           _mm_slli_epi16(_mm_and_si128(w, _mm_set1_epi16(Mask6)), 8));
+        _mm_storeu_si128((__m128i *)(out + i * 2), charsetLookup64(idx, tab));
+        }
+
+    return(i);
+    }
+#endif
+
 /*---------------------------  End Of File  ------------------------------*/
 
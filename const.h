@@ -68,6 +68,25 @@
 */
 #define CcCycleTime             0
 
+/*
+**  Use SSE2 for scanning byte streams (available on all x86-64 hosts).
+*/
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CcSse2                  1
+#else
+#define CcSse2                  0
+#endif
+
+/*
+**  Use the time stamp counter as the clock for CPU opcode profiling.
+*/
+#if    (defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))) \
+    || (defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64)))
+#define CcRdtsc                 1
+#else
+#define CcRdtsc                 0
+#endif
+
 /*
 **  Device types.
 */
@@ -117,13 +136,31 @@
 #define MaxDeadStart            020
 #define MaxChannels             040
 
-#define MaxIwStack              12
+#define MaxIwStack              12      /* at most 16, stack entries are tracked in u16 masks */
+#define IwHashSize              16      /* power of two, at least MaxIwStack */
+#define IwHashMask              (IwHashSize - 1)
 
 #define FontLarge               32
 #define FontMedium              16
 #define FontSmall               8
 #define FontDot                 0
 
+/*
+**  Card decks.
+*/
+#define DeckQueueSize           32      /* decks per reader, power of two */
+#define DeckCr405               0       /* ~eoi/~eof/~eor/~bin card syntax */
+#define DeckCr3447              1       /* adds }, ~raw and short ~eor forms */
+#define CardAscii               0       /* columns hold ASCII characters */
+#define CardRaw                 1       /* columns hold 12 bit punch images */
+#define CardFlagBinary          01      /* 7/9 punch in column 1 */
+#define CardFlagFile            02      /* 7/8 punch in column 1 */
+
+/*
+**  Device statistics.
+*/
+#define StatsLatencyBuckets     16      /* host I/O latency buckets, 1 us to 32 ms and above */
+
 #ifndef _MAX_PATH
 #define _MAX_PATH                256
 #endif
@@ -208,6 +245,34 @@
 #define EmFlagExpandedAddress   02000000
 #define EmFlagUemEnable         04000000
 
+/*
+**  Log categories (see log.c).
+*/
+#define LogErrors               0
+#define LogDd8xx                1
+#define LogMt362x               2
+#define LogMt669                3
+#define LogMt679                4
+#define LogNpu                  5
+#define LogPci                  6
+#define LogMch                  7
+#define LogCategories           8
+
+/*
+**  Channel capture file records (see channel.c and replay.c). The file
+**  starts with the magic string and the channel number, followed by
+**  records of a type byte and, for all but activate and disconnect, a
+**  little endian 12 bit word. Function records carry one more byte with
+**  the FcStatus the devices returned.
+*/
+#define CapMagic                "DTCAPT01"
+#define CapMagicSize            8
+#define CapFunction             'F'
+#define CapActivate             'A'
+#define CapDisconnect           'D'
+#define CapOutput               'O'
+#define CapInput                'I'
+
 /*
 **  Channel status masks.
 */
@@ -220,6 +285,19 @@
 **  ----------------------
 */
 #define LogErrorLocation        __FILE__, __LINE__
+#define LogOn(cat)              ((logCategories & (1 << (cat))) != 0)
+
+/*
+**  Force inlining of small functions whose parameters are constant at the
+**  call site, so the compiler can fold them.
+*/
+#if defined(_MSC_VER)
+#define ForceInline             __forceinline
+#elif defined(__GNUC__)
+#define ForceInline             __inline__ __attribute__((always_inline))
+#else
+#define ForceInline
+#endif
 #if defined (__GNUC__) || defined(__SunOS)
 #define stricmp strcasecmp
 #endif
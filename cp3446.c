@@ -85,6 +85,11 @@
 #define StCp3446CompareErr       02000
 #define StCp3446NonIntStatus     02177
 
+/*
+**  Time a card is in motion before the punch accepts new data.
+*/
+#define CardMotionUs             20
+
 /*
 **  -----------------------
 **  Private Macro Functions
@@ -106,7 +111,7 @@ typedef struct
     int     col;
     int     lastnbcol;
     char    convtable[4096];
-    u32     getcardcycle;
+    TimerSlot cardMotion;
     char    card[322];
     } CpContext;
 
@@ -509,10 +514,10 @@ static void cp3446Io(void)
         /*
         **  Don't admit to having new data immediately after completing
         **  a card, otherwise 1CD may get stuck occasionally.
-        **  So we simulate card in motion for 20 major cycles.
+        **  So we simulate card in motion for a short while.
         */
         if (   !activeChannel->full
-            || cycles - cc->getcardcycle < 20)
+            || timerPending(&cc->cardMotion))
             {
             break;
             }
@@ -665,9 +670,9 @@ static void cp3446FlushCard(DevSlot *up, CpContext *cc)
         }
     
     /*
-    **  Remember the cycle counter when the card punch started.
+    **  Start the card motion timer.
     */
-    cc->getcardcycle = cycles;
+    timerStart(&cc->cardMotion, CardMotionUs, NULL, NULL);
     
     if (cc->binary && cc->rawcard)
         {
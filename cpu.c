@@ -34,6 +34,21 @@
 #include "const.h"
 #include "types.h"
 #include "proto.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#endif
+#if CcRdtsc && defined(_MSC_VER)
+#include <intrin.h>
+#elif CcRdtsc
+#include <x86intrin.h>
+#endif
 
 /*
 **  -----------------
@@ -58,12 +73,46 @@
 #define EcsBankSize             (131072 - 5120)
 #define EsmBankSize             131072
 
+/*
+**  Marks an initialised shared ECS segment.
+*/
+#define EcsSharedMagic          0x45435331
+
 /*
 **  -----------------------
 **  Private Macro Functions
 **  -----------------------
 */
 
+/*
+**  Define a CPU step function specialised for the feature set of one model.
+**  HasNoCejMej is a configuration option, so it remains a runtime test.
+*/
+#define CpuStepForModel(name, modelFeatures, profile)                           \
+    static void name(void)                                                      \
+        {                                                                       \
+        cpuStepModel((ModelFeatures)((modelFeatures) | (features & HasNoCejMej)), profile); \
+        }
+
+/*
+**  Host clock used for opcode profiling.
+*/
+#if CcRdtsc
+#define CpuTicks()              ((u64)__rdtsc())
+#else
+#define CpuTicks()              cpuHostTicks()
+#endif
+
+/*
+**  Atomic update of the ECS flag register, which may be shared with other
+**  emulator processes.
+*/
+#if defined(_WIN32)
+#define EcsFlagUpdate(p, o, n)  (InterlockedCompareExchange((volatile LONG *)(p), (LONG)(n), (LONG)(o)) == (LONG)(o))
+#else
+#define EcsFlagUpdate(p, o, n)  __sync_bool_compare_and_swap((p), (o), (n))
+#endif
+
 /*
 **  -----------------------------------------
 **  Private Typedef and Structure Definitions
@@ -75,18 +124,56 @@ typedef struct opDispatch
     u8   length;
     } OpDispatch;
 
+/*
+**  Start of a shared ECS segment, followed by the ECS words.
+*/
+typedef struct ecsShared
+    {
+    volatile u32    magic;              /* EcsSharedMagic once initialised */
+    u32             words;              /* size of ECS in words */
+    volatile u32    flagRegister;       /* ECS flag register */
+    volatile u32    attached;           /* number of attached emulators (Windows or no lock support) */
+    } EcsShared;
+
 /*
 **  ---------------------------
 **  Private Function Prototypes
 **  ---------------------------
 */
+static ForceInline void cpuStepModel(ModelFeatures modelFeatures, bool profile);
+static void cpuStep6400(void);
+static void cpuStepCyber73(void);
+static void cpuStepCyber173(void);
+static void cpuStepCyber175(void);
+static void cpuStepCyber840A(void);
+static void cpuStepCyber865(void);
+static void cpuProfile6400(void);
+static void cpuProfileCyber73(void);
+static void cpuProfileCyber173(void);
+static void cpuProfileCyber175(void);
+static void cpuProfileCyber840A(void);
+static void cpuProfileCyber865(void);
+#if !CcRdtsc
+static u64 cpuHostTicks(void);
+#endif
+static bool cpuEcsAttachShared(char *name, u32 words);
+static void cpuEcsDetachShared(bool *last);
+#if !defined(_WIN32)
+static int cpuEcsLock(int fd, short type, bool wait);
+#endif
 static void cpuOpIllegal(void);
-static bool cpuCheckOpAddress(u32 address, u32 *location);
+static void cpuSetWindow(void);
+static ForceInline bool cpuCheckOpAddress(ModelFeatures modelFeatures, u32 address, u32 *location);
+static ForceInline void cpuFetchOpWordModel(ModelFeatures modelFeatures, u32 address, CpWord *data);
 static void cpuFetchOpWord(u32 address, CpWord *data);
+static ForceInline int cpuIwLookup(u32 location);
+static int cpuIwEnter(u32 location);
+static void cpuIwRemove(int i);
 static void cpuVoidIwStack(u32 branchAddr);
 static bool cpuReadMem(u32 address, CpWord *data);
 static bool cpuWriteMem(u32 address, CpWord *data);
 static void cpuRegASemantics(void);
+static ForceInline u32 cpuAddRaModel(ModelFeatures modelFeatures, u32 op);
 static u32 cpuAddRa(u32 op);
 static u32 cpuAdd18(u32 op1, u32 op2);
 static u32 cpuAdd24(u32 op1, u32 op2);
@@ -176,11 +263,12 @@ static void cpOp77(void);
 */
 CpWord *cpMem;
 CpWord *extMem;
-u32 ecsFlagRegister;
 CpuContext cpu;
 bool cpuStopped = TRUE;
 u32 cpuMaxMemory;
 u32 extMaxMemory;
+void (*cpuStep)(void) = cpuStep6400;
+CpuOpStats cpuOpStats[01000];
 
 /*
 **  -----------------
@@ -189,6 +277,23 @@ u32 extMaxMemory;
 */
 static FILE *cmHandle;
 static FILE *ecsHandle;
+static u32 ecsFlagLocal;
+static volatile u32 *ecsFlagRegister = &ecsFlagLocal;
+static EcsShared *ecsShared = NULL;
+#if defined(_WIN32)
+static HANDLE ecsMapping;
+#else
+static int ecsSharedFd = -1;
+static char ecsShmName[_MAX_PATH];
+#endif
+/*
+**  Directly addressable part of the current field length, recomputed
+**  whenever RA or FL change (i.e. on an exchange jump).
+*/
+static CpWord *cmWindowBase;
+static u32 cmWindowRa;
+static u32 cmWindowLimit;
+
 static u8 opOffset;
 static CpWord opWord;
 static u8 opFm;
@@ -283,6 +388,19 @@ static OpDispatch decodeCpuOpcode[] =
 
 static u8 cpOp01Length[8] = { 30, 30, 30, 30, 15, 15, 15, 15 };
 
+/*
+**  Step functions by model (ModelType order), plain and profiling.
+*/
+static void (*cpuStepModels[][2])(void) =
+    {
+    { cpuStep6400,      cpuProfile6400      },
+    { cpuStepCyber73,   cpuProfileCyber73   },
+    { cpuStepCyber173,  cpuProfileCyber173  },
+    { cpuStepCyber175,  cpuProfileCyber175  },
+    { cpuStepCyber840A, cpuProfileCyber840A },
+    { cpuStepCyber865,  cpuProfileCyber865  },
+    };
+
 /*
 **--------------------------------------------------------------------------
 **
@@ -306,6 +424,7 @@ static u8 cpOp01Length[8] = { 30, 30, 30, 30, 15, 15, 15, 15 };
 void cpuInit(char *model, u32 memory, u32 emBanks, ExtMemory emType)
     {
     u32 extBanksSize;
+    bool ecsLoad = TRUE;
 
     /*
     **  Allocate configured central memory.
@@ -318,6 +437,7 @@ void cpuInit(char *model, u32 memory, u32 emBanks, ExtMemory emType)
         }
 
     cpuMaxMemory = memory;
+    cpuSetWindow();
 
     switch (emType)
         {
@@ -331,16 +451,30 @@ void cpuInit(char *model, u32 memory, u32 emBanks, ExtMemory emType)
         }
 
     /*
-    **  Allocate configured ECS memory.
+    **  Allocate configured ECS memory, either private or shared with
+    **  other emulators forming a multi-mainframe complex. Only the
+    **  emulator creating a shared ECS loads its persistent contents.
     */
-    extMem = calloc(emBanks * extBanksSize, sizeof(CpWord));
-    if (extMem == NULL)
+    extMaxMemory = emBanks * extBanksSize;
+    if (*ecsSharedName != '\0')
         {
-        fprintf(stderr, "Failed to allocate ECS memory\n");
-        exit(1);
-        }
+        if (extMaxMemory == 0)
+            {
+            fprintf(stderr, "Shared ECS requires 'ecsbanks' or 'esmbanks'\n");
+            exit(1);
+            }
 
-    extMaxMemory = emBanks * extBanksSize;
+        ecsLoad = cpuEcsAttachShared(ecsSharedName, extMaxMemory);
+        }
+    else
+        {
+        extMem = calloc(emBanks * extBanksSize, sizeof(CpWord));
+        if (extMem == NULL)
+            {
+            fprintf(stderr, "Failed to allocate ECS memory\n");
+            exit(1);
+            }
+        }
 
     /*
     **  Optionally read in persistent CM and ECS contents.
@@ -385,7 +519,7 @@ void cpuInit(char *model, u32 memory, u32 emBanks, ExtMemory emType)
         strcpy(fileName, persistDir);
         strcat(fileName, "/ecsStore");
         ecsHandle = fopen(fileName, "r+b");
-        if (ecsHandle != NULL)
+        if (ecsHandle != NULL && ecsLoad)
             {
             /*
             **  Read ECS contents.
@@ -396,7 +530,7 @@ void cpuInit(char *model, u32 memory, u32 emBanks, ExtMemory emType)
                 memset(extMem, 0, extMaxMemory);
                 }
             }
-        else
+        else if (ecsHandle == NULL)
             {
             /*
             **  Create a new file.
@@ -410,6 +544,11 @@ void cpuInit(char *model, u32 memory, u32 emBanks, ExtMemory emType)
             }
         }
 
+    /*
+    **  Select the step function specialised for this model.
+    */
+    cpuStep = cpuStepModels[modelType][0];
+
     /*
     **  Print a friendly message.
     */
@@ -426,6 +565,8 @@ void cpuInit(char *model, u32 memory, u32 emBanks, ExtMemory emType)
 **------------------------------------------------------------------------*/
 void cpuTerminate(void)
     {
+    bool ecsSave = TRUE;
+
     /*
     **  Optionally save CM.
     */
@@ -441,14 +582,23 @@ void cpuTerminate(void)
         }
 
     /*
-    **  Optionally save ECS.
+    **  Optionally save ECS. A shared ECS is saved by the last emulator
+    **  to detach from it.
     */
+    if (ecsShared != NULL)
+        {
+        cpuEcsDetachShared(&ecsSave);
+        }
+
     if (ecsHandle != NULL)
         {
-        fseek(ecsHandle, 0, SEEK_SET);
-        if (fwrite(extMem, sizeof(CpWord), extMaxMemory, ecsHandle) != extMaxMemory)
+        if (ecsSave)
             {
-            fprintf(stderr, "Error writing ECS backing file\n");
+            fseek(ecsHandle, 0, SEEK_SET);
+            if (fwrite(extMem, sizeof(CpWord), extMaxMemory, ecsHandle) != extMaxMemory)
+                {
+                fprintf(stderr, "Error writing ECS backing file\n");
+                }
             }
 
         fclose(ecsHandle);
@@ -458,7 +608,49 @@ void cpuTerminate(void)
     **  Free allocated memory.
     */
     free(cpMem);
-    free(extMem);
+    if (ecsShared != NULL)
+        {
+#if defined(_WIN32)
+        UnmapViewOfFile(ecsShared);
+        CloseHandle(ecsMapping);
+#else
+        munmap(ecsShared, sizeof(EcsShared) + extMaxMemory * sizeof(CpWord));
+        close(ecsSharedFd);
+#endif
+        }
+    else
+        {
+        free(extMem);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Switch per-opcode profiling on or off. While on, every
+**                  instruction is counted and timed in cpuOpStats, indexed
+**                  by opcode and i field (fm * 8 + i).
+**
+**  Parameters:     Name        Description.
+**                  enable      TRUE to profile, FALSE for full speed.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void cpuProfile(bool enable)
+    {
+    cpuStep = cpuStepModels[modelType][enable ? 1 : 0];
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read the host clock used for opcode profiling.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Clock ticks (TSC cycles or nanoseconds).
+**
+**------------------------------------------------------------------------*/
+u64 cpuProfileTicks(void)
+    {
+    return(CpuTicks());
     }
 
 /*--------------------------------------------------------------------------
@@ -652,6 +844,7 @@ bool cpuExchangeJump(u32 addr)
     cpu.regX[7]  = *mem++ & Mask60;
 
     cpu.exitCondition = EcNone;
+    cpuSetWindow();
 
 #if CcDebug == 1
     traceExchange(&cpu, addr, "New");
@@ -715,115 +908,6 @@ bool cpuExchangeJump(u32 addr)
     return(TRUE);
     }
 
-/*--------------------------------------------------------------------------
-**  Purpose:        Execute next instruction in the CPU.
-**
-**  Parameters:     Name        Description.
-**
-**  Returns:        Nothing.
-**
-**------------------------------------------------------------------------*/
-void cpuStep(void)
-    {
-    if (cpuStopped)
-        {
-        return;
-        }
-
-#if CcSMM_EJT
-    if (skipStep != 0)
-        {
-        skipStep -= 1;
-        return;
-        }
-#endif
-
-    /*
-    **  Execute one CM word atomically.
-    */
-    do
-        {
-        /*
-        **  Decode based on type.
-        */
-        opFm = (u8)((opWord >> (opOffset -  6)) & Mask6);
-        opI  = (u8)((opWord >> (opOffset -  9)) & Mask3);
-        opJ  = (u8)((opWord >> (opOffset - 12)) & Mask3);
-        opLength = decodeCpuOpcode[opFm].length;
-
-        if (opLength == 0)
-            {
-            opLength = cpOp01Length[opI];
-            }
-
-        if (opLength == 15)
-            {
-            opK       = (u8)((opWord >> (opOffset - 15)) & Mask3);
-            opAddress = 0;
-
-            opOffset -= 15;
-            }
-        else
-            {
-            if (opOffset == 15)
-                {
-                /*
-                **  Invalid packing is handled as illegal instruction.
-                */
-                cpuOpIllegal();
-                return;
-                }
-
-            opK       = 0;
-            opAddress = (u32)((opWord >> (opOffset - 30)) & Mask18);
-
-            opOffset -= 30;
-            }
-
-        oldRegP = cpu.regP;
-
-        /*
-        **  Force B0 to 0.
-        */
-        cpu.regB[0] = 0;
-
-        /*
-        **  Execute instruction.
-        */
-        decodeCpuOpcode[opFm].execute();
-
-        /*
-        **  Force B0 to 0.
-        */
-        cpu.regB[0] = 0;
-
-#if CcDebug == 1
-        traceCpu(oldRegP, opFm, opI, opJ, opK, opAddress);
-#endif
-
-        if (cpuStopped)
-            {
-            if (opOffset == 0)
-                {
-                cpu.regP = (cpu.regP + 1) & Mask18;
-                }
-#if CcDebug == 1
-            traceCpuPrint("Stopped\n");
-#endif
-            return;
-            }
-
-        /*
-        **  Fetch next instruction word if necessary.
-        */
-        if (opOffset == 0)
-            {
-            cpu.regP = (cpu.regP + 1) & Mask18;
-            cpuFetchOpWord(cpu.regP, &opWord);
-            }
-        } while (opOffset != 60);
-    }
-
 /*--------------------------------------------------------------------------
 **  Purpose:        Perform ECS flag register operation.
 **
@@ -837,6 +921,7 @@ bool cpuEcsFlagRegister(u32 ecsAddress)
     {
     u32 flagFunction = (ecsAddress >> 21) & Mask3;
     u32 flagWord = ecsAddress & Mask18;
+    u32 flags;
 
     switch (flagFunction)
         {
@@ -844,29 +929,36 @@ bool cpuEcsFlagRegister(u32 ecsAddress)
         /*
         **  Ready/Select.
         */
-        if ((ecsFlagRegister & flagWord ) != 0)
+        do
             {
-            /*
-            **  Error exit.
-            */
-            return(FALSE);
-            }
+            flags = *ecsFlagRegister;
+            if ((flags & flagWord ) != 0)
+                {
+                /*
+                **  Error exit.
+                */
+                return(FALSE);
+                }
+            } while (!EcsFlagUpdate(ecsFlagRegister, flags, flags | flagWord));
 
-        ecsFlagRegister |= flagWord;
         break;
 
     case 5:
         /*
         **  Selective set.
         */
-        ecsFlagRegister |= flagWord;
+        do
+            {
+            flags = *ecsFlagRegister;
+            } while (!EcsFlagUpdate(ecsFlagRegister, flags, flags | flagWord));
+
         break;
 
     case 6:
         /*
         **  Status.
         */
-        if ((ecsFlagRegister & flagWord ) != 0)
+        if ((*ecsFlagRegister & flagWord ) != 0)
             {
             /*
             **  Error exit.
@@ -880,7 +972,11 @@ bool cpuEcsFlagRegister(u32 ecsAddress)
         /*
         **  Selective clear,
         */
-        ecsFlagRegister = (ecsFlagRegister & ~flagWord) & Mask18;
+        do
+            {
+            flags = *ecsFlagRegister;
+            } while (!EcsFlagUpdate(ecsFlagRegister, flags, (flags & ~flagWord) & Mask18));
+
         break;
         }
 
@@ -942,73 +1038,516 @@ bool cpuDdpTransfer(u32 ecsAddress, CpWord *data, bool writeToEcs)
 */
 
 /*--------------------------------------------------------------------------
-**  Purpose:        Handle illegal instruction
+**  Purpose:        Attach to (and if necessary create) a shared ECS
+**                  segment. ECS contents and the flag register are then
+**                  shared by all emulators attached to the segment.
 **
 **  Parameters:     Name        Description.
+**                  name        segment name
+**                  words       size of ECS in words
 **
-**  Returns:        Nothing
+**  Returns:        TRUE if the segment was created by this emulator.
 **
 **------------------------------------------------------------------------*/
-static void cpuOpIllegal(void)
+static bool cpuEcsAttachShared(char *name, u32 words)
     {
-    cpuStopped = TRUE;
-    if (cpu.regRaCm < cpuMaxMemory)
+    u32 size = sizeof(EcsShared) + words * sizeof(CpWord);
+    bool created;
+    int retry;
+#if defined(_WIN32)
+    ecsMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name);
+    if (ecsMapping == NULL)
         {
-        cpMem[cpu.regRaCm] = ((CpWord)cpu.exitCondition << 48) | ((CpWord)(cpu.regP + 1) << 30);
+        fprintf(stderr, "Failed to create shared ECS %s\n", name);
+        exit(1);
         }
 
-    cpu.regP = 0;
-
-    if ((features & (HasNoCejMej | IsSeries6x00)) == 0 && !cpu.monitorMode)
+    created = GetLastError() != ERROR_ALREADY_EXISTS;
+    ecsShared = (EcsShared *)MapViewOfFile(ecsMapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (ecsShared == NULL)
         {
-        /*
-        **  Exchange jump to MA.
-        */
-        cpu.monitorMode = TRUE;
-        cpuExchangeJump(cpu.regMa);
+        fprintf(stderr, "Failed to map shared ECS %s\n", name);
+        exit(1);
         }
-    }
+#else
+    struct stat st;
+    void *addr;
+    int lock;
+    int fd;
 
-/*--------------------------------------------------------------------------
-**  Purpose:        Check if CPU instruction word address is within limits.
-**
-**  Parameters:     Name        Description.
-**                  address     RA relative address to read.
-**                  location    Pointer to u32 which will contain absolute address.
-**
-**  Returns:        TRUE if validation failed, FALSE otherwise;
-**
-**------------------------------------------------------------------------*/
-static bool cpuCheckOpAddress(u32 address, u32 *location)
-    {
     /*
-    **  Calculate absolute address.
+    **  Portable POSIX shared memory object names start with '/'.
     */
-    *location = cpuAddRa(address);
-    
-    if (address >= cpu.regFlCm || (*location >= cpuMaxMemory && (features & HasNoCmWrap) != 0))
-        {
-        /*
-        **  Exit mode is always selected for RNI or branch.
-        */
-        cpuStopped = TRUE;
+    ecsShmName[0] = '/';
+    strcpy(ecsShmName + (*name == '/' ? 0 : 1), name);
 
-        cpu.exitCondition |= EcAddressOutOfRange;
-        if (cpu.regRaCm < cpuMaxMemory)
+    /*
+    **  Every attached emulator holds a read lock on the segment, which
+    **  the system drops when an emulator dies. A segment nobody holds a
+    **  lock on has been left behind by a crash and is removed, so the
+    **  next emulator creates (and loads) a fresh one.
+    */
+    for (retry = 0; ; retry++)
+        {
+        fd = shm_open(ecsShmName, O_RDWR | O_CREAT | O_EXCL, 0660);
+        created = fd >= 0;
+        if (created)
             {
-            // not need for RNI or branch - how about other uses?
-            if ((cpu.exitMode & EmAddressOutOfRange) != 0)
+            cpuEcsLock(fd, F_RDLCK, TRUE);
+            if (ftruncate(fd, size) != 0)
                 {
-                cpMem[cpu.regRaCm] = ((CpWord)cpu.exitCondition << 48) | ((CpWord)(cpu.regP) << 30);
+                fprintf(stderr, "Failed to size shared ECS %s\n", name);
+                shm_unlink(ecsShmName);
+                exit(1);
                 }
+
+            break;
             }
 
-        cpu.regP = 0;
-    
-        if ((features & (HasNoCejMej | IsSeries6x00)) == 0 && !cpu.monitorMode)
+        fd = shm_open(ecsShmName, O_RDWR, 0);
+        if (fd < 0)
             {
-            /*
-            **  Exchange jump to MA.
+            if (errno == ENOENT && retry < 100)
+                {
+                /*
+                **  Removed in the meantime.
+                */
+                continue;
+                }
+
+            fprintf(stderr, "Failed to open shared ECS %s\n", name);
+            exit(1);
+            }
+
+        lock = cpuEcsLock(fd, F_WRLCK, FALSE);
+        if (lock > 0)
+            {
+            if (fstat(fd, &st) == 0 && st.st_size == 0 && retry < 100)
+                {
+                /*
+                **  Just created, give the creator time to lock it.
+                */
+                close(fd);
+                usleep(10000);
+                continue;
+                }
+
+            printf("Removing stale shared ECS %s\n", name);
+            shm_unlink(ecsShmName);
+            close(fd);
+            continue;
+            }
+
+        if (lock == 0)
+            {
+            cpuEcsLock(fd, F_RDLCK, TRUE);
+            }
+
+        /*
+        **  Start over if the segment was found stale by another emulator
+        **  before we got our lock.
+        */
+        if (fstat(fd, &st) == 0 && st.st_nlink == 0 && retry < 100)
+            {
+            close(fd);
+            continue;
+            }
+
+        /*
+        **  Allow the creator to size the segment.
+        */
+        for (retry = 0; fstat(fd, &st) == 0 && st.st_size == 0 && retry < 100; retry++)
+            {
+            usleep(10000);
+            }
+
+        if (fstat(fd, &st) != 0 || st.st_size != (off_t)size)
+            {
+            fprintf(stderr, "Shared ECS %s has a different size\n", name);
+            exit(1);
+            }
+
+        break;
+        }
+
+    /*
+    **  The descriptor stays open, closing it would drop the lock.
+    */
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        {
+        fprintf(stderr, "Failed to map shared ECS %s\n", name);
+        exit(1);
+        }
+
+    ecsSharedFd = fd;
+    ecsShared = (EcsShared *)addr;
+#endif
+
+    if (created)
+        {
+        ecsShared->words = words;
+        ecsShared->flagRegister = 0;
+#if defined(_WIN32)
+        MemoryBarrier();
+#else
+        __sync_synchronize();
+#endif
+        ecsShared->magic = EcsSharedMagic;
+        }
+    else
+        {
+        for (retry = 0; ecsShared->magic != EcsSharedMagic && retry < 100; retry++)
+            {
+#if defined(_WIN32)
+            Sleep(10);
+#else
+            usleep(10000);
+#endif
+            }
+
+        if (ecsShared->magic != EcsSharedMagic || ecsShared->words != words)
+            {
+            fprintf(stderr, "Shared ECS %s is not compatible with this configuration\n", name);
+            exit(1);
+            }
+        }
+
+#if defined(_WIN32)
+    InterlockedIncrement((volatile LONG *)&ecsShared->attached);
+#else
+    __sync_fetch_and_add(&ecsShared->attached, 1);
+#endif
+
+    extMem = (CpWord *)(ecsShared + 1);
+    ecsFlagRegister = &ecsShared->flagRegister;
+
+    printf("%s shared ECS %s\n", created ? "Created" : "Attached to", name);
+    return(created);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Detach from the shared ECS segment. The segment is
+**                  removed when the last emulator detaches. On Windows
+**                  the system removes it once no emulator has it open,
+**                  even after a crash.
+**
+**  Parameters:     Name        Description.
+**                  last        returns TRUE if this was the last emulator
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void cpuEcsDetachShared(bool *last)
+    {
+#if defined(_WIN32)
+    *last = InterlockedDecrement((volatile LONG *)&ecsShared->attached) == 0;
+#else
+    u32 count;
+    int lock;
+
+    /*
+    **  The last emulator is the only one which can turn its read lock
+    **  into a write lock. The attach count is only used if the host
+    **  doesn't support locks on shared memory.
+    */
+    count = __sync_sub_and_fetch(&ecsShared->attached, 1);
+    lock = cpuEcsLock(ecsSharedFd, F_WRLCK, FALSE);
+    *last = lock > 0 || (lock < 0 && count == 0);
+    if (*last)
+        {
+        shm_unlink(ecsShmName);
+        }
+#endif
+    }
+
+#if !defined(_WIN32)
+/*--------------------------------------------------------------------------
+**  Purpose:        Lock the whole shared ECS segment.
+**
+**  Parameters:     Name        Description.
+**                  fd          segment file descriptor
+**                  type        F_RDLCK or F_WRLCK
+**                  wait        TRUE to wait for a conflicting lock
+**
+**  Returns:        1 if locked, 0 if held by another emulator, -1 if
+**                  the host doesn't support the lock.
+**
+**------------------------------------------------------------------------*/
+static int cpuEcsLock(int fd, short type, bool wait)
+    {
+    struct flock fl;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = 0;
+    fl.l_len = 0;
+
+    if (fcntl(fd, wait ? F_SETLKW : F_SETLK, &fl) == 0)
+        {
+        return(1);
+        }
+
+    return(errno == EACCES || errno == EAGAIN ? 0 : -1);
+    }
+#endif
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Execute next instruction in the CPU.
+**
+**                  This is expanded once per model with the model's
+**                  feature set as a constant, with and without profiling.
+**
+**  Parameters:     Name        Description.
+**                  modelFeatures feature set of the model
+**                  profile     count and time each instruction
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static ForceInline void cpuStepModel(ModelFeatures modelFeatures, bool profile)
+    {
+    CpuOpStats *sp;
+    u64 start;
+
+    if (cpuStopped)
+        {
+        return;
+        }
+
+#if CcSMM_EJT
+    if (skipStep != 0)
+        {
+        skipStep -= 1;
+        return;
+        }
+#endif
+
+    /*
+    **  Execute one CM word atomically.
+    */
+    do
+        {
+        /*
+        **  Decode based on type.
+        */
+        opFm = (u8)((opWord >> (opOffset -  6)) & Mask6);
+        opI  = (u8)((opWord >> (opOffset -  9)) & Mask3);
+        opJ  = (u8)((opWord >> (opOffset - 12)) & Mask3);
+        opLength = decodeCpuOpcode[opFm].length;
+
+        if (opLength == 0)
+            {
+            opLength = cpOp01Length[opI];
+            }
+
+        if (opLength == 15)
+            {
+            opK       = (u8)((opWord >> (opOffset - 15)) & Mask3);
+            opAddress = 0;
+
+            opOffset -= 15;
+            }
+        else
+            {
+            if (opOffset == 15)
+                {
+                /*
+                **  Invalid packing is handled as illegal instruction.
+                */
+                cpuOpIllegal();
+                return;
+                }
+
+            opK       = 0;
+            opAddress = (u32)((opWord >> (opOffset - 30)) & Mask18);
+
+            opOffset -= 30;
+            }
+
+        oldRegP = cpu.regP;
+
+        /*
+        **  Force B0 to 0.
+        */
+        cpu.regB[0] = 0;
+
+        /*
+        **  Execute instruction.
+        */
+        if (profile)
+            {
+            sp = cpuOpStats + ((opFm << 3) | opI);
+            start = CpuTicks();
+            decodeCpuOpcode[opFm].execute();
+            sp->ticks += CpuTicks() - start;
+            sp->count += 1;
+            }
+        else
+            {
+            decodeCpuOpcode[opFm].execute();
+            }
+
+        /*
+        **  Force B0 to 0.
+        */
+        cpu.regB[0] = 0;
+
+#if CcDebug == 1
+        traceCpu(oldRegP, opFm, opI, opJ, opK, opAddress);
+#endif
+
+        if (cpuStopped)
+            {
+            if (opOffset == 0)
+                {
+                cpu.regP = (cpu.regP + 1) & Mask18;
+                }
+#if CcDebug == 1
+            traceCpuPrint("Stopped\n");
+#endif
+            return;
+            }
+
+        /*
+        **  Fetch next instruction word if necessary.
+        */
+        if (opOffset == 0)
+            {
+            cpu.regP = (cpu.regP + 1) & Mask18;
+            cpuFetchOpWordModel(modelFeatures, cpu.regP, &opWord);
+            }
+        } while (opOffset != 60);
+    }
+
+/*
+**  Specialised step functions.
+*/
+CpuStepForModel(cpuStep6400, Features6400, FALSE)
+CpuStepForModel(cpuStepCyber73, FeaturesCyber73, FALSE)
+CpuStepForModel(cpuStepCyber173, FeaturesCyber173, FALSE)
+CpuStepForModel(cpuStepCyber175, FeaturesCyber175, FALSE)
+CpuStepForModel(cpuStepCyber840A, FeaturesCyber840A, FALSE)
+CpuStepForModel(cpuStepCyber865, FeaturesCyber865, FALSE)
+
+CpuStepForModel(cpuProfile6400, Features6400, TRUE)
+CpuStepForModel(cpuProfileCyber73, FeaturesCyber73, TRUE)
+CpuStepForModel(cpuProfileCyber173, FeaturesCyber173, TRUE)
+CpuStepForModel(cpuProfileCyber175, FeaturesCyber175, TRUE)
+CpuStepForModel(cpuProfileCyber840A, FeaturesCyber840A, TRUE)
+CpuStepForModel(cpuProfileCyber865, FeaturesCyber865, TRUE)
+
+#if !CcRdtsc
+/*--------------------------------------------------------------------------
+**  Purpose:        Read a nanosecond host clock for opcode profiling
+**                  where there is no time stamp counter.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Time in nanoseconds.
+**
+**------------------------------------------------------------------------*/
+static u64 cpuHostTicks(void)
+    {
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+
+    if (frequency.QuadPart == 0)
+        {
+        QueryPerformanceFrequency(&frequency);
+        }
+
+    QueryPerformanceCounter(&now);
+    return((u64)((double)now.QuadPart * 1000000000.0 / (double)frequency.QuadPart));
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((u64)ts.tv_sec * 1000000000 + (u64)ts.tv_nsec);
+#endif
+    }
+#endif
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Handle illegal instruction
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing
+**
+**------------------------------------------------------------------------*/
+static void cpuOpIllegal(void)
+    {
+    cpuStopped = TRUE;
+    if (cpu.regRaCm < cpuMaxMemory)
+        {
+        cpMem[cpu.regRaCm] = ((CpWord)cpu.exitCondition << 48) | ((CpWord)(cpu.regP + 1) << 30);
+        }
+
+    cpu.regP = 0;
+
+    if ((features & (HasNoCejMej | IsSeries6x00)) == 0 && !cpu.monitorMode)
+        {
+        /*
+        **  Exchange jump to MA.
+        */
+        cpu.monitorMode = TRUE;
+        cpuExchangeJump(cpu.regMa);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Check if CPU instruction word address is within limits.
+**
+**  Parameters:     Name        Description.
+**                  modelFeatures feature set of the model
+**                  address     RA relative address to read.
+**                  location    Pointer to u32 which will contain absolute address.
+**
+**  Returns:        TRUE if validation failed, FALSE otherwise;
+**
+**------------------------------------------------------------------------*/
+static ForceInline bool cpuCheckOpAddress(ModelFeatures modelFeatures, u32 address, u32 *location)
+    {
+    /*
+    **  Fast path for addresses within the window.
+    */
+    if (address < cmWindowLimit)
+        {
+        *location = cmWindowRa + address;
+        return(FALSE);
+        }
+
+    /*
+    **  Calculate absolute address.
+    */
+    *location = cpuAddRaModel(modelFeatures, address);
+    
+    if (address >= cpu.regFlCm || (*location >= cpuMaxMemory && (modelFeatures & HasNoCmWrap) != 0))
+        {
+        /*
+        **  Exit mode is always selected for RNI or branch.
+        */
+        cpuStopped = TRUE;
+
+        cpu.exitCondition |= EcAddressOutOfRange;
+        if (cpu.regRaCm < cpuMaxMemory)
+            {
+            // not need for RNI or branch - how about other uses?
+            if ((cpu.exitMode & EmAddressOutOfRange) != 0)
+                {
+                cpMem[cpu.regRaCm] = ((CpWord)cpu.exitCondition << 48) | ((CpWord)(cpu.regP) << 30);
+                }
+            }
+
+        cpu.regP = 0;
+    
+        if ((features & (HasNoCejMej | IsSeries6x00)) == 0 && !cpu.monitorMode)
+            {
+            /*
+            **  Exchange jump to MA.
             */
             cpu.monitorMode = TRUE;
             cpuExchangeJump(cpu.regMa);
@@ -1030,51 +1569,44 @@ static bool cpuCheckOpAddress(u32 address, u32 *location)
 **                  within limits.
 **
 **  Parameters:     Name        Description.
+**                  modelFeatures feature set of the model
 **                  address     RA relative address to read.
 **                  data        Pointer to 60 bit word which gets the data.
 **
 **  Returns:        Nothing.
 **
 **------------------------------------------------------------------------*/
-static void cpuFetchOpWord(u32 address, CpWord *data)
+static ForceInline void cpuFetchOpWordModel(ModelFeatures modelFeatures, u32 address, CpWord *data)
     {
     u32 location;
 
-    if (cpuCheckOpAddress(address, &location))
+    if (cpuCheckOpAddress(modelFeatures, address, &location))
         {
         return;
         }
 
-    if ((features & HasInstructionStack) != 0)
+    if ((modelFeatures & HasInstructionStack) != 0)
         {
         int i;
 
         /*
         **  Check if instruction word is in stack.
-        **  (optimise this by starting search from last match).
         */
-        for (i = 0; i < MaxIwStack; i++)
-            {
-            if (cpu.iwValid[i] && cpu.iwAddress[i] == location)
-                {
-                *data = cpu.iwStack[i];
-                break;
-                }
-            }
-
-        if (i == MaxIwStack)
+        i = cpuIwLookup(location);
+        if (i < 0)
             {
             /*
             **  No hit, fetch the instruction from CM and enter it into the stack.
             */
-            cpu.iwRank = (cpu.iwRank + 1) % MaxIwStack;
-            cpu.iwAddress[cpu.iwRank] = location;
-            cpu.iwStack[cpu.iwRank] = cpMem[location] & Mask60;
-            cpu.iwValid[cpu.iwRank] = TRUE;
-            *data = cpu.iwStack[cpu.iwRank];
+            i = cpuIwEnter(location);
             }
 
-        if ((features & HasIStackPrefetch) != 0 && (i == MaxIwStack || i == cpu.iwRank))
+        *data = cpu.iwStack[i];
+
+        /*
+        **  Prefetch after a miss or a hit on the most recently entered word.
+        */
+        if ((modelFeatures & HasIStackPrefetch) != 0 && i == cpu.iwRank)
             {
 #if 0
             /*
@@ -1083,30 +1615,24 @@ static void cpuFetchOpWord(u32 address, CpWord *data)
             for (i = 2; i > 0; i--)
                 {
                 address += 1;
-                if (cpuCheckOpAddress(address, &location))
+                if (cpuCheckOpAddress(modelFeatures, address, &location))
                     {
                     return;
                     }
 
-                cpu.iwRank = (cpu.iwRank + 1) % MaxIwStack;
-                cpu.iwAddress[cpu.iwRank] = location;
-                cpu.iwStack[cpu.iwRank] = cpMem[location] & Mask60;
-                cpu.iwValid[cpu.iwRank] = TRUE;
+                cpuIwEnter(location);
                 }
 #else
             /*
             **  Prefetch one instruction word.
             */
             address += 1;
-            if (cpuCheckOpAddress(address, &location))
+            if (cpuCheckOpAddress(modelFeatures, address, &location))
                 {
                 return;
                 }
 
-            cpu.iwRank = (cpu.iwRank + 1) % MaxIwStack;
-            cpu.iwAddress[cpu.iwRank] = location;
-            cpu.iwStack[cpu.iwRank] = cpMem[location] & Mask60;
-            cpu.iwValid[cpu.iwRank] = TRUE;
+            cpuIwEnter(location);
 #endif
             }
         }
@@ -1124,45 +1650,149 @@ static void cpuFetchOpWord(u32 address, CpWord *data)
     }
 
 /*--------------------------------------------------------------------------
-**  Purpose:        Void the instruction stack unless branch target is
-**                  within stack (or unconditionally if address is ~0).
+**  Purpose:        Read CPU instruction word using the run time feature set.
 **
 **  Parameters:     Name        Description.
-**                  branchAddr  Target location for a branch or ~0 for
-**                              unconditional voiding.
+**                  address     RA relative address to read.
+**                  data        Pointer to 60 bit word which gets the data.
 **
 **  Returns:        Nothing.
 **
 **------------------------------------------------------------------------*/
-static void cpuVoidIwStack(u32 branchAddr)
+static void cpuFetchOpWord(u32 address, CpWord *data)
+    {
+    cpuFetchOpWordModel(features, address, data);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Find instruction word in the stack.
+**
+**  Parameters:     Name        Description.
+**                  location    absolute CM address
+**
+**  Returns:        Stack entry or -1 if not in stack.
+**
+**------------------------------------------------------------------------*/
+static ForceInline int cpuIwLookup(u32 location)
     {
-    u32 location;
     int i;
+    u16 unindexed;
 
-    if (branchAddr != ~0)
+    /*
+    **  Normally the word's hash slot leads directly to its entry.
+    */
+    i = cpu.iwSlot[location & IwHashMask];
+    if ((cpu.iwValid & (1 << i)) != 0 && cpu.iwAddress[i] == location)
         {
-        location = cpuAddRa(branchAddr);
+        return(i);
+        }
 
-        for (i = 0; i < MaxIwStack; i++)
+    /*
+    **  Entries which collided with another word's hash slot must be
+    **  searched. Straight line code never collides, so this is rare.
+    */
+    unindexed = cpu.iwValid & ~cpu.iwIndexed;
+    for (i = 0; unindexed != 0; i++, unindexed >>= 1)
+        {
+        if ((unindexed & 1) != 0 && cpu.iwAddress[i] == location)
             {
-            if (cpu.iwValid[i] && cpu.iwAddress[i] == location)
-                {
-                /*
-                **  Branch target is within stack - do nothing.
-                */
-                return;
-                }
+            return(i);
             }
         }
 
+    return(-1);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Enter instruction word from CM into the stack as the
+**                  most recent entry, replacing the oldest one.
+**
+**  Parameters:     Name        Description.
+**                  location    absolute CM address
+**
+**  Returns:        Stack entry.
+**
+**------------------------------------------------------------------------*/
+static int cpuIwEnter(u32 location)
+    {
+    int i;
+    u16 mask;
+    u8 *slot;
+
     /*
-    **  Branch target is NOT within stack or unconditional voiding required.
+    **  A prefetch may enter a word which is already in the stack, drop
+    **  the older copy.
     */
-    for (i = 0; i < MaxIwStack; i++)
+    i = cpuIwLookup(location);
+    if (i >= 0)
+        {
+        cpuIwRemove(i);
+        }
+
+    cpu.iwRank = (cpu.iwRank + 1) % MaxIwStack;
+    i = cpu.iwRank;
+    cpuIwRemove(i);
+
+    mask = 1 << i;
+    cpu.iwAddress[i] = location;
+    cpu.iwStack[i] = cpMem[location] & Mask60;
+    cpu.iwValid |= mask;
+
+    /*
+    **  Claim the hash slot unless a valid entry is indexed there already.
+    */
+    slot = cpu.iwSlot + (location & IwHashMask);
+    if (   (cpu.iwIndexed & (1 << *slot)) == 0
+        || ((cpu.iwAddress[*slot] ^ location) & IwHashMask) != 0)
+        {
+        *slot = (u8)i;
+        cpu.iwIndexed |= mask;
+        }
+
+    return(i);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Invalidate one instruction stack entry.
+**
+**  Parameters:     Name        Description.
+**                  i           stack entry
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void cpuIwRemove(int i)
+    {
+    cpu.iwValid &= ~(1 << i);
+    cpu.iwIndexed &= ~(1 << i);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Void the instruction stack unless branch target is
+**                  within stack (or unconditionally if address is ~0).
+**
+**  Parameters:     Name        Description.
+**                  branchAddr  Target location for a branch or ~0 for
+**                              unconditional voiding.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void cpuVoidIwStack(u32 branchAddr)
+    {
+    if (branchAddr != ~0 && cpuIwLookup(cpuAddRa(branchAddr)) >= 0)
         {
-        cpu.iwValid[i] = FALSE;
+        /*
+        **  Branch target is within stack - do nothing.
+        */
+        return;
         }
 
+    /*
+    **  Branch target is NOT within stack or unconditional voiding required.
+    */
+    cpu.iwValid = 0;
+    cpu.iwIndexed = 0;
     cpu.iwRank = 0;
     }
 
@@ -1180,6 +1810,12 @@ static bool cpuReadMem(u32 address, CpWord *data)
     {
     u32 location;
 
+    if (address < cmWindowLimit)
+        {
+        *data = cmWindowBase[address] & Mask60;
+        return(FALSE);
+        }
+
     if (address >= cpu.regFlCm)
         {
         cpu.exitCondition |= EcAddressOutOfRange;
@@ -1267,6 +1903,12 @@ static bool cpuWriteMem(u32 address, CpWord *data)
     {
     u32 location;
 
+    if (address < cmWindowLimit)
+        {
+        cmWindowBase[address] = *data & Mask60;
+        return(FALSE);
+        }
+
     if (address >= cpu.regFlCm)
         {
         cpu.exitCondition |= EcAddressOutOfRange;
@@ -1366,19 +2008,56 @@ static void cpuRegASemantics(void)
         }
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Compute the memory window of the current exchange
+**                  package: RA relative addresses below the limit are
+**                  within FL, do not wrap in the ones-complement RA adder
+**                  and lie within configured memory, so they can be
+**                  accessed without any further checks.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void cpuSetWindow(void)
+    {
+    u32 mask = (features & IsSeries800) != 0 ? Mask21 : Mask18;
+
+    cmWindowRa = cpu.regRaCm & mask;
+    cmWindowBase = cpMem;
+    cmWindowLimit = 0;
+
+    if (cmWindowRa < cpuMaxMemory)
+        {
+        cmWindowBase = cpMem + cmWindowRa;
+        cmWindowLimit = mask - cmWindowRa;
+        if (cmWindowLimit > cpuMaxMemory - cmWindowRa)
+            {
+            cmWindowLimit = cpuMaxMemory - cmWindowRa;
+            }
+
+        if (cmWindowLimit > cpu.regFlCm)
+            {
+            cmWindowLimit = cpu.regFlCm;
+            }
+        }
+    }
+
 /*--------------------------------------------------------------------------
 **  Purpose:        Addition of 18 or 21 bit RA and 18 bit offset in
 **                  ones-complement with subtractive adder
 **
 **  Parameters:     Name        Description.
+**                  modelFeatures feature set of the model
 **                  op          18 bit offset
 **
 **  Returns:        18 or 21 bit result.
 **
 **------------------------------------------------------------------------*/
-static u32 cpuAddRa(u32 op)
+static ForceInline u32 cpuAddRaModel(ModelFeatures modelFeatures, u32 op)
     {
-    if ((features & IsSeries800) != 0)
+    if ((modelFeatures & IsSeries800) != 0)
         {
         acc21 = (cpu.regRaCm & Mask21) - (~op & Mask21);
         if ((acc21 & Overflow21) != 0)
@@ -1398,6 +2077,20 @@ static u32 cpuAddRa(u32 op)
     return(acc18 & Mask18);
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Add RA using the run time feature set.
+**
+**  Parameters:     Name        Description.
+**                  op          18 bit offset
+**
+**  Returns:        18 or 21 bit result.
+**
+**------------------------------------------------------------------------*/
+static u32 cpuAddRa(u32 op)
+    {
+    return(cpuAddRaModel(features, op));
+    }
+
 /*--------------------------------------------------------------------------
 **  Purpose:        18 bit ones-complement addition with subtractive adder
 **
@@ -0,0 +1,1058 @@
+/*--------------------------------------------------------------------------
+**
+**  Copyright (c) 2003-2011, Tom Hunter
+**
+**  Name: cpurun.c
+**
+**  Description:
+**      Standalone CPU program runner for opcode level benchmarks. Runs
+**      synthetic kernels or an absolute binary on the CPU emulation
+**      without PPs, devices or operating system and reports instructions
+**      per second and per-opcode timings.
+**
+**      Usage: dtcpurun [-m <model>] [-n <iterations>] [-e <entry>]
+**                      [<kernel>|<file> ...]
+**
+**      Kernels are int, float, branch, ecs and cmu; without arguments
+**      all kernels are run. A file holds 60 bit words packed two per 15
+**      bytes, as in a binary tape record; a leading 77 table is skipped
+**      and the rest is loaded at RA+100 and entered at <entry> (default
+**      100). Programs stop with PS or an error exit.
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License version 3 as
+**  published by the Free Software Foundation.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License version 3 for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  version 3 along with this program in file "license-gpl-3.0.txt".
+**  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+**
+**--------------------------------------------------------------------------
+*/
+
+/*
+**  -------------
+**  Include Files
+**  -------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "const.h"
+#include "types.h"
+#include "proto.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/*
+**  -----------------
+**  Private Constants
+**  -----------------
+*/
+#define RunCmSize               0400000
+#define RunXp                   0
+#define RunRa                   01000
+#define RunFl                   0100000
+#define RunFlEcs                0100000
+#define RunLoad                 0100
+#define RunBuf1                 010000
+#define RunBuf2                 020000
+#define RunInner                010000
+#define RunEcsBlock             0100
+#define RunMaxSteps             10000000000LL
+
+#define MaxLabels               16
+#define MaxFixups               32
+
+/*
+**  Labels used by the kernels.
+*/
+#define LabelOuter              0
+#define LabelInner              1
+#define Label1                  2
+#define Label2                  3
+#define Label3                  4
+#define Label4                  5
+#define LabelSub                6
+#define LabelError              7
+#define LabelDesc               8
+
+/*
+**  -----------------------
+**  Private Macro Functions
+**  -----------------------
+*/
+
+/*
+**  -----------------------------------------
+**  Private Typedef and Structure Definitions
+**  -----------------------------------------
+*/
+typedef struct kernel
+    {
+    char            *name;              /* name on the command line */
+    bool            (*build)(void);     /* assemble into CM, FALSE if not supported */
+    } Kernel;
+
+typedef struct fixup
+    {
+    u32             address;            /* RA relative word address */
+    u8              bit;                /* lowest bit of the K field */
+    u8              label;              /* label referenced */
+    } Fixup;
+
+/*
+**  ---------------------------
+**  Private Function Prototypes
+**  ---------------------------
+*/
+static bool runProgram(char *name, bool (*build)(void));
+static u64 runUntilStop(long long *steps);
+static void runExchangePackage(void);
+static void runReport(void);
+static bool runLoadFile(void);
+static bool runBuildInt(void);
+static bool runBuildFloat(void);
+static bool runBuildBranch(void);
+static bool runBuildEcs(void);
+static bool runBuildCmu(void);
+static void runLoopBegin(void);
+static void runLoopEnd(void);
+static void asmStart(u32 address);
+static void asmEnd(void);
+static void asmParcel(u32 parcel, u8 length);
+static void asmI15(u8 fm, u8 i, u8 j, u8 k);
+static void asmI30(u8 fm, u8 i, u8 j, u32 K);
+static void asmJump(u8 fm, u8 i, u8 j, u8 label);
+static void asmWord(CpWord word);
+static void asmLabel(u8 label);
+static void asmForceUpper(void);
+static CpWord asmCmuWord(u32 k1, u32 c1, u32 k2, u32 c2, u32 ll);
+static u64 runClock(void);
+
+/*
+**  ----------------
+**  Public Variables
+**  ----------------
+*/
+
+/*
+**  Normally provided by init.c and rtc.c.
+*/
+ModelFeatures features;
+ModelType modelType;
+char persistDir[256];
+char ecsSharedName[64];
+u32 rtcClock;
+
+/*
+**  -----------------
+**  Private Variables
+**  -----------------
+*/
+static Kernel kernels[] =
+    {
+    { "int",    runBuildInt    },
+    { "float",  runBuildFloat  },
+    { "branch", runBuildBranch },
+    { "ecs",    runBuildEcs    },
+    { "cmu",    runBuildCmu    },
+    };
+
+static struct
+    {
+    char            *name;
+    ModelType       type;
+    ModelFeatures   features;
+    } models[] =
+    {
+    { "6400",       Model6400,      Features6400      },
+    { "CYBER73",    ModelCyber73,   FeaturesCyber73   },
+    { "CYBER173",   ModelCyber173,  FeaturesCyber173  },
+    { "CYBER175",   ModelCyber175,  FeaturesCyber175  },
+    { "CYBER840A",  ModelCyber840A, FeaturesCyber840A },
+    { "CYBER865",   ModelCyber865,  FeaturesCyber865  },
+    };
+
+/*
+**  Opcode names, by fm and, for 01 and 46, by fm and i.
+*/
+static char *opNames[0100] =
+    {
+    "PS",          "01",          "JP Bi+K",     "Xj jump",     "EQ Bi,Bj",    "NE Bi,Bj",    "GE Bi,Bj",    "LT Bi,Bj",
+    "BXi Xj",      "BXi Xj*Xk",   "BXi Xj+Xk",   "BXi Xj-Xk",   "BXi -Xk",     "BXi -Xk*Xj",  "BXi -Xk+Xj",  "BXi -Xk-Xj",
+    "LXi jk",      "AXi jk",      "LXi Bj,Xk",   "AXi Bj,Xk",   "NXi Bj,Xk",   "ZXi Bj,Xk",   "UXi Bj,Xk",   "PXi Bj,Xk",
+    "FXi Xj+Xk",   "FXi Xj-Xk",   "DXi Xj+Xk",   "DXi Xj-Xk",   "RXi Xj+Xk",   "RXi Xj-Xk",   "IXi Xj+Xk",   "IXi Xj-Xk",
+    "FXi Xj*Xk",   "RXi Xj*Xk",   "DXi Xj*Xk",   "MXi jk",      "FXi Xj/Xk",   "RXi Xj/Xk",   "46",          "CXi Xk",
+    "SAi Aj+K",    "SAi Bj+K",    "SAi Xj+K",    "SAi Xj+Bk",   "SAi Aj+Bk",   "SAi Aj-Bk",   "SAi Bj+Bk",   "SAi Bj-Bk",
+    "SBi Aj+K",    "SBi Bj+K",    "SBi Xj+K",    "SBi Xj+Bk",   "SBi Aj+Bk",   "SBi Aj-Bk",   "SBi Bj+Bk",   "SBi Bj-Bk",
+    "SXi Aj+K",    "SXi Bj+K",    "SXi Xj+K",    "SXi Xj+Bk",   "SXi Aj+Bk",   "SXi Aj-Bk",   "SXi Bj+Bk",   "SXi Bj-Bk",
+    };
+
+static char *op01Names[010] = { "RJ K", "RE Bj+K", "WE Bj+K", "XJ Bj+K", "RXj Xk", "WXj Xk", "RC Xj", "017" };
+static char *op46Names[010] = { "NO", "NO", "NO", "NO", "IM Bj+K", "DM", "CC", "CU" };
+
+static char *fileName = NULL;
+static u32 entryAddress = RunLoad;
+static long long iterations = 1000000;
+static u32 innerCount;
+static u32 outerCount;
+static u32 stopAddress;
+
+static u64 totalCount[01000];
+static u64 totalTicks[01000];
+static u64 profileTicks;
+static u64 profileNs;
+
+static u32 asmAddress;
+static u8 asmShift;
+static u32 labels[MaxLabels];
+static Fixup fixups[MaxFixups];
+static int fixupCount;
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Public Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        CPU runner main program.
+**
+**  Parameters:     Name        Description.
+**                  argc        Argument count.
+**                  argv        Array of argument strings.
+**
+**  Returns:        Zero if all programs loaded and stopped normally,
+**                  1 otherwise.
+**
+**------------------------------------------------------------------------*/
+int main(int argc, char **argv)
+    {
+    char *model = "CYBER173";
+    int status = 0;
+    bool ok;
+    int i;
+    int k;
+    int first;
+
+    /*
+    **  Parse options.
+    */
+    for (i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2)
+        {
+        if (strcmp(argv[i], "-m") == 0)
+            {
+            model = argv[i + 1];
+            }
+        else if (strcmp(argv[i], "-n") == 0)
+            {
+            iterations = atoll(argv[i + 1]);
+            }
+        else if (strcmp(argv[i], "-e") == 0)
+            {
+            entryAddress = (u32)strtol(argv[i + 1], NULL, 8);
+            }
+        else
+            {
+            break;
+            }
+        }
+
+    first = i;
+    if ((first < argc && argv[first][0] == '-') || iterations < 1)
+        {
+        fprintf(stderr, "Usage: dtcpurun [-m <model>] [-n <iterations>] [-e <entry>] [<kernel>|<file> ...]\n");
+        fprintf(stderr, "       kernels: int, float, branch, ecs, cmu\n");
+        exit(1);
+        }
+
+    for (k = 0; k < sizeof(models) / sizeof(models[0]); k++)
+        {
+        if (stricmp(model, models[k].name) == 0)
+            {
+            break;
+            }
+        }
+
+    if (k == sizeof(models) / sizeof(models[0]))
+        {
+        fprintf(stderr, "Unsupported mainframe model %s\n", model);
+        exit(1);
+        }
+
+    modelType = models[k].type;
+    features = models[k].features;
+    cpuInit(models[k].name, RunCmSize, 1, ECS);
+
+    /*
+    **  Split the iterations into an inner loop counted in B7 and an outer
+    **  loop counted in B6, both limited to 17 bits.
+    */
+    innerCount = iterations < RunInner ? (u32)iterations : RunInner;
+    outerCount = (u32)(iterations / innerCount);
+    if (outerCount > 0377777)
+        {
+        outerCount = 0377777;
+        }
+
+    /*
+    **  Run the programs.
+    */
+    printf("\n%-10s %14s %12s %10s\n", "Program", "Instructions", "Time (ms)", "MIPS");
+    if (first == argc)
+        {
+        for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+            {
+            if (!runProgram(kernels[k].name, kernels[k].build))
+                {
+                status = 1;
+                }
+            }
+        }
+
+    for (i = first; i < argc; i++)
+        {
+        for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+            {
+            if (strcmp(argv[i], kernels[k].name) == 0)
+                {
+                break;
+                }
+            }
+
+        if (k < sizeof(kernels) / sizeof(kernels[0]))
+            {
+            ok = runProgram(kernels[k].name, kernels[k].build);
+            }
+        else
+            {
+            fileName = argv[i];
+            ok = runProgram(fileName, runLoadFile);
+            }
+
+        if (!ok)
+            {
+            status = 1;
+            }
+        }
+
+    runReport();
+    cpuTerminate();
+
+    return(status);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Stand-in for the RTC update done by rtc.c; the clock
+**                  read by RC follows the host clock.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void rtcReadUsCounter(void)
+    {
+    rtcClock = (u32)(runClock() / 1000);
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Run a program twice: once profiled to count and time
+**                  each instruction, once at full speed for the MIPS
+**                  figure.
+**
+**  Parameters:     Name        Description.
+**                  name        program name
+**                  build       function placing the program into CM
+**
+**  Returns:        FALSE if the program failed to load or did not stop
+**                  normally.
+**
+**------------------------------------------------------------------------*/
+static bool runProgram(char *name, bool (*build)(void))
+    {
+    u64 instructions;
+    u64 ticks;
+    u64 ns;
+    long long steps;
+    CpWord exitWord;
+    int i;
+
+    /*
+    **  Profiled run.
+    */
+    memset(cpMem, 0, RunCmSize * sizeof(CpWord));
+    if (!build())
+        {
+        return(FALSE);
+        }
+
+    runExchangePackage();
+    memset(cpuOpStats, 0, sizeof(cpuOpStats));
+    cpuProfile(TRUE);
+    ticks = cpuProfileTicks();
+    ns = runUntilStop(&steps);
+    profileTicks += cpuProfileTicks() - ticks;
+    profileNs += ns;
+
+    instructions = 0;
+    for (i = 0; i < 01000; i++)
+        {
+        instructions += cpuOpStats[i].count;
+        totalCount[i] += cpuOpStats[i].count;
+        totalTicks[i] += cpuOpStats[i].ticks;
+        }
+
+    /*
+    **  Timed run.
+    */
+    memset(cpMem, 0, RunCmSize * sizeof(CpWord));
+    build();
+    runExchangePackage();
+    cpuProfile(FALSE);
+    ns = runUntilStop(&steps);
+
+    printf("%-10s %14llu %12.3f %10.2f\n", name, (unsigned long long)instructions,
+        (double)(long long)ns / 1000000.0, ns == 0 ? 0.0 : (double)(long long)instructions * 1000.0 / (double)(long long)ns);
+
+    /*
+    **  Report anything but a regular stop.
+    */
+    exitWord = cpMem[RunRa];
+    if (!cpuStopped)
+        {
+        printf("    did not stop within %lld instruction words\n", steps);
+        cpuStopped = TRUE;
+        return(FALSE);
+        }
+
+    if (exitWord != 0)
+        {
+        printf("    error exit, condition %02o at P=%06o\n", (int)((exitWord >> 48) & Mask6), (u32)((exitWord >> 30) & Mask18) - 1);
+        return(FALSE);
+        }
+
+    if (build != runLoadFile && cpu.regP != stopAddress)
+        {
+        printf("    unexpected stop at P=%06o\n", cpu.regP);
+        return(FALSE);
+        }
+
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Exchange to the program in monitor mode and step the
+**                  CPU until it stops.
+**
+**  Parameters:     Name        Description.
+**                  steps       returns number of instruction words executed
+**
+**  Returns:        Elapsed time in nanoseconds.
+**
+**------------------------------------------------------------------------*/
+static u64 runUntilStop(long long *steps)
+    {
+    long long n = 0;
+    u64 start;
+
+    cpuExchangeJump(RunXp);
+    cpu.monitorMode = TRUE;
+
+    start = runClock();
+    while (!cpuStopped && n < RunMaxSteps)
+        {
+        cpuStep();
+        n += 1;
+        }
+
+    *steps = n;
+    return(runClock() - start);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Build the exchange package. B1 is one, B4, B5 and B6
+**                  hold half the inner, the inner and the outer loop
+**                  count, and all error exits are selected.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void runExchangePackage(void)
+    {
+    CpWord *xp = cpMem + RunXp;
+    u32 exitMode = EmAddressOutOfRange | EmOperandOutOfRange | EmIndefiniteOperand;
+
+    memset(xp, 0, 020 * sizeof(CpWord));
+    xp[0] = (CpWord)entryAddress << 36;
+    xp[1] = ((CpWord)RunRa << 36) | 1;
+    xp[2] = (CpWord)RunFl << 36;
+    xp[3] = (CpWord)exitMode << 36;
+    xp[4] = ((CpWord)0 << 36) | (innerCount / 2);
+    xp[5] = ((CpWord)RunFlEcs << 36) | innerCount;
+    xp[6] = ((CpWord)RunXp << 36) | outerCount;
+    cpMem[RunRa] = 0;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Print the per-opcode profile of all programs run.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void runReport(void)
+    {
+    u64 overhead = ~(u64)0;
+    u64 t;
+    u64 count;
+    u64 ticks;
+    u64 allTicks = 0;
+    double nsPerTick;
+    char op[8];
+    char *name;
+    int fm;
+    int i;
+    int j;
+
+    if (profileNs == 0)
+        {
+        return;
+        }
+
+    /*
+    **  Calibrate the profiling clock and the cost of reading it.
+    */
+    nsPerTick = (double)(long long)profileNs / (double)(long long)profileTicks;
+    for (i = 0; i < 1000; i++)
+        {
+        t = cpuProfileTicks();
+        t = cpuProfileTicks() - t;
+        if (t < overhead)
+            {
+            overhead = t;
+            }
+        }
+
+    for (i = 0; i < 01000; i++)
+        {
+        t = overhead * totalCount[i];
+        totalTicks[i] = totalTicks[i] > t ? totalTicks[i] - t : 0;
+        allTicks += totalTicks[i];
+        }
+
+    printf("\n%-6s %-12s %14s %10s %7s\n", "Opcode", "Instruction", "Count", "ns/op", "Time");
+    for (fm = 0; fm < 0100; fm++)
+        {
+        for (i = 0; i < 010; i++)
+            {
+            /*
+            **  Opcodes 01 and 46 are split by i, all others are summed.
+            */
+            count = 0;
+            ticks = 0;
+            if (fm == 001 || fm == 046)
+                {
+                count = totalCount[(fm << 3) | i];
+                ticks = totalTicks[(fm << 3) | i];
+                sprintf(op, "%02o%o", fm, i);
+                name = fm == 001 ? op01Names[i] : op46Names[i];
+                }
+            else if (i == 0)
+                {
+                for (j = 0; j < 010; j++)
+                    {
+                    count += totalCount[(fm << 3) | j];
+                    ticks += totalTicks[(fm << 3) | j];
+                    }
+
+                sprintf(op, "%02o", fm);
+                name = opNames[fm];
+                }
+
+            if (count != 0)
+                {
+                printf("%-6s %-12s %14llu %10.2f %6.1f%%\n", op, name, (unsigned long long)count,
+                    (double)(long long)ticks * nsPerTick / (double)(long long)count,
+                    allTicks == 0 ? 0.0 : 100.0 * (double)(long long)ticks / (double)(long long)allTicks);
+                }
+            }
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Load an absolute binary file at RA+100.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        TRUE if loaded.
+**
+**------------------------------------------------------------------------*/
+static bool runLoadFile(void)
+    {
+    FILE *fcb;
+    u8 buf[15];
+    CpWord word[2];
+    size_t len;
+    u32 skip = 0;
+    u32 address = RunRa + RunLoad;
+    bool first = TRUE;
+    int n;
+    int i;
+
+    fcb = fopen(fileName, "rb");
+    if (fcb == NULL)
+        {
+        printf("%-10s failed to open\n", fileName);
+        return(FALSE);
+        }
+
+    while ((len = fread(buf, 1, sizeof(buf), fcb)) >= 8)
+        {
+        /*
+        **  Unpack two words from 15 bytes, a trailing single word takes 8.
+        */
+        memset(buf + len, 0, sizeof(buf) - len);
+        word[0] = 0;
+        word[1] = 0;
+        for (i = 0; i < 7; i++)
+            {
+            word[0] = (word[0] << 8) | buf[i];
+            word[1] = (word[1] << 8) | buf[i + 8];
+            }
+
+        word[0] = (word[0] << 4) | (buf[7] >> 4);
+        word[1] = ((CpWord)(buf[7] & Mask4) << 56) | word[1];
+        n = len == sizeof(buf) ? 2 : 1;
+
+        for (i = 0; i < n; i++)
+            {
+            /*
+            **  Skip a 77 (prefix) table.
+            */
+            if (first && (word[i] >> 48) == 07700)
+                {
+                skip = (u32)((word[i] >> 36) & Mask12) + 1;
+                }
+
+            first = FALSE;
+            if (skip > 0)
+                {
+                skip -= 1;
+                continue;
+                }
+
+            if (address >= RunRa + RunFl)
+                {
+                printf("%-10s does not fit into FL %o\n", fileName, RunFl);
+                fclose(fcb);
+                return(FALSE);
+                }
+
+            cpMem[address++] = word[i] & Mask60;
+            }
+        }
+
+    fclose(fcb);
+    if (address == RunRa + RunLoad)
+        {
+        printf("%-10s contains no program\n", fileName);
+        return(FALSE);
+        }
+
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Integer kernel: boolean, shift and integer add
+**                  instructions with a load and a store per iteration.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        TRUE.
+**
+**------------------------------------------------------------------------*/
+static bool runBuildInt(void)
+    {
+    asmStart(RunLoad);
+    asmI30(071, 1, 0, 3);               /* SX1 B0+3 */
+    asmI30(071, 2, 0, 5);               /* SX2 B0+5 */
+    runLoopBegin();
+    asmI15(036, 6, 6, 1);               /* IX6 X6+X1 */
+    asmI15(037, 7, 7, 2);               /* IX7 X7-X2 */
+    asmI15(011, 5, 6, 7);               /* BX5 X6*X7 */
+    asmI15(013, 4, 4, 5);               /* BX4 X4-X5 */
+    asmI15(020, 3, 0, 1);               /* LX3 1 */
+    asmI15(021, 4, 0, 3);               /* AX4 3 */
+    asmI15(076, 0, 0, 1);               /* SX0 X0+B1 */
+    asmI30(051, 2, 7, RunBuf1);         /* SA2 B7+BUF1 */
+    asmI30(051, 6, 7, RunBuf2);         /* SA6 B7+BUF2 */
+    asmI15(012, 3, 3, 2);               /* BX3 X3+X2 */
+    runLoopEnd();
+    asmEnd();
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Floating point kernel: single, rounded and double
+**                  precision add, multiply and divide plus normalize and
+**                  unpack.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        TRUE.
+**
+**------------------------------------------------------------------------*/
+static bool runBuildFloat(void)
+    {
+    u8 i;
+
+    asmStart(RunLoad);
+    for (i = 1; i <= 3; i++)
+        {
+        asmI30(071, i, 0, 2 * i + 1);   /* SXi B0+3,5,7 */
+        asmI15(027, i, 0, i);           /* PXi B0,Xi */
+        asmI15(024, i, 0, i);           /* NXi B0,Xi */
+        }
+
+    runLoopBegin();
+    asmI15(040, 6, 1, 2);               /* FX6 X1*X2 */
+    asmI15(044, 7, 6, 3);               /* FX7 X6/X3 */
+    asmI15(030, 5, 7, 1);               /* FX5 X7+X1 */
+    asmI15(031, 4, 5, 2);               /* FX4 X5-X2 */
+    asmI15(024, 4, 0, 4);               /* NX4 B0,X4 */
+    asmI15(041, 0, 4, 3);               /* RX0 X4*X3 */
+    asmI15(032, 5, 6, 7);               /* DX5 X6+X7 */
+    asmI15(045, 4, 6, 2);               /* RX4 X6/X2 */
+    asmI15(026, 0, 2, 7);               /* UX0 B2,X7 */
+    runLoopEnd();
+    asmEnd();
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Branch kernel: data dependent X and B register
+**                  jumps, unconditional jumps and a return jump to a
+**                  subroutine per iteration.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        TRUE.
+**
+**------------------------------------------------------------------------*/
+static bool runBuildBranch(void)
+    {
+    asmStart(RunLoad);
+    runLoopBegin();
+    asmI30(071, 6, 7, 0);               /* SX6 B7 */
+    asmI15(020, 6, 7, 3);               /* LX6 59 */
+    asmJump(003, 2, 6, Label1);         /* PL X6,L1 */
+    asmI15(076, 5, 5, 1);               /* SX5 X5+B1 */
+    asmJump(004, 0, 0, Label2);         /* EQ L2 */
+    asmLabel(Label1);
+    asmI15(076, 4, 4, 1);               /* L1: SX4 X4+B1 */
+    asmLabel(Label2);
+    asmJump(006, 7, 4, Label3);         /* L2: GE B7,B4,L3 */
+    asmI15(076, 3, 3, 1);               /* SX3 X3+B1 */
+    asmLabel(Label3);
+    asmJump(003, 0, 0, Label4);         /* L3: ZR X0,L4 */
+    asmI15(000, 0, 0, 0);               /* PS */
+    asmLabel(Label4);
+    asmJump(001, 0, 0, LabelSub);       /* L4: RJ SUB */
+    asmForceUpper();
+    runLoopEnd();
+    asmLabel(LabelSub);
+    asmWord(0);                         /* SUB: PS, replaced by the return jump */
+    asmI15(076, 2, 2, 1);               /* SX2 X2+B1 */
+    asmJump(002, 0, 0, LabelSub);       /* JP SUB */
+    asmEnd();
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        ECS kernel: a block write and read per iteration.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        TRUE.
+**
+**------------------------------------------------------------------------*/
+static bool runBuildEcs(void)
+    {
+    asmStart(RunLoad);
+    asmI30(051, 0, 0, RunBuf1);         /* SA0 BUF1 */
+    asmI30(071, 0, 0, 0);               /* SX0 0 */
+    runLoopBegin();
+    asmForceUpper();
+    asmI30(001, 2, 0, RunEcsBlock);     /* WE BLOCK */
+    asmJump(004, 0, 0, LabelError);     /* error exit: EQ ERR */
+    asmI30(001, 1, 0, RunEcsBlock);     /* RE BLOCK */
+    asmJump(004, 0, 0, LabelError);     /* error exit: EQ ERR */
+    runLoopEnd();
+    asmLabel(LabelError);
+    asmI15(000, 0, 0, 0);               /* ERR: PS */
+    asmEnd();
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        CMU kernel: a direct and an indirect move with
+**                  different character positions per iteration.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        TRUE, or FALSE if the model has no CMU.
+**
+**------------------------------------------------------------------------*/
+static bool runBuildCmu(void)
+    {
+    if ((features & HasCMU) == 0)
+        {
+        printf("%-10s skipped, no CMU on this model\n", "cmu");
+        return(FALSE);
+        }
+
+    asmStart(RunLoad);
+    runLoopBegin();
+    asmForceUpper();
+    asmWord(asmCmuWord(RunBuf1, 0, RunBuf2, 3, 100) | ((CpWord)04650 << 48));
+    asmJump(046, 4, 0, LabelDesc);      /* IM DESC */
+    asmForceUpper();
+    runLoopEnd();
+    asmLabel(LabelDesc);
+    asmWord(asmCmuWord(RunBuf2, 5, RunBuf1 + 0400, 0, 200));
+    asmEnd();
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Start the kernel loops. The outer loop reloads the
+**                  inner counter B7 from B5.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void runLoopBegin(void)
+    {
+    asmLabel(LabelOuter);
+    asmI15(066, 7, 5, 0);               /* SB7 B5 */
+    asmLabel(LabelInner);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Close the kernel loops and stop.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void runLoopEnd(void)
+    {
+    asmI15(067, 7, 7, 1);               /* SB7 B7-B1 */
+    asmJump(005, 7, 0, LabelInner);     /* NE B7,B0,INNER */
+    asmI15(067, 6, 6, 1);               /* SB6 B6-B1 */
+    asmJump(005, 6, 0, LabelOuter);     /* NE B6,B0,OUTER */
+    asmForceUpper();
+    stopAddress = asmAddress;
+    asmI15(000, 0, 0, 0);               /* PS */
+    asmForceUpper();
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Start assembling at a RA relative address.
+**
+**  Parameters:     Name        Description.
+**                  address     RA relative address
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void asmStart(u32 address)
+    {
+    asmAddress = address;
+    asmShift = 60;
+    fixupCount = 0;
+    memset(labels, 0, sizeof(labels));
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Finish assembly and resolve jump addresses.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void asmEnd(void)
+    {
+    Fixup *fp;
+    int i;
+
+    asmForceUpper();
+    for (i = 0; i < fixupCount; i++)
+        {
+        fp = fixups + i;
+        cpMem[RunRa + fp->address] |= (CpWord)labels[fp->label] << fp->bit;
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Place a parcel, padding the word with pass
+**                  instructions if a 30 bit instruction does not fit.
+**
+**  Parameters:     Name        Description.
+**                  parcel      instruction
+**                  length      15 or 30
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void asmParcel(u32 parcel, u8 length)
+    {
+    if (length > asmShift)
+        {
+        asmForceUpper();
+        }
+
+    asmShift -= length;
+    cpMem[RunRa + asmAddress] |= (CpWord)parcel << asmShift;
+    if (asmShift == 0)
+        {
+        asmAddress += 1;
+        asmShift = 60;
+        }
+    }
+
+static void asmI15(u8 fm, u8 i, u8 j, u8 k)
+    {
+    asmParcel(((u32)fm << 9) | (i << 6) | (j << 3) | k, 15);
+    }
+
+static void asmI30(u8 fm, u8 i, u8 j, u32 K)
+    {
+    asmParcel(((u32)fm << 24) | (i << 21) | (j << 18) | (K & Mask18), 30);
+    }
+
+static void asmJump(u8 fm, u8 i, u8 j, u8 label)
+    {
+    if (asmShift < 30)
+        {
+        asmForceUpper();
+        }
+
+    fixups[fixupCount].address = asmAddress;
+    fixups[fixupCount].bit = asmShift - 30;
+    fixups[fixupCount].label = label;
+    fixupCount += 1;
+    asmI30(fm, i, j, 0);
+    }
+
+static void asmWord(CpWord word)
+    {
+    asmForceUpper();
+    cpMem[RunRa + asmAddress] = word & Mask60;
+    asmAddress += 1;
+    }
+
+static void asmLabel(u8 label)
+    {
+    asmForceUpper();
+    labels[label] = asmAddress;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Pad the current word with pass instructions so that
+**                  the next instruction starts a new word.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void asmForceUpper(void)
+    {
+    while (asmShift != 60)
+        {
+        asmParcel(046000, 15);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Build a CMU move descriptor (for an indirect move) or
+**                  the address part of a direct move instruction.
+**
+**  Parameters:     Name        Description.
+**                  k1          source word
+**                  c1          source character
+**                  k2          destination word
+**                  c2          destination character
+**                  ll          length in characters
+**
+**  Returns:        Descriptor word.
+**
+**------------------------------------------------------------------------*/
+static CpWord asmCmuWord(u32 k1, u32 c1, u32 k2, u32 c2, u32 ll)
+    {
+    return(  ((CpWord)(ll >> 4) << 48)
+           | ((CpWord)k1 << 30)
+           | ((CpWord)(ll & Mask4) << 26)
+           | ((CpWord)c1 << 22)
+           | ((CpWord)c2 << 18)
+           | (CpWord)k2);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read a monotonic nanosecond clock.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Time in nanoseconds.
+**
+**------------------------------------------------------------------------*/
+static u64 runClock(void)
+    {
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+
+    if (frequency.QuadPart == 0)
+        {
+        QueryPerformanceFrequency(&frequency);
+        }
+
+    QueryPerformanceCounter(&now);
+    return((u64)((double)now.QuadPart * 1000000000.0 / (double)frequency.QuadPart));
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((u64)ts.tv_sec * 1000000000 + (u64)ts.tv_nsec);
+#endif
+    }
+
+/*---------------------------  End Of File  ------------------------------*/
@@ -89,6 +89,11 @@
 #define StCr3447CompareErr       02000
 #define StCr3447NonIntStatus     02177
 
+/*
+**  Time a card is in motion before its data becomes available.
+*/
+#define CardMotionUs             20
+
 /*
 **  -----------------------
 **  Private Macro Functions
@@ -109,8 +114,9 @@ typedef struct
     int     status;
     int     col;
     const u16 *table;
-    u32     getcardcycle;
-    PpWord  card[80];
+    TimerSlot cardMotion;
+    DeckQueue deck;
+    Card    *card;
     } CrContext;
 
     
@@ -124,6 +130,7 @@ static void cr3447Io(void);
 static void cr3447Activate(void);
 static void cr3447Disconnect(void);
 static void cr3447NextCard(DevSlot *up, CrContext *cc);
+static void cr3447CheckTray(CrContext *cc);
 static char *cr3447Func2String(PpWord funcCode);
 
 /*
@@ -156,8 +163,9 @@ static FILE *cr3447Log = NULL;
 **                  eqNo        equipment number
 **                  unitCount   number of units to initialise
 **                  channelNo   channel number the device is attached to
-**                  deviceName  optional card source file name, "026" (default)
-**                              or "029" to select translation mode
+**                  deviceName  optional "026" (default) or "029" to select
+**                              translation mode, followed by a spool
+**                              directory ([026|029][,watchDir])
 **
 **  Returns:        Nothing.
 **
@@ -166,6 +174,7 @@ void cr3447Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     {
     DevSlot *up;
     CrContext *cc;
+    char *watchDir = NULL;
     
 #if DEBUG
     if (cr3447Log == NULL)
@@ -204,6 +213,15 @@ void cr3447Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     */
     cc->table = asciiTo026;     // default translation table
     if (deviceName != NULL)
+        {
+        watchDir = strchr(deviceName, ',');
+        if (watchDir != NULL)
+            {
+            *watchDir++ = 0;
+            }
+        }
+
+    if (deviceName != NULL && *deviceName != 0)
         {
         if (strcmp(deviceName, "029") == 0)
             {
@@ -216,14 +234,25 @@ void cr3447Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
             }
         }
 
+    /*
+    **  Cards are kept in ASCII, BCD or binary conversion is selected
+    **  by the PP when the card is read.
+    */
+    deckInit(&cc->deck, DeckCr3447, NULL, watchDir);
+
     /*
     **  Print a friendly message.
     */
     printf("CR3447 initialised on channel %o equipment %o\n", channelNo, eqNo);
+    if (watchDir != NULL && *watchDir != 0)
+        {
+        printf("CR3447 spool directory %s\n", watchDir);
+        }
     }
 
 /*--------------------------------------------------------------------------
-**  Purpose:        Load cards on 3447 card reader.
+**  Purpose:        Load cards on 3447 card reader. The deck is added to the
+**                  input tray behind any decks already loaded.
 **
 **  Parameters:     Name        Description.
 **
@@ -237,7 +266,6 @@ void cr3447LoadCards(char *params)
     int numParam;
     int channelNo;
     int equipmentNo;
-    FILE *fcb;
     static char str[200];
 
     /*
@@ -284,36 +312,11 @@ void cr3447LoadCards(char *params)
     cc = (CrContext *) (dp->context[0]);
 
     /*
-    **  Ensure the tray is empty.
+    **  The deck is read by the loader thread and picked up by the
+    **  next function or status request once the reader has run out
+    **  of cards.
     */
-    if (dp->fcb[0] != NULL)
-        {
-        printf("Input tray full\n");
-        return;
-        }
-
-    dp->fcb[0] = NULL;
-    cc->status = StCr3447Eof;
-
-    fcb = fopen(str, "r");
-
-    /*
-    **  Check if the open succeeded.
-    */
-    if (fcb == NULL)
-        {
-        printf("Failed to open %s\n", str);
-        return;
-        }
-
-    dp->fcb[0] = fcb;
-    cc->status = StCr3447Ready;
-    cr3447NextCard(dp, cc);
-
-    activeDevice = channelFindDevice((u8)channelNo, DtDcc6681);
-    dcc6681Interrupt((cc->status & cc->intmask) != 0);
-
-    printf("CR3447 loaded with %s", str);
+    deckLoad(&cc->deck, str);
     }
 
 /*
@@ -348,6 +351,7 @@ static FcStatus cr3447Func(PpWord funcCode)
 #endif
 
     cc = (CrContext *)active3000Device->context[0];
+    cr3447CheckTray(cc);
 
     switch (funcCode)
         {
@@ -365,7 +369,7 @@ static FcStatus cr3447Func(PpWord funcCode)
     case Fc6681InputToEor:
     case Fc6681Input:
         st = FcAccepted;
-        cc->getcardcycle = cycles;
+        timerStart(&cc->cardMotion, CardMotionUs, NULL, NULL);
         cc->status = StCr3447Ready;
         active3000Device->fcode = funcCode;
         break;
@@ -460,6 +464,7 @@ static void cr3447Io(void)
     case Fc6681DevStatusReq:
         if (!activeChannel->full)
             {
+            cr3447CheckTray(cc);
             activeChannel->data = (cc->status & (cc->intmask | StCr3447NonIntStatus));
             activeChannel->full = TRUE;
 #if DEBUG
@@ -472,14 +477,14 @@ static void cr3447Io(void)
     case Fc6681Input:
         // Don't admit to having new data immediately after completing
         // a card, otherwise 1CD may get stuck occasionally.
-        // So we simulate card in motion for 20 major cycles.
+        // So we simulate card in motion for a short while.
         if (   activeChannel->full
-            || cycles - cc->getcardcycle < 20)
+            || timerPending(&cc->cardMotion))
             {
             break;
             }
 
-        if (active3000Device->fcb[0] == NULL)
+        if (cc->card == NULL)
             {
             cc->status = StCr3447Eof;
             break;
@@ -504,7 +509,7 @@ static void cr3447Io(void)
             }
         else
             {
-            c = cc->card[cc->col++];
+            c = cc->card->col[cc->col++];
             if (cc->rawcard)
                 {
                 activeChannel->data = c;
@@ -516,7 +521,7 @@ static void cr3447Io(void)
             else
                 {
                 activeChannel->data = asciiToBcd[c] << 6;
-                c = cc->card[cc->col++];
+                c = cc->card->col[cc->col++];
                 activeChannel->data += asciiToBcd[c];
                 }
 
@@ -581,7 +586,7 @@ static void cr3447Disconnect(void)
         {
         cc->status |= StCr3447EoiInt;
         dcc6681Interrupt((cc->status & cc->intmask) != 0);
-        if (active3000Device->fcb[0] != NULL && cc->col != 0)
+        if (cc->card != NULL && cc->col != 0)
             {
             cr3447NextCard(active3000Device, cc);
             }
@@ -598,197 +603,56 @@ static void cr3447Disconnect(void)
 **------------------------------------------------------------------------*/
 static void cr3447NextCard (DevSlot *up, CrContext *cc)
     {
-    static char buffer[326];
-    char *cp;
-    char c;
-    int value;
-    int i;
-    int j;
-    PpWord col1;
+    (void)up;
 
     /* 
     **  Initialise read.
     */
-    cc->getcardcycle = cycles;
+    timerStart(&cc->cardMotion, CardMotionUs, NULL, NULL);
     cc->col = 0;
-    cc->rawcard = FALSE;
 
     /*
-    **  Read the next card.
+    **  Get the next card. The loader has already added a 6/7/8/9 card
+    **  at the end of each deck.
     */
-    cp = fgets(buffer, sizeof(buffer), up->fcb[0]);
-    if (cp == NULL)
+    cc->card = deckNextCard(&cc->deck);
+    if (cc->card == NULL)
         {
-        /*
-        **  If the last card wasn't a 6/7/8/9 card, fake one.
-        */
-        if (cc->card[0] != 00017)
-            {
-            cc->rawcard = TRUE;//    ???? what if we don't read binary (i.e. cc->binary)
-            cc->status |= StCr3447Binary;
-            memset(cc->card, 0, sizeof(cc->card));
-            cc->card[0] = 00017;
-            return;
-            }
-
-        fclose(up->fcb[0]);
-        up->fcb[0] = NULL;
+        cc->rawcard = FALSE;
         cc->status = StCr3447Eof;
         return;
         }
 
-    /*
-    **  Deal with special first-column codes.
-    */
-    if (buffer[0] == '}')
+    cc->rawcard = cc->card->type == CardRaw;
+    if (cc->card->flags & CardFlagBinary)
         {
-        /*
-        **  EOI = 6/7/8/9 card.
-        */
-        cc->rawcard = TRUE;
         cc->status |= StCr3447Binary;
-        memset(cc->card, 0, sizeof(cc->card));
-        cc->card[0] = 00017;
-        return;
         }
-
-    if (buffer[0] == '~')
+    else if ((cc->card->flags & CardFlagFile) != 0 && !cc->binary)
         {
-        if (strcmp(buffer + 1, "eoi\n") == 0)
-            {
-            /*
-            **  EOI = 6/7/8/9 card.
-            */
-            cc->rawcard = TRUE;
-            cc->status |= StCr3447Binary;
-            memset(cc->card, 0, sizeof(cc->card));
-            cc->card[0] = 00017;
-            return;
-            }
-
-        if (strcmp(buffer + 1, "eof\n") == 0)
-            {
-            /*
-            **  EOF = 6/7/9 card.
-            */
-            cc->rawcard = TRUE;
-            cc->status |= StCr3447Binary;
-            memset(cc->card, 0, sizeof(cc->card));
-            cc->card[0] = 00015;
-            return;
-            }
-
-        if (strcmp(buffer + 1, "eor\n") == 0 || buffer[1] == '\n' || buffer[1] == ' ')
-            {
-            /*
-            **  EOR = 7/8/9 card.
-            */
-            cc->rawcard = TRUE;
-            cc->status |= StCr3447Binary;
-            memset(cc->card, 0, sizeof(cc->card));
-            cc->card[0] = 00007;
-            return;
-            }
-
-        if (memcmp(buffer + 1, "raw", 3) == 0)
-            {
-            /*
-            **  Raw binary card.
-            */
-            cc->rawcard = TRUE;
-            col1 = buffer[4] & Mask5;
-            if (col1 == 00005)
-                {
-                cc->status |= StCr3447Binary;
-                }
-            else if (col1 == 00006 && !cc->binary)
-                {
-                cc->status |= StCr3447File;
-                }
-            }
+        cc->status |= StCr3447File;
         }
+    }
 
-    if (!cc->rawcard)
+/*--------------------------------------------------------------------------
+**  Purpose:        Check an empty input tray for newly loaded decks and
+**                  make the reader ready when one has arrived.
+**
+**  Parameters:     Name        Description.
+**                  cc          pointer to card reader context
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void cr3447CheckTray(CrContext *cc)
+    {
+    if (cc->card != NULL || !deckReady(&cc->deck))
         {
-        /*
-        **  Skip over any characters past column 80 (if line is longer).
-        */
-        if ((cp = strchr(buffer, '\n')) == NULL)
-            {
-            do 
-                {
-                c = fgetc(up->fcb[0]);
-                } while (c != '\n' && c != EOF);
-            cp = buffer + 80;
-            }
-
-        /*
-        **  Blank fill line shorter then 80 characters.
-        */
-        for ( ; cp < buffer + 80; cp++)
-            {
-            *cp = ' ';
-            }
-
-        /*
-        **  Transfer buffer.
-        */
-        for (i = 0; i < 80; i++)
-            {
-            c = buffer[i];
-            /*
-            **  Convert any non-ASCII characters to blank.
-            */
-            cc->card[i] = (c & 0x80) ? ' ' : c;
-            }
+        return;
         }
-    else
-        {
-        /*
-        **  Skip over any characters past column 324 (if line is longer).
-        */
-        if ((cp = strchr(buffer, '\n')) == NULL)
-            {
-            do 
-                {
-                c = fgetc(up->fcb[0]);
-                } while (c != '\n' && c != EOF);
-            cp = buffer + 324;
-            }
-
-        /*
-        **  Zero fill line shorter then 320 characters.
-        */
-        for ( ; cp < buffer + 324; cp++)
-            {
-            *cp = '0';
-            }
-
-        /*
-        **  Convert raw binary card (80 x 4 octal digits).
-        */
-        cp = buffer + 4;
-        for (i = 0; i < 80; i++)
-            {
-            value = 0;
-            for (j = 0; j < 4; j++)
-                {
-                if (cp[j] >= '0' && cp[j] <= '7')
-                    {
-                    value = (value << 3) | (cp[j] - '0');
-                    }
-                else
-                    {
-                    value = 0;
-                    break;
-                    }
-                }
-
-            cc->card[i] = value;
 
-            cp += 4;
-            }
-        }
+    cc->status = StCr3447Ready;
+    cr3447NextCard(active3000Device, cc);
     }
 
 /*--------------------------------------------------------------------------
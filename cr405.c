@@ -58,6 +58,11 @@
 #define StCr405EOF              00002
 #define StCr405CompareErr       00004
 
+/*
+**  Time a card is in motion before its data becomes available.
+*/
+#define CardMotionUs            20
+
 /*
 **  -----------------------
 **  Private Macro Functions
@@ -72,9 +77,10 @@
 typedef struct cr405Context
     {
     const u16 *table;
-    u32     getCardCycle;
+    TimerSlot cardMotion;
+    DeckQueue deck;
+    Card    *card;
     int     col;
-    PpWord  card[80];
     } Cr405Context;
 
 /*
@@ -114,7 +120,8 @@ static void cr405NextCard (DevSlot *dp);
 **                  eqNo        equipment number
 **                  unitNo      unit number
 **                  channelNo   channel number the device is attached to
-**                  deviceName  optional device file name
+**                  deviceName  optional card code and spool directory
+**                              ([026|029][,watchDir])
 **
 **  Returns:        Nothing.
 **
@@ -123,8 +130,7 @@ void cr405Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     {
     Cr405Context *cc;
     DevSlot *dp;
-
-    (void)deviceName;
+    char *watchDir = NULL;
 
     if (eqNo != 0)
         {
@@ -169,6 +175,15 @@ void cr405Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     */
     cc->table = asciiTo026;     // default translation table
     if (deviceName != NULL)
+        {
+        watchDir = strchr(deviceName, ',');
+        if (watchDir != NULL)
+            {
+            *watchDir++ = 0;
+            }
+        }
+
+    if (deviceName != NULL && *deviceName != 0)
         {
         if (strcmp(deviceName, "029") == 0)
             {
@@ -183,14 +198,24 @@ void cr405Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
 
     cc->col = 80;
 
+    /*
+    **  Decks are converted to punch images when they are loaded.
+    */
+    deckInit(&cc->deck, DeckCr405, cc->table, watchDir);
+
     /*
     **  Print a friendly message.
     */
     printf("CR405 initialised on channel %o\n", channelNo);
+    if (watchDir != NULL && *watchDir != 0)
+        {
+        printf("CR405 spool directory %s\n", watchDir);
+        }
     }
 
 /*--------------------------------------------------------------------------
-**  Purpose:        Load cards on 3447 card reader.
+**  Purpose:        Load cards on 405 card reader. The deck is added to the
+**                  input tray behind any decks already loaded.
 **
 **  Parameters:     Name        Description.
 **
@@ -250,28 +275,9 @@ void cr405LoadCards(char *params)
     cc = (Cr405Context *) (dp->context[0]);
 
     /*
-    **  Ensure the tray is empty.
+    **  The deck is read and converted by the loader thread.
     */
-    if (dp->fcb[0] != NULL)
-        {
-        printf("Input tray full\n");
-        return;
-        }
-
-    dp->fcb[0] = fopen(str, "r");
-
-    /*
-    **  Check if the open succeeded.
-    */
-    if (dp->fcb[0] == NULL)
-        {
-        printf("Failed to open %s\n", str);
-        return;
-        }
-
-    cr405NextCard(dp);
-
-    printf("CR405 loaded with %s", str);
+    deckLoad(&cc->deck, str);
     }
 
 /*--------------------------------------------------------------------------
@@ -324,7 +330,12 @@ static void cr405Io(void)
         break;
 
     case FcCr405StatusReq:
-        if (activeDevice->fcb[0] == NULL && cc->col >= 80)
+        if (cc->col >= 80)
+            {
+            cr405NextCard(activeDevice);
+            }
+
+        if (cc->col >= 80)
             {
             activeChannel->data = StCr405NotReady;
             }
@@ -337,9 +348,9 @@ static void cr405Io(void)
 
     case FcCr405ReadNonStop:
         /*
-        **  Simulate card in motion for 20 major cycles.
+        **  Simulate card in motion.
         */
-        if (cycles - cc->getCardCycle < 20)
+        if (timerPending(&cc->cardMotion))
             {
             break;
             }
@@ -349,7 +360,16 @@ static void cr405Io(void)
             break;
             }
 
-        activeChannel->data = cc->card[cc->col++] & Mask12;
+        if (cc->col >= 80)
+            {
+            /*
+            **  Input tray was empty, try again.
+            */
+            cr405NextCard(activeDevice);
+            break;
+            }
+
+        activeChannel->data = cc->card->col[cc->col++] & Mask12;
         activeChannel->full = TRUE;
 
         if (cc->col >= 80)
@@ -396,175 +416,19 @@ static void cr405Disconnect(void)
 static void cr405NextCard(DevSlot *dp)
     {
     Cr405Context *cc = dp->context[0];
-    static char buffer[322];
-    bool binaryCard;
-    char *cp;
-    char c;
-    int value;
-    int i;
-    int j;
-
-    if (dp->fcb[0] == NULL)
+
+    cc->card = deckNextCard(&cc->deck);
+    if (cc->card == NULL)
         {
+        cc->col = 80;
         return;
         }
-    
+
     /* 
     **  Initialise read.
     */
-    cc->getCardCycle = cycles;
+    timerStart(&cc->cardMotion, CardMotionUs, NULL, NULL);
     cc->col = 0;
-    binaryCard = FALSE;
-
-    /*
-    **  Read the next card.
-    */
-    cp = fgets(buffer, sizeof(buffer), dp->fcb[0]);
-    if (cp == NULL)
-        {
-        /*
-        **  If the last card wasn't a 6/7/8/9 card, fake one.
-        */
-        if (cc->card[0] != 00017)
-            {
-            memset(cc->card, 0, sizeof(cc->card));
-            cc->card[0] = 00017;
-            }
-        else
-            {
-            cc->col = 80;
-            }
-
-        fclose(dp->fcb[0]);
-        dp->fcb[0] = NULL;
-        return;
-        }
-
-    /*
-    **  Deal with special first-column codes.
-    */
-    if (buffer[0] == '~')
-        {
-        if (memcmp(buffer + 1, "eoi\n", 4) == 0)
-            {
-            /*
-            **  EOI = 6/7/8/9 card.
-            */
-            memset(cc->card, 0, sizeof(cc->card));
-            cc->card[0] = 00017;
-            return;
-            }
-
-        if (memcmp(buffer + 1, "eof\n", 4) == 0)
-            {
-            /*
-            **  EOF = 6/7/9 card.
-            */
-            memset(cc->card, 0, sizeof(cc->card));
-            cc->card[0] = 00015;
-            return;
-            }
-
-        if (memcmp(buffer + 1, "eor\n", 4) == 0)
-            {
-            /*
-            **  EOR = 7/8/9 card.
-            */
-            memset(cc->card, 0, sizeof(cc->card));
-            cc->card[0] = 00007;
-            return;
-            }
-
-        if (memcmp(buffer + 1, "bin", 3) == 0)
-            {
-            /*
-            **  Binary = 7/9 card.
-            */
-            binaryCard = TRUE;
-            cc->card[0] = 00005;
-            }
-        }
-
-    /*
-    **  Convert cards.
-    */
-    if (!binaryCard)
-        {
-        /*
-        **  Skip over any characters past column 80 (if line is longer).
-        */
-        if ((cp = strchr(buffer, '\n')) == NULL)
-            {
-            do 
-                {
-                c = fgetc(dp->fcb[0]);
-                } while (c != '\n' && c != EOF);
-            cp = buffer + 80;
-            }
-
-        /*
-        **  Blank fill line shorter then 80 characters.
-        */
-        for ( ; cp < buffer + 80; cp++)
-            {
-            *cp = ' ';
-            }
-
-        /*
-        **  Convert ASCII card.
-        */
-        for (i = 0; i < 80; i++)
-            {
-            cc->card[i] = cc->table[buffer[i]];
-            }
-        }
-    else
-        {
-        /*
-        **  Skip over any characters past column 320 (if line is longer).
-        */
-        if ((cp = strchr(buffer, '\n')) == NULL)
-            {
-            do 
-                {
-                c = fgetc(dp->fcb[0]);
-                } while (c != '\n' && c != EOF);
-            cp = buffer + 320;
-            }
-
-        /*
-        **  Zero fill line shorter then 320 characters.
-        */
-        for ( ; cp < buffer + 320; cp++)
-            {
-            *cp = '0';
-            }
-
-        /*
-        **  Convert binary card (79 x 4 octal digits).
-        */
-        cp = buffer + 4;
-        for (i = 1; i < 80; i++)
-            {
-            value = 0;
-            for (j = 0; j < 4; j++)
-                {
-                if (cp[j] >= '0' && cp[j] <= '7')
-                    {
-                    value = (value << 3) | (cp[j] - '0');
-                    }
-                else
-                    {
-                    value = 0;
-                    break;
-                    }
-                }
-
-            cc->card[i] = value;
-
-            cp += 4;
-            }
-        }
     }
 
 /*---------------------------  End Of File  ------------------------------*/
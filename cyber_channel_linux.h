@@ -39,6 +39,12 @@
 #define DEVICE_NODE         "/dev/cyber_channel0"
 #define IOCTL_FPGA_READ     _IOR('f', 0, struct ioCb *)
 #define IOCTL_FPGA_WRITE    _IOR('f', 1, struct ioCb *)
+#define IOCTL_FPGA_BATCH    _IOWR('f', 2, struct ioBatch *)
+
+/*
+**  Maximum number of commands submitted by one IOCTL_FPGA_BATCH.
+*/
+#define IoBatchMax          64
 
 /*
 **  ----------------------
@@ -57,6 +63,18 @@ typedef struct ioCb
     unsigned short  data;
     } IoCB;
 
+/*
+**  IOCTL_FPGA_BATCH writes each command in turn (waiting for the busy
+**  bit to clear before each one), then reads the status register into
+**  status. A batch with count zero just reads the status.
+*/
+typedef struct ioBatch
+    {
+    int             count;
+    unsigned short  status;
+    IoCB            op[IoBatchMax];
+    } IoBatch;
+
 /*
 **  --------------------------
 **  Public Function Prototypes
@@ -27,8 +27,6 @@
 **--------------------------------------------------------------------------
 */
 
-#define DEBUG 0
-
 /*
 **  -------------
 **  Include Files
@@ -41,6 +39,13 @@
 #include "const.h"
 #include "types.h"
 #include "proto.h"
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 /*
 **  -----------------
@@ -175,6 +180,26 @@
 #define CtClassic               1
 #define CtPacked                2
 
+/*
+**  Byte locked in a shared disk container while a unit is reserved by
+**  this emulator. It lies beyond the end of the largest container.
+*/
+#define ReserveLockOffset       0x7ffffff0
+
+/*
+**  Thin disk container. A header is followed by the block map (one 32 bit
+**  little endian entry per track, 0 = not allocated) and the allocated
+**  tracks in allocation order. Tracks which were never written are read
+**  from the base image (if any) or as zeros.
+*/
+#define ThinMagic               "DTCYTHN1"
+#define ThinHeaderSize          512
+#define ThinNameSize            256
+#define ThinOffSectorSize       8
+#define ThinOffSectorsPerBlock  12
+#define ThinOffBlockCount       16
+#define ThinOffBaseName         32
+
 /*
 **  -----------------------
 **  Private Macro Functions
@@ -193,6 +218,19 @@ typedef struct diskSize
     i32         maxSectors;
     } DiskSize;
 
+typedef struct diskImage
+    {
+    FILE        *fcb;
+    char        name[ThinNameSize];
+    u32         *map;           /* block map, NULL for a flat base image */
+    u32         blockCount;
+    u32         blocksUsed;
+    u32         sectorsPerBlock;
+    u32         sectorSize;
+    long        dataStart;
+    struct diskImage *base;     /* read-only base image or NULL */
+    } DiskImage;
+
 typedef struct diskParam
     {
     PpWord      (*read)(struct diskParam *, FILE *fcb);
@@ -207,6 +245,10 @@ typedef struct diskParam
     u8          diskNo;
     u8          unitNo;
     u8          diskType;
+    bool        shared;         /* container shared with other emulators */
+    bool        reserved;       /* unit reserved by this emulator */
+    DiskImage   *image;         /* thin container, NULL for a flat file */
+    i32         position;       /* byte offset within a thin container */
     PpWord      buffer[SectorSize];
     PpWord      *bufPtr;
     } DiskParam;
@@ -231,7 +273,23 @@ static void dd8xxWriteClassic(DiskParam *dp, FILE *fcb, PpWord data);
 static void dd8xxWritePacked(DiskParam *dp, FILE *fcb, PpWord data);
 static void dd8xxSectorRead(DiskParam *dp, FILE *fcb, PpWord *sector);
 static void dd8xxSectorWrite(DiskParam *dp, FILE *fcb, PpWord *sector);
+static void dd8xxContainerPosition(DiskParam *dp, FILE *fcb, i32 pos);
+static void dd8xxContainerRead(DiskParam *dp, FILE *fcb, void *data);
+static void dd8xxContainerWrite(DiskParam *dp, FILE *fcb, void *data);
+static void dd8xxReopen(DevSlot *ds, u8 unitNo, DiskImage *ip);
+static DiskImage *dd8xxThinOpen(char *name, bool readOnly, DiskParam *dp);
+static DiskImage *dd8xxThinOpenBase(char *name, DiskParam *dp);
+static DiskImage *dd8xxThinCreate(char *name, char *baseName, DiskParam *dp);
+static void dd8xxThinRead(DiskImage *ip, u32 sector, u8 *data);
+static bool dd8xxThinWrite(DiskImage *ip, u32 sector, u8 *data);
+static bool dd8xxThinAllocate(DiskImage *ip, u32 block);
+static u32 dd8xxGetU32(u8 *p);
+static void dd8xxPutU32(u8 *p, u32 value);
 static void dd844SetClearFlaw(DiskParam *dp, PpWord flawState);
+static bool dd8xxSelectUnit(i8 unitNo);
+static void dd8xxUnbuffered(DiskParam *dp, FILE *fcb);
+static bool dd8xxReserve(DiskParam *dp, FILE *fcb);
+static void dd8xxRelease(void);
 static char *dd8xxFunc2String(PpWord funcCode);
 
 /*
@@ -252,27 +310,16 @@ static DiskSize sizeDd844_2 = {MaxCylinders844_2, MaxTracks844, MaxSectors844};
 static DiskSize sizeDd844_4 = {MaxCylinders844_4, MaxTracks844, MaxSectors844};
 static DiskSize sizeDd885_1 = {MaxCylinders885_1, MaxTracks885, MaxSectors885};
 
-#if DEBUG
-static FILE *dd8xxLog = NULL;
-#endif
-
-#if DEBUG
 #define OctalColumn(x) (5 * (x) + 1 + 5)
 #define AsciiColumn(x) (OctalColumn(5) + 2 + (2 * x))
 #define LogLineLength (AsciiColumn(5))
-#endif
 
-#if DEBUG
 static void dd8xxLogFlush (void);
 static void dd8xxLogByte (int b);
-#endif
 
-#if DEBUG
 static char dd8xxLogBuf[LogLineLength + 1];
 static int dd8xxLogCol = 0;
-#endif
 
-#if DEBUG
 /*--------------------------------------------------------------------------
 **  Purpose:        Flush incomplete numeric/ascii data line
 **
@@ -285,7 +332,7 @@ static void dd8xxLogFlush(void)
     {
     if (dd8xxLogCol != 0)
         {
-        fputs(dd8xxLogBuf, dd8xxLog);
+        logPrintf(LogDd8xx, "%s", dd8xxLogBuf);
         }
 
     dd8xxLogCol = 0;
@@ -319,7 +366,6 @@ static void dd8xxLogByte(int b)
         dd8xxLogFlush();
         }
     }
-#endif
 
 /*
 **--------------------------------------------------------------------------
@@ -337,7 +383,9 @@ static void dd8xxLogByte(int b)
 **                  eqNo        equipment number
 **                  unitNo      unit number
 **                  channelNo   channel number the device is attached to
-**                  deviceName  optional device file name
+**                  deviceName  optional device file name followed by
+**                              options: classic|packed, shared, thin and
+**                              base=<file> (thin overlay on a base pack)
 **
 **  Returns:        Nothing.
 **
@@ -357,6 +405,114 @@ void dd885Init_1(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     dd8xxInit(eqNo, unitNo, channelNo, deviceName, &sizeDd885_1, DiskType885);
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Take a snapshot of a thin disk container. The current
+**                  overlay is frozen under the snapshot name and the unit
+**                  continues in a new empty overlay on top of it.
+**
+**  Parameters:     Name        Description.
+**                  params      parameters: channel,unit,snapshot file
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void dd8xxSnapshot(char *params)
+    {
+    DevSlot *ds;
+    DiskParam *dp;
+    DiskImage *ip;
+    DiskImage *np;
+    FILE *fcb;
+    int numParam;
+    int channelNo;
+    int unitNo;
+    char snapName[ThinNameSize];
+    char name[ThinNameSize];
+
+    numParam = sscanf(params, "%o,%o,%255s", &channelNo, &unitNo, snapName);
+    if (numParam != 3)
+        {
+        printf("Not enough or invalid parameters\n");
+        return;
+        }
+
+    if (channelNo < 0 || channelNo >= MaxChannels)
+        {
+        printf("Invalid channel no\n");
+        return;
+        }
+
+    if (unitNo < 0 || unitNo >= MaxUnits)
+        {
+        printf("Invalid unit no\n");
+        return;
+        }
+
+    ds = channelFindDevice((u8)channelNo, DtDd8xx);
+    if (ds == NULL || ds->context[unitNo] == NULL)
+        {
+        printf("No disk unit %o on channel %o\n", unitNo, channelNo);
+        return;
+        }
+
+    dp = (DiskParam *)ds->context[unitNo];
+    ip = dp->image;
+    if (ip == NULL)
+        {
+        printf("Disk unit %o on channel %o is not a thin container\n", unitNo, channelNo);
+        return;
+        }
+
+    fcb = fopen(snapName, "rb");
+    if (fcb != NULL)
+        {
+        fclose(fcb);
+        printf("%s already exists\n", snapName);
+        return;
+        }
+
+    /*
+    **  Freeze the current overlay under the snapshot name; it becomes the
+    **  read-only base of a new overlay with the original name.
+    */
+    strcpy(name, ip->name);
+    fclose(ip->fcb);
+    if (rename(name, snapName) != 0)
+        {
+        printf("Failed to rename %s to %s\n", name, snapName);
+        dd8xxReopen(ds, (u8)unitNo, ip);
+        return;
+        }
+
+    fcb = fopen(snapName, "rb");
+    if (fcb == NULL)
+        {
+        printf("Failed to open %s\n", snapName);
+        rename(snapName, name);
+        dd8xxReopen(ds, (u8)unitNo, ip);
+        return;
+        }
+
+    np = dd8xxThinCreate(name, snapName, dp);
+    if (np == NULL)
+        {
+        printf("Failed to create %s\n", name);
+        fclose(fcb);
+        rename(snapName, name);
+        dd8xxReopen(ds, (u8)unitNo, ip);
+        return;
+        }
+
+    ip->fcb = fcb;
+    strcpy(ip->name, snapName);
+    np->base = ip;
+
+    dp->image = np;
+    ds->fcb[unitNo] = np->fcb;
+
+    printf("Snapshot of disk unit %o on channel %o saved as %s\n", unitNo, channelNo, snapName);
+    }
+
 /*
 **--------------------------------------------------------------------------
 **
@@ -389,21 +545,12 @@ static void dd8xxInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName, DiskSi
     u8 yy, mm, dd;
     u8 containerType;
     char *opt = NULL;
+    char *next;
+    char *baseName = NULL;
+    bool thin = FALSE;
 
     (void)eqNo;
 
-#if DEBUG
-    if (dd8xxLog == NULL)
-        {
-        dd8xxLog = fopen("dd8xxlog.txt", "wt");
-        if (dd8xxLog == NULL)
-            {
-            fprintf(stderr, "dd8xxlog.txt - aborting\n");
-            exit(1);
-            }
-        }
-#endif
-
     /*
     **  Setup channel functions.
     */
@@ -438,12 +585,35 @@ static void dd8xxInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName, DiskSi
         opt = strchr (deviceName, ',');
         }
 
+    /*
+    **  Default values.
+    */
+    switch (diskType)
+        {
+    case DiskType885:
+        containerType = CtPacked;
+        break;
+
+    case DiskType844:
+        containerType = CtClassic;
+        break;
+        }
+
     if (opt != NULL)
         {
-        /*
-        **  Process options.
-        */
         *opt++ = '\0';
+        }
+
+    /*
+    **  Process options.
+    */
+    while (opt != NULL)
+        {
+        next = strchr (opt, ',');
+        if (next != NULL)
+            {
+            *next++ = '\0';
+            }
 
         if (   strcmp (opt, "old")     == 0
             || strcmp (opt, "classic") == 0)
@@ -455,27 +625,26 @@ static void dd8xxInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName, DiskSi
             {
             containerType = CtPacked;
             }
+        else if (strcmp (opt, "shared") == 0)
+            {
+            dp->shared = TRUE;
+            }
+        else if (strcmp (opt, "thin") == 0)
+            {
+            thin = TRUE;
+            }
+        else if (strncmp (opt, "base=", 5) == 0)
+            {
+            thin = TRUE;
+            baseName = opt + 5;
+            }
         else
             {
             fprintf (stderr, "Unrecognized option name %s\n", opt);
             exit (1);
             }
-        }
-    else
-        {
-        /*
-        **  No options specified - use default values.
-        */
-        switch (diskType)
-            {
-        case DiskType885:
-            containerType = CtPacked;
-            break;
 
-        case DiskType844:
-            containerType = CtClassic;
-            break;
-            }
+        opt = next;
         }
 
     /*
@@ -578,30 +747,86 @@ static void dd8xxInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName, DiskSi
         }
 
     /*
-    **  Try to open existing disk image.
+    **  Try to open existing disk image. Thin containers are recognised
+    **  by their header.
     */
-    fcb = fopen(fname, "r+b");
-    if (fcb == NULL)
+    dp->image = dd8xxThinOpen(fname, FALSE, dp);
+    if (dp->shared && (thin || dp->image != NULL))
+        {
+        fprintf(stderr, "Thin disk containers can't be shared\n");
+        exit(1);
+        }
+
+    if (dp->image != NULL)
+        {
+        fcb = dp->image->fcb;
+        }
+    else
+        {
+        fcb = fopen(fname, "r+b");
+        if (fcb != NULL && thin)
+            {
+            fprintf(stderr, "%s is not a thin disk container\n", fname);
+            exit(1);
+            }
+
+        dd8xxUnbuffered(dp, fcb);
+        }
+
+    if (fcb == NULL && baseName != NULL)
         {
         /*
-        **  Disk does not yet exist - manufacture one.
+        **  New copy-on-write overlay for an existing pack, which already
+        **  carries its factory and utility data.
         */
-        fcb = fopen(fname, "w+b");
-        if (fcb == NULL)
+        dp->image = dd8xxThinCreate(fname, baseName, dp);
+        if (dp->image == NULL)
             {
-            fprintf(stderr, "Failed to open %s\n", fname);
+            fprintf(stderr, "Failed to create %s\n", fname);
             exit(1);
             }
 
+        dp->image->base = dd8xxThinOpenBase(baseName, dp);
+        fcb = dp->image->fcb;
+        }
+
+    if (fcb == NULL)
+        {
         /*
-        **  Write last disk sector to reserve the space.
+        **  Disk does not yet exist - manufacture one.
         */
-        memset(mySector, 0, SectorSize * 2);
-        dp->cylinder = size->maxCylinders - 1;
-        dp->track = size->maxTracks - 1;
-        dp->sector = size->maxSectors - 1;
-        fseek(fcb, dd8xxSeek(dp), SEEK_SET);
-        dd8xxSectorWrite(dp, fcb, mySector);
+        if (thin)
+            {
+            dp->image = dd8xxThinCreate(fname, NULL, dp);
+            if (dp->image == NULL)
+                {
+                fprintf(stderr, "Failed to create %s\n", fname);
+                exit(1);
+                }
+
+            fcb = dp->image->fcb;
+            }
+        else
+            {
+            fcb = fopen(fname, "w+b");
+            if (fcb == NULL)
+                {
+                fprintf(stderr, "Failed to open %s\n", fname);
+                exit(1);
+                }
+
+            dd8xxUnbuffered(dp, fcb);
+
+            /*
+            **  Write last disk sector to reserve the space.
+            */
+            memset(mySector, 0, SectorSize * 2);
+            dp->cylinder = size->maxCylinders - 1;
+            dp->track = size->maxTracks - 1;
+            dp->sector = size->maxSectors - 1;
+            dd8xxContainerPosition(dp, fcb, dd8xxSeek(dp));
+            dd8xxSectorWrite(dp, fcb, mySector);
+            }
 
         /*
         **  Position to cylinder with the disk's factory and utility
@@ -626,7 +851,7 @@ static void dd8xxInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName, DiskSi
             {
             for (dp->sector = 0; dp->sector < size->maxSectors; dp->sector++)
                 {
-                fseek(fcb, dd8xxSeek(dp), SEEK_SET);
+                dd8xxContainerPosition(dp, fcb, dd8xxSeek(dp));
                 dd8xxSectorWrite(dp, fcb, mySector);
                 }
             }
@@ -652,7 +877,7 @@ static void dd8xxInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName, DiskSi
 
         dp->track = 0;
         dp->sector = 0;
-        fseek(fcb, dd8xxSeek(dp), SEEK_SET);
+        dd8xxContainerPosition(dp, fcb, dd8xxSeek(dp));
         dd8xxSectorWrite(dp, fcb, mySector);
         }
 
@@ -665,13 +890,13 @@ static void dd8xxInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName, DiskSi
     dp->track = 0;
     dp->sector = 0;
     dp->interlace = 1;
-    fseek(fcb, dd8xxSeek(dp), SEEK_SET);
+    dd8xxContainerPosition(dp, fcb, dd8xxSeek(dp));
 
     /*
     **  Print a friendly message.
     */
-    printf("Disk with %d cylinders initialised on channel %o unit %o\n",
-        dp->size.maxCylinders, channelNo, unitNo);
+    printf("Disk with %d cylinders initialised on channel %o unit %o%s\n",
+        dp->size.maxCylinders, channelNo, unitNo, dp->shared ? " (shared)" : dp->image != NULL ? " (thin)" : "");
     }
 
 /*--------------------------------------------------------------------------
@@ -713,66 +938,89 @@ static FcStatus dd8xxFunc(PpWord funcCode)
         dp = (DiskParam *)activeDevice->context[unitNo];
         }
 
-#if DEBUG
-    dd8xxLogFlush();
-    if (dp != NULL)
-        {
-        fprintf(dd8xxLog, "\n%06d PP:%02o CH:%02o DSK:%d f:%04o T:%-25s   c:%3d t:%2d s:%2d  >   ", 
-            traceSequenceNo,
-            activePpu->id,
-            activeDevice->channel->id,
-            dp->diskNo,
-            funcCode,
-            dd8xxFunc2String(funcCode),
-            dp->cylinder,
-            dp->track,
-            dp->sector);
-        }
-    else
+    if (LogOn(LogDd8xx))
         {
-        fprintf(dd8xxLog, "\n%06d PP:%02o CH:%02o DSK:? f:%04o T:%-25s  >   ", 
-            traceSequenceNo,
-            activePpu->id,
-            activeDevice->channel->id,
-            funcCode,
-            dd8xxFunc2String(funcCode));
+        dd8xxLogFlush();
+        if (dp != NULL)
+            {
+            logPrintf(LogDd8xx, "\n%06d PP:%02o CH:%02o DSK:%d f:%04o T:%-25s   c:%3d t:%2d s:%2d  >   ", 
+                traceSequenceNo,
+                activePpu->id,
+                activeDevice->channel->id,
+                dp->diskNo,
+                funcCode,
+                dd8xxFunc2String(funcCode),
+                dp->cylinder,
+                dp->track,
+                dp->sector);
+            }
+        else
+            {
+            logPrintf(LogDd8xx, "\n%06d PP:%02o CH:%02o DSK:? f:%04o T:%-25s  >   ", 
+                traceSequenceNo,
+                activePpu->id,
+                activeDevice->channel->id,
+                funcCode,
+                dd8xxFunc2String(funcCode));
+            }
         }
 
-    fflush(dd8xxLog);
-#endif
-
     /*
     **  Catch functions which try to operate on not selected drives.
     */
-    if (unitNo == -1)
+    switch (funcCode)
         {
-        switch (funcCode)
+    case Fc8xxConnect:
+    case Fc8xxSeekFull:
+    case Fc8xxSeekHalf:
+    case Fc8xxOpComplete:
+    case Fc8xxDropSeeks:
+    case Fc8xxGeneralStatus:
+    case Fc8xxStartMemLoad:
+    case Fc8xxDriveRelease:
+    case Fc8xxManipulateProcessor:
+    case Fc8xxDisableReserve:
+    case Fc8xxClearCoupler:
+        /*
+        **  These functions are OK - do nothing.
+        */
+        break;
+    
+    default:
+        /*
+        **  All remaining functions are declined if no drive is selected.
+        */
+        if (unitNo == -1)
             {
-        case Fc8xxConnect:
-        case Fc8xxSeekFull:
-        case Fc8xxSeekHalf:
-        case Fc8xxOpComplete:
-        case Fc8xxDropSeeks:
-        case Fc8xxGeneralStatus:
-        case Fc8xxStartMemLoad:
-        case Fc8xxDriveRelease:
-        case Fc8xxManipulateProcessor:
-        case Fc8xxDisableReserve:
-        case Fc8xxClearCoupler:
-            /*
-            **  These functions are OK - do nothing.
-            */
-            break;
-        
-        default:
-            /*
-            **  All remaining functions are declined if no drive is selected.
-            */
-#if DEBUG
-            fprintf(dd8xxLog, " No drive selected, function declined ");
-#endif
+            if (LogOn(LogDd8xx))
+                {
+                logPrintf(LogDd8xx, " No drive selected, function declined ");
+                }
+
+            return(FcDeclined);
+            }
+
+        /*
+        **  Operation complete and drive release keep the unit selected
+        **  but drop the reservation of a shared unit, so take it again
+        **  before the drive is used.
+        */
+        if (dp != NULL && !dd8xxReserve(dp, fcb))
+            {
+            if (LogOn(LogDd8xx))
+                {
+                logPrintf(LogDd8xx, " Reserved by opposite access, function declined ");
+                }
+
+            activeDevice->status = St8xxOppositeReserved;
             return(FcDeclined);
             }
+
+        if (activeDevice->status == St8xxOppositeReserved)
+            {
+            activeDevice->status = 0;
+            }
+        break;
         }
 
     /*
@@ -781,9 +1029,11 @@ static FcStatus dd8xxFunc(PpWord funcCode)
     switch (funcCode)
         {
     default:
-#if DEBUG
-        fprintf(dd8xxLog, " !!!!!FUNC not implemented & declined!!!!!! ");
-#endif
+        if (LogOn(LogDd8xx))
+            {
+            logPrintf(LogDd8xx, " !!!!!FUNC not implemented & declined!!!!!! ");
+            }
+
         return(FcDeclined);
 
     case Fc8xxClearCoupler:
@@ -822,6 +1072,7 @@ static FcStatus dd8xxFunc(PpWord funcCode)
         break;
 
     case Fc8xxOpComplete:
+        dd8xxRelease();
         return(FcProcessed);
 
     case Fc8xxDropSeeks:
@@ -878,6 +1129,7 @@ static FcStatus dd8xxFunc(PpWord funcCode)
         break;
 
     case Fc8xxDriveRelease:
+        dd8xxRelease();
         return(FcProcessed);
 
     case Fc8xxDeadstart:
@@ -904,7 +1156,7 @@ static FcStatus dd8xxFunc(PpWord funcCode)
             break;
             }
 
-        fseek(fcb, dd8xxSeek(dp), SEEK_SET);
+        dd8xxContainerPosition(dp, fcb, dd8xxSeek(dp));
         activeDevice->recordLength = SectorSize;
         break;
 
@@ -940,18 +1192,17 @@ static FcStatus dd8xxFunc(PpWord funcCode)
     case Fc8xxGapWrite:
     case Fc8xxGapWriteVerify:
     case Fc8xxGapReadCheckword:
-#if DEBUG
-        fprintf(dd8xxLog, " !!!!!FUNC not implemented but accepted!!!!!! ");
-#endif
+        if (LogOn(LogDd8xx))
+            {
+            logPrintf(LogDd8xx, " !!!!!FUNC not implemented but accepted!!!!!! ");
+            }
+
         logError(LogErrorLocation, "ch %o, function %04o not implemented\n", activeChannel->id, funcCode);
         break;
         }
 
     activeDevice->fcode = funcCode;
 
-#if DEBUG
-    fflush(dd8xxLog);
-#endif
     return(FcAccepted);
     }
 
@@ -988,23 +1239,9 @@ static void dd8xxIo(void)
         if (activeChannel->full)
             {
             unitNo = activeChannel->data & 07;
-            if (unitNo != activeDevice->selectedUnit)
-                {
-                if (activeDevice->fcb[unitNo] != NULL)
-                    {
-                    activeDevice->selectedUnit = unitNo;
-                    dp = (DiskParam *)activeDevice->context[unitNo];
-                    dp->detailedStatus[12] &= ~01000;
-                    }
-                else
-                    {
-                    activeDevice->selectedUnit = -1;
-                    logError(LogErrorLocation, "channel %02o - invalid connect: %4.4o", activeChannel->id, (u32)activeDevice->fcode);
-                    }
-                }
-            else
+            if (!dd8xxSelectUnit(unitNo))
                 {
-                dp->detailedStatus[12] |= 01000;
+                logError(LogErrorLocation, "channel %02o - invalid connect: %4.4o", activeChannel->id, (u32)activeDevice->fcode);
                 }
 
             activeChannel->full = FALSE;
@@ -1019,24 +1256,20 @@ static void dd8xxIo(void)
                 {
             case 4:
                 unitNo = activeChannel->data & 07;
-                if (unitNo != activeDevice->selectedUnit)
+                if (!dd8xxSelectUnit(unitNo))
                     {
-                    if (activeDevice->fcb[unitNo] != NULL)
-                        {
-                        activeDevice->selectedUnit = unitNo;
-                        dp = (DiskParam *)activeDevice->context[unitNo];
-                        dp->detailedStatus[12] &= ~01000;
+                    logError(LogErrorLocation, "channel %02o - invalid select: %4.4o", activeChannel->id, (u32)activeDevice->fcode);
+                    }
 
-                        }
-                    else
-                        {
-                        logError(LogErrorLocation, "channel %02o - invalid select: %4.4o", activeChannel->id, (u32)activeDevice->fcode);
-                        activeDevice->selectedUnit = -1;
-                        }
+                if (activeDevice->selectedUnit != -1)
+                    {
+                    dp = (DiskParam *)activeDevice->context[activeDevice->selectedUnit];
+                    fcb = activeDevice->fcb[activeDevice->selectedUnit];
                     }
                 else
                     {
-                    dp->detailedStatus[12] |= 01000;
+                    dp = NULL;
+                    fcb = NULL;
                     }
                 break;
 
@@ -1070,10 +1303,10 @@ static void dd8xxIo(void)
                     pos = dd8xxSeek(dp);
                     if (pos >= 0 && fcb != NULL)
                         {
-                        fseek(fcb, pos, SEEK_SET);
+                        dd8xxContainerPosition(dp, fcb, pos);
                         }
                     }
-                else
+                else if (activeDevice->status != St8xxOppositeReserved)
                     {
                     activeDevice->status = 05020;
                     }
@@ -1084,9 +1317,10 @@ static void dd8xxIo(void)
                 break;
                 }
 
-#if DEBUG
-            fprintf(dd8xxLog, " %04o[%d]", activeChannel->data, activeChannel->data);
-#endif
+            if (LogOn(LogDd8xx))
+                {
+                logPrintf(LogDd8xx, " %04o[%d]", activeChannel->data, activeChannel->data);
+                }
 
             activeChannel->full = FALSE;
             }
@@ -1121,7 +1355,7 @@ static void dd8xxIo(void)
                 pos = dd8xxSeekNextSector(dp);
                 if (pos >= 0)
                     {
-                    fseek(fcb, pos, SEEK_SET);
+                    dd8xxContainerPosition(dp, fcb, pos);
                     }
                 }
             }
@@ -1134,9 +1368,10 @@ static void dd8xxIo(void)
             {
             activeChannel->data = dp->read(dp, fcb);
             activeChannel->full = TRUE;
-#if DEBUG
-            dd8xxLogByte(activeChannel->data);
-#endif
+            if (LogOn(LogDd8xx))
+                {
+                dd8xxLogByte(activeChannel->data);
+                }
 
             if (--activeDevice->recordLength == 0)
                 {
@@ -1148,7 +1383,7 @@ static void dd8xxIo(void)
                     }
                 if (pos >= 0)
                     {
-                    fseek(fcb, pos, SEEK_SET);
+                    dd8xxContainerPosition(dp, fcb, pos);
                     }
                 }
             }
@@ -1163,15 +1398,17 @@ static void dd8xxIo(void)
             dp->write(dp, fcb, activeChannel->data);
             activeChannel->full = FALSE;
 
-#if DEBUG
-            dd8xxLogByte(activeChannel->data);
-#endif
+            if (LogOn(LogDd8xx))
+                {
+                dd8xxLogByte(activeChannel->data);
+                }
+
             if (--activeDevice->recordLength == 0)
                 {
                 pos = dd8xxSeekNextSector(dp);
                 if (pos >= 0)
                     {
-                    fseek(fcb, pos, SEEK_SET);
+                    dd8xxContainerPosition(dp, fcb, pos);
                     }
                 }
             }
@@ -1183,9 +1420,10 @@ static void dd8xxIo(void)
             activeChannel->data = activeDevice->status;
             activeChannel->full = TRUE;
 
-#if DEBUG
-            fprintf(dd8xxLog, " %04o[%d]", activeChannel->data, activeChannel->data);
-#endif
+            if (LogOn(LogDd8xx))
+                {
+                logPrintf(LogDd8xx, " %04o[%d]", activeChannel->data, activeChannel->data);
+                }
 
             if (--activeDevice->recordLength == 0)
                 {
@@ -1212,9 +1450,10 @@ static void dd8xxIo(void)
             activeChannel->data = dp->detailedStatus[12 - activeDevice->recordLength];
             activeChannel->full = TRUE;
 
-#if DEBUG
-            fprintf(dd8xxLog, " %04o[%d]", activeChannel->data, activeChannel->data);
-#endif
+            if (LogOn(LogDd8xx))
+                {
+                logPrintf(LogDd8xx, " %04o[%d]", activeChannel->data, activeChannel->data);
+                }
 
             if (--activeDevice->recordLength == 0)
                 {
@@ -1228,9 +1467,10 @@ static void dd8xxIo(void)
             {
             activeChannel->data = dp->detailedStatus[20 - activeDevice->recordLength];
             activeChannel->full = TRUE;
-#if DEBUG
-            fprintf(dd8xxLog, " %04o[%d]", activeChannel->data, activeChannel->data);
-#endif
+            if (LogOn(LogDd8xx))
+                {
+                logPrintf(LogDd8xx, " %04o[%d]", activeChannel->data, activeChannel->data);
+                }
 
             if (--activeDevice->recordLength == 0)
                 {
@@ -1246,9 +1486,10 @@ static void dd8xxIo(void)
             activeChannel->data = dp->read(dp, fcb);
             activeChannel->full = TRUE;
 
-#if DEBUG
-            fprintf(dd8xxLog, " %04o[%d]", activeChannel->data, activeChannel->data);
-#endif
+            if (LogOn(LogDd8xx))
+                {
+                logPrintf(LogDd8xx, " %04o[%d]", activeChannel->data, activeChannel->data);
+                }
 
             if (--activeDevice->recordLength == 0)
                 {
@@ -1260,9 +1501,11 @@ static void dd8xxIo(void)
     case Fc8xxSetClearFlaw:
         if (activeChannel->full)
             {
-#if DEBUG
-            fprintf(dd8xxLog, " %04o[%d]", activeChannel->data, activeChannel->data);
-#endif
+            if (LogOn(LogDd8xx))
+                {
+                logPrintf(LogDd8xx, " %04o[%d]", activeChannel->data, activeChannel->data);
+                }
+
             dd844SetClearFlaw(dp, activeChannel->data);
             activeChannel->full = FALSE;
             }
@@ -1272,9 +1515,10 @@ static void dd8xxIo(void)
         if (activeChannel->full)
             {
             activeChannel->full = FALSE;
-#if DEBUG
-            fprintf(dd8xxLog, " %04o[%d]", activeChannel->data, activeChannel->data);
-#endif
+            if (LogOn(LogDd8xx))
+                {
+                logPrintf(LogDd8xx, " %04o[%d]", activeChannel->data, activeChannel->data);
+                }
             }
         break;
 
@@ -1307,14 +1551,13 @@ static void dd8xxIo(void)
 **------------------------------------------------------------------------*/
 static void dd8xxActivate(void)
     {
-#if DEBUG
-    fprintf(dd8xxLog, "\n%06d PP:%02o CH:%02o Activate",
-        traceSequenceNo,
-        activePpu->id,
-        activeDevice->channel->id);
-
-    fflush(dd8xxLog);
-#endif
+    if (LogOn(LogDd8xx))
+        {
+        logPrintf(LogDd8xx, "\n%06d PP:%02o CH:%02o Activate",
+            traceSequenceNo,
+            activePpu->id,
+            activeDevice->channel->id);
+        }
     }
 
 /*--------------------------------------------------------------------------
@@ -1332,14 +1575,171 @@ static void dd8xxDisconnect(void)
     */
     activeChannel->discAfterInput = FALSE;
 
-#if DEBUG
-    fprintf(dd8xxLog, "\n%06d PP:%02o CH:%02o Disconnect",
-        traceSequenceNo,
-        activePpu->id,
-        activeDevice->channel->id);
+    if (LogOn(LogDd8xx))
+        {
+        logPrintf(LogDd8xx, "\n%06d PP:%02o CH:%02o Disconnect",
+            traceSequenceNo,
+            activePpu->id,
+            activeDevice->channel->id);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Select a unit for the following operations. A shared
+**                  unit must first be reserved for this emulator.
+**
+**  Parameters:     Name        Description.
+**                  unitNo      unit number
+**
+**  Returns:        FALSE if there is no such unit.
+**
+**------------------------------------------------------------------------*/
+static bool dd8xxSelectUnit(i8 unitNo)
+    {
+    DiskParam *dp;
+
+    if (activeDevice->fcb[unitNo] == NULL)
+        {
+        activeDevice->selectedUnit = -1;
+        return(FALSE);
+        }
+
+    dp = (DiskParam *)activeDevice->context[unitNo];
+    if (unitNo != activeDevice->selectedUnit)
+        {
+        dp->detailedStatus[12] &= ~01000;
+        }
+    else
+        {
+        dp->detailedStatus[12] |= 01000;
+        }
+
+    if (!dd8xxReserve(dp, activeDevice->fcb[unitNo]))
+        {
+        /*
+        **  Reserved by the opposite access (another emulator).
+        */
+        activeDevice->selectedUnit = -1;
+        activeDevice->status = St8xxOppositeReserved;
+        return(TRUE);
+        }
+
+    if (activeDevice->status == St8xxOppositeReserved)
+        {
+        activeDevice->status = 0;
+        }
 
-    fflush(dd8xxLog);
+    activeDevice->selectedUnit = unitNo;
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Turn off stdio buffering of a shared container, so
+**                  every sector read sees the latest write of any
+**                  emulator. Must be called before any I/O on the file.
+**
+**  Parameters:     Name        Description.
+**                  dp          Disk parameters (context).
+**                  fcb         File control block.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void dd8xxUnbuffered(DiskParam *dp, FILE *fcb)
+    {
+    if (dp->shared && fcb != NULL)
+        {
+        setvbuf(fcb, NULL, _IONBF, 0);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Reserve a shared unit for this emulator by locking its
+**                  container.
+**
+**  Parameters:     Name        Description.
+**                  dp          Disk parameters (context).
+**                  fcb         File control block.
+**
+**  Returns:        TRUE if the unit is reserved (or not shared).
+**
+**------------------------------------------------------------------------*/
+static bool dd8xxReserve(DiskParam *dp, FILE *fcb)
+    {
+#if defined(_WIN32)
+    OVERLAPPED ov;
+#else
+    struct flock lock;
+#endif
+
+    if (!dp->shared || dp->reserved)
+        {
+        return(TRUE);
+        }
+
+#if defined(_WIN32)
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = ReserveLockOffset;
+    dp->reserved = LockFileEx((HANDLE)_get_osfhandle(_fileno(fcb)),
+        LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &ov) != 0;
+#else
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = ReserveLockOffset;
+    lock.l_len = 1;
+    dp->reserved = fcntl(fileno(fcb), F_SETLK, &lock) == 0;
 #endif
+
+    return(dp->reserved);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Release all shared units reserved through this
+**                  controller, allowing other emulators to use them.
+**                  The selected unit stays selected; dd8xxFunc reserves
+**                  it again before the next function which uses it.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void dd8xxRelease(void)
+    {
+    DiskParam *dp;
+    FILE *fcb;
+    int unitNo;
+#if defined(_WIN32)
+    OVERLAPPED ov;
+#else
+    struct flock lock;
+#endif
+
+    for (unitNo = 0; unitNo < MaxUnits; unitNo++)
+        {
+        dp = (DiskParam *)activeDevice->context[unitNo];
+        fcb = activeDevice->fcb[unitNo];
+        if (dp == NULL || fcb == NULL || !dp->reserved)
+            {
+            continue;
+            }
+
+#if defined(_WIN32)
+        memset(&ov, 0, sizeof(ov));
+        ov.Offset = ReserveLockOffset;
+        UnlockFileEx((HANDLE)_get_osfhandle(_fileno(fcb)), 0, 1, 0, &ov);
+#else
+        memset(&lock, 0, sizeof(lock));
+        lock.l_type = F_UNLCK;
+        lock.l_whence = SEEK_SET;
+        lock.l_start = ReserveLockOffset;
+        lock.l_len = 1;
+        fcntl(fileno(fcb), F_SETLK, &lock);
+#endif
+
+        dp->reserved = FALSE;
+        }
     }
 
 /*--------------------------------------------------------------------------
@@ -1362,9 +1762,11 @@ static i32 dd8xxSeek(DiskParam *dp)
 
     if (dp->cylinder >= dp->size.maxCylinders)
         {
-#if DEBUG
-        fprintf(dd8xxLog, "ch %o, cylinder %d invalid\n", activeChannel->id, dp->cylinder); 
-#endif
+        if (LogOn(LogDd8xx))
+            {
+            logPrintf(LogDd8xx, "ch %o, cylinder %d invalid\n", activeChannel->id, dp->cylinder); 
+            }
+
         logError(LogErrorLocation, "ch %o, cylinder %d invalid\n", activeChannel->id, dp->cylinder);
         activeDevice->status = 01000;
         return(-1);
@@ -1372,9 +1774,11 @@ static i32 dd8xxSeek(DiskParam *dp)
 
     if (dp->track >= dp->size.maxTracks)
         {
-#if DEBUG
-        fprintf(dd8xxLog, "ch %o, track %d invalid\n", activeChannel->id, dp->track);
-#endif
+        if (LogOn(LogDd8xx))
+            {
+            logPrintf(LogDd8xx, "ch %o, track %d invalid\n", activeChannel->id, dp->track);
+            }
+
         logError(LogErrorLocation, "ch %o, track %d invalid\n", activeChannel->id, dp->track);
         activeDevice->status = 01000;
         return(-1);
@@ -1382,9 +1786,11 @@ static i32 dd8xxSeek(DiskParam *dp)
 
     if (dp->sector >= dp->size.maxSectors)
         {
-#if DEBUG
-        fprintf(dd8xxLog, "ch %o, sector %d invalid\n", activeChannel->id, dp->sector);
-#endif
+        if (LogOn(LogDd8xx))
+            {
+            logPrintf(LogDd8xx, "ch %o, sector %d invalid\n", activeChannel->id, dp->sector);
+            }
+
         logError(LogErrorLocation, "ch %o, sector %d invalid\n", activeChannel->id, dp->sector);
         activeDevice->status = 01000;
         return(-1);
@@ -1475,13 +1881,17 @@ static i32 dd8xxSeekNextSector(DiskParam *dp)
 **------------------------------------------------------------------------*/
 static PpWord dd8xxReadClassic(DiskParam *dp, FILE *fcb)
     {
+    u64 start;
+
     /*
     **  Read an entire sector if the current buffer is empty.
     */
     if (dp->bufPtr == NULL)
         {
         dp->bufPtr = dp->buffer;
-        fread(dp->buffer, 1, dp->sectorSize, fcb);
+        start = statsClock();
+        dd8xxContainerRead(dp, fcb, dp->buffer);
+        statsHostIo(&activeDevice->stats, dp->sectorSize, start);
         }
 
     /*
@@ -1508,6 +1918,8 @@ static PpWord dd8xxReadClassic(DiskParam *dp, FILE *fcb)
 **------------------------------------------------------------------------*/
 static void dd8xxWriteClassic(DiskParam *dp, FILE *fcb, PpWord data)
     {
+    u64 start;
+
     /*
     **  Fail gracefully if we write too much data.
     */
@@ -1531,7 +1943,9 @@ static void dd8xxWriteClassic(DiskParam *dp, FILE *fcb, PpWord data)
     */
     if (dp->bufPtr == dp->buffer + SectorSize)
         {
-        fwrite(dp->buffer, 1, dp->sectorSize, fcb);
+        start = statsClock();
+        dd8xxContainerWrite(dp, fcb, dp->buffer);
+        statsHostIo(&activeDevice->stats, dp->sectorSize, start);
         }
     }
 
@@ -1547,10 +1961,8 @@ static void dd8xxWriteClassic(DiskParam *dp, FILE *fcb, PpWord data)
 **------------------------------------------------------------------------*/
 static PpWord dd8xxReadPacked(DiskParam *dp, FILE *fcb)
     {
-    u16 byteCount;
+    u64 start;
     static u8 sector[512];
-    u8 *sp;
-    PpWord *pp;
 
     /*
     **  Read an entire sector if the current buffer is empty.
@@ -1558,19 +1970,14 @@ static PpWord dd8xxReadPacked(DiskParam *dp, FILE *fcb)
     if (dp->bufPtr == NULL)
         {
         dp->bufPtr = dp->buffer;
-        fread(sector, 1, dp->sectorSize, fcb);
+        start = statsClock();
+        dd8xxContainerRead(dp, fcb, sector);
+        statsHostIo(&activeDevice->stats, dp->sectorSize, start);
 
         /*
         **  Unpack the sector into the buffer.
         */
-        sp = sector;
-        pp = dp->buffer;
-        for (byteCount = SectorSize; byteCount > 0; byteCount -= 2)
-            {
-            *pp++ = (sp[0] << 4) + (sp[1] >> 4);
-            *pp++ = (sp[1] << 8) + (sp[2] >> 0);
-            sp += 3;
-            }
+        packBytesToWords(sector, SectorSize * 3 / 2, dp->buffer);
         }
 
     /*
@@ -1600,10 +2007,8 @@ static PpWord dd8xxReadPacked(DiskParam *dp, FILE *fcb)
 **------------------------------------------------------------------------*/
 static void dd8xxWritePacked(DiskParam *dp, FILE *fcb, PpWord data)
     {
-    u16 byteCount;
+    u64 start;
     static u8 sector[512];
-    u8 *sp;
-    PpWord *pp;
 
     /*
     **  Fail gracefully if we write too much data.
@@ -1631,21 +2036,14 @@ static void dd8xxWritePacked(DiskParam *dp, FILE *fcb, PpWord data)
         /*
         **  Pack the buffer into a sector.
         */
-        sp = sector;
-        pp = dp->buffer;
-        for (byteCount = SectorSize; byteCount > 0; byteCount -= 2)
-            {
-            *sp++  = (u8)(pp[0] >> 4);
-            *sp    = (u8)(pp[0] << 4);
-            *sp++ |= (u8)(pp[1] >> 8);
-            *sp++  = (u8)(pp[1] >> 0);
-            pp += 2;
-            }
+        packWordsToBytes(dp->buffer, SectorSize, sector);
 
         /*
         **  Write the sector.
         */
-        fwrite(sector, 1, dp->sectorSize, fcb);
+        start = statsClock();
+        dd8xxContainerWrite(dp, fcb, sector);
+        statsHostIo(&activeDevice->stats, dp->sectorSize, start);
         }
     }
 
@@ -1691,6 +2089,477 @@ static void dd8xxSectorWrite(DiskParam *dp, FILE *fcb, PpWord *sector)
         }
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Position a disk container to a sector.
+**
+**  Parameters:     Name        Description.
+**                  dp          Disk parameters (context).
+**                  fcb         File control block.
+**                  pos         Byte offset as returned by dd8xxSeek.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void dd8xxContainerPosition(DiskParam *dp, FILE *fcb, i32 pos)
+    {
+    dp->position = pos;
+    if (dp->image == NULL && pos >= 0)
+        {
+        fseek(fcb, pos, SEEK_SET);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read the sector at the current container position and
+**                  advance to the next one.
+**
+**  Parameters:     Name        Description.
+**                  dp          Disk parameters (context).
+**                  fcb         File control block.
+**                  data        Buffer for dp->sectorSize bytes.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void dd8xxContainerRead(DiskParam *dp, FILE *fcb, void *data)
+    {
+    if (dp->image == NULL)
+        {
+        fread(data, 1, dp->sectorSize, fcb);
+        return;
+        }
+
+    if (dp->position < 0)
+        {
+        memset(data, 0, dp->sectorSize);
+        return;
+        }
+
+    dd8xxThinRead(dp->image, dp->position / dp->sectorSize, data);
+    dp->position += dp->sectorSize;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write the sector at the current container position and
+**                  advance to the next one.
+**
+**  Parameters:     Name        Description.
+**                  dp          Disk parameters (context).
+**                  fcb         File control block.
+**                  data        Buffer with dp->sectorSize bytes.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void dd8xxContainerWrite(DiskParam *dp, FILE *fcb, void *data)
+    {
+    if (dp->image == NULL)
+        {
+        fwrite(data, 1, dp->sectorSize, fcb);
+        return;
+        }
+
+    if (dp->position < 0)
+        {
+        return;
+        }
+
+    if (!dd8xxThinWrite(dp->image, dp->position / dp->sectorSize, data))
+        {
+        logError(LogErrorLocation, "write to thin disk container %s failed", dp->image->name);
+        }
+
+    dp->position += dp->sectorSize;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Reopen the overlay of a thin container after a failed
+**                  snapshot. The unit goes offline if this fails too.
+**
+**  Parameters:     Name        Description.
+**                  ds          Device slot.
+**                  unitNo      Unit number.
+**                  ip          Overlay image.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void dd8xxReopen(DevSlot *ds, u8 unitNo, DiskImage *ip)
+    {
+    ip->fcb = fopen(ip->name, "r+b");
+    ds->fcb[unitNo] = ip->fcb;
+    if (ip->fcb == NULL)
+        {
+        printf("Failed to reopen %s - disk unit %o is offline\n", ip->name, unitNo);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Open an existing thin disk container and its base
+**                  image(s).
+**
+**  Parameters:     Name        Description.
+**                  name        Container file name.
+**                  readOnly    TRUE when opened as a base image.
+**                  dp          Disk parameters (geometry to check).
+**
+**  Returns:        Image or NULL if the file does not exist or is not
+**                  a thin container.
+**
+**------------------------------------------------------------------------*/
+static DiskImage *dd8xxThinOpen(char *name, bool readOnly, DiskParam *dp)
+    {
+    u8 header[ThinHeaderSize];
+    DiskImage *ip;
+    FILE *fcb;
+    u32 i;
+
+    fcb = fopen(name, readOnly ? "rb" : "r+b");
+    if (fcb == NULL)
+        {
+        return(NULL);
+        }
+
+    if (   fread(header, 1, ThinHeaderSize, fcb) != ThinHeaderSize
+        || memcmp(header, ThinMagic, 8) != 0)
+        {
+        fclose(fcb);
+        return(NULL);
+        }
+
+    ip = (DiskImage *)calloc(1, sizeof(DiskImage));
+    if (ip == NULL)
+        {
+        fprintf(stderr, "Failed to allocate thin disk context\n");
+        exit(1);
+        }
+
+    ip->fcb = fcb;
+    strcpy(ip->name, name);
+    ip->sectorSize = dd8xxGetU32(header + ThinOffSectorSize);
+    ip->sectorsPerBlock = dd8xxGetU32(header + ThinOffSectorsPerBlock);
+    ip->blockCount = dd8xxGetU32(header + ThinOffBlockCount);
+    ip->dataStart = (ThinHeaderSize + ip->blockCount * 4 + ThinHeaderSize - 1) & ~(ThinHeaderSize - 1);
+
+    if (   ip->sectorSize != (u32)dp->sectorSize
+        || ip->sectorsPerBlock != (u32)dp->size.maxSectors
+        || ip->blockCount != (u32)(dp->size.maxCylinders * dp->size.maxTracks))
+        {
+        fprintf(stderr, "%s does not match the disk type or container format\n", name);
+        exit(1);
+        }
+
+    /*
+    **  Load the block map.
+    */
+    ip->map = (u32 *)calloc(ip->blockCount, sizeof(u32));
+    if (ip->map == NULL)
+        {
+        fprintf(stderr, "Failed to allocate thin disk block map\n");
+        exit(1);
+        }
+
+    if (fread(ip->map, sizeof(u32), ip->blockCount, fcb) != ip->blockCount)
+        {
+        fprintf(stderr, "%s: block map is truncated\n", name);
+        exit(1);
+        }
+
+    for (i = 0; i < ip->blockCount; i++)
+        {
+        ip->map[i] = dd8xxGetU32((u8 *)&ip->map[i]);
+        if (ip->map[i] > ip->blocksUsed)
+            {
+            ip->blocksUsed = ip->map[i];
+            }
+        }
+
+    /*
+    **  Chain to the base image.
+    */
+    header[ThinOffBaseName + ThinNameSize - 1] = '\0';
+    if (header[ThinOffBaseName] != '\0')
+        {
+        ip->base = dd8xxThinOpenBase((char *)header + ThinOffBaseName, dp);
+        }
+
+    return(ip);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Open a read-only base image, which is either a thin
+**                  container or a flat disk container.
+**
+**  Parameters:     Name        Description.
+**                  name        Base file name.
+**                  dp          Disk parameters (geometry to check).
+**
+**  Returns:        Image.
+**
+**------------------------------------------------------------------------*/
+static DiskImage *dd8xxThinOpenBase(char *name, DiskParam *dp)
+    {
+    DiskImage *ip;
+    FILE *fcb;
+
+    ip = dd8xxThinOpen(name, TRUE, dp);
+    if (ip != NULL)
+        {
+        return(ip);
+        }
+
+    fcb = fopen(name, "rb");
+    if (fcb == NULL)
+        {
+        fprintf(stderr, "Failed to open base disk image %s\n", name);
+        exit(1);
+        }
+
+    ip = (DiskImage *)calloc(1, sizeof(DiskImage));
+    if (ip == NULL)
+        {
+        fprintf(stderr, "Failed to allocate thin disk context\n");
+        exit(1);
+        }
+
+    ip->fcb = fcb;
+    strcpy(ip->name, name);
+    ip->sectorSize = dp->sectorSize;
+    ip->sectorsPerBlock = dp->size.maxSectors;
+    ip->blockCount = dp->size.maxCylinders * dp->size.maxTracks;
+
+    return(ip);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Create an empty thin disk container.
+**
+**  Parameters:     Name        Description.
+**                  name        Container file name.
+**                  baseName    Base image recorded in the header or NULL.
+**                              The caller opens the base image.
+**                  dp          Disk parameters (geometry).
+**
+**  Returns:        Image or NULL if the file can't be created.
+**
+**------------------------------------------------------------------------*/
+static DiskImage *dd8xxThinCreate(char *name, char *baseName, DiskParam *dp)
+    {
+    u8 header[ThinHeaderSize];
+    DiskImage *ip;
+    FILE *fcb;
+
+    if (baseName != NULL && strlen(baseName) >= ThinNameSize)
+        {
+        return(NULL);
+        }
+
+    fcb = fopen(name, "w+b");
+    if (fcb == NULL)
+        {
+        return(NULL);
+        }
+
+    ip = (DiskImage *)calloc(1, sizeof(DiskImage));
+    if (ip == NULL)
+        {
+        fprintf(stderr, "Failed to allocate thin disk context\n");
+        exit(1);
+        }
+
+    ip->fcb = fcb;
+    strcpy(ip->name, name);
+    ip->sectorSize = dp->sectorSize;
+    ip->sectorsPerBlock = dp->size.maxSectors;
+    ip->blockCount = dp->size.maxCylinders * dp->size.maxTracks;
+    ip->dataStart = (ThinHeaderSize + ip->blockCount * 4 + ThinHeaderSize - 1) & ~(ThinHeaderSize - 1);
+    ip->map = (u32 *)calloc(ip->blockCount, sizeof(u32));
+    if (ip->map == NULL)
+        {
+        fprintf(stderr, "Failed to allocate thin disk block map\n");
+        exit(1);
+        }
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, ThinMagic, 8);
+    dd8xxPutU32(header + ThinOffSectorSize, ip->sectorSize);
+    dd8xxPutU32(header + ThinOffSectorsPerBlock, ip->sectorsPerBlock);
+    dd8xxPutU32(header + ThinOffBlockCount, ip->blockCount);
+    if (baseName != NULL)
+        {
+        strcpy((char *)header + ThinOffBaseName, baseName);
+        }
+
+    /*
+    **  An all zero map is the same in any byte order.
+    */
+    if (   fwrite(header, 1, ThinHeaderSize, fcb) != ThinHeaderSize
+        || fwrite(ip->map, sizeof(u32), ip->blockCount, fcb) != ip->blockCount
+        || fflush(fcb) != 0)
+        {
+        fclose(fcb);
+        free(ip->map);
+        free(ip);
+        remove(name);
+        return(NULL);
+        }
+
+    return(ip);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read a sector from a disk image.
+**
+**  Parameters:     Name        Description.
+**                  ip          Image.
+**                  sector      Linear sector number.
+**                  data        Buffer for ip->sectorSize bytes.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void dd8xxThinRead(DiskImage *ip, u32 sector, u8 *data)
+    {
+    u32 block = sector / ip->sectorsPerBlock;
+    size_t done = 0;
+
+    if (ip->map == NULL)
+        {
+        /*
+        **  Flat base image.
+        */
+        fseek(ip->fcb, (long)sector * ip->sectorSize, SEEK_SET);
+        done = fread(data, 1, ip->sectorSize, ip->fcb);
+        }
+    else if (block < ip->blockCount && ip->map[block] != 0)
+        {
+        fseek(ip->fcb, ip->dataStart
+            + (long)(ip->map[block] - 1) * ip->sectorsPerBlock * ip->sectorSize
+            + (long)(sector % ip->sectorsPerBlock) * ip->sectorSize, SEEK_SET);
+        done = fread(data, 1, ip->sectorSize, ip->fcb);
+        }
+    else if (ip->base != NULL)
+        {
+        dd8xxThinRead(ip->base, sector, data);
+        done = ip->sectorSize;
+        }
+
+    if (done < ip->sectorSize)
+        {
+        memset(data + done, 0, ip->sectorSize - done);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write a sector to a thin container, allocating its
+**                  track on first write.
+**
+**  Parameters:     Name        Description.
+**                  ip          Image.
+**                  sector      Linear sector number.
+**                  data        Buffer with ip->sectorSize bytes.
+**
+**  Returns:        FALSE on a host I/O error.
+**
+**------------------------------------------------------------------------*/
+static bool dd8xxThinWrite(DiskImage *ip, u32 sector, u8 *data)
+    {
+    u32 block = sector / ip->sectorsPerBlock;
+
+    if (block >= ip->blockCount)
+        {
+        return(FALSE);
+        }
+
+    if (ip->map[block] == 0 && !dd8xxThinAllocate(ip, block))
+        {
+        return(FALSE);
+        }
+
+    fseek(ip->fcb, ip->dataStart
+        + (long)(ip->map[block] - 1) * ip->sectorsPerBlock * ip->sectorSize
+        + (long)(sector % ip->sectorsPerBlock) * ip->sectorSize, SEEK_SET);
+
+    return(fwrite(data, 1, ip->sectorSize, ip->fcb) == ip->sectorSize);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Allocate a track in a thin container and copy its
+**                  current contents from the base image. The map entry
+**                  is written after the data.
+**
+**  Parameters:     Name        Description.
+**                  ip          Image.
+**                  block       Block (track) number.
+**
+**  Returns:        FALSE on a host I/O error.
+**
+**------------------------------------------------------------------------*/
+static bool dd8xxThinAllocate(DiskImage *ip, u32 block)
+    {
+    static u8 data[SectorSize * 2];
+    u8 entry[4];
+    u32 i;
+
+    fseek(ip->fcb, ip->dataStart + (long)ip->blocksUsed * ip->sectorsPerBlock * ip->sectorSize, SEEK_SET);
+    for (i = 0; i < ip->sectorsPerBlock; i++)
+        {
+        if (ip->base != NULL)
+            {
+            dd8xxThinRead(ip->base, block * ip->sectorsPerBlock + i, data);
+            }
+        else
+            {
+            memset(data, 0, ip->sectorSize);
+            }
+
+        if (fwrite(data, 1, ip->sectorSize, ip->fcb) != ip->sectorSize)
+            {
+            return(FALSE);
+            }
+        }
+
+    ip->blocksUsed += 1;
+    ip->map[block] = ip->blocksUsed;
+
+    dd8xxPutU32(entry, ip->map[block]);
+    fseek(ip->fcb, ThinHeaderSize + block * 4, SEEK_SET);
+
+    return(fwrite(entry, 1, 4, ip->fcb) == 4);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Get a 32 bit little endian value.
+**
+**  Parameters:     Name        Description.
+**                  p           Pointer to the value.
+**
+**  Returns:        Value.
+**
+**------------------------------------------------------------------------*/
+static u32 dd8xxGetU32(u8 *p)
+    {
+    return(p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24));
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Store a 32 bit little endian value.
+**
+**  Parameters:     Name        Description.
+**                  p           Pointer to the value.
+**                  value       Value to store.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void dd8xxPutU32(u8 *p, u32 value)
+    {
+    p[0] = (u8)(value >>  0);
+    p[1] = (u8)(value >>  8);
+    p[2] = (u8)(value >> 16);
+    p[3] = (u8)(value >> 24);
+    }
+
 /*--------------------------------------------------------------------------
 **  Purpose:        Manipulate 844 utility (flaw) map.
 **
@@ -1740,8 +2609,8 @@ static void dd844SetClearFlaw(DiskParam *dp, PpWord flawState)
     dp->cylinder = dp->size.maxCylinders - 1;
     dp->track = 0;
     dp->sector = 2;
-    fseek(fcb, dd8xxSeek(dp), SEEK_SET);
-    fread(mySector, 2, SectorSize, fcb);
+    dd8xxContainerPosition(dp, fcb, dd8xxSeek(dp));
+    dd8xxSectorRead(dp, fcb, mySector);
 
     /*
     **  Process request.
@@ -1800,7 +2669,7 @@ static void dd844SetClearFlaw(DiskParam *dp, PpWord flawState)
     /*
     **  Update the 844 utility map sector.
     */
-    fseek(fcb, dd8xxSeek(dp), SEEK_SET);
+    dd8xxContainerPosition(dp, fcb, dd8xxSeek(dp));
     dd8xxSectorWrite(dp, fcb, mySector);
     }
 
@@ -1815,7 +2684,6 @@ static void dd844SetClearFlaw(DiskParam *dp, PpWord flawState)
 **------------------------------------------------------------------------*/
 static char *dd8xxFunc2String(PpWord funcCode)
     {
-#if DEBUG
     switch(funcCode)
         {
     case Fc8xxConnect                :  return "Connect";              
@@ -1853,7 +2721,6 @@ static char *dd8xxFunc2String(PpWord funcCode)
     case Fc8xxDeadstart              :  return "Deadstart";            
     case Fc8xxStartMemLoad           :  return "StartMemLoad";         
         }
-#endif
     return "UNKNOWN";
     }
 
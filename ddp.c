@@ -66,6 +66,11 @@
 #define StDdpChParErr            00020
 #define StDdp6640ParErr          00040
 
+/*
+**  Delay between receiving the ECS address and presenting the first word.
+*/
+#define AddrDelayUs              20
+
 /*
 **  DDP magical ECS address bits
 */
@@ -91,7 +96,7 @@ typedef struct
     u32     addr;
     int     dbyte;
     int     abyte;
-    int     endaddrcycle;
+    TimerSlot addrDelay;
     PpWord  stat;
     } DdpContext;
 
@@ -294,7 +299,7 @@ static void ddpIo(void)
                     /*
                     **  Delay a bit before we set channel full.
                     */
-                    dc->endaddrcycle = cycles;
+                    timerStart(&dc->addrDelay, AddrDelayUs, NULL, NULL);
 
                     /*
                     **  A flag register reference occurs when bit 23 is set address.
@@ -326,7 +331,7 @@ static void ddpIo(void)
 
         if (activeDevice->fcode == FcDdpReadECS)
             {
-            if (!activeChannel->full && cycles - dc->endaddrcycle > 20)
+            if (!activeChannel->full && !timerPending(&dc->addrDelay))
                 {
                 if (dc->dbyte == -1)
                     {
@@ -0,0 +1,838 @@
+/*--------------------------------------------------------------------------
+**
+**  Copyright (c) 2003-2011, Tom Hunter
+**
+**  Name: deck.c
+**
+**  Description:
+**      Card deck loader for the card readers. Deck files are parsed into
+**      card images by a background thread when they are loaded, so the
+**      readers only have to pick up the next prepared card. Each reader
+**      has a queue of loaded decks which are read one after the other,
+**      and may name a spool directory whose files are loaded (and then
+**      deleted) as they appear. Files whose name starts with a '.' are
+**      ignored, so a submitter can write a deck under a temporary name
+**      and rename it when complete.
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License version 3 as
+**  published by the Free Software Foundation.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License version 3 for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  version 3 along with this program in file "license-gpl-3.0.txt".
+**  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+**
+**--------------------------------------------------------------------------
+*/
+
+/*
+**  -------------
+**  Include Files
+**  -------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "const.h"
+#include "types.h"
+#include "proto.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+/*
+**  -----------------
+**  Private Constants
+**  -----------------
+*/
+#define DeckRequests            32          /* pending load requests, power of two */
+#define MaxDeckWatch            16          /* readers with a spool directory */
+#define MaxScanFiles            256         /* files picked up per directory scan */
+#define DeckPollMs              100
+#define DeckScanPolls           10          /* scan spool directories every second */
+#define DeckLineSize            330
+
+/*
+**  -----------------------
+**  Private Macro Functions
+**  -----------------------
+*/
+#if defined(_WIN32)
+#define DeckBarrier()           MemoryBarrier()
+#else
+#define DeckBarrier()           __sync_synchronize()
+#endif
+
+#define DeckQueueFull(dq)       ((dq)->head - (dq)->tail >= DeckQueueSize)
+
+/*
+**  -----------------------------------------
+**  Private Typedef and Structure Definitions
+**  -----------------------------------------
+*/
+typedef struct deck
+    {
+    u32             count;              /* number of cards */
+    u32             size;               /* number of cards allocated */
+    Card            *cards;             /* card images */
+    } Deck;
+
+typedef struct deckRequest
+    {
+    DeckQueue       *dq;                /* reader to load */
+    char            fileName[_MAX_PATH];/* deck file */
+    } DeckRequest;
+
+/*
+**  ---------------------------
+**  Private Function Prototypes
+**  ---------------------------
+*/
+static void deckCreateThread(void);
+#if defined(_WIN32)
+static void deckThread(void *param);
+#else
+static void *deckThread(void *param);
+#endif
+static void deckLoadFile(DeckQueue *dq, char *fileName, bool spooled);
+static Deck *deckParse(DeckQueue *dq, FILE *fcb);
+static void deckParseCard(DeckQueue *dq, FILE *fcb, char *buffer, Card *cp);
+static void deckParseOctal(char *buffer, int columns, PpWord *col);
+static Card *deckAppend(Deck *dp);
+static void deckScanDir(DeckQueue *dq);
+static int deckCompareNames(const void *a, const void *b);
+static void deckSleep(u32 ms);
+
+/*
+**  ----------------
+**  Public Variables
+**  ----------------
+*/
+
+/*
+**  -----------------
+**  Private Variables
+**  -----------------
+*/
+static bool deckThreadStarted = FALSE;
+
+/*
+**  Load requests from the operator thread to the loader thread.
+*/
+static DeckRequest requestRing[DeckRequests];
+static volatile u32 requestHead = 0;
+static volatile u32 requestTail = 0;
+
+/*
+**  Readers watching a spool directory.
+*/
+static DeckQueue *watchList[MaxDeckWatch];
+static volatile int watchCount = 0;
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Public Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Initialise the deck queue of a card reader.
+**
+**  Parameters:     Name        Description.
+**                  dq          pointer to deck queue
+**                  syntax      DeckCr405 or DeckCr3447
+**                  table       ASCII to punch code table applied while
+**                              loading, NULL to keep ASCII
+**                  watchDir    spool directory or NULL
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void deckInit(DeckQueue *dq, u8 syntax, const u16 *table, char *watchDir)
+    {
+    memset(dq, 0, sizeof(DeckQueue));
+    dq->syntax = syntax;
+    dq->table = table;
+
+    if (watchDir != NULL && *watchDir != 0)
+        {
+        if (watchCount >= MaxDeckWatch)
+            {
+            fprintf(stderr, "Too many card reader spool directories\n");
+            exit(1);
+            }
+
+        strncpy(dq->watchDir, watchDir, sizeof(dq->watchDir) - 1);
+        watchList[watchCount] = dq;
+        DeckBarrier();
+        watchCount += 1;
+        }
+
+    if (!deckThreadStarted)
+        {
+        deckThreadStarted = TRUE;
+        deckCreateThread();
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Queue a deck file for loading (operator interface).
+**
+**  Parameters:     Name        Description.
+**                  dq          pointer to deck queue
+**                  fileName    deck file
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void deckLoad(DeckQueue *dq, char *fileName)
+    {
+    DeckRequest *rp;
+
+    if (requestHead - requestTail >= DeckRequests)
+        {
+        printf("Card loader busy - please try again later\n");
+        return;
+        }
+
+    rp = requestRing + (requestHead & (DeckRequests - 1));
+    rp->dq = dq;
+    strncpy(rp->fileName, fileName, sizeof(rp->fileName) - 1);
+    rp->fileName[sizeof(rp->fileName) - 1] = 0;
+    DeckBarrier();
+    requestHead += 1;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Get the next card of a reader. Finished decks are
+**                  released and the next queued deck is started.
+**
+**  Parameters:     Name        Description.
+**                  dq          pointer to deck queue
+**
+**  Returns:        Pointer to card, NULL if the input tray is empty. The
+**                  card remains valid until the next call.
+**
+**------------------------------------------------------------------------*/
+Card *deckNextCard(DeckQueue *dq)
+    {
+    Deck *dp;
+
+    for (;;)
+        {
+        dp = dq->current;
+        if (dp != NULL)
+            {
+            if (dq->next < dp->count)
+                {
+                return(dp->cards + dq->next++);
+                }
+
+            free(dp->cards);
+            free(dp);
+            dq->current = NULL;
+            }
+
+        if (dq->tail == dq->head)
+            {
+            return(NULL);
+            }
+
+        DeckBarrier();
+        dq->current = dq->ring[dq->tail & (DeckQueueSize - 1)];
+        dq->next = 0;
+        DeckBarrier();
+        dq->tail += 1;
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Check if a reader has any cards left.
+**
+**  Parameters:     Name        Description.
+**                  dq          pointer to deck queue
+**
+**  Returns:        TRUE if cards are available.
+**
+**------------------------------------------------------------------------*/
+bool deckReady(DeckQueue *dq)
+    {
+    return(   (dq->current != NULL && dq->next < dq->current->count)
+           || dq->tail != dq->head);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Return the number of decks in the input tray.
+**
+**  Parameters:     Name        Description.
+**                  dq          pointer to deck queue
+**
+**  Returns:        Number of decks, including the one being read.
+**
+**------------------------------------------------------------------------*/
+int deckCount(DeckQueue *dq)
+    {
+    int count = (int)(dq->head - dq->tail);
+
+    if (dq->current != NULL && dq->next < dq->current->count)
+        {
+        count += 1;
+        }
+
+    return(count);
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Create the deck loader thread.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void deckCreateThread(void)
+    {
+#if defined(_WIN32)
+    DWORD dwThreadId;
+    HANDLE hThread;
+
+    /*
+    **  Create deck loader thread.
+    */
+    hThread = CreateThread(
+        NULL,                                       // no security attribute
+        0,                                          // default stack size
+        (LPTHREAD_START_ROUTINE)deckThread,
+        (LPVOID)NULL,                               // thread parameter
+        0,                                          // not suspended
+        &dwThreadId);                               // returns thread ID
+
+    if (hThread == NULL)
+        {
+        fprintf(stderr, "Failed to create deck loader thread\n");
+        exit(1);
+        }
+#else
+    int rc;
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    /*
+    **  Create POSIX thread with default attributes.
+    */
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&thread, &attr, deckThread, NULL);
+    if (rc != 0)
+        {
+        fprintf(stderr, "Failed to create deck loader thread\n");
+        exit(1);
+        }
+#endif
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Deck loader thread.
+**
+**  Parameters:     Name        Description.
+**                  param       unused
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+#if defined(_WIN32)
+static void deckThread(void *param)
+#else
+static void *deckThread(void *param)
+#endif
+    {
+    DeckRequest *rp;
+    int polls = 0;
+    int i;
+
+    (void)param;
+
+    for (;;)
+        {
+        /*
+        **  Process operator load requests. A request for a reader whose
+        **  input tray is full waits until there is room.
+        */
+        while (requestTail != requestHead)
+            {
+            DeckBarrier();
+            rp = requestRing + (requestTail & (DeckRequests - 1));
+            if (DeckQueueFull(rp->dq))
+                {
+                break;
+                }
+
+            deckLoadFile(rp->dq, rp->fileName, FALSE);
+            DeckBarrier();
+            requestTail += 1;
+            }
+
+        /*
+        **  Pick up new decks from the spool directories.
+        */
+        if (++polls >= DeckScanPolls)
+            {
+            polls = 0;
+            for (i = 0; i < watchCount; i++)
+                {
+                deckScanDir(watchList[i]);
+                }
+            }
+
+        deckSleep(DeckPollMs);
+        }
+
+#if !defined(_WIN32)
+    return(NULL);
+#endif
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Load a deck file and add it to a reader's input tray.
+**
+**  Parameters:     Name        Description.
+**                  dq          pointer to deck queue
+**                  fileName    deck file
+**                  spooled     file came from spool directory, delete it
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void deckLoadFile(DeckQueue *dq, char *fileName, bool spooled)
+    {
+    FILE *fcb;
+    Deck *dp;
+
+    fcb = fopen(fileName, "r");
+    if (fcb == NULL)
+        {
+        printf("Failed to open %s\n", fileName);
+        return;
+        }
+
+    dp = deckParse(dq, fcb);
+    fclose(fcb);
+
+    if (spooled && remove(fileName) != 0)
+        {
+        /*
+        **  Don't load the same deck over and over again.
+        */
+        printf("Failed to remove spooled deck %s - not loaded\n", fileName);
+        free(dp->cards);
+        free(dp);
+        return;
+        }
+
+    dq->ring[dq->head & (DeckQueueSize - 1)] = dp;
+    DeckBarrier();
+    dq->head += 1;
+
+    if (!spooled)
+        {
+        printf("Card reader loaded with %s (%u cards)\n", fileName, dp->count);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Parse a deck file. A 6/7/8/9 card is added at the end
+**                  if the deck does not have one.
+**
+**  Parameters:     Name        Description.
+**                  dq          pointer to deck queue
+**                  fcb         deck file
+**
+**  Returns:        Pointer to deck.
+**
+**------------------------------------------------------------------------*/
+static Deck *deckParse(DeckQueue *dq, FILE *fcb)
+    {
+    char buffer[DeckLineSize];
+    Card *cp;
+    Deck *dp;
+
+    dp = calloc(1, sizeof(Deck));
+    if (dp == NULL)
+        {
+        fprintf(stderr, "Failed to allocate card deck\n");
+        exit(1);
+        }
+
+    while (fgets(buffer, sizeof(buffer), fcb) != NULL)
+        {
+        deckParseCard(dq, fcb, buffer, deckAppend(dp));
+        }
+
+    cp = dp->count == 0 ? NULL : dp->cards + dp->count - 1;
+    if (cp == NULL || cp->type != CardRaw || cp->col[0] != 00017)
+        {
+        cp = deckAppend(dp);
+        memset(cp, 0, sizeof(Card));
+        cp->type = CardRaw;
+        cp->flags = CardFlagBinary;
+        cp->col[0] = 00017;
+        }
+
+    return(dp);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Convert one line of a deck file to a card image.
+**
+**  Parameters:     Name        Description.
+**                  dq          pointer to deck queue
+**                  fcb         deck file (to skip long lines)
+**                  buffer      line
+**                  cp          pointer to card
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void deckParseCard(DeckQueue *dq, FILE *fcb, char *buffer, Card *cp)
+    {
+    char *lp;
+    int len;
+    int c;
+    int i;
+    u8 col1;
+
+    memset(cp, 0, sizeof(Card));
+    cp->type = CardAscii;
+
+    /*
+    **  Deal with special first-column codes.
+    */
+    if (   (buffer[0] == '}' && dq->syntax == DeckCr3447)
+        || strcmp(buffer, "~eoi\n") == 0)
+        {
+        /*
+        **  EOI = 6/7/8/9 card.
+        */
+        cp->type = CardRaw;
+        cp->flags = CardFlagBinary;
+        cp->col[0] = 00017;
+        return;
+        }
+
+    if (buffer[0] == '~')
+        {
+        if (strcmp(buffer + 1, "eof\n") == 0)
+            {
+            /*
+            **  EOF = 6/7/9 card.
+            */
+            cp->type = CardRaw;
+            cp->flags = CardFlagBinary;
+            cp->col[0] = 00015;
+            return;
+            }
+
+        if (   strcmp(buffer + 1, "eor\n") == 0
+            || (dq->syntax == DeckCr3447 && (buffer[1] == '\n' || buffer[1] == ' ')))
+            {
+            /*
+            **  EOR = 7/8/9 card.
+            */
+            cp->type = CardRaw;
+            cp->flags = CardFlagBinary;
+            cp->col[0] = 00007;
+            return;
+            }
+
+        if (dq->syntax == DeckCr405 && memcmp(buffer + 1, "bin", 3) == 0)
+            {
+            /*
+            **  Binary = 7/9 card followed by 79 columns of 4 octal digits.
+            */
+            cp->type = CardRaw;
+            cp->flags = CardFlagBinary;
+            cp->col[0] = 00005;
+            len = 320;
+            }
+        else if (dq->syntax == DeckCr3447 && memcmp(buffer + 1, "raw", 3) == 0)
+            {
+            /*
+            **  Raw binary card of 80 columns of 4 octal digits.
+            */
+            cp->type = CardRaw;
+            col1 = buffer[4] & Mask5;
+            if (col1 == 00005)
+                {
+                cp->flags = CardFlagBinary;
+                }
+            else if (col1 == 00006)
+                {
+                cp->flags = CardFlagFile;
+                }
+
+            len = 324;
+            }
+        }
+
+    if (cp->type == CardAscii)
+        {
+        len = 80;
+        }
+
+    /*
+    **  Skip over any characters past the last column (if line is longer)
+    **  and fill short lines.
+    */
+    if ((lp = strchr(buffer, '\n')) == NULL)
+        {
+        lp = buffer + strlen(buffer);
+        if (lp == buffer + DeckLineSize - 1)
+            {
+            do
+                {
+                c = fgetc(fcb);
+                } while (c != '\n' && c != EOF);
+            }
+        }
+
+    for ( ; lp < buffer + len; lp++)
+        {
+        *lp = cp->type == CardAscii ? ' ' : '0';
+        }
+
+    if (cp->type == CardRaw)
+        {
+        if (cp->col[0] == 00005)
+            {
+            deckParseOctal(buffer + 4, 79, cp->col + 1);
+            }
+        else
+            {
+            deckParseOctal(buffer + 4, 80, cp->col);
+            }
+
+        return;
+        }
+
+    /*
+    **  Convert ASCII card, any non-ASCII characters become blanks.
+    */
+    for (i = 0; i < 80; i++)
+        {
+        c = (u8)buffer[i];
+        if (c & 0x80)
+            {
+            c = ' ';
+            }
+
+        cp->col[i] = dq->table != NULL ? dq->table[c] : (PpWord)c;
+        }
+
+    if (dq->table != NULL)
+        {
+        cp->type = CardRaw;
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Convert columns of 4 octal digits.
+**
+**  Parameters:     Name        Description.
+**                  buffer      digits
+**                  columns     number of columns
+**                  col         column images
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void deckParseOctal(char *buffer, int columns, PpWord *col)
+    {
+    int value;
+    int i;
+    int j;
+
+    for (i = 0; i < columns; i++)
+        {
+        value = 0;
+        for (j = 0; j < 4; j++)
+            {
+            if (buffer[j] >= '0' && buffer[j] <= '7')
+                {
+                value = (value << 3) | (buffer[j] - '0');
+                }
+            else
+                {
+                value = 0;
+                break;
+                }
+            }
+
+        col[i] = (PpWord)value;
+        buffer += 4;
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Add a card to a deck.
+**
+**  Parameters:     Name        Description.
+**                  dp          pointer to deck
+**
+**  Returns:        Pointer to new card.
+**
+**------------------------------------------------------------------------*/
+static Card *deckAppend(Deck *dp)
+    {
+    if (dp->count == dp->size)
+        {
+        dp->size = dp->size == 0 ? 256 : dp->size * 2;
+        dp->cards = realloc(dp->cards, dp->size * sizeof(Card));
+        if (dp->cards == NULL)
+            {
+            fprintf(stderr, "Failed to allocate card deck\n");
+            exit(1);
+            }
+        }
+
+    return(dp->cards + dp->count++);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Load all decks found in a reader's spool directory,
+**                  in name order.
+**
+**  Parameters:     Name        Description.
+**                  dq          pointer to deck queue
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void deckScanDir(DeckQueue *dq)
+    {
+    static char *names[MaxScanFiles];
+    char path[_MAX_PATH * 2];
+    int count = 0;
+    int i;
+#if defined(_WIN32)
+    WIN32_FIND_DATA fd;
+    HANDLE hFind;
+
+    sprintf(path, "%s\\*", dq->watchDir);
+    hFind = FindFirstFile(path, &fd);
+    if (hFind == INVALID_HANDLE_VALUE)
+        {
+        return;
+        }
+
+    do
+        {
+        if (   (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0
+            && fd.cFileName[0] != '.'
+            && count < MaxScanFiles)
+            {
+            names[count++] = _strdup(fd.cFileName);
+            }
+        } while (FindNextFile(hFind, &fd));
+
+    FindClose(hFind);
+#else
+    struct dirent *ep;
+    struct stat st;
+    DIR *dir;
+
+    dir = opendir(dq->watchDir);
+    if (dir == NULL)
+        {
+        return;
+        }
+
+    while ((ep = readdir(dir)) != NULL && count < MaxScanFiles)
+        {
+        if (ep->d_name[0] == '.')
+            {
+            continue;
+            }
+
+        sprintf(path, "%s/%s", dq->watchDir, ep->d_name);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+            {
+            names[count++] = strdup(ep->d_name);
+            }
+        }
+
+    closedir(dir);
+#endif
+
+    qsort(names, count, sizeof(char *), deckCompareNames);
+
+    for (i = 0; i < count; i++)
+        {
+        if (!DeckQueueFull(dq))
+            {
+#if defined(_WIN32)
+            sprintf(path, "%s\\%s", dq->watchDir, names[i]);
+#else
+            sprintf(path, "%s/%s", dq->watchDir, names[i]);
+#endif
+            deckLoadFile(dq, path, TRUE);
+            }
+
+        free(names[i]);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Compare two file names for qsort.
+**
+**  Parameters:     Name        Description.
+**                  a           pointer to first name
+**                  b           pointer to second name
+**
+**  Returns:        Result of strcmp.
+**
+**------------------------------------------------------------------------*/
+static int deckCompareNames(const void *a, const void *b)
+    {
+    return(strcmp(*(char **)a, *(char **)b));
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Sleep for a number of milliseconds.
+**
+**  Parameters:     Name        Description.
+**                  ms          milliseconds
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void deckSleep(u32 ms)
+    {
+#if defined(_WIN32)
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+    }
+
+/*---------------------------  End Of File  ------------------------------*/
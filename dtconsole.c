@@ -0,0 +1,406 @@
+/*--------------------------------------------------------------------------
+**
+**  Copyright (c) 2003-2011, Tom Hunter
+**
+**  Name: dtconsole.c
+**
+**  Description:
+**      Thin viewer for the console display served by a headless emulator
+**      (see window_net.c). The display list received from the emulator
+**      is rendered with the regular X11 console window and keystrokes
+**      are sent back to the emulator.
+**
+**      Usage: dtconsole [host [port]]
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License version 3 as
+**  published by the Free Software Foundation.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License version 3 for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  version 3 along with this program in file "license-gpl-3.0.txt".
+**  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+**
+**--------------------------------------------------------------------------
+*/
+
+/*
+**  -------------
+**  Include Files
+**  -------------
+*/
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include "const.h"
+#include "types.h"
+#include "proto.h"
+
+/*
+**  -----------------
+**  Private Constants
+**  -----------------
+*/
+#define ListSize        5000
+#define PollTime        5000
+#define NetHeaderSize   6
+#define NetRunSize      4
+#define NetEntrySize    6
+#define NetFlagPaused   0x01
+#define MaxMsgSize      (NetHeaderSize + NetRunSize + ListSize * NetEntrySize)
+#define DefaultPort     6612
+
+/*
+**  -----------------------
+**  Private Macro Functions
+**  -----------------------
+*/
+#define GetU16(p)       ((u16)(((p)[0] << 8) | (p)[1]))
+
+/*
+**  -----------------------------------------
+**  Private Typedef and Structure Definitions
+**  -----------------------------------------
+*/
+typedef struct dispList
+    {
+    u16             xPos;           /* horizontal position */
+    u16             yPos;           /* vertical position */
+    u8              fontSize;       /* size of font */
+    u8              ch;             /* character to be displayed */
+    } DispList;
+
+/*
+**  ---------------------------
+**  Private Function Prototypes
+**  ---------------------------
+*/
+static int consoleConnect(char *host, int port);
+static u32 consoleMessageLength(u8 *msg, u32 len);
+static bool consoleApply(u8 *msg);
+static void consoleRender(void);
+
+/*
+**  ----------------
+**  Public Variables
+**  ----------------
+*/
+
+/*
+**  Variables used by the X11 console window.
+*/
+char ppKeyIn;
+u32 traceMask = 0;
+volatile bool opActive = FALSE;
+#if CcDebug == 1
+static PpSlot ppuDummy[10];
+PpSlot *ppu = ppuDummy;
+CpuContext cpu;
+#endif
+#if CcCycleTime
+double cycleTime;
+#endif
+
+/*
+**  -----------------
+**  Private Variables
+**  -----------------
+*/
+static DispList dispList[ListSize];
+static u32 listEnd = 0;
+static u8 rxBuf[2 * MaxMsgSize];
+static u32 rxLen = 0;
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Public Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Console viewer main.
+**
+**  Parameters:     Name        Description.
+**                  argc        argument count
+**                  argv        argument list
+**
+**  Returns:        Exit status.
+**
+**------------------------------------------------------------------------*/
+int main(int argc, char **argv)
+    {
+    fd_set readFds;
+    struct timeval timeout;
+    int connFd;
+    int rc;
+    u32 msgLen;
+    u32 pos;
+    u8 key;
+
+    connFd = consoleConnect(argc > 1 ? argv[1] : "127.0.0.1", argc > 2 ? atoi(argv[2]) : DefaultPort);
+
+    /*
+    **  Frames are complete when they arrive, so mark them explicitly
+    **  instead of relying on the beam returning to the top.
+    */
+    windowInit();
+    windowUpdate();
+
+    for (;;)
+        {
+        /*
+        **  Pass on keystrokes picked up by the window thread.
+        */
+        if (ppKeyIn != 0)
+            {
+            key = (u8)ppKeyIn;
+            ppKeyIn = 0;
+            send(connFd, &key, 1, 0);
+            }
+
+        FD_ZERO(&readFds);
+        FD_SET(connFd, &readFds);
+        timeout.tv_sec = 0;
+        timeout.tv_usec = PollTime;
+        rc = select(connFd + 1, &readFds, NULL, NULL, &timeout);
+        if (rc < 0 && errno != EINTR)
+            {
+            perror("select");
+            break;
+            }
+
+        if (rc <= 0)
+            {
+            continue;
+            }
+
+        rc = recv(connFd, rxBuf + rxLen, sizeof(rxBuf) - rxLen, 0);
+        if (rc <= 0)
+            {
+            fprintf(stderr, "Connection to emulator closed\n");
+            break;
+            }
+
+        rxLen += rc;
+
+        /*
+        **  Apply all complete messages, but render only the last frame.
+        */
+        pos = 0;
+        while ((msgLen = consoleMessageLength(rxBuf + pos, rxLen - pos)) != 0)
+            {
+            if (!consoleApply(rxBuf + pos))
+                {
+                fprintf(stderr, "%.*s", (int)(rxLen - pos), rxBuf + pos);
+                close(connFd);
+                windowTerminate();
+                return(1);
+                }
+
+            pos += msgLen;
+            }
+
+        if (pos != 0)
+            {
+            consoleRender();
+            rxLen -= pos;
+            memmove(rxBuf, rxBuf + pos, rxLen);
+            }
+        }
+
+    close(connFd);
+    windowTerminate();
+    return(0);
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Connect to the emulator.
+**
+**  Parameters:     Name        Description.
+**                  host        host name or address
+**                  port        TCP port
+**
+**  Returns:        Socket descriptor.
+**
+**------------------------------------------------------------------------*/
+static int consoleConnect(char *host, int port)
+    {
+    struct sockaddr_in server;
+    struct hostent *hp;
+    int connFd;
+
+    hp = gethostbyname(host);
+    if (hp == NULL)
+        {
+        fprintf(stderr, "Unknown host %s\n", host);
+        exit(1);
+        }
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    memcpy(&server.sin_addr, hp->h_addr, sizeof(server.sin_addr));
+    server.sin_port = htons((u16)port);
+
+    connFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connFd < 0)
+        {
+        fprintf(stderr, "Can't create socket\n");
+        exit(1);
+        }
+
+    if (connect(connFd, (struct sockaddr *)&server, sizeof(server)) < 0)
+        {
+        fprintf(stderr, "Can't connect to %s port %d\n", host, port);
+        exit(1);
+        }
+
+    return(connFd);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Determine the length of the message at the start of
+**                  the receive buffer.
+**
+**  Parameters:     Name        Description.
+**                  msg         start of message
+**                  len         bytes available
+**
+**  Returns:        Message length, 0 if not yet complete.
+**
+**------------------------------------------------------------------------*/
+static u32 consoleMessageLength(u8 *msg, u32 len)
+    {
+    u32 pos = NetHeaderSize;
+    u16 runs;
+
+    if (len < NetHeaderSize)
+        {
+        /*
+        **  Not a display message - treat whatever arrived as complete.
+        */
+        return(len != 0 && msg[0] != 'K' && msg[0] != 'D' ? len : 0);
+        }
+
+    if (msg[0] != 'K' && msg[0] != 'D')
+        {
+        return(len);
+        }
+
+    runs = GetU16(msg + 4);
+    while (runs-- != 0)
+        {
+        if (pos + NetRunSize > len)
+            {
+            return(0);
+            }
+
+        pos += NetRunSize + GetU16(msg + pos + 2) * NetEntrySize;
+        if (pos > len)
+            {
+            return(0);
+            }
+        }
+
+    return(pos);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Apply a message to the local display list.
+**
+**  Parameters:     Name        Description.
+**                  msg         start of message
+**
+**  Returns:        FALSE if this is not a display message.
+**
+**------------------------------------------------------------------------*/
+static bool consoleApply(u8 *msg)
+    {
+    DispList *elem;
+    u8 *mp = msg + NetHeaderSize;
+    u16 runs;
+    u16 start;
+    u16 count;
+
+    if (msg[0] != 'K' && msg[0] != 'D')
+        {
+        return(FALSE);
+        }
+
+    opActive = (msg[1] & NetFlagPaused) != 0;
+    runs = GetU16(msg + 4);
+
+    while (runs-- != 0)
+        {
+        start = GetU16(mp);
+        count = GetU16(mp + 2);
+        mp += NetRunSize;
+
+        for (elem = dispList + start; count-- != 0; elem++)
+            {
+            if (elem < dispList + ListSize)
+                {
+                elem->xPos = GetU16(mp);
+                elem->yPos = GetU16(mp + 2);
+                elem->fontSize = mp[4];
+                elem->ch = mp[5];
+                }
+
+            mp += NetEntrySize;
+            }
+        }
+
+    listEnd = GetU16(msg + 2);
+    if (listEnd > ListSize)
+        {
+        listEnd = ListSize;
+        }
+
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Hand the local display list to the console window.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void consoleRender(void)
+    {
+    DispList *elem;
+
+    for (elem = dispList; elem < dispList + listEnd; elem++)
+        {
+        windowSetFont(elem->fontSize);
+        windowSetX(elem->xPos);
+        windowSetY((u16)(0777 - elem->yPos));
+        windowQueue(elem->ch);
+        }
+
+    windowUpdate();
+    }
+
+/*---------------------------  End Of File  ------------------------------*/
@@ -174,9 +174,8 @@ void dumpCpu(void)
     CpWord data;
     CpWord lastData;
     bool duplicateLine;
-    u8 ch;
+    char text[10];
     u8 i;
-    u8 shiftCount;
 
     fprintf(cpuF, "P       %06o  ", cpu.regP);
     fprintf(cpuF, "A%d %06o  ", 0, cpu.regA[0]);
@@ -262,13 +261,8 @@ void dumpCpu(void)
                 (PpWord)((data >> 12) & Mask12),
                 (PpWord)((data      ) & Mask12));
 
-            shiftCount = 60;
-            for (i = 0; i < 10; i++)
-                {
-                shiftCount -= 6;
-                ch = (u8)((data >> shiftCount) & Mask6);
-                fprintf(cpuF, "%c", cdcToAscii[ch]);
-                }
+            charsetCmToAscii(&data, 1, text, cdcToAscii);
+            fwrite(text, 1, sizeof(text), cpuF);
             }
 
         if (!duplicateLine) 
@@ -297,8 +291,7 @@ void dumpPpu(u8 pp)
     u32 addr;
     PpWord *pm = ppu[pp].mem;
     FILE *pf = ppuF[pp];
-    u8 i;
-    PpWord pw;
+    char text[16];
 
     fprintf(pf, "P   %04o\n", ppu[pp].regP);
     fprintf(pf, "A %06o\n", ppu[pp].regA);
@@ -318,11 +311,8 @@ void dumpPpu(u8 pp)
             pm[addr + 6] & Mask12,
             pm[addr + 7] & Mask12);
 
-        for (i = 0; i < 8; i++)
-            {
-            pw = pm[addr + i] & Mask12;
-            fprintf(pf, "%c%c", cdcToAscii[(pw >> 6) & Mask6], cdcToAscii[pw & Mask6]);
-            }
+        charsetPpToAscii(pm + addr, 8, text, cdcToAscii);
+        fwrite(text, 1, sizeof(text), pf);
 
         fprintf(pf, "\n");
         }
@@ -85,6 +85,9 @@ extern u8 deadstartCount;
 ModelFeatures features;
 ModelType modelType;
 char persistDir[256];
+char ecsSharedName[64];
+u16 consoleNetPort;
+u16 consoleNetConns;
 
 /*
 **  -----------------
@@ -104,18 +107,12 @@ static union
     u8 bytes[4];
     } endianCheck;
 
-static ModelFeatures features6400 = (IsSeries6x00);
-static ModelFeatures featuresCyber73 = (IsSeries70 | HasInterlockReg | HasCMU);
-static ModelFeatures featuresCyber173 =
-    (IsSeries170 | HasStatusAndControlReg | HasCMU);
-static ModelFeatures featuresCyber175 =
-    (IsSeries170 | HasStatusAndControlReg | HasInstructionStack | HasIStackPrefetch | Has175Float);
-static ModelFeatures featuresCyber840A =
-    (  IsSeries800 | HasNoCmWrap | HasFullRTC | HasTwoPortMux | HasMaintenanceChannel | HasCMU | HasChannelFlag
-     | HasErrorFlag | HasRelocationRegLong | HasMicrosecondClock | HasInstructionStack | HasIStackPrefetch);
-static ModelFeatures featuresCyber865 =
-    (  IsSeries800 | HasNoCmWrap | HasFullRTC | HasTwoPortMux | HasStatusAndControlReg
-     | HasRelocationRegShort | HasMicrosecondClock | HasInstructionStack | HasIStackPrefetch | Has175Float);
+static ModelFeatures features6400 = Features6400;
+static ModelFeatures featuresCyber73 = FeaturesCyber73;
+static ModelFeatures featuresCyber173 = FeaturesCyber173;
+static ModelFeatures featuresCyber175 = FeaturesCyber175;
+static ModelFeatures featuresCyber840A = FeaturesCyber840A;
+static ModelFeatures featuresCyber865 = FeaturesCyber865;
 
 /*
 **--------------------------------------------------------------------------
@@ -171,6 +168,8 @@ void initStartup(char *config)
         {
         mchInit(0, 0, ChMaintenance, NULL);
         }
+
+    statsInit();
     }
 
 /*--------------------------------------------------------------------------
@@ -224,6 +223,10 @@ static void initCyber(char *config)
     long port;
     long conns;
     long setMHz;
+    long rollover;
+    long jobSplit;
+    char printFormat[10];
+    char logList[80];
 
     if (!initOpenSection(config))
         {
@@ -384,6 +387,11 @@ static void initCyber(char *config)
             }
         }
 
+    /*
+    **  Optional name of an ECS shared with other emulators.
+    */
+    initGetString("ecsShared", "", ecsSharedName, sizeof(ecsSharedName));
+
     /*
     **  Initialise CPU.
     */
@@ -496,6 +504,48 @@ static void initCyber(char *config)
     */
     initGetInteger("telnetconns", 4, &conns);
     mux6676TelnetConns = (u16)conns;
+
+    /*
+    **  Get optional console display port and max viewers (headless build).
+    */
+    initGetInteger("consoleport", 6612, &port);
+    consoleNetPort = (u16)port;
+    initGetInteger("consoleconns", 4, &conns);
+    consoleNetConns = (u16)conns;
+
+    /*
+    **  Get optional local port serving device statistics (0 = disabled).
+    */
+    initGetInteger("statsport", 0, &port);
+    statsPort = (u16)port;
+
+    /*
+    **  Get optional printer spool settings: rollover size in kilobytes
+    **  (0 = never), rollover at end of each job and print file format.
+    */
+    initGetInteger("printRollover", 0, &rollover);
+    spoolRolloverSize = (u32)rollover * 1024;
+    initGetInteger("printJobSplit", 0, &jobSplit);
+    spoolJobSplit = jobSplit != 0;
+    initGetString("printFormat", "raw", printFormat, sizeof(printFormat));
+    if (stricmp(printFormat, "asa") == 0)
+        {
+        spoolAsaFormat = TRUE;
+        }
+    else if (stricmp(printFormat, "raw") != 0)
+        {
+        fprintf(stderr, "Entry 'printFormat' invalid in section [cyber] in %s - must be 'raw' or 'asa'\n", startupFile);
+        exit(1);
+        }
+
+    /*
+    **  Get optional list of device log categories to enable at startup.
+    */
+    if (initGetString("logCategories", "", logList, sizeof(logList)) && !logSelect(logList))
+        {
+        fprintf(stderr, "Entry 'logCategories' invalid in section [cyber] in %s\n", startupFile);
+        exit(1);
+        }
     }
 
 /*--------------------------------------------------------------------------
@@ -5,17 +5,25 @@
 **  Name: log.c
 **
 **  Description:
-**      Perform logging of abnormal conditions.
+**      Perform logging of abnormal conditions and device debug logging.
+**
+**      Messages are formatted by the calling thread into a ring buffer of
+**      its own and written to the log files by a background writer
+**      thread, so logging costs the emulation no file I/O and no locks.
+**      A message which does not fit into a full ring is dropped and
+**      counted. Each log category has its own file and can be switched
+**      on and off at run time ("logCategories" in cyber.ini or the
+**      set_log operator command).
 **
 **  This program is free software: you can redistribute it and/or modify
 **  it under the terms of the GNU General Public License version 3 as
 **  published by the Free Software Foundation.
-**  
+**
 **  This program is distributed in the hope that it will be useful,
 **  but WITHOUT ANY WARRANTY; without even the implied warranty of
 **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 **  GNU General Public License version 3 for more details.
-**  
+**
 **  You should have received a copy of the GNU General Public License
 **  version 3 along with this program in file "license-gpl-3.0.txt".
 **  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
@@ -35,43 +43,114 @@
 #include "const.h"
 #include "types.h"
 #include "proto.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 /*
 **  -----------------
 **  Private Constants
 **  -----------------
 */
+#define LogRingSize             (256 * 1024)    /* bytes per thread, power of two */
+#define MaxLogRings             32              /* threads which may log */
+#define LogMaxText              1024            /* longest message */
+#define LogPollMs               20
+#define LogStopPolls            100             /* wait at most 2 seconds at exit */
+#define LogHeaderSize           4               /* length (2), category, unused */
+#define LogPad                  0xff            /* category of a record padding to the ring end */
 
 /*
 **  -----------------------
 **  Private Macro Functions
 **  -----------------------
 */
+#if defined(_WIN32)
+#define LogBarrier()            MemoryBarrier()
+#define LogAtomicInc(p)         ((u32)InterlockedIncrement((LONG volatile *)(p)))
+#define LogThreadLocal          __declspec(thread)
+#define LogVsnprintf            _vsnprintf
+#else
+#define LogBarrier()            __sync_synchronize()
+#define LogAtomicInc(p)         __sync_add_and_fetch((p), 1)
+#define LogThreadLocal          __thread
+#define LogVsnprintf            vsnprintf
+#endif
+
+#define LogRecordSize(len)      ((LogHeaderSize + (len) + 3) & ~3)
 
 /*
 **  -----------------------------------------
 **  Private Typedef and Structure Definitions
 **  -----------------------------------------
 */
+typedef struct logRing
+    {
+    volatile u32    head;                   /* advanced by the owning thread */
+    volatile u32    tail;                   /* advanced by the writer thread */
+    u32             dropped[LogCategories]; /* messages lost to a full ring */
+    u8              data[LogRingSize];
+    } LogRing;
+
+typedef struct logCategory
+    {
+    char            *name;
+    char            *fileName;
+    FILE            *fcb;                   /* opened by the writer thread */
+    u32             written;                /* messages written */
+    } LogCategory;
 
 /*
 **  ---------------------------
 **  Private Function Prototypes
 **  ---------------------------
 */
+static LogRing *logThreadRing(void);
+static u32 logFormat(char *buf, u32 size, char *fmt, va_list args);
+static void logPut(u8 category, char *text, u32 len);
+static void logCreateThread(void);
+#if defined(_WIN32)
+static void logThread(void *param);
+#else
+static void *logThread(void *param);
+#endif
+static bool logDrain(void);
+static void logFlushAtExit(void);
+static void logSleep(u32 ms);
 
 /*
 **  ----------------
 **  Public Variables
 **  ----------------
 */
+volatile u32 logCategories = 1 << LogErrors;
 
 /*
 **  -----------------
 **  Private Variables
 **  -----------------
 */
-static FILE *logF;
+static LogCategory category[LogCategories] =
+    {
+    {"error",    "log.txt",          NULL, 0},
+    {"dd8xx",    "dd8xxlog.txt",     NULL, 0},
+    {"mt362x",   "mt362xlog.txt",    NULL, 0},
+    {"mt669",    "mt669log.txt",     NULL, 0},
+    {"mt679",    "mt679log.txt",     NULL, 0},
+    {"npu",      "npulog.txt",       NULL, 0},
+    {"pci",      "pcilog.txt",       NULL, 0},
+    {"mch",      "mchlog.txt",       NULL, 0},
+    };
+
+static LogThreadLocal LogRing *threadRing = NULL;
+static LogRing * volatile ringPool[MaxLogRings];
+static volatile u32 ringReserved = 0;
+static volatile u32 ringsLost = 0;          /* messages from threads without a ring */
+static volatile bool logStopping = FALSE;
+static volatile bool logStopped = FALSE;
 
 /*
 **--------------------------------------------------------------------------
@@ -91,11 +170,14 @@ static FILE *logF;
 **------------------------------------------------------------------------*/
 void logInit(void)
     {
-    logF = fopen("log.txt", "wt");
-    if (logF == NULL)
+    category[LogErrors].fcb = fopen(category[LogErrors].fileName, "wt");
+    if (category[LogErrors].fcb == NULL)
         {
         fprintf(stderr, "can't open log file");
         }
+
+    logCreateThread();
+    atexit(logFlushAtExit);
     }
 
 /*--------------------------------------------------------------------------
@@ -112,15 +194,525 @@ void logInit(void)
 **------------------------------------------------------------------------*/
 void logError(char *file, int line, char *fmt, ...)
     {
+    char text[LogMaxText];
+    va_list param;
+    u32 len;
+
+    if (!LogOn(LogErrors))
+        {
+        return;
+        }
+
+    sprintf(text, "[%.200s:%d] ", file, line);
+    len = (u32)strlen(text);
+    va_start(param, fmt);
+    len += logFormat(text + len, sizeof(text) - len - 1, fmt, param);
+    va_end(param);
+    text[len++] = '\n';
+    logPut(LogErrors, text, len);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write text to a device log. Callers check LogOn first
+**                  to avoid evaluating the arguments when the category is
+**                  switched off.
+**
+**  Parameters:     Name        Description.
+**                  cat         log category (LogXxx)
+**                  fmt         format string
+**                  ...         variable length argument list
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void logPrintf(u8 cat, char *fmt, ...)
+    {
+    char text[LogMaxText];
     va_list param;
+    u32 len;
 
     va_start(param, fmt);
-    fprintf(logF, "[%s:%d] ", file, line); 
-    vfprintf(logF, fmt, param);
+    len = logFormat(text, sizeof(text), fmt, param);
     va_end(param);
-    fprintf(logF, "\n");
-    fflush(logF);
+    logPut(cat, text, len);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write text to a device log (va_list version).
+**
+**  Parameters:     Name        Description.
+**                  cat         log category (LogXxx)
+**                  fmt         format string
+**                  args        argument list
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void logVPrintf(u8 cat, char *fmt, va_list args)
+    {
+    char text[LogMaxText];
+    u32 len;
+
+    len = logFormat(text, sizeof(text), fmt, args);
+    logPut(cat, text, len);
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Switch log categories on or off.
+**
+**  Parameters:     Name        Description.
+**                  list        comma separated category names; a leading
+**                              '-' switches a category off, "all" and
+**                              "none" select every device category
+**
+**  Returns:        FALSE if a name is not recognised.
+**
+**------------------------------------------------------------------------*/
+bool logSelect(char *list)
+    {
+    char name[32];
+    u32 mask;
+    bool on;
+    int len;
+    int i;
+
+    mask = logCategories;
+    while (*list != 0)
+        {
+        while (*list == ',' || *list == ' ')
+            {
+            list += 1;
+            }
+
+        on = *list != '-';
+        if (!on)
+            {
+            list += 1;
+            }
+
+        for (len = 0; *list != 0 && *list != ',' && *list != ' '; list++)
+            {
+            if (len < (int)sizeof(name) - 1)
+                {
+                name[len++] = *list;
+                }
+            }
+
+        name[len] = 0;
+        if (len == 0)
+            {
+            continue;
+            }
+
+        if (strcmp(name, "all") == 0 || strcmp(name, "none") == 0)
+            {
+            if (strcmp(name, "all") == 0)
+                {
+                mask |= ~(1 << LogErrors) & ((1 << LogCategories) - 1);
+                }
+            else
+                {
+                mask &= 1 << LogErrors;
+                }
+
+            continue;
+            }
+
+        for (i = 0; i < LogCategories; i++)
+            {
+            if (strcmp(name, category[i].name) == 0)
+                {
+                break;
+                }
+            }
+
+        if (i == LogCategories)
+            {
+            printf("Unknown log category %s\n", name);
+            return(FALSE);
+            }
+
+        if (on)
+            {
+            mask |= 1 << i;
+            }
+        else
+            {
+            mask &= ~(1 << i);
+            }
+        }
+
+    logCategories = mask;
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Show the log categories and their counters.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void logShow(void)
+    {
+    LogRing *rp;
+    u32 dropped;
+    int i;
+    int j;
+
+    printf("Category  State  Written     Dropped     File\n");
+    for (i = 0; i < LogCategories; i++)
+        {
+        dropped = 0;
+        for (j = 0; j < MaxLogRings; j++)
+            {
+            rp = ringPool[j];
+            if (rp != NULL)
+                {
+                dropped += rp->dropped[i];
+                }
+            }
+
+        printf("%-8s  %-5s  %-10u  %-10u  %s\n",
+            category[i].name,
+            LogOn(i) ? "on" : "off",
+            category[i].written,
+            dropped,
+            category[i].fileName);
+        }
+
+    if (ringsLost != 0)
+        {
+        printf("%u messages dropped from threads without a log buffer\n", ringsLost);
+        }
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Get the log ring of the calling thread, allocating one
+**                  the first time a thread logs.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Pointer to ring or NULL if none is available.
+**
+**------------------------------------------------------------------------*/
+static LogRing *logThreadRing(void)
+    {
+    LogRing *rp;
+    u32 index;
+
+    if (threadRing != NULL)
+        {
+        return(threadRing);
+        }
+
+    index = LogAtomicInc(&ringReserved) - 1;
+    if (index >= MaxLogRings)
+        {
+        return(NULL);
+        }
+
+    rp = calloc(1, sizeof(LogRing));
+    if (rp == NULL)
+        {
+        return(NULL);
+        }
+
+    LogBarrier();
+    ringPool[index] = rp;
+    threadRing = rp;
+    return(rp);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Format a message, truncating it if it is too long.
+**
+**  Parameters:     Name        Description.
+**                  buf         output buffer
+**                  size        size of buffer
+**                  fmt         format string
+**                  args        argument list
+**
+**  Returns:        Length of formatted text.
+**
+**------------------------------------------------------------------------*/
+static u32 logFormat(char *buf, u32 size, char *fmt, va_list args)
+    {
+    int len;
+
+    len = LogVsnprintf(buf, size, fmt, args);
+    if (len < 0 || (u32)len >= size)
+        {
+        len = size - 1;
+        buf[len] = 0;
+        }
+
+    return((u32)len);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Add a message to the calling thread's ring. Records
+**                  never wrap; a record which does not fit before the end
+**                  of the ring is preceded by a pad record.
+**
+**  Parameters:     Name        Description.
+**                  cat         log category
+**                  text        message text
+**                  len         length of text
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void logPut(u8 cat, char *text, u32 len)
+    {
+    LogRing *rp;
+    u32 size;
+    u32 pos;
+    u32 pad = 0;
+    u8 *hp;
+
+    rp = logThreadRing();
+    if (rp == NULL)
+        {
+        LogAtomicInc(&ringsLost);
+        return;
+        }
+
+    size = LogRecordSize(len);
+    pos = rp->head & (LogRingSize - 1);
+    if (pos + size > LogRingSize)
+        {
+        pad = LogRingSize - pos;
+        }
+
+    if (pad + size > LogRingSize - (rp->head - rp->tail))
+        {
+        rp->dropped[cat] += 1;
+        return;
+        }
+
+    if (pad != 0)
+        {
+        rp->data[pos + 2] = LogPad;
+        pos = 0;
+        }
+
+    hp = rp->data + pos;
+    hp[0] = (u8)(len & 0xff);
+    hp[1] = (u8)(len >> 8);
+    hp[2] = cat;
+    hp[3] = 0;
+    memcpy(hp + LogHeaderSize, text, len);
+
+    LogBarrier();
+    rp->head += pad + size;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Create the log writer thread.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void logCreateThread(void)
+    {
+#if defined(_WIN32)
+    DWORD dwThreadId;
+    HANDLE hThread;
+
+    /*
+    **  Create log writer thread.
+    */
+    hThread = CreateThread(
+        NULL,                                       // no security attribute
+        0,                                          // default stack size
+        (LPTHREAD_START_ROUTINE)logThread,
+        (LPVOID)NULL,                               // thread parameter
+        0,                                          // not suspended
+        &dwThreadId);                               // returns thread ID
+
+    if (hThread == NULL)
+        {
+        fprintf(stderr, "Failed to create log writer thread\n");
+        exit(1);
+        }
+#else
+    int rc;
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    /*
+    **  Create POSIX thread with default attributes.
+    */
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&thread, &attr, logThread, NULL);
+    if (rc != 0)
+        {
+        fprintf(stderr, "Failed to create log writer thread\n");
+        exit(1);
+        }
+#endif
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Log writer thread.
+**
+**  Parameters:     Name        Description.
+**                  param       unused
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+#if defined(_WIN32)
+static void logThread(void *param)
+#else
+static void *logThread(void *param)
+#endif
+    {
+    (void)param;
+
+    while (!logStopping)
+        {
+        if (!logDrain())
+            {
+            logSleep(LogPollMs);
+            }
+        }
+
+    /*
+    **  Write whatever is left and stop.
+    */
+    while (logDrain())
+        {
+        }
+
+    LogBarrier();
+    logStopped = TRUE;
+
+#if !defined(_WIN32)
+    return(NULL);
+#endif
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write the contents of all rings to the log files.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        TRUE if anything was written.
+**
+**------------------------------------------------------------------------*/
+static bool logDrain(void)
+    {
+    bool touched[LogCategories];
+    bool any = FALSE;
+    LogRing *rp;
+    LogCategory *cp;
+    u32 pos;
+    u32 len;
+    u8 *hp;
+    int i;
+
+    memset(touched, 0, sizeof(touched));
+    for (i = 0; i < MaxLogRings; i++)
+        {
+        rp = ringPool[i];
+        if (rp == NULL)
+            {
+            continue;
+            }
+
+        while (rp->tail != rp->head)
+            {
+            LogBarrier();
+            pos = rp->tail & (LogRingSize - 1);
+            hp = rp->data + pos;
+            if (hp[2] == LogPad)
+                {
+                rp->tail += LogRingSize - pos;
+                continue;
+                }
+
+            len = hp[0] | (hp[1] << 8);
+            cp = category + hp[2];
+            if (cp->fcb == NULL)
+                {
+                cp->fcb = fopen(cp->fileName, "wt");
+                }
+
+            if (cp->fcb != NULL)
+                {
+                fwrite(hp + LogHeaderSize, 1, len, cp->fcb);
+                }
+
+            cp->written += 1;
+            touched[hp[2]] = TRUE;
+            any = TRUE;
+
+            LogBarrier();
+            rp->tail += LogRecordSize(len);
+            }
+        }
+
+    for (i = 0; i < LogCategories; i++)
+        {
+        if (touched[i] && category[i].fcb != NULL)
+            {
+            fflush(category[i].fcb);
+            }
+        }
+
+    return(any);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Let the writer thread write out pending messages when
+**                  the emulator exits.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void logFlushAtExit(void)
+    {
+    int polls = 0;
+
+    logStopping = TRUE;
+    while (!logStopped && polls++ < LogStopPolls)
+        {
+        logSleep(LogPollMs);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Sleep for a number of milliseconds.
+**
+**  Parameters:     Name        Description.
+**                  ms          milliseconds
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void logSleep(u32 ms)
+    {
+#if defined(_WIN32)
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+    }
 
 /*---------------------------  End Of File  ------------------------------*/
@@ -150,15 +150,10 @@ void lp1612Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     dp->selectedUnit = 0;
 
     /*
-    **  Open the device file.
+    **  Open the print file spool.
     */
     sprintf(fname, "LP1612_C%02o", channelNo);
-    dp->fcb[0] = fopen(fname, "w+t");
-    if (dp->fcb[0] == NULL)
-        {
-        fprintf(stderr, "Failed to open %s\n", fname);
-        exit(1);
-        }
+    dp->context[0] = spoolOpen(fname, "LP1612");
 
     /*
     **  Print a friendly message.
@@ -166,6 +161,24 @@ void lp1612Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     printf("LP1612 initialised on channel %o\n", channelNo);
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Flush the print file of a 1612 line printer.
+**
+**  Parameters:     Name        Description.
+**                  dp          Device control block
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void lp1612Terminate(DevSlot *dp)
+    {
+    if (dp->context[0] != NULL)
+        {
+        spoolClose((Spool *)dp->context[0]);
+        dp->context[0] = NULL;
+        }
+    }
+
 /*--------------------------------------------------------------------------
 **  Purpose:        Remove the paper (operator interface).
 **
@@ -181,10 +194,6 @@ void lp1612RemovePaper(char *params)
     int numParam;
     int channelNo;
     int equipmentNo;
-    time_t currentTime;
-    struct tm t;
-    char fname[80];
-    char fnameNew[80];
 
     /*
     **  Operator wants to remove paper.
@@ -222,48 +231,13 @@ void lp1612RemovePaper(char *params)
         }
 
     /*
-    **  Close the old device file.
+    **  The spool writer renames the print file to the format
+    **  "LP1612_yyyymmdd_hhmmss" and starts a new one.
     */
-    fflush(dp->fcb[0]);
-    fclose(dp->fcb[0]);
-    dp->fcb[0] = NULL;
-
-    /*
-    **  Rename the device file to the format "LP1612_yyyymmdd_hhmmss".
-    */
-    sprintf(fname, "LP1612_C%02o", channelNo);
-
-    time(&currentTime);
-    t = *localtime(&currentTime);
-    sprintf(fnameNew, "LP1612_%04d%02d%02d_%02d%02d%02d",
-        t.tm_year + 1900,
-        t.tm_mon + 1,
-        t.tm_mday,
-        t.tm_hour,
-        t.tm_min,
-        t.tm_sec);
-
-    if (rename(fname, fnameNew) != 0)
-        {
-        printf("Could not rename %s to %s - %s\n", fname, fnameNew, strerror(errno));
-        return;
-        }
-
-    /*
-    **  Open the device file.
-    */
-    dp->fcb[0] = fopen(fname, "w");
-
-    /*
-    **  Check if the open succeeded.
-    */
-    if (dp->fcb[0] == NULL)
+    if (!spoolRemovePaper((Spool *)dp->context[0], "Paper removed from 1612 printer\n"))
         {
-        printf("Failed to open %s\n", fname);
-        return;
+        printf("Previous paper removal still in progress\n");
         }
-
-    printf("Paper removed from 1612 printer\n");
     }
 
 /*--------------------------------------------------------------------------
@@ -277,7 +251,7 @@ void lp1612RemovePaper(char *params)
 **------------------------------------------------------------------------*/
 static FcStatus lp1612Func(PpWord funcCode)
     {
-    FILE *fcb = activeDevice->fcb[0];
+    Spool *sp = (Spool *)activeDevice->context[0];
 
     switch (funcCode)
         {
@@ -288,23 +262,23 @@ static FcStatus lp1612Func(PpWord funcCode)
         break;
 
     case FcPrintSingleSpace:
-        fprintf(fcb, "\n");
+        spoolPutChar(sp, '\n');
         break;
 
     case FcPrintDoubleSpace:
-        fprintf(fcb, "\n\n");
+        spoolPutString(sp, "\n\n");
         break;
 
     case FcPrintMoveChannel7:
-        fprintf(fcb, "\n");
+        spoolPutChar(sp, '\n');
         break;
 
     case FcPrintMoveTOF:
-        fprintf(fcb, "\f");
+        spoolPutChar(sp, '\f');
         break;
 
     case FcPrintPrint:
-        fprintf(fcb, "\n");
+        spoolPutChar(sp, '\n');
         break;
 
     case FcPrintSuppressLF:
@@ -338,7 +312,7 @@ static FcStatus lp1612Func(PpWord funcCode)
 **------------------------------------------------------------------------*/
 static void lp1612Io(void)
     {
-    FILE *fcb = activeDevice->fcb[0];
+    Spool *sp = (Spool *)activeDevice->context[0];
 
     switch (activeDevice->fcode)
         {
@@ -359,7 +333,7 @@ static void lp1612Io(void)
     case FcPrintFormat6:
         if (activeChannel->full)
             {
-            fputc(extBcdToAscii[activeChannel->data & 077], fcb);
+            spoolPutChar(sp, extBcdToAscii[activeChannel->data & 077]);
             activeChannel->full = FALSE;
             }
         break;
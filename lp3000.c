@@ -171,6 +171,7 @@ typedef struct lpContext
     int flags;
     bool printed;
     bool keepInt;
+    Spool *spool;
     } LpContext;
 
 
@@ -300,6 +301,26 @@ void lp512Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
 
     lp3000Init (unitNo, eqNo, channelNo, flags);
     }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Flush the print file of a 3000 class line printer.
+**
+**  Parameters:     Name        Description.
+**                  dp          Device control block
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void lp3000Terminate(DevSlot *dp)
+    {
+    LpContext *lc = (LpContext *)dp->context[0];
+
+    if (lc != NULL && lc->spool != NULL)
+        {
+        spoolClose(lc->spool);
+        lc->spool = NULL;
+        }
+    }
  
 /*
 **--------------------------------------------------------------------------
@@ -353,15 +374,10 @@ static void lp3000Init(u8 unitNo, u8 eqNo, u8 channelNo, int flags)
     lc->flags = flags;
     
     /*
-    **  Open the device file.
+    **  Open the print file spool.
     */
     sprintf(fname, "LP5xx_C%02o_E%o", channelNo, eqNo);
-    up->fcb[0] = fopen(fname, "w");
-    if (up->fcb[0] == NULL)
-        {
-        fprintf(stderr, "Failed to open %s\n", fname);
-        exit(1);
-        }
+    lc->spool = spoolOpen(fname, "LP5xx");
 
     /*
     **  Print a friendly message.
@@ -384,13 +400,10 @@ static void lp3000Init(u8 unitNo, u8 eqNo, u8 channelNo, int flags)
 void lp3000RemovePaper(char *params)
     {
     DevSlot *dp;
+    LpContext *lc;
     int numParam;
     int channelNo;
     int equipmentNo;
-    time_t currentTime;
-    struct tm t;
-    char fname[80];
-    char fnameNew[80];
 
     /*
     **  Operator wants to remove paper.
@@ -428,48 +441,14 @@ void lp3000RemovePaper(char *params)
         }
 
     /*
-    **  Close the old device file.
+    **  The spool writer renames the print file to the format
+    **  "LP5xx_yyyymmdd_hhmmss" and starts a new one.
     */
-    fflush(dp->fcb[0]);
-    fclose(dp->fcb[0]);
-    dp->fcb[0] = NULL;
-
-    /*
-    **  Rename the device file to the format "LP5xx_yyyymmdd_hhmmss".
-    */
-    sprintf(fname, "LP5xx_C%02o_E%o", channelNo, equipmentNo);
-
-    time(&currentTime);
-    t = *localtime(&currentTime);
-    sprintf(fnameNew, "LP5xx_%04d%02d%02d_%02d%02d%02d",
-        t.tm_year + 1900,
-        t.tm_mon + 1,
-        t.tm_mday,
-        t.tm_hour,
-        t.tm_min,
-        t.tm_sec);
-
-    if (rename(fname, fnameNew) != 0)
+    lc = (LpContext *)dp->context[0];
+    if (!spoolRemovePaper(lc->spool, "Paper removed from 5xx printer\n"))
         {
-        printf("Could not rename %s to %s - %s\n", fname, fnameNew, strerror(errno));
-        return;
+        printf("Previous paper removal still in progress\n");
         }
-
-    /*
-    **  Open the device file.
-    */
-    dp->fcb[0] = fopen(fname, "w");
-
-    /*
-    **  Check if the open succeeded.
-    */
-    if (dp->fcb[0] == NULL)
-        {
-        printf("Failed to open %s\n", fname);
-        return;
-        }
-
-    printf("Paper removed from 5xx printer\n");
     }
 
 /*--------------------------------------------------------------------------
@@ -483,10 +462,8 @@ void lp3000RemovePaper(char *params)
 **------------------------------------------------------------------------*/
 static FcStatus lp3000Func(PpWord funcCode)
     {
-    FILE *fcb;
     LpContext *lc;
 
-    fcb = active3000Device->fcb[0];
     lc = (LpContext *)active3000Device->context[0];
     
     /*
@@ -519,7 +496,7 @@ static FcStatus lp3000Func(PpWord funcCode)
         // Release is sent at end of job, so flush the print file
         if (lc->printed)
             {
-            fflush (fcb);
+            spoolEndJob(lc->spool);
             lc->printed = FALSE;
             }
         return(FcProcessed);
@@ -527,7 +504,7 @@ static FcStatus lp3000Func(PpWord funcCode)
     case FcPrintSingle:
     case FcPrintLastLine:
         // Treat last-line codes as a single blank line
-        fputc('\n', fcb);
+        spoolPutChar(lc->spool, '\n');
 #if DEBUG
     lp3000DebugData();
 #endif
@@ -535,14 +512,14 @@ static FcStatus lp3000Func(PpWord funcCode)
 
     case FcPrintEject:
         // Turn eject into a formfeed character
-        fputc('\f', fcb);
+        spoolPutChar(lc->spool, '\f');
 #if DEBUG
     lp3000DebugData();
 #endif
         return(FcProcessed);
 
     case FcPrintDouble:
-        fprintf(fcb, "\n\n");
+        spoolPutString(lc->spool, "\n\n");
 #if DEBUG
     lp3000DebugData();
 #endif
@@ -771,10 +748,8 @@ static FcStatus lp3000Func(PpWord funcCode)
 **------------------------------------------------------------------------*/
 static void lp3000Io(void)
     {
-    FILE *fcb;
     LpContext *lc;
 
-    fcb = active3000Device->fcb[0];
     lc = (LpContext *)active3000Device->context[0];
     
     /*
@@ -799,13 +774,13 @@ static void lp3000Io(void)
             if (lc->flags & Lp3000Type501)
                 {
                 // 501 printer, output display code
-                fputc(bcdToAscii[(activeChannel->data >> 6) & Mask6], fcb);
-                fputc(bcdToAscii[activeChannel->data & Mask6], fcb);
+                spoolPutChar(lc->spool, bcdToAscii[(activeChannel->data >> 6) & Mask6]);
+                spoolPutChar(lc->spool, bcdToAscii[activeChannel->data & Mask6]);
                 }
             else
                 {
                 // 512 printer, output ASCII
-                fputc(activeChannel->data & 0377, fcb);
+                spoolPutChar(lc->spool, (u8)(activeChannel->data & 0377));
                 }
             activeChannel->full = FALSE;
             lc->printed = TRUE;
@@ -851,12 +826,12 @@ static void lp3000Activate(void)
 **------------------------------------------------------------------------*/
 static void lp3000Disconnect(void)
     {
-    FILE *fcb = active3000Device->fcb[0];
+    LpContext *lc = (LpContext *)active3000Device->context[0];
 
     if (active3000Device->fcode == Fc6681Output)
         {
         // Rule is "space after the line is printed" so do that here
-        fputc('\n', fcb);
+        spoolPutChar(lc->spool, '\n');
 #if DEBUG
     lp3000DebugData();
 #endif
@@ -877,6 +852,8 @@ static void lp3000Disconnect(void)
 static void lp3000DebugData(void)
     {
 #if DEBUG
+    char text[32];
+    int count;
     int i;
 
     if (linePos == 0)
@@ -884,15 +861,11 @@ static void lp3000DebugData(void)
         return;
         }
 
-    for (i = 0; i < linePos; i++)
+    for (i = 0; i < linePos; i += 16)
         {
-        if (i % 16 == 0)
-            {
-            fputc('\n', lp3000Log);
-            }
-
-//        fprintf(lp3000Log, " %04o", lineData[i]);
-        fprintf(lp3000Log, "%c%c", bcdToAscii[(lineData[i] >> 6) & Mask6], bcdToAscii[(lineData[i] >> 0) & Mask6]);
+        count = linePos - i < 16 ? linePos - i : 16;
+        fputc('\n', lp3000Log);
+        fwrite(text, 1, charsetPpToAscii(lineData + i, count, text, bcdToAscii), lp3000Log);
         }
 
     fputc('\n', lp3000Log);
@@ -199,6 +199,7 @@ int main(int argc, char **argv)
 
         channelStep();
         rtcTick();
+        timerStep();
 
 #if CcCycleTime
         cycleTime = rtcStopTimer();
@@ -228,6 +229,7 @@ int main(int argc, char **argv)
     cpuTerminate();
     ppTerminate();
     channelTerminate();
+    tapeTerminate();
 
     exit(0);
     }
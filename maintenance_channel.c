@@ -23,8 +23,6 @@
 **--------------------------------------------------------------------------
 */
 
-#define DEBUG 0
-
 /*
 **  -------------
 **  Include Files
@@ -280,10 +278,6 @@ static u64 dataIou[256];
 static u64 dataMem[256];
 static u64 dataCpu[256];
 
-#if DEBUG
-static FILE *mchLog = NULL;
-#endif
-
 /*
 **--------------------------------------------------------------------------
 **
@@ -310,13 +304,6 @@ void mchInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     (void)eqNo;
     (void)deviceName;
 
-#if DEBUG
-    if (mchLog == NULL)
-        {
-        mchLog = fopen("mchlog.txt", "wt");
-        }
-#endif
-
     dp = channelAttach(channelNo, eqNo, DtMch);
     dp->activate = mchActivate;
     dp->disconnect = mchDisconnect;
@@ -378,15 +365,16 @@ static FcStatus mchFunc(PpWord funcCode)
     opCode   = funcCode & FcOpMask;
     typeCode = funcCode & FcTypeMask;
 
-#if DEBUG
-    fprintf(mchLog, "\n%06d PP:%02o CH:%02o f:0x%03X C:%-25s O:%-25s  >   ",
-        traceSequenceNo,
-        activePpu->id,
-        activeDevice->channel->id,
-        funcCode,
-        mchConn2String(connCode),
-        mchOp2String(opCode));
-#endif
+    if (LogOn(LogMch))
+        {
+        logPrintf(LogMch, "\n%06d PP:%02o CH:%02o f:0x%03X C:%-25s O:%-25s  >   ",
+            traceSequenceNo,
+            activePpu->id,
+            activeDevice->channel->id,
+            funcCode,
+            mchConn2String(connCode),
+            mchOp2String(opCode));
+        }
 
     /*
     **  Connect codes 0x800 - 0xF00 causes the MCH to be deselected.
@@ -402,9 +390,11 @@ static FcStatus mchFunc(PpWord funcCode)
     switch (opCode)
         {
     default:
-#if DEBUG
-        fprintf(mchLog, " Operation not implemented & declined!");
-#endif
+        if (LogOn(LogMch))
+            {
+            logPrintf(LogMch, " Operation not implemented & declined!");
+            }
+
         return(FcDeclined);
 
     case FcOpHalt:
@@ -464,9 +454,11 @@ static void mchIo(void)
             {
             if (activeChannel->full)
                 {
-#if DEBUG
-                fprintf(mchLog, " a%02X", activeChannel->data);
-#endif
+                if (LogOn(LogMch))
+                    {
+                    logPrintf(LogMch, " a%02X", activeChannel->data);
+                    }
+
                 activeChannel->full = FALSE;
                 activeDevice->recordLength -= 1;
 
@@ -522,9 +514,10 @@ static void mchIo(void)
                     activeChannel->data = 0;
                     }
                 activeChannel->full = TRUE;
-#if DEBUG
-                fprintf(mchLog, " i%02X", activeChannel->data);
-#endif
+                if (LogOn(LogMch))
+                    {
+                    logPrintf(LogMch, " i%02X", activeChannel->data);
+                    }
                 }
             }
 
@@ -535,9 +528,11 @@ static void mchIo(void)
             {
             if (activeChannel->full)
                 {
-#if DEBUG
-                fprintf(mchLog, " a%02X", activeChannel->data);
-#endif
+                if (LogOn(LogMch))
+                    {
+                    logPrintf(LogMch, " a%02X", activeChannel->data);
+                    }
+
                 activeChannel->full = FALSE;
                 activeDevice->recordLength -= 1;
 
@@ -590,9 +585,10 @@ static void mchIo(void)
                     dp[mchLocation] |= ((u64)activeChannel->data & Mask8) << shiftCount;
                     }
 
-#if DEBUG
-                fprintf(mchLog, " o%02X", activeChannel->data);
-#endif
+                if (LogOn(LogMch))
+                    {
+                    logPrintf(LogMch, " o%02X", activeChannel->data);
+                    }
                 
                 if (   connCode == FcConnIou
                     && mchLocation == RegAddrEnvControl
@@ -637,9 +633,11 @@ static void mchIo(void)
             {
             if (activeChannel->full)
                 {
-#if DEBUG
-                fprintf(mchLog, " a%02X", activeChannel->data);
-#endif
+                if (LogOn(LogMch))
+                    {
+                    logPrintf(LogMch, " a%02X", activeChannel->data);
+                    }
+
                 activeChannel->full = FALSE;
                 activeDevice->recordLength -= 1;
 
@@ -658,9 +656,10 @@ static void mchIo(void)
                 {
                 activeChannel->data = (PpWord)mchLocation;
                 activeChannel->full = TRUE;
-#if DEBUG
-                fprintf(mchLog, " e%02X", activeChannel->data);
-#endif
+                if (LogOn(LogMch))
+                    {
+                    logPrintf(LogMch, " e%02X", activeChannel->data);
+                    }
                 }
             }
 
@@ -725,14 +724,12 @@ static void mchDisconnect(void)
 static char *mchConn2String(PpWord connCode)
     {
     static char buf[30];
-#if DEBUG
     switch(connCode)
         {
     case FcConnIou         : return "IOU";
     case FcConnMemory      : return "Memory";
     case FcConnCpu         : return "Processor";
         }
-#endif
     sprintf(buf, "UNKNOWN: %03X", connCode);
     return(buf);
     }
@@ -749,7 +746,6 @@ static char *mchConn2String(PpWord connCode)
 static char *mchOp2String(PpWord opCode)
     {
     static char buf[30];
-#if DEBUG
     switch(opCode)
         {
     case FcOpHalt              : return "Halt";
@@ -762,7 +758,6 @@ static char *mchOp2String(PpWord opCode)
     case FcOpEchoData          : return "EchoData";
     case FcOpRequSummaryStatus : return "RequSummaryStatus";
         }
-#endif
     sprintf(buf, "UNKNOWN: %03X", opCode);
     return(buf);
     }
@@ -25,8 +25,6 @@
 **--------------------------------------------------------------------------
 */
 
-#define DEBUG 0
-
 /*
 **  -------------
 **  Include Files
@@ -111,6 +109,7 @@
 #define MaxPpBuf                40000
 #define MaxByteBuf              60000
 #define MaxTapeSize             1250000000   // this may need adjusting for shorter real tapes
+#define RewindTimeUs            1000
 
 /*
 **  -----------------------
@@ -167,7 +166,7 @@ typedef struct tapeParam
     bool        reserved;
 
     bool        rewinding;
-    u32         rewindStart;
+    TimerSlot   rewindTimer;
 
     /*
     **  I/O buffer.
@@ -186,6 +185,8 @@ static void mt362xInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName, u8 tr
 static void mt362xInitStatus(TapeParam *tp);
 static void mt362xResetStatus(TapeParam *tp);
 static void mt362xSetupStatus(TapeParam *tp);
+static void mt362xRewindDone(void *param);
+static void mt362xAttachTape(TapeMount *mp);
 static FcStatus mt362xFunc(PpWord funcCode);
 static void mt362xIo(void);
 static void mt362xActivate(void);
@@ -213,8 +214,6 @@ static TapeParam *firstTape = NULL;
 static TapeParam *lastTape = NULL;
 static u8 rawBuffer[MaxByteBuf];
 
-#if DEBUG
-static FILE *mt362xLog = NULL;
 
 #define OctalColumn(x) (5 * (x) + 1 + 5)
 #define AsciiColumn(x) (OctalColumn(5) + 2 + (2 * x))
@@ -237,7 +236,7 @@ static void mt362xLogFlush(void)
     {
     if (mt362xLogCol != 0)
         {
-        fputs(mt362xLogBuf, mt362xLog);
+        logPrintf(LogMt362x, "%s", mt362xLogBuf);
         }
 
     mt362xLogCol = 0;
@@ -271,7 +270,6 @@ static void mt362xLogByte(int b)
         mt362xLogFlush();
         }
     }
-#endif
 
 /*
 **--------------------------------------------------------------------------
@@ -321,13 +319,6 @@ static void mt362xInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName, u8 tr
     FILE *fcb;
     TapeParam *tp;
 
-#if DEBUG
-    if (mt362xLog == NULL)
-        {
-        mt362xLog = fopen("mt362xlog.txt", "wt");
-        }
-#endif
-
 	/*
 	** Attach 362x controller to converter (create if necessary).
 	*/
@@ -379,7 +370,7 @@ static void mt362xInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName, u8 tr
     if (deviceName != NULL)
         {
         strncpy(tp->fileName, deviceName, _MAX_PATH);
-        fcb = fopen(deviceName, "rb");
+        fcb = tapeOpen(deviceName, "rb");
         if (fcb == NULL)
             {
             fprintf(stderr, "Failed to open %s\n", deviceName);
@@ -435,7 +426,7 @@ void mt362xLoadTape(char *params)
     int equipmentNo;
     int unitNo;
     TapeParam *tp;
-    FILE *fcb;
+    TapeMount mount;
     u8 unitMode;
 
     /*
@@ -498,52 +489,26 @@ void mt362xLoadTape(char *params)
     /*
     **  Check if the unit has been unloaded.
     */
-    if (dp->fcb[unitNo] != NULL)
+    if (dp->fcb[unitNo] != NULL || tapeMountPending(dp, (u8)unitNo))
         {
         printf("Unit %d not unloaded\n", unitNo);
         return;
         }
 
     /*
-    **  Open the file in the requested mode.
-    */
-    if (unitMode == 'w')
-        {
-        fcb = fopen(str, "r+b");
-        if (fcb == NULL)
-            {
-            fcb = fopen(str, "w+b");
-            }
-        }
-    else
-        {
-        fcb = fopen(str, "rb");
-        }
-
-    dp->fcb[unitNo] = fcb;
-
-    /*
-    **  Check if the open succeeded.
+    **  Open the file in the background, the unit goes ready when it is
+    **  attached by mt362xAttachTape.
     */
-    if (fcb == NULL)
+    memset(&mount, 0, sizeof(mount));
+    mount.dp = dp;
+    mount.unitNo = (u8)unitNo;
+    mount.ringIn = unitMode == 'w';
+    strncpy(mount.fileName, str, _MAX_PATH - 1);
+    mount.attach = mt362xAttachTape;
+    if (tapeMount(&mount))
         {
-        printf("Failed to open %s\n", str);
-        return;
+        printf("Mounting %s\n", str);
         }
-
-    /*
-    **  Setup show_tape path name.
-    */
-    strncpy(tp->fileName, str, _MAX_PATH);
-
-    /*
-    **  Setup status.
-    */
-    mt362xInitStatus(tp);
-    tp->unitReady = TRUE;
-    tp->ringIn = unitMode == 'w';
-
-    printf("Successfully loaded %s\n", str);
     }
 
 /*--------------------------------------------------------------------------
@@ -621,7 +586,7 @@ void mt362xUnloadTape(char *params)
     /*
     **  Close the file.
     */
-    fclose(dp->fcb[unitNo]);
+    tapeClose(dp->fcb[unitNo]);
     dp->fcb[unitNo] = NULL;
 
     /*
@@ -694,7 +659,7 @@ static void mt362xInitStatus(TapeParam *tp)
     tp->reserved       = FALSE;
 
     tp->rewinding      = FALSE;
-    tp->rewindStart    = FALSE;
+    timerCancel(&tp->rewindTimer);
     }
 
 /*--------------------------------------------------------------------------
@@ -732,17 +697,7 @@ static void mt362xSetupStatus(TapeParam *tp)
 
     if (tp->rewinding)
         {
-        if (labs(cycles - tp->rewindStart) > 1000)
-            {
-            tp->rewinding = FALSE;
-            tp->blockNo = 0;
-            tp->endOfOperation = TRUE;
-            tp->intStatus |= Int362xEndOfOp;
-            }
-        else
-            {
-            tp->busy = TRUE;
-            }
+        tp->busy = TRUE;
         }
     else
         {
@@ -825,6 +780,55 @@ static void mt362xSetupStatus(TapeParam *tp)
         }
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Complete a rewind (timer expiry handler).
+**
+**  Parameters:     Name        Description.
+**                  param       pointer to tape parameters
+**
+**  Returns:        Nothing
+**
+**------------------------------------------------------------------------*/
+static void mt362xRewindDone(void *param)
+    {
+    TapeParam *tp = param;
+
+    tp->rewinding = FALSE;
+    tp->blockNo = 0;
+    tp->endOfOperation = TRUE;
+    tp->intStatus |= Int362xEndOfOp;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Attach a tape mounted by the tape mount thread.
+**
+**  Parameters:     Name        Description.
+**                  mp          pointer to mount request
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void mt362xAttachTape(TapeMount *mp)
+    {
+    TapeParam *tp = (TapeParam *)mp->dp->context[mp->unitNo];
+
+    mp->dp->fcb[mp->unitNo] = mp->fcb;
+
+    /*
+    **  Setup show_tape path name.
+    */
+    strncpy(tp->fileName, mp->fileName, _MAX_PATH);
+
+    /*
+    **  Setup status.
+    */
+    mt362xInitStatus(tp);
+    tp->unitReady = TRUE;
+    tp->ringIn = mp->ringIn;
+
+    printf("Successfully loaded %s\n", mp->fileName);
+    }
+
 /*--------------------------------------------------------------------------
 **  Purpose:        Execute function code on 362x tape controller.
 **
@@ -856,16 +860,17 @@ static FcStatus mt362xFunc(PpWord funcCode)
         return(FcDeclined);
         }
 
-#if DEBUG
-    mt362xLogFlush();
-    fprintf(mt362xLog, "\n%06d PP:%02o CH:%02o Unit:%02o f:%04o T:%-25s  >   ",
-        traceSequenceNo,
-        activePpu->id,
-        activeDevice->channel->id,
-        unitNo,
-        funcCode,
-        mt362xFunc2String(funcCode));
-#endif
+    if (LogOn(LogMt362x))
+        {
+        mt362xLogFlush();
+        logPrintf(LogMt362x, "\n%06d PP:%02o CH:%02o Unit:%02o f:%04o T:%-25s  >   ",
+            traceSequenceNo,
+            activePpu->id,
+            activeDevice->channel->id,
+            unitNo,
+            funcCode,
+            mt362xFunc2String(funcCode));
+        }
 
 
 	switch (funcCode)
@@ -915,7 +920,7 @@ static FcStatus mt362xFunc(PpWord funcCode)
                 if (!tp->rewinding)
                     {
                     tp->rewinding = TRUE;
-                    tp->rewindStart = cycles;
+                    timerStart(&tp->rewindTimer, RewindTimeUs, mt362xRewindDone, tp);
                     }
                 }
 
@@ -932,7 +937,7 @@ static FcStatus mt362xFunc(PpWord funcCode)
             tp->blockNo = 0;
             tp->unitReady = FALSE;
             tp->ringIn = FALSE;
-            fclose(active3000Device->fcb[unitNo]);
+            tapeClose(active3000Device->fcb[unitNo]);
             active3000Device->fcb[unitNo] = NULL;
 			tp->endOfOperation = TRUE;
 			tp->intStatus |= Int362xEndOfOp;
@@ -1180,12 +1185,12 @@ static void mt362xIo(void)
     **  when probed via FJM and EJM PP opcodes. This allows a second PP
     **  to monitor the progress of a transfer.
     */
-    if (activeChannel->delayStatus != 0)
+    if (activeChannel->delayStatus.pending)
         {
         return;
         }
 
-    activeChannel->delayStatus = 0;
+    channelDelayStatus(0);
 
     /*
     **  Setup selected unit context.
@@ -1215,9 +1220,10 @@ static void mt362xIo(void)
 			activeChannel->full = TRUE;
 			tp->endOfOperation = TRUE;
 			tp->intStatus |= Int362xEndOfOp;
-#if DEBUG
-    fprintf(mt362xLog, " %04o", activeChannel->data);
-#endif
+    if (LogOn(LogMt362x))
+        {
+        logPrintf(LogMt362x, " %04o", activeChannel->data);
+        }
 		    }
 		break;
 
@@ -1247,9 +1253,10 @@ static void mt362xIo(void)
                 activeChannel->data = *tp->bp++;
                 }
 
-#if DEBUG
-            mt362xLogByte(activeChannel->data);
-#endif
+            if (LogOn(LogMt362x))
+                {
+                mt362xLogByte(activeChannel->data);
+                }
 
             activeChannel->full = TRUE;
             tp->recordLength -= 1;
@@ -1273,9 +1280,10 @@ static void mt362xIo(void)
             *tp->bp++ = activeChannel->data;
             activeChannel->full = FALSE;
             active3000Device->recordLength += 1;
-#if DEBUG
-            mt362xLogByte(activeChannel->data);
-#endif
+            if (LogOn(LogMt362x))
+                {
+                mt362xLogByte(activeChannel->data);
+                }
             }
 
         break;
@@ -1302,7 +1310,7 @@ static void mt362xIo(void)
 **------------------------------------------------------------------------*/
 static void mt362xActivate(void)
     {
-    activeChannel->delayStatus = 5;
+    channelDelayStatus(5);
     }
 
 /*--------------------------------------------------------------------------
@@ -1318,7 +1326,6 @@ static void mt362xDisconnect(void)
     FILE *fcb;
     TapeParam *tp;
     i8 unitNo;
-    u32 i;
     u32 recLen0;
     u32 recLen1;
     u32 recLen2;
@@ -1338,7 +1345,7 @@ static void mt362xDisconnect(void)
     /*
     **  Abort pending device disconnects - the PP is doing the disconnect.
     */
-    activeChannel->delayDisconnect = 0;
+    channelDelayDisconnect(0);
     activeChannel->discAfterInput = FALSE;
 
     /*
@@ -1372,12 +1379,7 @@ static void mt362xDisconnect(void)
                 /*
                 **  Make BCD readable as ASCII.
                 */
-                for (i = 0; i < recLen2; i++)
-                    {
-                    *rp++ = bcdToAscii[(*ip >> 6) & Mask6];
-                    *rp++ = bcdToAscii[(*ip >> 0) & Mask6];
-                    ip += 1;
-                    }
+                rp += packConvWordsToBytes(ip, recLen2, rp, (const u8 *)bcdToAscii);
 
                 recLen0 = rp - rawBuffer;
                 }
@@ -1386,13 +1388,7 @@ static void mt362xDisconnect(void)
                 /*
                 **  No conversion, just unpack.
                 */
-                for (i = 0; i < recLen2; i += 2)
-                    {
-                    *rp++ = ((ip[0] >> 4) & 0xFF);
-                    *rp++ = ((ip[0] << 4) & 0xF0) | ((ip[1] >> 8) & 0x0F);
-                    *rp++ = ((ip[1] >> 0) & 0xFF);
-                    ip += 2;
-                    }
+                packWordsToBytes(ip, recLen2, rp);
 
                 /*
                 **  Calculate the actual length.
@@ -1413,12 +1409,7 @@ static void mt362xDisconnect(void)
                 /*
                 **  Make BCD readable as ASCII.
                 */
-                for (i = 0; i < recLen2; i++)
-                    {
-                    *rp++ = bcdToAscii[(*ip >> 6) & Mask6];
-                    *rp++ = bcdToAscii[(*ip >> 0) & Mask6];
-                    ip += 1;
-                    }
+                rp += packConvWordsToBytes(ip, recLen2, rp, (const u8 *)bcdToAscii);
 
                 }
             else
@@ -1426,12 +1417,7 @@ static void mt362xDisconnect(void)
                 /*
                 **  No conversion, just unpack.
                 */
-                for (i = 0; i < recLen2; i++)
-                    {
-                    *rp++ = ((*ip >> 6) & Mask6);
-                    *rp++ = ((*ip >> 0) & Mask6);
-                    ip += 1;
-                    }
+                rp += packConvWordsToBytes(ip, recLen2, rp, NULL);
                 }
 
             recLen0 = rp - rawBuffer;
@@ -1522,9 +1508,10 @@ static void mt362xFuncRead(void)
         tp->endOfOperation = TRUE;
         tp->fileMark = TRUE;
 
-#if DEBUG
-        fprintf(mt362xLog, "TAP is at EOF (simulate tape mark)\n");
-#endif
+        if (LogOn(LogMt362x))
+            {
+            logPrintf(LogMt362x, "TAP is at EOF (simulate tape mark)\n");
+            }
 
         return;
         }
@@ -1563,9 +1550,11 @@ static void mt362xFuncRead(void)
         tp->endOfOperation = TRUE;
         tp->blockNo += 1;
 
-#if DEBUG
-        fprintf(mt362xLog, "Tape mark\n");
-#endif
+        if (LogOn(LogMt362x))
+            {
+            logPrintf(LogMt362x, "Tape mark\n");
+            }
+
         return;
         }
 
@@ -1634,9 +1623,10 @@ static void mt362xFuncRead(void)
     /*
     **  Setup length, buffer pointer and block number.
     */
-#if DEBUG
-    fprintf(mt362xLog, "Read fwd %d PP words (%d 8-bit bytes)\n", active3000Device->recordLength, recLen1);
-#endif
+    if (LogOn(LogMt362x))
+        {
+        logPrintf(LogMt362x, "Read fwd %d PP words (%d 8-bit bytes)\n", active3000Device->recordLength, recLen1);
+        }
 
     tp->recordLength = active3000Device->recordLength;
     tp->bp = tp->ioBuffer;
@@ -1790,9 +1780,10 @@ static void mt362xFuncReadBkw(void)
         /*
         **  Setup length and buffer pointer.
         */
-#if DEBUG
-        fprintf(mt362xLog, "Read bkwd %d PP words (%d 8-bit bytes)\n", active3000Device->recordLength, recLen1);
-#endif
+        if (LogOn(LogMt362x))
+            {
+            logPrintf(LogMt362x, "Read bkwd %d PP words (%d 8-bit bytes)\n", active3000Device->recordLength, recLen1);
+            }
 
         tp->recordLength = active3000Device->recordLength;
         tp->bp = tp->ioBuffer + tp->recordLength - 1;
@@ -1806,9 +1797,10 @@ static void mt362xFuncReadBkw(void)
         tp->fileMark = TRUE;
         tp->endOfOperation = TRUE;
 
-#if DEBUG
-        fprintf(mt362xLog, "Tape mark\n");
-#endif
+        if (LogOn(LogMt362x))
+            {
+            logPrintf(LogMt362x, "Tape mark\n");
+            }
         }
 
     /*
@@ -1860,9 +1852,11 @@ static void mt362xFuncForespace(void)
         tp->intStatus |= Int362xEndOfOp;
         tp->endOfOperation = TRUE;
         tp->fileMark = TRUE;
-#if DEBUG
-        fprintf(mt362xLog, "TAP is at EOF (simulate tape mark)\n");
-#endif
+        if (LogOn(LogMt362x))
+            {
+            logPrintf(LogMt362x, "TAP is at EOF (simulate tape mark)\n");
+            }
+
         return;
         }
 
@@ -1899,9 +1893,11 @@ static void mt362xFuncForespace(void)
         tp->intStatus |= Int362xEndOfOp;
         tp->endOfOperation = TRUE;
 
-#if DEBUG
-        fprintf(mt362xLog, "Tape mark\n");
-#endif
+        if (LogOn(LogMt362x))
+            {
+            logPrintf(LogMt362x, "Tape mark\n");
+            }
+
         return;
         }
 
@@ -2094,9 +2090,10 @@ static void mt362xFuncBackspace(void)
         tp->intStatus |= Int362xEndOfOp;
         tp->endOfOperation = TRUE;
 
-#if DEBUG
-        fprintf(mt362xLog, "Tape mark\n");
-#endif
+        if (LogOn(LogMt362x))
+            {
+            logPrintf(LogMt362x, "Tape mark\n");
+            }
         }
 
     /*
@@ -2125,8 +2122,6 @@ static void mt362xPackAndConvert(u32 recLen)
     {
     i8 unitNo = active3000Device->selectedUnit;
     TapeParam *tp = active3000Device->context[unitNo];
-    u32 i;
-    u16 c1, c2, c3;
     u16 *op;
     u8 *rp;
 
@@ -2143,13 +2138,7 @@ static void mt362xPackAndConvert(u32 recLen)
         */
         rawBuffer[recLen] = 0;
 
-        for (i = 0; i < recLen; i += 2)
-            {
-            *op++ = ((PpWord)asciiToBcd[rp[0]] << 6) | ((PpWord)asciiToBcd[rp[1]] << 0);
-            rp += 2;
-            }
-
-        active3000Device->recordLength = op - tp->ioBuffer;
+        active3000Device->recordLength = (PpWord)packConvBytesToWords(rp, (recLen + 1) & ~1, op, asciiToBcd, NULL);
         }
     else
         {
@@ -2163,15 +2152,7 @@ static void mt362xPackAndConvert(u32 recLen)
             /*
             **  Convert the raw data into PP Word data.
             */
-            for (i = 0; i < recLen; i += 3)
-                {
-                c1 = *rp++;
-                c2 = *rp++;
-                c3 = *rp++;
-
-                *op++ = ((c1 << 4) | (c2 >> 4)) & Mask12;
-                *op++ = ((c2 << 8) | (c3 >> 0)) & Mask12;
-                }
+            packBytesToWords(rp, recLen, op);
 
             /*
             **  Now calculate the number of PP words.
@@ -2190,13 +2171,7 @@ static void mt362xPackAndConvert(u32 recLen)
             */
             rawBuffer[recLen] = 0;
 
-            for (i = 0; i < recLen; i += 2)
-                {
-                *op++ = ((PpWord)(rp[0] & Mask6) << 6) | ((PpWord)(rp[1] & Mask6) << 0);
-                rp += 2;
-                }
-
-            active3000Device->recordLength = op - tp->ioBuffer;
+            active3000Device->recordLength = (PpWord)packConvBytesToWords(rp, (recLen + 1) & ~1, op, NULL, NULL);
             }
         }
     }
@@ -2220,7 +2195,7 @@ static void mt362xUnload(TapeParam *tp)
     tp->ringIn = FALSE;
     tp->endOfOperation = TRUE;
     unitNo = active3000Device->selectedUnit;
-    fclose(active3000Device->fcb[unitNo]);
+    tapeClose(active3000Device->fcb[unitNo]);
     active3000Device->fcb[unitNo] = NULL;
     }
 
@@ -2236,7 +2211,6 @@ static void mt362xUnload(TapeParam *tp)
 static char *mt362xFunc2String(PpWord funcCode)
     {
     static char buf[30];
-#if DEBUG
     switch(funcCode)
         {
     case Fc362xRelease                : return "Fc362xRelease";
@@ -2267,7 +2241,6 @@ static char *mt362xFunc2String(PpWord funcCode)
     case Fc6681Input                  : return "Fc6681Input";
     case Fc6681Output                 : return "Fc6681Output";
         }
-#endif
     sprintf(buf, "UNKNOWN: %04o", funcCode);
     return(buf);
     }
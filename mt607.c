@@ -218,7 +218,7 @@ void mt607Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
         strcpy(fname, deviceName);
         }
 
-    dp->fcb[unitNo] = fopen(fname, "rb");
+    dp->fcb[unitNo] = tapeOpen(fname, "rb");
     if (dp->fcb[unitNo] == NULL)
         {
         fprintf(stderr, "Failed to open %s\n", fname);
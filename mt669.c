@@ -24,8 +24,6 @@
 **--------------------------------------------------------------------------
 */
 
-#define DEBUG 0
-
 /*
 **  -------------
 **  Include Files
@@ -198,6 +196,7 @@
 #define MaxByteBuf                  60000
 #define MaxPackedConvBuf            (((256 * 8) + 11) / 12)
 #define MaxTapeSize                 1250000000   // this may need adjusting for shorter real tapes
+#define RewindTimeUs                1000
 
 
 /*
@@ -260,7 +259,7 @@ typedef struct tapeParam
     bool        flagBitDetected;
     bool        rewinding;
     bool        suppressBot;
-    u32         rewindStart;
+    TimerSlot   rewindTimer;
     u16         blockCrc;
     u8          errorCode;
     u32         blockNo;
@@ -284,6 +283,8 @@ static void mt669SetupGeneralStatus(TapeParam *tp);
 static void mt669SetupDetailedStatus(TapeParam *tp);
 static void mt669SetupCumulativeStatus(TapeParam *tp);
 static void mt669SetupUnitReadyStatus(void);
+static void mt669RewindDone(void *param);
+static void mt669AttachTape(TapeMount *mp);
 static FcStatus mt669Func(PpWord funcCode);
 static void mt669Io(void);
 static void mt669Activate(void);
@@ -310,10 +311,6 @@ static TapeParam *firstTape = NULL;
 static TapeParam *lastTape = NULL;
 static u8 rawBuffer[MaxByteBuf];
 
-#if DEBUG
-static FILE *mt669Log = NULL;
-#endif
-
 /*
 **--------------------------------------------------------------------------
 **
@@ -341,13 +338,6 @@ void mt669Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
 
     (void)eqNo;
 
-#if DEBUG
-    if (mt669Log == NULL)
-        {
-        mt669Log = fopen("mt669log.txt", "wt");
-        }
-#endif
-
     /*
     **  Attach device to channel.
     */
@@ -442,7 +432,7 @@ void mt669Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     if (deviceName != NULL)
         {
         strncpy(tp->fileName, deviceName, _MAX_PATH);
-        fcb = fopen(deviceName, "rb");
+        fcb = tapeOpen(deviceName, "rb");
         if (fcb == NULL)
             {
             fprintf(stderr, "Failed to open %s\n", deviceName);
@@ -526,7 +516,7 @@ void mt669LoadTape(char *params)
     int equipmentNo;
     int unitNo;
     TapeParam *tp;
-    FILE *fcb;
+    TapeMount mount;
     u8 unitMode;
 
     /*
@@ -589,53 +579,26 @@ void mt669LoadTape(char *params)
     /*
     **  Check if the unit has been unloaded.
     */
-    if (dp->fcb[unitNo] != NULL)
+    if (dp->fcb[unitNo] != NULL || tapeMountPending(dp, (u8)unitNo))
         {
         printf("Unit %d not unloaded\n", unitNo);
         return;
         }
 
     /*
-    **  Open the file in the requested mode.
+    **  Open the file in the background, the unit goes ready when it is
+    **  attached by mt669AttachTape.
     */
-    if (unitMode == 'w')
-        {
-        fcb = fopen(str, "r+b");
-        if (fcb == NULL)
-            {
-            fcb = fopen(str, "w+b");
-            }
-        }
-    else
+    memset(&mount, 0, sizeof(mount));
+    mount.dp = dp;
+    mount.unitNo = (u8)unitNo;
+    mount.ringIn = unitMode == 'w';
+    strncpy(mount.fileName, str, _MAX_PATH - 1);
+    mount.attach = mt669AttachTape;
+    if (tapeMount(&mount))
         {
-        fcb = fopen(str, "rb");
+        printf("Mounting %s\n", str);
         }
-
-    dp->fcb[unitNo] = fcb;
-
-    /*
-    **  Check if the open succeeded.
-    */
-    if (fcb == NULL)
-        {
-        printf("Failed to open %s\n", str);
-        return;
-        }
-
-    /*
-    **  Setup show_tape path name.
-    */
-    strncpy(tp->fileName, str, _MAX_PATH);
-
-    /*
-    **  Setup status.
-    */
-    mt669ResetStatus(tp);
-    tp->ringIn = unitMode == 'w';
-    tp->blockNo = 0;
-    tp->unitReady = TRUE;
-
-    printf("Successfully loaded %s\n", str);
     }
 
 /*--------------------------------------------------------------------------
@@ -713,7 +676,7 @@ void mt669UnloadTape(char *params)
     /*
     **  Close the file.
     */
-    fclose(dp->fcb[unitNo]);
+    tapeClose(dp->fcb[unitNo]);
     dp->fcb[unitNo] = NULL;
 
     /*
@@ -728,7 +691,7 @@ void mt669UnloadTape(char *params)
     tp->unitReady = FALSE;
     tp->ringIn = FALSE;
     tp->rewinding = FALSE;
-    tp->rewindStart = 0;
+    timerCancel(&tp->rewindTimer);
     tp->blockCrc = 0;
     tp->blockNo = 0;
 
@@ -844,11 +807,6 @@ static void mt669SetupGeneralStatus(TapeParam *tp)
     if (tp->rewinding)
         {
         cp->deviceStatus[1] |= St669Busy;
-        if (labs(cycles - tp->rewindStart) > 1000)
-            {
-            tp->rewinding = FALSE;
-            tp->blockNo = 0;
-            }
         }
     else
         {
@@ -988,18 +946,10 @@ static void mt669SetupUnitReadyStatus(void)
         tp = (TapeParam *)activeDevice->context[unitNo];
         if (tp != NULL && tp->unitReady)
             {
-            if (tp->rewinding)
-                {
-                /*
-                **  Unit is not ready while rewinding.
-                */
-                if (labs(cycles - tp->rewindStart) > 1000)
-                    {
-                    tp->rewinding = FALSE;
-                    tp->blockNo = 0;
-                    }
-                }
-            else
+            /*
+            **  Unit is not ready while rewinding.
+            */
+            if (!tp->rewinding)
                 {
                 s |= 1 << unitNo;
                 }
@@ -1010,6 +960,54 @@ static void mt669SetupUnitReadyStatus(void)
     cp->deviceStatus[2] = s & cp->excludedUnits;
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Complete a rewind (timer expiry handler).
+**
+**  Parameters:     Name        Description.
+**                  param       pointer to tape parameters
+**
+**  Returns:        Nothing
+**
+**------------------------------------------------------------------------*/
+static void mt669RewindDone(void *param)
+    {
+    TapeParam *tp = param;
+
+    tp->rewinding = FALSE;
+    tp->blockNo = 0;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Attach a tape mounted by the tape mount thread.
+**
+**  Parameters:     Name        Description.
+**                  mp          pointer to mount request
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void mt669AttachTape(TapeMount *mp)
+    {
+    TapeParam *tp = (TapeParam *)mp->dp->context[mp->unitNo];
+
+    mp->dp->fcb[mp->unitNo] = mp->fcb;
+
+    /*
+    **  Setup show_tape path name.
+    */
+    strncpy(tp->fileName, mp->fileName, _MAX_PATH);
+
+    /*
+    **  Setup status.
+    */
+    mt669ResetStatus(tp);
+    tp->ringIn = mp->ringIn;
+    tp->blockNo = 0;
+    tp->unitReady = TRUE;
+
+    printf("Successfully loaded %s\n", mp->fileName);
+    }
+
 /*--------------------------------------------------------------------------
 **  Purpose:        Execute function code on 669 tape drives.
 **
@@ -1037,15 +1035,16 @@ static FcStatus mt669Func(PpWord funcCode)
         tp = NULL;
         }
  
-#if DEBUG
-    fprintf(mt669Log, "\n%06d PP:%02o CH:%02o u:%d f:%04o T:%-25s  >   ",
-        traceSequenceNo,
-        activePpu->id,
-        activeDevice->channel->id,
-        unitNo, 
-        funcCode,
-        mt669Func2String(funcCode));
-#endif
+    if (LogOn(LogMt669))
+        {
+        logPrintf(LogMt669, "\n%06d PP:%02o CH:%02o u:%d f:%04o T:%-25s  >   ",
+            traceSequenceNo,
+            activePpu->id,
+            activeDevice->channel->id,
+            unitNo, 
+            funcCode,
+            mt669Func2String(funcCode));
+        }
 
     /*
     **  Reset function code.
@@ -1070,9 +1069,11 @@ static FcStatus mt669Func(PpWord funcCode)
     switch (funcCode)
         {
     default:
-#if DEBUG
-        fprintf(mt669Log, " FUNC not implemented & declined!");
-#endif
+        if (LogOn(LogMt669))
+            {
+            logPrintf(LogMt669, " FUNC not implemented & declined!");
+            }
+
         if (unitNo != -1)
             {
             tp->errorCode = EcIllegalFunction;
@@ -1139,7 +1140,7 @@ static FcStatus mt669Func(PpWord funcCode)
                 if (!tp->rewinding)
                     {
                     tp->rewinding = TRUE;
-                    tp->rewindStart = cycles;
+                    timerStart(&tp->rewindTimer, RewindTimeUs, mt669RewindDone, tp);
                     }
                 }
             }
@@ -1153,7 +1154,7 @@ static FcStatus mt669Func(PpWord funcCode)
             tp->blockNo = 0;
             tp->unitReady = FALSE;
             tp->ringIn = FALSE;
-            fclose(activeDevice->fcb[unitNo]);
+            tapeClose(activeDevice->fcb[unitNo]);
             activeDevice->fcb[unitNo] = NULL;
             }
 
@@ -1481,12 +1482,12 @@ static void mt669Io(void)
     **  to monitor the progress of a transfer (used by 1MT and 1LT to
     **  coordinate the transfer of a large tape record).
     */
-    if (activeChannel->delayStatus != 0)
+    if (activeChannel->delayStatus.pending)
         {
         return;
         }
 
-    activeChannel->delayStatus = 3;
+    channelDelayStatus(3);
 
     /*
     **  Setup selected unit context.
@@ -1524,9 +1525,10 @@ static void mt669Io(void)
                 {
                 wordNumber = 3 - activeDevice->recordLength;
 
-#if DEBUG
-                fprintf(mt669Log, " %04o", activeChannel->data);
-#endif
+                if (LogOn(LogMt669))
+                    {
+                    logPrintf(LogMt669, " %04o", activeChannel->data);
+                    }
 
                 if (wordNumber == 1)
                     {
@@ -1706,9 +1708,11 @@ static void mt669Io(void)
                 activeChannel->data = cp->deviceStatus[wordNumber];
                 activeChannel->full = TRUE;
                 activeDevice->recordLength -= 1;
-#if DEBUG
-                fprintf(mt669Log, " %04o", activeChannel->data);
-#endif
+                if (LogOn(LogMt669))
+                    {
+                    logPrintf(LogMt669, " %04o", activeChannel->data);
+                    }
+
                 if (activeDevice->recordLength == 0)
                     {
                     /*
@@ -1717,7 +1721,7 @@ static void mt669Io(void)
                     */
                     activeDevice->fcode = 0;
                     activeChannel->discAfterInput = TRUE;
-                    activeChannel->delayDisconnect = 50;
+                    channelDelayDisconnect(50);
                     }
                 else
                     {
@@ -1725,7 +1729,7 @@ static void mt669Io(void)
                     **  Force a disconnect if the PP didn't read the status for too many cycles.
                     **  This is needed for SMM/KRONOS which expect only one status word.
                     */
-                    activeChannel->delayDisconnect = 50;
+                    channelDelayDisconnect(50);
                     }
                 }
             }
@@ -1741,9 +1745,11 @@ static void mt669Io(void)
                 activeChannel->data = cp->deviceStatus[wordNumber];
                 activeChannel->full = TRUE;
                 activeDevice->recordLength -= 1;
-#if DEBUG
-                fprintf(mt669Log, " %04o", activeChannel->data);
-#endif
+                if (LogOn(LogMt669))
+                    {
+                    logPrintf(LogMt669, " %04o", activeChannel->data);
+                    }
+
                 if (activeDevice->recordLength == 0)
                     {
                     /*
@@ -1776,9 +1782,10 @@ static void mt669Io(void)
                     }
 
                 activeChannel->full = TRUE;
-#if DEBUG
-                fprintf(mt669Log, " %04o", activeChannel->data);
-#endif
+                if (LogOn(LogMt669))
+                    {
+                    logPrintf(LogMt669, " %04o", activeChannel->data);
+                    }
                 }
             }
 
@@ -1789,9 +1796,11 @@ static void mt669Io(void)
             {
             if (activeChannel->full)
                 {
-#if DEBUG
-                fprintf(mt669Log, " %04o", activeChannel->data);
-#endif
+                if (LogOn(LogMt669))
+                    {
+                    logPrintf(LogMt669, " %04o", activeChannel->data);
+                    }
+
                 /*
                 **  Ignore the possibility of the alternate meaning when bit 8
                 **  is clear as it is never used.
@@ -1825,7 +1834,7 @@ static void mt669Io(void)
 **------------------------------------------------------------------------*/
 static void mt669Activate(void)
     {
-    activeChannel->delayStatus = 5;
+    channelDelayStatus(5);
     }
 
 /*--------------------------------------------------------------------------
@@ -1838,11 +1847,11 @@ static void mt669Activate(void)
 **------------------------------------------------------------------------*/
 static void mt669Disconnect(void)
     {
+    u64 start;
     CtrlParam *cp = activeDevice->controllerContext;
     FILE *fcb;
     TapeParam *tp;
     i8 unitNo;
-    u32 i;
     u32 recLen0;
     u32 recLen1;
     u32 recLen2;
@@ -1854,7 +1863,7 @@ static void mt669Disconnect(void)
     /*
     **  Abort pending device disconnects - the PP is doing the disconnect.
     */
-    activeChannel->delayDisconnect = 0;
+    channelDelayDisconnect(0);
     activeChannel->discAfterInput = FALSE;
 
     /*
@@ -1890,13 +1899,7 @@ static void mt669Disconnect(void)
         /*
         **  No conversion, just unpack.
         */
-        for (i = 0; i < recLen2; i += 2)
-            {
-            *rp++ = ((ip[0] >> 4) & 0xFF);
-            *rp++ = ((ip[0] << 4) & 0xF0) | ((ip[1] >> 8) & 0x0F);
-            *rp++ = ((ip[1] >> 0) & 0xFF);
-            ip += 2;
-            }
+        packWordsToBytes(ip, recLen2, rp);
 
         /*
         **  Now implement the Mode 1 Write table on page B-6 of the
@@ -1937,14 +1940,7 @@ static void mt669Disconnect(void)
         */
         writeConv = cp->writeConv[tp->selectedConversion - 1];
 
-        for (i = 0; i < recLen2; i++)
-             {
-             *rp++ = writeConv[(*ip >> 6) & 077];
-             *rp++ = writeConv[(*ip >> 0) & 077];
-             ip += 1;
-             }
-
-        recLen0 = rp - rawBuffer;
+        recLen0 = packConvWordsToBytes(ip, recLen2, rp, writeConv);
         if (oddFrameCount)
             {
             recLen0 -= 1;
@@ -1972,9 +1968,11 @@ static void mt669Disconnect(void)
     /*
     **  Write the TAP record.
     */
+    start = statsClock();
     fwrite(&recLen1, sizeof(recLen1), 1, fcb);
     fwrite(&rawBuffer, 1, recLen0, fcb);
     fwrite(&recLen1, sizeof(recLen1), 1, fcb);
+    statsHostIo(&activeDevice->stats, recLen0, start);
 
     /*
     **  The following fseek prepares for any subsequent fread.
@@ -2006,11 +2004,10 @@ static void mt669PackAndConvert(u32 recLen)
     i8 unitNo = activeDevice->selectedUnit;
     TapeParam *tp = activeDevice->context[unitNo];
     CtrlParam *cp = activeDevice->controllerContext;
-    u32 i;
-    u16 c1, c2, c3;
     u16 *op;
     u8 *rp;
     u8 *readConv;
+    bool flagged;
 
     /*
     **  Determine odd count setting.
@@ -2044,15 +2041,7 @@ static void mt669PackAndConvert(u32 recLen)
         /*
         **  Convert the raw data into PP Word data.
         */
-        for (i = 0; i < recLen; i += 3)
-            {
-            c1 = *rp++;
-            c2 = *rp++;
-            c3 = *rp++;
-
-            *op++ = ((c1 << 4) | (c2 >> 4)) & Mask12;
-            *op++ = ((c2 << 8) | (c3 >> 0)) & Mask12;
-            }
+        op += packBytesToWords(rp, recLen, op);
 
         /*
         **  Now calculate the number of PP words taking into account the
@@ -2075,30 +2064,17 @@ static void mt669PackAndConvert(u32 recLen)
         **  Convert the Raw data to appropriate character set.
         */
         readConv = cp->readConv[tp->selectedConversion - 1];
-        for (i = 0; i < recLen; i++)
+        flagged = FALSE;
+        activeDevice->recordLength = (PpWord)packConvBytesToWords(rp, recLen, op, readConv, &flagged);
+        if (flagged)
             {
-            c1 = readConv[*rp++];
-            if ((c1 & (1 << 6)) != 0)
-                {
-                /*
-                **  Indicate illegal character.
-                */
-                tp->alert = TRUE;
-                tp->flagBitDetected = TRUE;
-                }
-
-            if ((i & 1) == 0)
-                {
-                *op = (c1 & Mask6) << 6;
-                }
-            else
-                {
-                *op++ |= c1 & Mask6;
-                }
+            /*
+            **  Indicate illegal character.
+            */
+            tp->alert = TRUE;
+            tp->flagBitDetected = TRUE;
             }
 
-        activeDevice->recordLength = op - tp->ioBuffer;
-
         if (tp->oddCount) 
             {
             activeDevice->recordLength += 1;
@@ -2117,6 +2093,7 @@ static void mt669PackAndConvert(u32 recLen)
 **------------------------------------------------------------------------*/
 static void mt669FuncRead(void)
     {
+    u64 start;
     u32 len;
     u32 recLen0;
     u32 recLen1;
@@ -2151,9 +2128,10 @@ static void mt669FuncRead(void)
             {
 //            tp->endOfTape = TRUE;
             tp->fileMark = TRUE;
-#if DEBUG
-            fprintf(mt669Log, "TAP is at EOF (simulate tape mark)\n");
-#endif
+            if (LogOn(LogMt669))
+                {
+                logPrintf(LogMt669, "TAP is at EOF (simulate tape mark)\n");
+                }
             }
 
         return;
@@ -2190,16 +2168,20 @@ static void mt669FuncRead(void)
         tp->fileMark = TRUE;
         tp->blockNo += 1;
 
-#if DEBUG
-        fprintf(mt669Log, "Tape mark\n");
-#endif
+        if (LogOn(LogMt669))
+            {
+            logPrintf(LogMt669, "Tape mark\n");
+            }
+
         return;
         }
 
     /*
     **  Read and verify the actual raw data.
     */
+    start = statsClock();
     len = fread(rawBuffer, 1, recLen1, activeDevice->fcb[unitNo]);
+    statsHostIo(&activeDevice->stats, len, start);
 
     if (recLen1 != (u32)len)
         {
@@ -2258,9 +2240,10 @@ static void mt669FuncRead(void)
     /*
     **  Setup length, buffer pointer and block number.
     */
-#if DEBUG
-    fprintf(mt669Log, "Read fwd %d PP words (%d 8-bit bytes)\n", activeDevice->recordLength, recLen1);
-#endif
+    if (LogOn(LogMt669))
+        {
+        logPrintf(LogMt669, "Read fwd %d PP words (%d 8-bit bytes)\n", activeDevice->recordLength, recLen1);
+        }
 
     tp->frameCount = (PpWord)recLen1;
     tp->recordLength = activeDevice->recordLength;
@@ -2278,6 +2261,7 @@ static void mt669FuncRead(void)
 **------------------------------------------------------------------------*/
 static void mt669FuncReadBkw(void)
     {
+    u64 start;
     u32 len;
     u32 recLen0;
     u32 recLen1;
@@ -2386,7 +2370,9 @@ static void mt669FuncReadBkw(void)
         /*
         **  Read and verify the actual raw data.
         */
+        start = statsClock();
         len = fread(rawBuffer, 1, recLen1, activeDevice->fcb[unitNo]);
+        statsHostIo(&activeDevice->stats, len, start);
 
         if (recLen1 != (u32)len)
             {
@@ -2409,9 +2395,10 @@ static void mt669FuncReadBkw(void)
         /*
         **  Setup length and buffer pointer.
         */
-#if DEBUG
-        fprintf(mt669Log, "Read bkwd %d PP words (%d 8-bit bytes)\n", activeDevice->recordLength, recLen1);
-#endif
+        if (LogOn(LogMt669))
+            {
+            logPrintf(LogMt669, "Read bkwd %d PP words (%d 8-bit bytes)\n", activeDevice->recordLength, recLen1);
+            }
 
         tp->frameCount = (PpWord)recLen1;
         tp->recordLength = activeDevice->recordLength;
@@ -2424,9 +2411,10 @@ static void mt669FuncReadBkw(void)
         */
         tp->fileMark = TRUE;
 
-#if DEBUG
-        fprintf(mt669Log, "Tape mark\n");
-#endif
+        if (LogOn(LogMt669))
+            {
+            logPrintf(LogMt669, "Tape mark\n");
+            }
         }
 
     /*
@@ -2484,9 +2472,10 @@ static void mt669FuncForespace(void)
             {
 //            tp->endOfTape = TRUE;
             tp->fileMark = TRUE;
-#if DEBUG
-            fprintf(mt669Log, "TAP is at EOF (simulate tape mark)\n");
-#endif
+            if (LogOn(LogMt669))
+                {
+                logPrintf(LogMt669, "TAP is at EOF (simulate tape mark)\n");
+                }
             }
 
         return;
@@ -2523,9 +2512,11 @@ static void mt669FuncForespace(void)
         tp->fileMark = TRUE;
         tp->blockNo += 1;
 
-#if DEBUG
-        fprintf(mt669Log, "Tape mark\n");
-#endif
+        if (LogOn(LogMt669))
+            {
+            logPrintf(LogMt669, "Tape mark\n");
+            }
+
         return;
         }
 
@@ -2707,9 +2698,10 @@ static void mt669FuncBackspace(void)
         */
         tp->fileMark = TRUE;
 
-#if DEBUG
-        fprintf(mt669Log, "Tape mark\n");
-#endif
+        if (LogOn(LogMt669))
+            {
+            logPrintf(LogMt669, "Tape mark\n");
+            }
         }
 
     /*
@@ -2738,7 +2730,6 @@ static void mt669FuncBackspace(void)
 static char *mt669Func2String(PpWord funcCode)
     {
     static char buf[30];
-#if DEBUG
     switch(funcCode)
         {
     case Fc669FormatUnit             : return "Fc669FormatUnit";
@@ -2821,7 +2812,6 @@ static char *mt669Func2String(PpWord funcCode)
     case Fc669MasterClear            : return "Fc669MasterClear";
     case Fc669ClearUnit              : return "Fc669ClearUnit";
         }
-#endif
     sprintf(buf, "UNKNOWN: %04o", funcCode);
     return(buf);
     }
@@ -24,8 +24,6 @@
 **--------------------------------------------------------------------------
 */
 
-#define DEBUG 0
-
 /*
 **  -------------
 **  Include Files
@@ -132,6 +130,7 @@
 #define MaxByteBuf              60000
 #define MaxPackedConvBuf        (((256 * 8) + 11) / 12)
 #define MaxTapeSize             1250000000   // this may need adjusting for shorter real tapes
+#define RewindTimeUs            1000
 
 
 /*
@@ -193,7 +192,7 @@ typedef struct tapeParam
     bool        flagBitDetected;
     bool        rewinding;
     bool        suppressBot;
-    u32         rewindStart;
+    TimerSlot   rewindTimer;
     u16         blockCrc;
     u8          errorCode;
 
@@ -211,6 +210,8 @@ typedef struct tapeParam
 */
 static void mt679ResetStatus(TapeParam *tp);
 static void mt679SetupStatus(TapeParam *tp);
+static void mt679RewindDone(void *param);
+static void mt679AttachTape(TapeMount *mp);
 static void mt679PackConversionTable(u8 *convTable);
 static void mt679UnpackConversionTable(u8 *convTable);
 static void mt679Unpack6BitTable(u8 *convTable);
@@ -241,10 +242,6 @@ static TapeParam *firstTape = NULL;
 static TapeParam *lastTape = NULL;
 static u8 rawBuffer[MaxByteBuf];
 
-#if DEBUG
-static FILE *mt679Log = NULL;
-#endif
-
 /*
 **--------------------------------------------------------------------------
 **
@@ -270,13 +267,6 @@ void mt679Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     FILE *fcb;
     TapeParam *tp;
 
-#if DEBUG
-    if (mt679Log == NULL)
-        {
-        mt679Log = fopen("mt679log.txt", "wt");
-        }
-#endif
-
     /*
     **  Attach device to channel.
     */
@@ -373,7 +363,7 @@ void mt679Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     if (deviceName != NULL)
         {
         strncpy(tp->fileName, deviceName, _MAX_PATH);
-        fcb = fopen(deviceName, "rb");
+        fcb = tapeOpen(deviceName, "rb");
         if (fcb == NULL)
             {
             fprintf(stderr, "Failed to open %s\n", deviceName);
@@ -458,7 +448,7 @@ void mt679LoadTape(char *params)
     int equipmentNo;
     int unitNo;
     TapeParam *tp;
-    FILE *fcb;
+    TapeMount mount;
     u8 unitMode;
 
     /*
@@ -521,53 +511,26 @@ void mt679LoadTape(char *params)
     /*
     **  Check if the unit has been unloaded.
     */
-    if (dp->fcb[unitNo] != NULL)
+    if (dp->fcb[unitNo] != NULL || tapeMountPending(dp, (u8)unitNo))
         {
         printf("Unit %d not unloaded\n", unitNo);
         return;
         }
 
     /*
-    **  Open the file in the requested mode.
-    */
-    if (unitMode == 'w')
-        {
-        fcb = fopen(str, "r+b");
-        if (fcb == NULL)
-            {
-            fcb = fopen(str, "w+b");
-            }
-        }
-    else
-        {
-        fcb = fopen(str, "rb");
-        }
-
-    dp->fcb[unitNo] = fcb;
-
-    /*
-    **  Check if the open succeeded.
+    **  Open the file in the background, the unit goes ready when it is
+    **  attached by mt679AttachTape.
     */
-    if (fcb == NULL)
+    memset(&mount, 0, sizeof(mount));
+    mount.dp = dp;
+    mount.unitNo = (u8)unitNo;
+    mount.ringIn = unitMode == 'w';
+    strncpy(mount.fileName, str, _MAX_PATH - 1);
+    mount.attach = mt679AttachTape;
+    if (tapeMount(&mount))
         {
-        printf("Failed to open %s\n", str);
-        return;
+        printf("Mounting %s\n", str);
         }
-
-    /*
-    **  Setup show_tape path name.
-    */
-    strncpy(tp->fileName, str, _MAX_PATH);
-
-    /*
-    **  Setup status.
-    */
-    mt679ResetStatus(tp);
-    tp->ringIn = unitMode == 'w';
-    tp->blockNo = 0;
-    tp->unitReady = TRUE;
-
-    printf("Successfully loaded %s\n", str);
     }
 
 /*--------------------------------------------------------------------------
@@ -645,7 +608,7 @@ void mt679UnloadTape(char *params)
     /*
     **  Close the file.
     */
-    fclose(dp->fcb[unitNo]);
+    tapeClose(dp->fcb[unitNo]);
     dp->fcb[unitNo] = NULL;
 
     /*
@@ -660,7 +623,7 @@ void mt679UnloadTape(char *params)
     tp->unitReady = FALSE;
     tp->ringIn = FALSE;
     tp->rewinding = FALSE;
-    tp->rewindStart = 0;
+    timerCancel(&tp->rewindTimer);
     tp->blockCrc = 0;
     tp->blockNo = 0;
 
@@ -776,11 +739,6 @@ static void mt679SetupStatus(TapeParam *tp)
         if (tp->rewinding)
             {
             tp->deviceStatus[1] |= St679Busy;
-            if (labs(cycles - tp->rewindStart) > 1000)
-                {
-                tp->rewinding = FALSE;
-                tp->blockNo = 0;
-                }
             }
         else
             {
@@ -879,6 +837,54 @@ static void mt679SetupStatus(TapeParam *tp)
         }
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Complete a rewind (timer expiry handler).
+**
+**  Parameters:     Name        Description.
+**                  param       pointer to tape parameters
+**
+**  Returns:        Nothing
+**
+**------------------------------------------------------------------------*/
+static void mt679RewindDone(void *param)
+    {
+    TapeParam *tp = param;
+
+    tp->rewinding = FALSE;
+    tp->blockNo = 0;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Attach a tape mounted by the tape mount thread.
+**
+**  Parameters:     Name        Description.
+**                  mp          pointer to mount request
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void mt679AttachTape(TapeMount *mp)
+    {
+    TapeParam *tp = (TapeParam *)mp->dp->context[mp->unitNo];
+
+    mp->dp->fcb[mp->unitNo] = mp->fcb;
+
+    /*
+    **  Setup show_tape path name.
+    */
+    strncpy(tp->fileName, mp->fileName, _MAX_PATH);
+
+    /*
+    **  Setup status.
+    */
+    mt679ResetStatus(tp);
+    tp->ringIn = mp->ringIn;
+    tp->blockNo = 0;
+    tp->unitReady = TRUE;
+
+    printf("Successfully loaded %s\n", mp->fileName);
+    }
+
 /*--------------------------------------------------------------------------
 **  Purpose:        Pack a conversion table into PP words.
 **
@@ -893,18 +899,10 @@ static void mt679PackConversionTable(u8 *convTable)
     CtrlParam *cp = activeDevice->controllerContext;
     PpWord *op = cp->packedConv;
     u8 *ip = convTable;
-    u16 c1, c2, c3;
-    int i;
-
-    for (i = 0; i < 85; i++)
-        {
-        c1 = *ip++;
-        c2 = *ip++;
-        c3 = *ip++;
+    u16 c1, c2;
 
-        *op++ = ((c1 << 4) | (c2 >> 4)) & Mask12;
-        *op++ = ((c2 << 8) | (c3 >> 0)) & Mask12;
-        }
+    op += packBytesToWords(ip, 255, op);
+    ip += 255;
 
     c1 = *ip++;
     c2 = *convTable;    // wrap
@@ -951,36 +949,30 @@ static void mt679UnpackConversionTable(u8 *convTable)
     CtrlParam *cp = activeDevice->controllerContext;
     PpWord *ip = cp->packedConv;
     u8 *op = convTable;
-    int i;
 
-    for (i = 0; i < 85; i++)
-        {
-        *op++ = ((ip[0] >> 4) & 0xFF);
-        *op++ = ((ip[0] << 4) & 0xF0) | ((ip[1] >> 8) & 0x0F);
-        *op++ = ((ip[1] >> 0) & 0xFF);
-        ip += 2;
-        }
+    op += packWordsToBytes(ip, 170, op);
+    ip += 170;
 
     *op++ = ((ip[0] >> 4) & 0xFF);    // discard last 4 bits
 
-#if DEBUG
-    {
-    int i;
-    fprintf(mt679Log, "\nConversion Table %d", cp->selectedConversion);
-
-    for (i = 0; i < 256; i++)
+    if (LogOn(LogMt679))
         {
-        if (i % 16 == 0)
+        int i;
+
+        logPrintf(LogMt679, "\nConversion Table %d", cp->selectedConversion);
+        for (i = 0; i < 256; i++)
             {
-            fprintf(mt679Log, "\n%02X :", i);
+            if (i % 16 == 0)
+                {
+                logPrintf(LogMt679, "\n%02X :", i);
+                }
+
+            logPrintf(LogMt679, " %02X", convTable[i]);
             }
 
-        fprintf(mt679Log, " %02X", convTable[i]);
+        logPrintf(LogMt679, "\n");
         }
     }
-    fprintf(mt679Log, "\n");
-#endif
-    }
 
 /*--------------------------------------------------------------------------
 **  Purpose:        Unpack PP words into a conversion table.
@@ -1005,24 +997,24 @@ static void mt679Unpack6BitTable(u8 *convTable)
         ip += 1;
         }
 
-#if DEBUG
-    {
-    int i;
-    fprintf(mt679Log, "\nConversion Table %d", cp->selectedConversion);
-
-    for (i = 0; i < 256; i++)
+    if (LogOn(LogMt679))
         {
-        if (i % 16 == 0)
+        int i;
+
+        logPrintf(LogMt679, "\nConversion Table %d", cp->selectedConversion);
+        for (i = 0; i < 256; i++)
             {
-            fprintf(mt679Log, "\n%02X :", i);
+            if (i % 16 == 0)
+                {
+                logPrintf(LogMt679, "\n%02X :", i);
+                }
+
+            logPrintf(LogMt679, " %02X", convTable[i]);
             }
 
-        fprintf(mt679Log, " %02X", convTable[i]);
+        logPrintf(LogMt679, "\n");
         }
     }
-    fprintf(mt679Log, "\n");
-#endif
-    }
 
 /*--------------------------------------------------------------------------
 **  Purpose:        Execute function code on 679 tape drives.
@@ -1051,15 +1043,16 @@ static FcStatus mt679Func(PpWord funcCode)
         tp = NULL;
         }
  
-#if DEBUG
-    fprintf(mt679Log, "\n%06d PP:%02o CH:%02o u:%d f:%04o T:%-25s  >   ",
-        traceSequenceNo,
-        activePpu->id,
-        activeDevice->channel->id,
-        unitNo, 
-        funcCode,
-        mt679Func2String(funcCode));
-#endif
+    if (LogOn(LogMt679))
+        {
+        logPrintf(LogMt679, "\n%06d PP:%02o CH:%02o u:%d f:%04o T:%-25s  >   ",
+            traceSequenceNo,
+            activePpu->id,
+            activeDevice->channel->id,
+            unitNo, 
+            funcCode,
+            mt679Func2String(funcCode));
+        }
 
     /*
     **  Reset function code.
@@ -1098,9 +1091,11 @@ static FcStatus mt679Func(PpWord funcCode)
     switch (funcCode)
         {
     default:
-#if DEBUG
-        fprintf(mt679Log, " FUNC not implemented & declined!");
-#endif
+        if (LogOn(LogMt679))
+            {
+            logPrintf(LogMt679, " FUNC not implemented & declined!");
+            }
+
         if (unitNo != -1)
             {
             tp->errorCode = EcIllegalFunction;
@@ -1150,7 +1145,7 @@ static FcStatus mt679Func(PpWord funcCode)
                 if (!tp->rewinding)
                     {
                     tp->rewinding = TRUE;
-                    tp->rewindStart = cycles;
+                    timerStart(&tp->rewindTimer, RewindTimeUs, mt679RewindDone, tp);
                     }
                 }
             }
@@ -1163,7 +1158,7 @@ static FcStatus mt679Func(PpWord funcCode)
             tp->blockNo = 0;
             tp->unitReady = FALSE;
             tp->ringIn = FALSE;
-            fclose(activeDevice->fcb[unitNo]);
+            tapeClose(activeDevice->fcb[unitNo]);
             activeDevice->fcb[unitNo] = NULL;
             }
         return(FcProcessed);
@@ -1459,9 +1454,11 @@ static FcStatus mt679Func(PpWord funcCode)
     case Fc679MeasureStartTFwd:
     case Fc679SetTransferCheckCh:
     case Fc679SetLoopWTRTcu:
-#if DEBUG
-        fprintf(mt679Log, "maintenance functions not implemented");
-#endif
+        if (LogOn(LogMt679))
+            {
+            logPrintf(LogMt679, "maintenance functions not implemented");
+            }
+
         return(FcProcessed);
 
     case Fc679SetLoopWTR1TU:
@@ -1475,9 +1472,11 @@ static FcStatus mt679Func(PpWord funcCode)
     case Fc679SetEvenWrParity:
     case Fc679SetEvenChParity:
     case Fc679ForceDataErrors:
-#if DEBUG
-        fprintf(mt679Log, "maintenance functions not implemented");
-#endif
+        if (LogOn(LogMt679))
+            {
+            logPrintf(LogMt679, "maintenance functions not implemented");
+            }
+
         return(FcProcessed);
 
     case Fc679MasterClear:
@@ -1511,12 +1510,12 @@ static void mt679Io(void)
     **  to monitor the progress of a transfer (used by 1MT and 1LT to
     **  coordinate the transfer of a large tape record).
     */
-    if (activeChannel->delayStatus != 0)
+    if (activeChannel->delayStatus.pending)
         {
         return;
         }
 
-    activeChannel->delayStatus = 3;
+    channelDelayStatus(3);
 
     /*
     **  Setup selected unit context.
@@ -1548,9 +1547,10 @@ static void mt679Io(void)
                 {
                 wordNumber = 4 - activeDevice->recordLength;
 
-#if DEBUG
-                fprintf(mt679Log, " %04o", activeChannel->data);
-#endif
+                if (LogOn(LogMt679))
+                    {
+                    logPrintf(LogMt679, " %04o", activeChannel->data);
+                    }
 
                 if (wordNumber == 1)
                     {
@@ -1642,9 +1642,10 @@ static void mt679Io(void)
                     }
 
                 activeChannel->full = TRUE;
-#if DEBUG
-                fprintf(mt679Log, " %04o", activeChannel->data);
-#endif
+                if (LogOn(LogMt679))
+                    {
+                    logPrintf(LogMt679, " %04o", activeChannel->data);
+                    }
                 }
             }
         break;
@@ -1658,7 +1659,7 @@ static void mt679Io(void)
         if (tp->recordLength == 0)
             {
             activeChannel->active = FALSE;
-            activeChannel->delayDisconnect = 0;
+            channelDelayDisconnect(0);
             }
 
         if (tp->recordLength > 0)
@@ -1671,7 +1672,7 @@ static void mt679Io(void)
                 /*
                 **  It appears that NOS/BE relies on the disconnect to happen delayed.
                 */
-                activeChannel->delayDisconnect = 10;
+                channelDelayDisconnect(10);
                 }
             }
         break;
@@ -1708,16 +1709,19 @@ static void mt679Io(void)
 
         if (activeDevice->recordLength < MaxPackedConvBuf)
             {
-    #if DEBUG
-            if (activeDevice->recordLength % 8 == 0)
+            if (LogOn(LogMt679))
                 {
-                fprintf(mt679Log, "\n");
+                if (activeDevice->recordLength % 8 == 0)
+                    {
+                    logPrintf(LogMt679, "\n");
+                    }
                 }
-    #endif
+
             activeChannel->data = cp->packedConv[activeDevice->recordLength++];
-    #if DEBUG
-            fprintf(mt679Log, " %04o", activeChannel->data);
-    #endif
+            if (LogOn(LogMt679))
+                {
+                logPrintf(LogMt679, " %04o", activeChannel->data);
+                }
             }
         else
             {
@@ -1748,13 +1752,15 @@ static void mt679Io(void)
 
         if (activeDevice->recordLength < MaxPackedConvBuf)
             {
-#if DEBUG
-            fprintf(mt679Log, " %04o", activeChannel->data);
-            if (activeDevice->recordLength % 8 == 0)
+            if (LogOn(LogMt679))
                 {
-                fprintf(mt679Log, "\n");
+                logPrintf(LogMt679, " %04o", activeChannel->data);
+                if (activeDevice->recordLength % 8 == 0)
+                    {
+                    logPrintf(LogMt679, "\n");
+                    }
                 }
-#endif
+
             cp->packedConv[activeDevice->recordLength++] = activeChannel->data;   // <<<<<<<<<<<<<<< add wrapping.
             }      
         break;
@@ -1771,14 +1777,15 @@ static void mt679Io(void)
 **------------------------------------------------------------------------*/
 static void mt679Activate(void)
     {
-#if DEBUG
-    CtrlParam *cp = activeDevice->controllerContext;
-    fprintf(mt679Log, "\n%06d PP:%02o CH:%02o Activate",
-        traceSequenceNo,
-        activePpu->id,
-        activeDevice->channel->id);
-#endif
-    activeChannel->delayStatus = 5;
+    if (LogOn(LogMt679))
+        {
+        logPrintf(LogMt679, "\n%06d PP:%02o CH:%02o Activate",
+            traceSequenceNo,
+            activePpu->id,
+            activeDevice->channel->id);
+        }
+
+    channelDelayStatus(5);
     }
 
 /*--------------------------------------------------------------------------
@@ -1793,17 +1800,18 @@ static void mt679Disconnect(void)
     {
     CtrlParam *cp = activeDevice->controllerContext;
 
-#if DEBUG
-    fprintf(mt679Log, "\n%06d PP:%02o CH:%02o Disconnect",
-        traceSequenceNo,
-        activePpu->id,
-        activeDevice->channel->id);
-#endif
+    if (LogOn(LogMt679))
+        {
+        logPrintf(LogMt679, "\n%06d PP:%02o CH:%02o Disconnect",
+            traceSequenceNo,
+            activePpu->id,
+            activeDevice->channel->id);
+        }
 
     /*
     **  Abort pending device disconnects - the PP is doing the disconnect.
     */
-    activeChannel->delayDisconnect = 0;
+    channelDelayDisconnect(0);
     activeChannel->discAfterInput = FALSE;
 
     /*
@@ -1858,11 +1866,11 @@ static void mt679Disconnect(void)
 **------------------------------------------------------------------------*/
 static void mt679FlushWrite(void)
     {
+    u64 start;
     CtrlParam *cp = activeDevice->controllerContext;
     FILE *fcb;
     TapeParam *tp;
     i8 unitNo;
-    u32 i;
     u32 recLen0;
     u32 recLen1;
     u32 recLen2;
@@ -1899,13 +1907,7 @@ static void mt679FlushWrite(void)
         /*
         **  No conversion, just unpack.
         */
-        for (i = 0; i < recLen2; i += 2)
-            {
-            *rp++ = ((ip[0] >> 4) & 0xFF);
-            *rp++ = ((ip[0] << 4) & 0xF0) | ((ip[1] >> 8) & 0x0F);
-            *rp++ = ((ip[1] >> 0) & 0xFF);
-            ip += 2;
-            }
+        rp += packWordsToBytes(ip, recLen2, rp);
 
         recLen0 = rp - rawBuffer;
 
@@ -1928,14 +1930,7 @@ static void mt679FlushWrite(void)
         */
         writeConv = cp->writeConv[cp->selectedConversion - 1];
 
-        for (i = 0; i < recLen2; i++)
-             {
-             *rp++ = writeConv[(*ip >> 6) & 077];
-             *rp++ = writeConv[(*ip >> 0) & 077];
-             ip += 1;
-             }
-
-        recLen0 = rp - rawBuffer;
+        recLen0 = packConvWordsToBytes(ip, recLen2, rp, writeConv);
         if (cp->oddFrameCount)
             {
             recLen0 -= 1;
@@ -1963,9 +1958,11 @@ static void mt679FlushWrite(void)
     /*
     **  Write the TAP record.
     */
+    start = statsClock();
     fwrite(&recLen1, sizeof(recLen1), 1, fcb);
     fwrite(&rawBuffer, 1, recLen0, fcb);
     fwrite(&recLen1, sizeof(recLen1), 1, fcb);
+    statsHostIo(&activeDevice->stats, recLen0, start);
 
     /*
     **  The following fseek prepares for any subsequent fread.
@@ -1993,11 +1990,10 @@ static void mt679PackAndConvert(u32 recLen)
     i8 unitNo = activeDevice->selectedUnit;
     TapeParam *tp = activeDevice->context[unitNo];
     CtrlParam *cp = activeDevice->controllerContext;
-    u32 i;
-    u16 c1, c2, c3;
     u16 *op;
     u8 *rp;
     u8 *readConv;
+    bool flagged;
 
     /*
     **  Convert the raw data into PP words suitable for a channel.
@@ -2020,15 +2016,7 @@ static void mt679PackAndConvert(u32 recLen)
         /*
         **  Convert the raw data into PP Word data.
         */
-        for (i = 0; i < recLen; i += 3)
-            {
-            c1 = *rp++;
-            c2 = *rp++;
-            c3 = *rp++;
-
-            *op++ = ((c1 << 4) | (c2 >> 4)) & Mask12;
-            *op++ = ((c2 << 8) | (c3 >> 0)) & Mask12;
-            }
+        op += packBytesToWords(rp, recLen, op);
 
         activeDevice->recordLength = op - tp->ioBuffer;
 
@@ -2055,30 +2043,17 @@ static void mt679PackAndConvert(u32 recLen)
         **  Convert the Raw data to appropriate character set.
         */
         readConv = cp->readConv[cp->selectedConversion - 1];
-        for (i = 0; i < recLen; i++)
+        flagged = FALSE;
+        activeDevice->recordLength = (PpWord)packConvBytesToWords(rp, recLen, op, readConv, &flagged);
+        if (flagged)
             {
-            c1 = readConv[*rp++];
-            if ((c1 & (1 << 6)) != 0)
-                {
-                /*
-                **  Indicate illegal character.
-                */
-                tp->alert = TRUE;
-                tp->flagBitDetected = TRUE;
-                }
-
-            if ((i & 1) == 0)
-                {
-                *op = (c1 & Mask6) << 6;
-                }
-            else
-                {
-                *op++ |= c1 & Mask6;
-                }
+            /*
+            **  Indicate illegal character.
+            */
+            tp->alert = TRUE;
+            tp->flagBitDetected = TRUE;
             }
 
-        activeDevice->recordLength = op - tp->ioBuffer;
-
         if ((recLen % 2) != 0) 
             {
             activeDevice->recordLength += 1;
@@ -2098,6 +2073,7 @@ static void mt679PackAndConvert(u32 recLen)
 **------------------------------------------------------------------------*/
 static void mt679FuncRead(void)
     {
+    u64 start;
     u32 len;
     u32 recLen0;
     u32 recLen1;
@@ -2132,9 +2108,10 @@ static void mt679FuncRead(void)
             {
 //            tp->endOfTape = TRUE;
             tp->fileMark = TRUE;
-#if DEBUG
-            fprintf(mt679Log, "TAP is at EOF (simulate tape mark)\n");
-#endif
+            if (LogOn(LogMt679))
+                {
+                logPrintf(LogMt679, "TAP is at EOF (simulate tape mark)\n");
+                }
             }
 
         return;
@@ -2171,16 +2148,20 @@ static void mt679FuncRead(void)
         tp->fileMark = TRUE;
         tp->blockNo += 1;
 
-#if DEBUG
-        fprintf(mt679Log, "Tape mark\n");
-#endif
+        if (LogOn(LogMt679))
+            {
+            logPrintf(LogMt679, "Tape mark\n");
+            }
+
         return;
         }
 
     /*
     **  Read and verify the actual raw data.
     */
+    start = statsClock();
     len = fread(rawBuffer, 1, recLen1, activeDevice->fcb[unitNo]);
+    statsHostIo(&activeDevice->stats, len, start);
 
     if (recLen1 != (u32)len)
         {
@@ -2239,9 +2220,10 @@ static void mt679FuncRead(void)
     /*
     **  Setup length, buffer pointer and block number.
     */
-#if DEBUG
-    fprintf(mt679Log, "Read fwd %d PP words (%d 8-bit bytes)\n", activeDevice->recordLength, recLen1);
-#endif
+    if (LogOn(LogMt679))
+        {
+        logPrintf(LogMt679, "Read fwd %d PP words (%d 8-bit bytes)\n", activeDevice->recordLength, recLen1);
+        }
 
     tp->recordLength = activeDevice->recordLength;
     tp->bp = tp->ioBuffer;
@@ -2258,6 +2240,7 @@ static void mt679FuncRead(void)
 **------------------------------------------------------------------------*/
 static void mt679FuncReadBkw(void)
     {
+    u64 start;
     u32 len;
     u32 recLen0;
     u32 recLen1;
@@ -2366,7 +2349,9 @@ static void mt679FuncReadBkw(void)
         /*
         **  Read and verify the actual raw data.
         */
+        start = statsClock();
         len = fread(rawBuffer, 1, recLen1, activeDevice->fcb[unitNo]);
+        statsHostIo(&activeDevice->stats, len, start);
 
         if (recLen1 != (u32)len)
             {
@@ -2389,9 +2374,10 @@ static void mt679FuncReadBkw(void)
         /*
         **  Setup length and buffer pointer.
         */
-#if DEBUG
-        fprintf(mt679Log, "Read bkwd %d bytes\n", activeDevice->recordLength);
-#endif
+        if (LogOn(LogMt679))
+            {
+            logPrintf(LogMt679, "Read bkwd %d bytes\n", activeDevice->recordLength);
+            }
 
         tp->recordLength = activeDevice->recordLength;
         tp->bp = tp->ioBuffer + tp->recordLength - 1;
@@ -2403,9 +2389,10 @@ static void mt679FuncReadBkw(void)
         */
         tp->fileMark = TRUE;
 
-#if DEBUG
-        fprintf(mt679Log, "Tape mark\n");
-#endif
+        if (LogOn(LogMt679))
+            {
+            logPrintf(LogMt679, "Tape mark\n");
+            }
         }
 
     /*
@@ -2463,9 +2450,10 @@ static void mt679FuncForespace(void)
             {
 //            tp->endOfTape = TRUE;
             tp->fileMark = TRUE;
-#if DEBUG
-            fprintf(mt679Log, "TAP is at EOF (simulate tape mark)\n");
-#endif
+            if (LogOn(LogMt679))
+                {
+                logPrintf(LogMt679, "TAP is at EOF (simulate tape mark)\n");
+                }
             }
 
         return;
@@ -2502,9 +2490,11 @@ static void mt679FuncForespace(void)
         tp->fileMark = TRUE;
         tp->blockNo += 1;
 
-#if DEBUG
-        fprintf(mt679Log, "Tape mark\n");
-#endif
+        if (LogOn(LogMt679))
+            {
+            logPrintf(LogMt679, "Tape mark\n");
+            }
+
         return;
         }
 
@@ -2686,9 +2676,10 @@ static void mt679FuncBackspace(void)
         */
         tp->fileMark = TRUE;
 
-#if DEBUG
-        fprintf(mt679Log, "Tape mark\n");
-#endif
+        if (LogOn(LogMt679))
+            {
+            logPrintf(LogMt679, "Tape mark\n");
+            }
         }
 
     /*
@@ -2717,7 +2708,6 @@ static void mt679FuncBackspace(void)
 static char *mt679Func2String(PpWord funcCode)
     {
     static char buf[30];
-#if DEBUG
     switch(funcCode)
         {
     case Fc679ClearUnit               : return "ClearUnit";
@@ -2814,7 +2804,6 @@ static char *mt679Func2String(PpWord funcCode)
     case Fc679ForceDataErrors         : return "ForceDataErrors";
     case Fc679MasterClear             : return "MasterClear";
         }
-#endif
     sprintf(buf, "UNKNOWN: %04o", funcCode);
     return(buf);
     }
@@ -79,6 +79,34 @@
 #define SfcResp         (1 << 6)    // Normal response
 #define SfcErr          (2 << 6)    // Abnormal response
                         
+/*
+**  Primary Service Message function codes.
+*/
+#define PfcREG          0x1     // logical link regulation 
+#define PfcICN          0x2     // initiate connection     
+#define PfcTCN          0x3     // terminate connection    
+#define PfcCHC          0x4     // change terminal characteristics
+#define PfcNPU          0xA     // initialize npu          
+#define PfcSUP          0xE     // initiate supervision    
+#define PfcCNF          0xF     // configure terminal      
+#define PfcENB          0x10    // enable command(s)       
+#define PfcDIB          0x11    // disable command(s)      
+#define PfcNPS          0x12    // npu status request      
+#define PfcLLS          0x13    // ll status request       
+#define PfcLIS          0x14    // line status request     
+#define PfcTES          0x15    // term status request     
+#define PfcTRS          0x16    // trunk status request    
+#define PfcCPS          0x17    // coupler status request  
+#define PfcVCS          0x18    // svc status request       
+#define PfcSTU          0x19    // unsolicated statuses    
+#define PfcSTI          0x1A    // statistics              
+#define PfcMSG          0x1B    // message(s)             
+#define PfcLOG          0x1C    // error log entry         
+#define PfcALM          0x1D    // operator alarm          
+#define PfcNPI          0x1E    // reload npu               
+#define PfcCDI          0x1F    // count(s)                
+#define PfcOLD          0x20    // on-line diagnostics     
+
 /*                      
 **  TIP types           
 */                      
@@ -376,8 +404,7 @@ typedef struct tcb
     u8                  *inBufPtr;
     u8                  *inBufStart;
 
-    bool                xInputTimerRunning;
-    u32                 xStartCycle;
+    TimerSlot           xInputTimer;
 
     /*
     **  Output state.
@@ -387,6 +414,12 @@ typedef struct tcb
     bool                dbcNoEchoplex;
     bool                dbcNoCursorPos;
     bool                lastOpWasInput;
+
+    /*
+    **  Statistics.
+    */
+    u32                 bytesIn;
+    u32                 bytesOut;
     } Tcb;
 
 /*
@@ -421,6 +454,7 @@ void npuBipNotifyDownlineReceived(void);
 void npuBipAbortDownlineReceived(void);
 void npuBipRequestUplineTransfer(NpuBuffer *bp);
 void npuBipRequestUplineCanned(u8 *msg, int msgSize);
+bool npuBipUplineBusy(u8 cn);
 void npuBipNotifyUplineSent(void);
 
 /*
@@ -460,6 +494,7 @@ void npuNetDisconnected(Tcb *tp);
 void npuNetSend(Tcb *tp, u8 *data, int len);
 void npuNetQueueAck(Tcb *tp, u8 blockSeqNo);
 void npuNetCheckStatus(void);
+int npuNetPrintableRun(u8 *data, int len);
 
 /*
 **  npu_async.c
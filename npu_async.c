@@ -44,12 +44,14 @@
 **  -----------------
 */
 #define MaxIvtData          100
+#define XInputTimeoutUs     200000
 
 /*
 **  -----------------------
 **  Private Macro Functions
 **  -----------------------
 */
+#define IsPlain(ch)         ((ch) >= 0x20 && (ch) <= 0x7E)
 
 /*
 **  -----------------------------------------
@@ -68,6 +70,8 @@ static void npuAsyncProcessUplineTransparent(Tcb *tp);
 static void npuAsyncProcessUplineAscii(Tcb *tp);
 static void npuAsyncProcessUplineSpecial(Tcb *tp);
 static void npuAsyncProcessUplineNormal(Tcb *tp);
+static int npuAsyncStorePlain(Tcb *tp, u8 *dp, int len);
+static void npuAsyncXInputTimeout(void *param);
 
 /*
 **  ----------------
@@ -289,7 +293,7 @@ void npuAsyncFlushUplineTransparent(Tcb *tp)
     tp->inBuf[BlkOffDbc] = DbcTransparent;
     npuBipRequestUplineCanned(tp->inBuf, tp->inBufPtr - tp->inBuf);
     npuTipInputReset(tp);
-    tp->xInputTimerRunning = FALSE;
+    timerCancel(&tp->xInputTimer);
     }
 
 /*
@@ -440,7 +444,7 @@ static void npuAsyncProcessUplineTransparent(Tcb *tp)
     /*
     **  Cancel transparent input forwarding timeout.
     */
-    tp->xInputTimerRunning = FALSE;
+    timerCancel(&tp->xInputTimer);
 
     /*
     **  Process transparent input.
@@ -507,8 +511,26 @@ static void npuAsyncProcessUplineTransparent(Tcb *tp)
     */
     if (tp->params.fvXTimeout && tp->inBufStart != tp->inBufPtr)
         {
-        tp->xStartCycle = cycles;
-        tp->xInputTimerRunning = TRUE;
+        timerStart(&tp->xInputTimer, XInputTimeoutUs, npuAsyncXInputTimeout, tp);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Handle transparent input forwarding timeout.
+**
+**  Parameters:     Name        Description.
+**                  param       TCB pointer
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void npuAsyncXInputTimeout(void *param)
+    {
+    Tcb *tp = param;
+
+    if (tp->state != StTermIdle)
+        {
+        npuAsyncFlushUplineTransparent(tp);
         }
     }
 
@@ -525,6 +547,7 @@ static void npuAsyncProcessUplineAscii(Tcb *tp)
     {
     u8 *dp;
     int len;
+    int plain;
     u8 ch;
 
     dp = tp->inputData;
@@ -535,8 +558,20 @@ static void npuAsyncProcessUplineAscii(Tcb *tp)
     */
     tp->inBuf[BlkOffDbc] = 0;   // non-transparent data
 
-    while (len--)
+    while (len > 0)
         {
+        /*
+        **  Store runs of plain characters in one go.
+        */
+        plain = npuAsyncStorePlain(tp, dp, len);
+        if (plain > 0)
+            {
+            dp += plain;
+            len -= plain;
+            continue;
+            }
+
+        len -= 1;
         ch = *dp++ & Mask7;
 
         /*
@@ -678,6 +713,7 @@ static void npuAsyncProcessUplineSpecial(Tcb *tp)
     {
     u8 *dp;
     int len;
+    int plain;
     u8 ch;
     int i;
     int cnt;
@@ -690,8 +726,20 @@ static void npuAsyncProcessUplineSpecial(Tcb *tp)
     */
     tp->inBuf[BlkOffDbc] = 0;   // non-transparent data
 
-    while (len--)
+    while (len > 0)
         {
+        /*
+        **  Store runs of plain characters in one go.
+        */
+        plain = npuAsyncStorePlain(tp, dp, len);
+        if (plain > 0)
+            {
+            dp += plain;
+            len -= plain;
+            continue;
+            }
+
+        len -= 1;
         ch = *dp++ & Mask7;
 
         /*
@@ -903,6 +951,7 @@ static void npuAsyncProcessUplineNormal(Tcb *tp)
     {
     u8 *dp;
     int len;
+    int plain;
     u8 ch;
     int i;
     int cnt;
@@ -915,8 +964,20 @@ static void npuAsyncProcessUplineNormal(Tcb *tp)
     */
     tp->inBuf[BlkOffDbc] = 0;   // non-transparent data
 
-    while (len--)
+    while (len > 0)
         {
+        /*
+        **  Store runs of plain characters in one go.
+        */
+        plain = npuAsyncStorePlain(tp, dp, len);
+        if (plain > 0)
+            {
+            dp += plain;
+            len -= plain;
+            continue;
+            }
+
+        len -= 1;
         ch = *dp++ & Mask7;
 
         /*
@@ -1127,4 +1188,58 @@ static void npuAsyncProcessUplineNormal(Tcb *tp)
         }
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Store a run of plain printable characters which need
+**                  no editing, echoing them if required.
+**
+**  Parameters:     Name        Description.
+**                  tp          TCB pointer
+**                  dp          input data
+**                  len         input length
+**
+**  Returns:        Number of characters stored.
+**
+**------------------------------------------------------------------------*/
+static int npuAsyncStorePlain(Tcb *tp, u8 *dp, int len)
+    {
+    TipParams *pp = &tp->params;
+    int room;
+    int run;
+
+    /*
+    **  Printable editing characters must be seen one at a time.
+    */
+    if (   IsPlain(pp->fvCN) || IsPlain(pp->fvEOL) || IsPlain(pp->fvBS)
+        || IsPlain(pp->fvUserBreak1) || IsPlain(pp->fvUserBreak2))
+        {
+        return(0);
+        }
+
+    /*
+    **  Leave the character which completes a block to the caller.
+    */
+    room = pp->fvBlockFactor * MaxIvtData - (tp->inBufPtr - tp->inBufStart) - 1;
+    if (len > room)
+        {
+        len = room;
+        }
+
+    if (len <= 0)
+        {
+        return(0);
+        }
+
+    run = npuNetPrintableRun(dp, len);
+    memcpy(tp->inBufPtr, dp, run);
+    tp->inBufPtr += run;
+
+    if (pp->fvEchoplex)
+        {
+        memcpy(echoPtr, dp, run);
+        echoPtr += run;
+        }
+
+    return(run);
+    }
+
 /*---------------------------  End Of File  ------------------------------*/
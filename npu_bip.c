@@ -45,6 +45,14 @@
 */
 #define NumBuffs        1000
 
+/*
+**  Upline scheduling: data blocks larger than this (or partial blocks)
+**  count as bulk data, and a connection with this many blocks waiting
+**  is asked to stop producing input until the backlog drains.
+*/
+#define BulkBlockSize   256
+#define UplineShare     8
+
 /*
 **  -----------------------
 **  Private Macro Functions
@@ -62,6 +70,9 @@
 **  Private Function Prototypes
 **  ---------------------------
 */
+static bool npuBipIsBulk(NpuBuffer *bp);
+static u8 npuBipConnection(NpuBuffer *bp);
+static NpuBuffer *npuBipUplineNext(void);
 
 /*
 **  ----------------
@@ -80,6 +91,14 @@ static int bufCount = 0;
 static NpuBuffer *bipUplineBuffer = NULL;
 static NpuQueue *bipUplineQueue;
 
+/*
+**  Per connection upline queues, served round-robin.
+*/
+static NpuQueue *bipConnQueue;
+static int *bipConnCount;
+static int bipConnTotal = 0;
+static int bipConnNext = 0;
+
 static NpuBuffer *bipDownlineBuffer = NULL;
 
 static enum
@@ -143,7 +162,9 @@ void npuBipInit(void)
     **  Allocate upline buffer queue.
     */
     bipUplineQueue = calloc(1, sizeof(NpuQueue));
-    if (bipUplineQueue == NULL)
+    bipConnQueue = calloc(npuNetTcpConns + 1, sizeof(NpuQueue));
+    bipConnCount = calloc(npuNetTcpConns + 1, sizeof(int));
+    if (bipUplineQueue == NULL || bipConnQueue == NULL || bipConnCount == NULL)
         {
         fprintf(stderr, "Failed to allocate NPU buffer queue\n");
         exit(1);
@@ -165,12 +186,13 @@ void npuBipReset(void)
         npuBipBufRelease(bipUplineBuffer);
         }
 
-    while ((bipUplineBuffer = npuBipQueueExtract(bipUplineQueue)) != NULL)
+    while ((bipUplineBuffer = npuBipUplineNext()) != NULL)
         {
         npuBipBufRelease(bipUplineBuffer);
         }
 
     bipUplineBuffer = NULL;
+    bipConnNext = 0;
 
     if (bipDownlineBuffer != NULL)
         {
@@ -513,12 +535,29 @@ void npuBipAbortDownlineReceived(void)
 **------------------------------------------------------------------------*/
 void npuBipRequestUplineTransfer(NpuBuffer *bp)
     {
+    u8 cn;
+
     if (bipUplineBuffer != NULL)
         {
         /*
-        **  Upline buffer pending, so queue this one for later.
+        **  Upline buffer pending, so queue this one for later. Service
+        **  messages have their own queue, data blocks are queued per
+        **  connection to keep them in sequence. A service message about
+        **  a connection which still has data queued goes behind that
+        **  data, so e.g. a disconnect can't overtake the last input.
         */
-        npuBipQueueAppend(bp, bipUplineQueue);
+        cn = npuBipConnection(bp);
+        if (cn == 0 || cn > npuNetTcpConns)
+            {
+            npuBipQueueAppend(bp, bipUplineQueue);
+            }
+        else
+            {
+            npuBipQueueAppend(bp, bipConnQueue + cn);
+            bipConnCount[cn] += 1;
+            bipConnTotal += 1;
+            }
+
         return;
         }
 
@@ -556,6 +595,27 @@ void npuBipRequestUplineCanned(u8 *msg, int msgSize)
     npuBipRequestUplineTransfer(bp);
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Check if a connection has used up its share of the
+**                  upline queue. The TIP stops reading input from the
+**                  terminal while this is the case.
+**
+**  Parameters:     Name        Description.
+**                  cn          connection number
+**
+**  Returns:        TRUE if connection should hold back input.
+**
+**------------------------------------------------------------------------*/
+bool npuBipUplineBusy(u8 cn)
+    {
+    if (cn == 0 || cn > npuNetTcpConns)
+        {
+        return(FALSE);
+        }
+
+    return(bipConnCount[cn] >= UplineShare);
+    }
+
 /*--------------------------------------------------------------------------
 **  Purpose:        Respond to completion of upline transfer.
 **
@@ -574,7 +634,7 @@ void npuBipNotifyUplineSent(void)
     /*
     **  Check if any more upline queued and send if necessary.
     */
-    bipUplineBuffer = npuBipQueueExtract(bipUplineQueue);
+    bipUplineBuffer = npuBipUplineNext();
     if (bipUplineBuffer != NULL)
         {
         npuHipUplineBlock(bipUplineBuffer);
@@ -589,4 +649,108 @@ void npuBipNotifyUplineSent(void)
 **--------------------------------------------------------------------------
 */
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Determine if a data block is bulk data (i.e. part of
+**                  a long or transparent transfer) rather than
+**                  interactive input.
+**
+**  Parameters:     Name        Description.
+**                  bp          pointer to NPU buffer
+**
+**  Returns:        TRUE if bulk data.
+**
+**------------------------------------------------------------------------*/
+static bool npuBipIsBulk(NpuBuffer *bp)
+    {
+    u8 bt = (bp->data[BlkOffBTBSN] >> BlkShiftBT) & BlkMaskBT;
+
+    return(bt == BtHTBLK || bt == BtHTQBLK || bp->numBytes > BulkBlockSize);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Determine the connection queue of an upline block.
+**                  Service messages which refer to a connection carry
+**                  its number in P3 and only need to be kept in sequence
+**                  with that connection's data if any is still queued.
+**
+**  Parameters:     Name        Description.
+**                  bp          pointer to NPU buffer
+**
+**  Returns:        Connection number or 0 for the service message queue.
+**
+**------------------------------------------------------------------------*/
+static u8 npuBipConnection(NpuBuffer *bp)
+    {
+    u8 cn = bp->data[BlkOffCN];
+
+    if (cn != 0 || bp->numBytes < BlkOffP3 + 1)
+        {
+        return(cn);
+        }
+
+    switch (bp->data[BlkOffPfc])
+        {
+    case PfcCNF:
+    case PfcICN:
+    case PfcTCN:
+        cn = bp->data[BlkOffP3];
+        if (cn != 0 && cn <= npuNetTcpConns && bipConnQueue[cn].first != NULL)
+            {
+            return(cn);
+            }
+        break;
+        }
+
+    return(0);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Select the next upline block. Service messages go
+**                  first, then interactive data and finally bulk data.
+**                  Connections are served round-robin within each class
+**                  and blocks of a connection (including service
+**                  messages queued behind them) are never reordered.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Pointer to a buffer or NULL if nothing is queued.
+**
+**------------------------------------------------------------------------*/
+static NpuBuffer *npuBipUplineNext(void)
+    {
+    NpuBuffer *bp;
+    bool bulk;
+    int count;
+    u8 cn;
+
+    bp = npuBipQueueExtract(bipUplineQueue);
+    if (bp != NULL || bipConnTotal == 0)
+        {
+        return(bp);
+        }
+
+    for (bulk = FALSE; ; bulk = TRUE)
+        {
+        cn = bipConnNext;
+        for (count = npuNetTcpConns; count > 0; count--)
+            {
+            cn = cn % npuNetTcpConns + 1;
+            bp = bipConnQueue[cn].first;
+            if (bp != NULL && (bulk || !npuBipIsBulk(bp)))
+                {
+                npuBipQueueExtract(bipConnQueue + cn);
+                bipConnCount[cn] -= 1;
+                bipConnTotal -= 1;
+                bipConnNext = cn;
+                return(bp);
+                }
+            }
+
+        if (bulk)
+            {
+            return(NULL);
+            }
+        }
+    }
+
 /*---------------------------  End Of File  ------------------------------*/
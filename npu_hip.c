@@ -24,8 +24,6 @@
 **--------------------------------------------------------------------------
 */
 
-#define DEBUG 0
-
 /*
 **  -------------
 **  Include Files
@@ -110,14 +108,12 @@
 /*
 **  Misc constants.
 */
-#define CyclesOneSecond         100000
+#define IdleIntervalUs          500000
 #define ReportInitCount         4
 
-#if DEBUG
 #define HexColumn(x) (4 * (x) + 1 + 4)
 #define AsciiColumn(x) (HexColumn(16) + 2 + (x))
 #define LogLineLength (AsciiColumn(16))
-#endif
 
 /*
 **  -----------------------
@@ -137,7 +133,7 @@ typedef struct npuParam
     PpWord      regOrder;
     NpuBuffer   *buffer;
     u8          *npuData;
-    u32         lastCommandTime;
+    TimerSlot   idleTimer;
     } NpuParam;
 
 /*
@@ -153,10 +149,8 @@ static void npuHipDisconnect(void);
 static void npuHipWriteNpuStatus(PpWord status);
 static PpWord npuHipReadNpuStatus(void);
 static char *npuHipFunc2String(PpWord funcCode);
-#if DEBUG
 static void npuLogFlush (void);
 static void npuLogByte (int b);
-#endif
 
 /*
 **  ----------------
@@ -180,11 +174,8 @@ static enum
     StHipDownline,
     } hipState = StHipInit;
 
-#if DEBUG
-static FILE *npuLog = NULL;
 static char npuLogBuf[LogLineLength + 1];
 static int npuLogCol = 0;
-#endif
 
 /*
 **--------------------------------------------------------------------------
@@ -212,13 +203,6 @@ void npuInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     (void)unitNo;
     (void)deviceName;
 
-#if DEBUG
-    if (npuLog == NULL)
-        {
-        npuLog = fopen("npulog.txt", "wt");
-        }
-#endif
-
     /*
     **  Attach device to channel and initialise device control block.
     */
@@ -327,16 +311,19 @@ bool npuHipDownlineBlock(NpuBuffer *bp)
 **------------------------------------------------------------------------*/
 void npuLogMessage(char *format, ...)
     {
-#if DEBUG
     va_list args;
 
+    if (!LogOn(LogNpu))
+        {
+        return;
+        }
+
     npuLogFlush();
-    fprintf(npuLog, "\n\n");
+    logPrintf(LogNpu, "\n\n");
     va_start(args, format);
-    vfprintf(npuLog, format, args);
+    logVPrintf(LogNpu, format, args);
     va_end(args);
-    fprintf(npuLog, "\n");
-#endif
+    logPrintf(LogNpu, "\n");
     }
 
 /*
@@ -368,6 +355,7 @@ static void npuReset(void)
     /*
     **  Reset HIP state.
     */
+    timerCancel(&npu->idleTimer);
     memset(npu, 0, sizeof(NpuParam));
     initCount = ReportInitCount;
     hipState = StHipInit;
@@ -388,25 +376,28 @@ static FcStatus npuHipFunc(PpWord funcCode)
 
     funcCode &= ~FcNpuEqMask;
 
-#if DEBUG
-    npuLogFlush();
-    if (funcCode != FcNpuInCouplerStatus)
+    if (LogOn(LogNpu))
         {
-        fprintf(npuLog, "\n%06d PP:%02o CH:%02o f:%04o T:%-25s  >   ",
-                traceSequenceNo,
-                activePpu->id,
-                activeChannel->id,
-                funcCode,
-                npuHipFunc2String(funcCode));
+        npuLogFlush();
+        if (funcCode != FcNpuInCouplerStatus)
+            {
+            logPrintf(LogNpu, "\n%06d PP:%02o CH:%02o f:%04o T:%-25s  >   ",
+                    traceSequenceNo,
+                    activePpu->id,
+                    activeChannel->id,
+                    funcCode,
+                    npuHipFunc2String(funcCode));
+            }
         }
-#endif
 
     switch (funcCode)
         {
     default:
-#if DEBUG
-        fprintf(npuLog, " FUNC not implemented & declined!");
-#endif
+        if (LogOn(LogNpu))
+            {
+            logPrintf(LogNpu, " FUNC not implemented & declined!");
+            }
+
         return(FcDeclined);
 
     case FcNpuInCouplerStatus:
@@ -444,7 +435,7 @@ static FcStatus npuHipFunc(PpWord funcCode)
                 **  Announce idle state to PIP at intervals of less then one second,
                 **  otherwise PIP will assume that the NPU is dead.
                 */
-                if (cycles - npu->lastCommandTime > CyclesOneSecond)
+                if (!timerPending(&npu->idleTimer))
                     {
                     npuHipWriteNpuStatus(StNpuIdle);
                     }
@@ -546,34 +537,40 @@ static void npuHipIo(void)
     case FcNpuInNpuStatus:
         activeChannel->data = npuHipReadNpuStatus();
         activeChannel->full = TRUE;
-#if DEBUG
-        fprintf(npuLog, " %03X", activeChannel->data);
-#endif
+        if (LogOn(LogNpu))
+            {
+            logPrintf(LogNpu, " %03X", activeChannel->data);
+            }
+
         break;
 
     case FcNpuInCouplerStatus:
         activeChannel->data = npu->regCouplerStatus;
         activeChannel->full = TRUE;
-#if DEBUG
-        if (npu->regCouplerStatus != 0)
+        if (LogOn(LogNpu))
             {
-            fprintf(npuLog, "\n%06d PP:%02o CH:%02o f:%04o T:%-25s  >    %03X",
-                    traceSequenceNo,
-                    activePpu->id,
-                    activeChannel->id,
-                    FcNpuInCouplerStatus,
-                    npuHipFunc2String(FcNpuInCouplerStatus),
-                    activeChannel->data);
+            if (npu->regCouplerStatus != 0)
+                {
+                logPrintf(LogNpu, "\n%06d PP:%02o CH:%02o f:%04o T:%-25s  >    %03X",
+                        traceSequenceNo,
+                        activePpu->id,
+                        activeChannel->id,
+                        FcNpuInCouplerStatus,
+                        npuHipFunc2String(FcNpuInCouplerStatus),
+                        activeChannel->data);
+                }
             }
-#endif
+
         break;
 
     case FcNpuInNpuOrder:
         activeChannel->data = npu->regOrder;
         activeChannel->full = TRUE;
-#if DEBUG
-        fprintf(npuLog, " %03X", activeChannel->data);
-#endif
+        if (LogOn(LogNpu))
+            {
+            logPrintf(LogNpu, " %03X", activeChannel->data);
+            }
+
         break;
         
     case FcNpuInData:
@@ -597,11 +594,13 @@ static void npuHipIo(void)
                 activeChannel->discAfterInput = TRUE;
                 activeDevice->fcode = 0;
                 hipState = StHipIdle;
+                activeDevice->stats.blocksUp += 1;
                 npuBipNotifyUplineSent();
                 }
-#if DEBUG
-            npuLogByte(activeChannel->data);
-#endif
+            if (LogOn(LogNpu))
+                {
+                npuLogByte(activeChannel->data);
+                }
             }
         
         break;
@@ -609,9 +608,11 @@ static void npuHipIo(void)
     case FcNpuOutData:
         if (activeChannel->full)
             {
-#if DEBUG
-            npuLogByte(activeChannel->data);
-#endif
+            if (LogOn(LogNpu))
+                {
+                npuLogByte(activeChannel->data);
+                }
+
             activeChannel->full = FALSE;
             if (activeDevice->recordLength < MaxBuffer)
                 {
@@ -625,6 +626,7 @@ static void npuHipIo(void)
                     npu->buffer->numBytes = activeDevice->recordLength;
                     activeDevice->fcode = 0;
                     hipState = StHipIdle;
+                    activeDevice->stats.blocksDown += 1;
                     npuBipNotifyDownlineReceived();
                     }
                 else if (activeDevice->recordLength >= MaxBuffer)
@@ -644,22 +646,24 @@ static void npuHipIo(void)
     case FcNpuOutNpuOrder:
         if (activeChannel->full)
             {
-#if DEBUG
-            static char *orderCode[] =
+            if (LogOn(LogNpu))
                 {
-                "",
-                "output level one - service messages",
-                "output level two - high priority",
-                "output level three - low priority",
-                "driver not ready for input",
-                "regulation level change",
-                "initialization request acknowledgment",
-                ""
-                };
-
-            fprintf(npuLog, " Order word %03X - function %02X : %s",
-                activeChannel->data, activeChannel->data >> 8, orderCode[(activeChannel->data >> 8) & 7]);
-#endif
+                static char *orderCode[] =
+                    {
+                    "",
+                    "output level one - service messages",
+                    "output level two - high priority",
+                    "output level three - low priority",
+                    "driver not ready for input",
+                    "regulation level change",
+                    "initialization request acknowledgment",
+                    ""
+                    };
+
+                logPrintf(LogNpu, " Order word %03X - function %02X : %s",
+                    activeChannel->data, activeChannel->data >> 8, orderCode[(activeChannel->data >> 8) & 7]);
+                }
+
             npu->regOrder = activeChannel->data;
             orderType  = activeChannel->data & OrdMaskType;
             orderValue = (u8)(activeChannel->data & OrdMaskValue);
@@ -767,7 +771,7 @@ static void npuHipDisconnect(void)
 **------------------------------------------------------------------------*/
 static void npuHipWriteNpuStatus(PpWord status)
     {
-    npu->lastCommandTime = cycles;
+    timerStart(&npu->idleTimer, IdleIntervalUs, NULL, NULL);
     npu->regNpuStatus = status;
     npu->regCouplerStatus |= StCplrStatusLoaded;
     }
@@ -801,7 +805,6 @@ static PpWord npuHipReadNpuStatus(void)
 static char *npuHipFunc2String(PpWord funcCode)
     {
     static char buf[30];
-#if DEBUG
     switch(funcCode)
         {
     case FcNpuInData             : return "FcNpuInData";
@@ -819,12 +822,10 @@ static char *npuHipFunc2String(PpWord funcCode)
     case FcNpuClearNpu           : return "FcNpuClearNpu";
     case FcNpuClearCoupler       : return "FcNpuClearCoupler";
         }
-#endif
     sprintf(buf, "UNKNOWN: %04o", funcCode);
     return(buf);
     }
 
-#if DEBUG
 /*--------------------------------------------------------------------------
 **  Purpose:        Flush incomplete numeric/ascii data line
 **
@@ -837,7 +838,7 @@ static void npuLogFlush(void)
     {
     if (npuLogCol != 0)
         {
-        fputs(npuLogBuf, npuLog);
+        logPrintf(LogNpu, "%s", npuLogBuf);
         }
 
     npuLogCol = 0;
@@ -856,7 +857,7 @@ static void npuLogFlush(void)
 **------------------------------------------------------------------------*/
 static void npuLogByte(int b)
     {
-    char hex[5];
+    char hex[10];
     int col;
     
     col = HexColumn(npuLogCol);
@@ -876,7 +877,6 @@ static void npuLogByte(int b)
         npuLogFlush();
         }
     }
-#endif
 
 /*---------------------------  End Of File  ------------------------------*/
 
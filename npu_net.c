@@ -50,13 +50,15 @@
 #include <arpa/inet.h>
 #include <signal.h>
 #endif
+#if CcSse2
+#include <emmintrin.h>
+#endif
 
 /*
 **  -----------------
 **  Private Constants
 **  -----------------
 */
-#define Ms200       200000
 
 /*
 **  -----------------------
@@ -94,6 +96,8 @@ static void *npuNetThread(void *param);
 #endif
 static void npuNetProcessNewConnection(int acceptFd, NpuConnType *ct);
 static void npuNetQueueOutput(Tcb *tp, u8 *data, int len);
+static void npuNetQueueEscaped(Tcb *tp, u8 *data, int len);
+static int npuNetFindEscape(u8 *data, int len);
 static void npuNetTryOutput(Tcb *tp);
 
 /*
@@ -339,45 +343,13 @@ void npuNetDisconnected(Tcb *tp)
 **------------------------------------------------------------------------*/
 void npuNetSend(Tcb *tp, u8 *data, int len)
     {
-    u8 *p;
-    int count;
-
     switch (tp->connType)
         {
     case ConnTypePterm:
         /*
         **  Telnet escape processing as required by Pterm.
         */
-        for (p = data; len > 0; len -= 1)
-            {
-            switch (*p++)
-                {
-            case 0xFF:
-                /*
-                **  Double FF to escape the Telnet IAC code making it a real FF.
-                */
-                count = p - data;
-                npuNetQueueOutput(tp, data, count);
-                npuNetQueueOutput(tp, (u8 *)"\xFF", 1);
-                data = p;
-                break;
-                
-            case 0x0D:
-                /*
-                **  Append zero to CR otherwise real zeroes will be stripped by Telnet.
-                */
-                count = p - data;
-                npuNetQueueOutput(tp, data, count);
-                npuNetQueueOutput(tp, (u8 *)"\x00", 1);
-                data = p;
-                break;
-                }
-            }
-                
-        if ((count = p - data) > 0)
-            {
-            npuNetQueueOutput(tp, data, count);
-            }
+        npuNetQueueEscaped(tp, data, len);
         break;
 
     case ConnTypeRaw:    
@@ -455,14 +427,6 @@ void npuNetCheckStatus(void)
             continue;
             }
 
-        /*
-        **  Handle transparent input timeout.
-        */
-        if (tp->xInputTimerRunning && (cycles - tp->xStartCycle) >= Ms200)
-            {
-            npuAsyncFlushUplineTransparent(tp);
-            }
-
         /*
         **  Handle network traffic.
         */
@@ -484,10 +448,12 @@ void npuNetCheckStatus(void)
             npuNetTryOutput(tp);
             }
 
-        if (FD_ISSET(tp->connFd, &readFds))
+        if (FD_ISSET(tp->connFd, &readFds) && !npuBipUplineBusy((u8)(tp - npuTcbs + 1)))
             {
             /*
-            **  Receive a block of data.
+            **  Receive a block of data unless this connection already has
+            **  its share of blocks waiting to go upline (TCP flow control
+            **  then holds back the terminal).
             */
             tp->inputCount = recv(tp->connFd, tp->inputData, sizeof(tp->inputData), 0);
             if (tp->inputCount <= 0)
@@ -513,6 +479,7 @@ void npuNetCheckStatus(void)
                 /*
                 **  Hand up to the ASYNC TIP.
                 */
+                tp->bytesIn += tp->inputCount;
                 npuAsyncProcessUplineData(tp);
                 }
 
@@ -528,6 +495,57 @@ void npuNetCheckStatus(void)
     pollIndex = 0;
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Determine the length of a run of printable ASCII
+**                  characters (20 to 7E hex).
+**
+**  Parameters:     Name        Description.
+**                  data        data address
+**                  len         data length
+**
+**  Returns:        Number of leading printable characters.
+**
+**------------------------------------------------------------------------*/
+int npuNetPrintableRun(u8 *data, int len)
+    {
+    int i = 0;
+#if CcSse2
+    __m128i low = _mm_set1_epi8(0x1F);
+    __m128i high = _mm_set1_epi8(0x7F);
+    __m128i chunk;
+    int mask;
+
+    /*
+    **  Signed compares also reject bytes with the top bit set.
+    */
+    for (; i + 16 <= len; i += 16)
+        {
+        chunk = _mm_loadu_si128((__m128i *)(data + i));
+        mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(chunk, low), _mm_cmplt_epi8(chunk, high))) ^ 0xFFFF;
+        if (mask != 0)
+            {
+            while ((mask & 1) == 0)
+                {
+                mask >>= 1;
+                i += 1;
+                }
+
+            return(i);
+            }
+        }
+#endif
+
+    for (; i < len; i++)
+        {
+        if (data[i] < 0x20 || data[i] > 0x7E)
+            {
+            break;
+            }
+        }
+
+    return(i);
+    }
+
 /*
 **--------------------------------------------------------------------------
 **
@@ -924,6 +942,125 @@ static void npuNetQueueOutput(Tcb *tp, u8 *data, int len)
         }
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Queue output to terminal with Telnet escaping: FF is
+**                  doubled to make it a real FF rather than IAC, and a
+**                  zero is appended to CR, otherwise real zeroes will be
+**                  stripped by Telnet. Runs of data without either are
+**                  copied straight into the output buffers.
+**
+**  Parameters:     Name        Description.
+**                  tp          TCB pointer
+**                  data        data address
+**                  len         data length
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void npuNetQueueEscaped(Tcb *tp, u8 *data, int len)
+    {
+    NpuBuffer *bp;
+    u8 *startAddress;
+    u8 *op;
+    int byteCount;
+    int run;
+
+    /*
+    **  Try to use the last pending buffer unless it carries a sequence number
+    **  which must be acknowledged. If there is none, get a new one and queue it.
+    */
+    bp = npuBipQueueGetLast(&tp->outputQ);
+    if (bp == NULL || bp->blockSeqNo != 0)
+        {
+        bp = npuBipBufGet();
+        npuBipQueueAppend(bp, &tp->outputQ);
+        }
+
+    while (bp != NULL && len > 0)
+        {
+        startAddress = bp->data + bp->offset + bp->numBytes;
+        byteCount = MaxBuffer - bp->offset - bp->numBytes;
+        if (byteCount < 2)
+            {
+            /*
+            **  No room for an escape sequence - continue in a new buffer.
+            */
+            bp = npuBipBufGet();
+            npuBipQueueAppend(bp, &tp->outputQ);
+            continue;
+            }
+
+        /*
+        **  Copy up to the next byte which needs escaping, but leave room
+        **  for the escape sequence.
+        */
+        byteCount = len < byteCount - 1 ? len : byteCount - 1;
+        run = npuNetFindEscape(data, byteCount);
+        memcpy(startAddress, data, run);
+        op = startAddress + run;
+        data += run;
+        len -= run;
+
+        if (run < byteCount)
+            {
+            *op++ = *data;
+            *op++ = *data == 0xFF ? 0xFF : 0x00;
+            data += 1;
+            len -= 1;
+            }
+
+        bp->numBytes += op - startAddress;
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Find the first byte which needs Telnet escaping (FF
+**                  or CR).
+**
+**  Parameters:     Name        Description.
+**                  data        data address
+**                  len         data length
+**
+**  Returns:        Index of the byte, or len if there is none.
+**
+**------------------------------------------------------------------------*/
+static int npuNetFindEscape(u8 *data, int len)
+    {
+    int i = 0;
+#if CcSse2
+    __m128i iac = _mm_set1_epi8((char)0xFF);
+    __m128i cr = _mm_set1_epi8(0x0D);
+    __m128i chunk;
+    int mask;
+
+    for (; i + 16 <= len; i += 16)
+        {
+        chunk = _mm_loadu_si128((__m128i *)(data + i));
+        mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, iac), _mm_cmpeq_epi8(chunk, cr)));
+        if (mask != 0)
+            {
+            while ((mask & 1) == 0)
+                {
+                mask >>= 1;
+                i += 1;
+                }
+
+            return(i);
+            }
+        }
+#endif
+
+    for (; i < len; i++)
+        {
+        if (data[i] == 0xFF || data[i] == 0x0D)
+            {
+            break;
+            }
+        }
+
+    return(i);
+    }
+
 /*--------------------------------------------------------------------------
 **  Purpose:        Try to send any queued data.
 **
@@ -966,6 +1103,11 @@ static void npuNetTryOutput(Tcb *tp)
             result = 0;
             }
 
+        if (result > 0)
+            {
+            tp->bytesOut += result;
+            }
+
         if (result >= bp->numBytes)
             {
             /*
@@ -44,34 +44,6 @@
 **  -----------------
 */
 
-/*
-**  Primary Service Message function codes.
-*/
-#define PfcREG          0x1     // logical link regulation 
-#define PfcICN          0x2     // initiate connection     
-#define PfcTCN          0x3     // terminate connection    
-#define PfcCHC          0x4     // change terminal characteristics
-#define PfcNPU          0xA     // initialize npu          
-#define PfcSUP          0xE     // initiate supervision    
-#define PfcCNF          0xF     // configure terminal      
-#define PfcENB          0x10    // enable command(s)       
-#define PfcDIB          0x11    // disable command(s)      
-#define PfcNPS          0x12    // npu status request      
-#define PfcLLS          0x13    // ll status request       
-#define PfcLIS          0x14    // line status request     
-#define PfcTES          0x15    // term status request     
-#define PfcTRS          0x16    // trunk status request    
-#define PfcCPS          0x17    // coupler status request  
-#define PfcVCS          0x18    // svc status request       
-#define PfcSTU          0x19    // unsolicated statuses    
-#define PfcSTI          0x1A    // statistics              
-#define PfcMSG          0x1B    // message(s)             
-#define PfcLOG          0x1C    // error log entry         
-#define PfcALM          0x1D    // operator alarm          
-#define PfcNPI          0x1E    // reload npu               
-#define PfcCDI          0x1F    // count(s)                
-#define PfcOLD          0x20    // on-line diagnostics     
-
 /*
 **  Secondary Service Message function codes.
 */
@@ -326,6 +326,7 @@ void npuTipReset(void)
     */
     for (i = 0; i < npuNetTcpConns; i++, tp++)
         {
+        timerCancel(&tp->xInputTimer);
         memset(tp, 0, sizeof(Tcb));
         tp->portNumber = i + 1;
         tp->params = defaultTc3;
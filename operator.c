@@ -96,6 +96,18 @@ static void opHelpLoadTape(void);
 static void opCmdShowTape(bool help, char *cmdParams);
 static void opHelpShowTape(void);
 
+static void opCmdShowStats(bool help, char *cmdParams);
+static void opHelpShowStats(void);
+
+static void opCmdSnapshotDisk(bool help, char *cmdParams);
+static void opHelpSnapshotDisk(void);
+
+static void opCmdCaptureChannel(bool help, char *cmdParams);
+static void opHelpCaptureChannel(void);
+
+static void opCmdSetLog(bool help, char *cmdParams);
+static void opHelpSetLog(void);
+
 static void opCmdUnloadTape(bool help, char *cmdParams);
 static void opHelpUnloadTape(void);
 
@@ -125,17 +137,25 @@ volatile bool opActive = FALSE;
 */
 static OpCmd decode[] = 
     {
+    "cc",                       opCmdCaptureChannel,
     "lc",                       opCmdLoadCards,
     "lt",                       opCmdLoadTape,
     "rc",                       opCmdRemoveCards,
     "rp",                       opCmdRemovePaper,
     "p",                        opCmdPause,
+    "sd",                       opCmdSnapshotDisk,
+    "sl",                       opCmdSetLog,
+    "ss",                       opCmdShowStats,
     "st",                       opCmdShowTape,
     "ut",                       opCmdUnloadTape,
+    "capture_channel",          opCmdCaptureChannel,
     "load_cards",               opCmdLoadCards,
     "load_tape",                opCmdLoadTape,
     "remove_cards",             opCmdRemoveCards,
     "remove_paper",             opCmdRemovePaper,
+    "snapshot_disk",            opCmdSnapshotDisk,
+    "set_log",                  opCmdSetLog,
+    "show_stats",               opCmdShowStats,
     "show_tape",                opCmdShowTape,
     "unload_tape",              opCmdUnloadTape,
     "?",                        opCmdHelp,
@@ -725,6 +745,85 @@ static void opHelpUnloadTape(void)
     printf("'unload_tape <channel>,<equipment>,<unit>' unload specified tape unit.\n");
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Snapshot a thin disk container.
+**
+**  Parameters:     Name        Description.
+**                  help        Request only help on this command.
+**                  cmdParams   Command parameters
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void opCmdSnapshotDisk(bool help, char *cmdParams)
+    {
+    /*
+    **  Process help request.
+    */
+    if (help)
+        {
+        opHelpSnapshotDisk();
+        return;
+        }
+
+    /*
+    **  Check parameters and process command.
+    */
+    if (strlen(cmdParams) == 0)
+        {
+        printf("parameters expected\n");
+        opHelpSnapshotDisk();
+        return;
+        }
+
+    dd8xxSnapshot(cmdParams);
+    }
+
+static void opHelpSnapshotDisk(void)
+    {
+    printf("'snapshot_disk <channel>,<unit>,<filename>' freeze thin disk container as <filename> and continue in a new overlay.\n");
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Record channel traffic for replay.
+**
+**  Parameters:     Name        Description.
+**                  help        Request only help on this command.
+**                  cmdParams   Command parameters
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void opCmdCaptureChannel(bool help, char *cmdParams)
+    {
+    /*
+    **  Process help request.
+    */
+    if (help)
+        {
+        opHelpCaptureChannel();
+        return;
+        }
+
+    /*
+    **  Check parameters and process command.
+    */
+    if (strlen(cmdParams) == 0)
+        {
+        printf("parameters expected\n");
+        opHelpCaptureChannel();
+        return;
+        }
+
+    channelCapture(cmdParams);
+    }
+
+static void opHelpCaptureChannel(void)
+    {
+    printf("'capture_channel <channel>,<filename>' record device traffic on <channel> for dtreplay.\n");
+    printf("'capture_channel off' stop recording.\n");
+    }
+
 /*--------------------------------------------------------------------------
 **  Purpose:        Show status of all tape units
 **
@@ -766,6 +865,84 @@ static void opHelpShowTape(void)
     printf("'show_tape' show status of all tape units.\n");
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Show device performance counters
+**
+**  Parameters:     Name        Description.
+**                  help        Request only help on this command.
+**                  cmdParams   Command parameters
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void opCmdShowStats(bool help, char *cmdParams)
+    {
+    /*
+    **  Process help request.
+    */
+    if (help)
+        {
+        opHelpShowStats();
+        return;
+        }
+
+    /*
+    **  Check parameters and process command.
+    */
+    if (strlen(cmdParams) != 0)
+        {
+        printf("no parameters expected\n");
+        opHelpShowStats();
+        return;
+        }
+
+    statsShow();
+    }
+
+static void opHelpShowStats(void)
+    {
+    printf("'show_stats' show device performance counters.\n");
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Switch device log categories on or off.
+**
+**  Parameters:     Name        Description.
+**                  help        Request only help on this command.
+**                  cmdParams   Command parameters
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void opCmdSetLog(bool help, char *cmdParams)
+    {
+    /*
+    **  Process help request.
+    */
+    if (help)
+        {
+        opHelpSetLog();
+        return;
+        }
+
+    /*
+    **  Check parameters and process command.
+    */
+    if (strlen(cmdParams) != 0 && !logSelect(cmdParams))
+        {
+        opHelpSetLog();
+        return;
+        }
+
+    logShow();
+    }
+
+static void opHelpSetLog(void)
+    {
+    printf("'set_log [<category>,-<category>,all,none]' switch logging on or off and show log counters.\n");
+    printf("         categories: error, dd8xx, mt362x, mt669, mt679, npu, pci, mch\n");
+    }
+
 /*--------------------------------------------------------------------------
 **  Purpose:        Remove paper from printer.
 **
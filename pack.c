@@ -0,0 +1,485 @@
+/*--------------------------------------------------------------------------
+**
+**  Copyright (c) 2003-2011, Tom Hunter
+**
+**  Name: pack.c
+**
+**  Description:
+**      Bulk conversion between 8 bit host bytes and 12 bit PP words as
+**      used by tape images and packed disk containers: three bytes hold
+**      two PP words. Also converts between 6 bit character codes (two
+**      per PP word) and bytes via translation tables.
+**
+**      Where the compiler supports it, the plain 8/12 bit conversions
+**      use SSSE3 or AVX2 kernels selected at run time; the scalar code
+**      is the reference and handles the tails.
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License version 3 as
+**  published by the Free Software Foundation.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License version 3 for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  version 3 along with this program in file "license-gpl-3.0.txt".
+**  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+**
+**--------------------------------------------------------------------------
+*/
+
+/*
+**  -------------
+**  Include Files
+**  -------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "const.h"
+#include "types.h"
+#include "proto.h"
+
+/*
+**  Run time selected SIMD kernels need GCC 5 or clang on x86.
+*/
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define PackSimd                1
+#include <immintrin.h>
+#else
+#define PackSimd                0
+#endif
+
+/*
+**  -----------------
+**  Private Constants
+**  -----------------
+*/
+#define PackScalar              0
+#define PackSsse3               1
+#define PackAvx2                2
+
+/*
+**  -----------------------
+**  Private Macro Functions
+**  -----------------------
+*/
+
+/*
+**  -----------------------------------------
+**  Private Typedef and Structure Definitions
+**  -----------------------------------------
+*/
+
+/*
+**  ---------------------------
+**  Private Function Prototypes
+**  ---------------------------
+*/
+static int packLevel(void);
+#if PackSimd
+static u32 packBytesToWordsSsse3(u8 *in, u32 groups, PpWord *out);
+static u32 packWordsToBytesSsse3(PpWord *in, u32 pairs, u8 *out);
+static u32 packBytesToWordsAvx2(u8 *in, u32 groups, PpWord *out);
+static u32 packWordsToBytesAvx2(PpWord *in, u32 pairs, u8 *out);
+#endif
+
+/*
+**  ----------------
+**  Public Variables
+**  ----------------
+*/
+
+/*
+**  -----------------
+**  Private Variables
+**  -----------------
+*/
+static int level = -1;
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Public Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Pack 8 bit frames into 12 bit PP words (three bytes
+**                  make two words). A partial last group is padded with
+**                  zero bits.
+**
+**  Parameters:     Name        Description.
+**                  in          input bytes
+**                  byteCount   number of input bytes
+**                  out         output PP words
+**
+**  Returns:        Number of words stored (always even).
+**
+**------------------------------------------------------------------------*/
+u32 packBytesToWords(u8 *in, u32 byteCount, PpWord *out)
+    {
+    u32 groups = byteCount / 3;
+    u32 done = 0;
+    PpWord *op;
+    u8 *ip;
+    u8 tail[3];
+
+#if PackSimd
+    switch (packLevel())
+        {
+    case PackAvx2:
+        done = packBytesToWordsAvx2(in, groups, out);
+        break;
+
+    case PackSsse3:
+        done = packBytesToWordsSsse3(in, groups, out);
+        break;
+        }
+#endif
+
+    ip = in + done * 3;
+    op = out + done * 2;
+    for (; done < groups; done++)
+        {
+        *op++ = ((ip[0] << 4) | (ip[1] >> 4)) & Mask12;
+        *op++ = ((ip[1] << 8) | (ip[2] >> 0)) & Mask12;
+        ip += 3;
+        }
+
+    if (byteCount % 3 != 0)
+        {
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, ip, byteCount % 3);
+        *op++ = ((tail[0] << 4) | (tail[1] >> 4)) & Mask12;
+        *op++ = ((tail[1] << 8) | (tail[2] >> 0)) & Mask12;
+        }
+
+    return(op - out);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Unpack 12 bit PP words into 8 bit frames (two words
+**                  make three bytes). An odd last word is padded with
+**                  zero bits.
+**
+**  Parameters:     Name        Description.
+**                  in          input PP words
+**                  wordCount   number of input words
+**                  out         output bytes
+**
+**  Returns:        Number of bytes stored (a multiple of three).
+**
+**------------------------------------------------------------------------*/
+u32 packWordsToBytes(PpWord *in, u32 wordCount, u8 *out)
+    {
+    u32 pairs = wordCount / 2;
+    u32 done = 0;
+    PpWord *ip;
+    PpWord w0, w1;
+    u8 *op;
+
+#if PackSimd
+    switch (packLevel())
+        {
+    case PackAvx2:
+        done = packWordsToBytesAvx2(in, pairs, out);
+        break;
+
+    case PackSsse3:
+        done = packWordsToBytesSsse3(in, pairs, out);
+        break;
+        }
+#endif
+
+    ip = in + done * 2;
+    op = out + done * 3;
+    for (; done < pairs; done++)
+        {
+        w0 = ip[0] & Mask12;
+        w1 = ip[1] & Mask12;
+        *op++ = (u8)(w0 >> 4);
+        *op++ = (u8)((w0 << 4) | (w1 >> 8));
+        *op++ = (u8)(w1 >> 0);
+        ip += 2;
+        }
+
+    if (wordCount % 2 != 0)
+        {
+        w0 = ip[0] & Mask12;
+        *op++ = (u8)(w0 >> 4);
+        *op++ = (u8)(w0 << 4);
+        *op++ = 0;
+        }
+
+    return(op - out);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Convert bytes to 6 bit characters via a translation
+**                  table and pack two characters per PP word. An odd
+**                  last character occupies the upper half of the last
+**                  word.
+**
+**  Parameters:     Name        Description.
+**                  in          input bytes
+**                  byteCount   number of input bytes
+**                  out         output PP words
+**                  table       translation table (NULL: use the low 6 bits)
+**                  flagged     set to TRUE if a translated character has
+**                              bit 6 set (illegal character), may be NULL
+**
+**  Returns:        Number of complete words stored.
+**
+**------------------------------------------------------------------------*/
+u32 packConvBytesToWords(u8 *in, u32 byteCount, PpWord *out, const u8 *table, bool *flagged)
+    {
+    u32 pairs = byteCount / 2;
+    u32 i;
+    u8 flags = 0;
+    u8 c1, c2;
+
+    for (i = 0; i < pairs; i++)
+        {
+        c1 = table != NULL ? table[in[0]] : in[0];
+        c2 = table != NULL ? table[in[1]] : in[1];
+        flags |= c1 | c2;
+        *out++ = ((c1 & Mask6) << 6) | (c2 & Mask6);
+        in += 2;
+        }
+
+    if (byteCount % 2 != 0)
+        {
+        c1 = table != NULL ? table[in[0]] : in[0];
+        flags |= c1;
+        *out = (c1 & Mask6) << 6;
+        }
+
+    if (flagged != NULL && table != NULL && (flags & (1 << 6)) != 0)
+        {
+        *flagged = TRUE;
+        }
+
+    return(pairs);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Split PP words into two 6 bit characters each and
+**                  convert them to bytes via a translation table.
+**
+**  Parameters:     Name        Description.
+**                  in          input PP words
+**                  wordCount   number of input words
+**                  out         output bytes
+**                  table       translation table with 64 entries (NULL:
+**                              store the 6 bit characters unchanged)
+**
+**  Returns:        Number of bytes stored.
+**
+**------------------------------------------------------------------------*/
+u32 packConvWordsToBytes(PpWord *in, u32 wordCount, u8 *out, const u8 *table)
+    {
+    u32 i;
+
+    if (table == NULL)
+        {
+        for (i = 0; i < wordCount; i++)
+            {
+            *out++ = (*in >> 6) & Mask6;
+            *out++ = (*in >> 0) & Mask6;
+            in += 1;
+            }
+
+        return(wordCount * 2);
+        }
+
+    return(charsetPpToAscii(in, wordCount, (char *)out, (const char *)table));
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Determine the best kernel supported by the host CPU.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        PackScalar, PackSsse3 or PackAvx2.
+**
+**------------------------------------------------------------------------*/
+static int packLevel(void)
+    {
+    if (level < 0)
+        {
+        level = PackScalar;
+#if PackSimd
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            {
+            level = PackAvx2;
+            }
+        else if (__builtin_cpu_supports("ssse3"))
+            {
+            level = PackSsse3;
+            }
+#endif
+        }
+
+    return(level);
+    }
+
+#if PackSimd
+/*--------------------------------------------------------------------------
+**  Purpose:        SSSE3 kernel: 12 bytes to 8 PP words per step.
+**
+**                  Each 16 bit lane receives the two bytes holding its
+**                  word in big endian order; even lanes are then shifted
+**                  right by 4, odd lanes masked to 12 bits.
+**
+**  Parameters:     Name        Description.
+**                  in          input bytes
+**                  groups      number of complete 3 byte groups
+**                  out         output PP words
+**
+**  Returns:        Number of groups processed.
+**
+**------------------------------------------------------------------------*/
+__attribute__((target("ssse3")))
+static u32 packBytesToWordsSsse3(u8 *in, u32 groups, PpWord *out)
+    {
+    const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m128i even = _mm_set1_epi32(0x00000FFF);
+    const __m128i odd = _mm_set1_epi32(0x0FFF0000);
+    __m128i v;
+    u32 done = 0;
+
+    /*
+    **  Each step loads 16 bytes, so stop while a full load is in bounds.
+    */
+    for (; done + 6 <= groups; done += 4)
+        {
+        v = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(in + done * 3)), shuffle);
+        v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 4), even), _mm_and_si128(v, odd));
+        _mm_storeu_si128((__m128i *)(out + done * 2), v);
+        }
+
+    return(done);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        SSSE3 kernel: 8 PP words to 12 bytes per step.
+**
+**                  Each 32 bit lane combines a word pair into a 24 bit
+**                  value whose bytes are then gathered in big endian
+**                  order.
+**
+**  Parameters:     Name        Description.
+**                  in          input PP words
+**                  pairs       number of complete word pairs
+**                  out         output bytes
+**
+**  Returns:        Number of pairs processed.
+**
+**------------------------------------------------------------------------*/
+__attribute__((target("ssse3")))
+static u32 packWordsToBytesSsse3(PpWord *in, u32 pairs, u8 *out)
+    {
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m128i mask = _mm_set1_epi32(0x00000FFF);
+    __m128i v;
+    u32 done = 0;
+
+    /*
+    **  Each step stores 16 bytes, so stop while a full store is in bounds.
+    */
+    for (; done + 6 <= pairs; done += 4)
+        {
+        v = _mm_loadu_si128((__m128i *)(in + done * 2));
+        v = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, mask), 12), _mm_and_si128(_mm_srli_epi32(v, 16), mask));
+        _mm_storeu_si128((__m128i *)(out + done * 3), _mm_shuffle_epi8(v, shuffle));
+        }
+
+    return(done);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        AVX2 kernel: 24 bytes to 16 PP words per step, using
+**                  the SSSE3 scheme in each 128 bit lane.
+**
+**  Parameters:     Name        Description.
+**                  in          input bytes
+**                  groups      number of complete 3 byte groups
+**                  out         output PP words
+**
+**  Returns:        Number of groups processed.
+**
+**------------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static u32 packBytesToWordsAvx2(u8 *in, u32 groups, PpWord *out)
+    {
+    const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                             1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i even = _mm256_set1_epi32(0x00000FFF);
+    const __m256i odd = _mm256_set1_epi32(0x0FFF0000);
+    __m256i v;
+    u8 *ip;
+    u32 done = 0;
+
+    for (; done + 10 <= groups; done += 8)
+        {
+        ip = in + done * 3;
+        v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((__m128i *)ip)),
+                                    _mm_loadu_si128((__m128i *)(ip + 12)), 1);
+        v = _mm256_shuffle_epi8(v, shuffle);
+        v = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(v, 4), even), _mm256_and_si256(v, odd));
+        _mm256_storeu_si256((__m256i *)(out + done * 2), v);
+        }
+
+    return(done + packBytesToWordsSsse3(in + done * 3, groups - done, out + done * 2));
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        AVX2 kernel: 16 PP words to 24 bytes per step, using
+**                  the SSSE3 scheme in each 128 bit lane.
+**
+**  Parameters:     Name        Description.
+**                  in          input PP words
+**                  pairs       number of complete word pairs
+**                  out         output bytes
+**
+**  Returns:        Number of pairs processed.
+**
+**------------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static u32 packWordsToBytesAvx2(PpWord *in, u32 pairs, u8 *out)
+    {
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                             2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i mask = _mm256_set1_epi32(0x00000FFF);
+    __m256i v;
+    u8 *op;
+    u32 done = 0;
+
+    for (; done + 10 <= pairs; done += 8)
+        {
+        v = _mm256_loadu_si256((__m256i *)(in + done * 2));
+        v = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(v, mask), 12), _mm256_and_si256(_mm256_srli_epi32(v, 16), mask));
+        v = _mm256_shuffle_epi8(v, shuffle);
+        op = out + done * 3;
+        _mm_storeu_si128((__m128i *)op, _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i *)(op + 12), _mm256_extracti128_si256(v, 1));
+        }
+
+    return(done + packWordsToBytesSsse3(in + done * 2, pairs - done, out + done * 3));
+    }
+#endif
+
+/*---------------------------  End Of File  ------------------------------*/
@@ -7,6 +7,16 @@
 **  Description:
 **      Interface to PCI channel adapter.
 **
+**      Commands are queued and submitted to the driver in batches. While
+**      the PP outputs a block (OAM/OAN) the channel is assumed to stay
+**      active and empty, so data words are queued across the transfer
+**      and only functions, disconnects and status checks which need the
+**      device's answer cause a driver call.
+**
+**      The device name "standin" selects a software stand-in for the
+**      driver and adapter, which loops output words back as input, for
+**      testing without the hardware.
+**
 **  This program is free software: you can redistribute it and/or modify
 **  it under the terms of the GNU General Public License version 3 as
 **  published by the Free Software Foundation.
@@ -23,8 +33,6 @@
 **--------------------------------------------------------------------------
 */
 
-#define DEBUG 0
-
 /*
 **  -------------
 **  Include Files
@@ -71,6 +79,15 @@
 #define PciMaskParity       0x1000
 #define PciShiftParity      12
 
+#define PciStreamCycles     IoBatchMax  /* max delay of queued output words */
+
+/*
+**  Stand-in device.
+*/
+#define StandinName         "standin"
+#define StandinFifoSize     4096        /* power of two */
+#define StandinFcRead       0002        /* function: loop queued words back */
+
 /*
 **  -----------------------
 **  Private Macro Functions
@@ -84,10 +101,30 @@
 */
 typedef struct pciParam
     {
+    DevSlot     *dp;
     int         fdPci;
     int         data;
+    bool        batched;        /* driver supports IOCTL_FPGA_BATCH */
+    IoBatch     batch;          /* commands not yet submitted */
+    ChEvent     flushEvent;     /* submits commands at end of major cycle */
+    u16         status;         /* last status read */
+    u32         statusCycle;    /* major cycle of last status read */
+    bool        statusValid;    /* no command issued since status read */
+    bool        streaming;      /* output queued, status assumed active and empty */
+    int         (*request)(int fd, unsigned long req, void *arg);
     } PciParam;
 
+typedef struct standin
+    {
+    bool        active;
+    bool        full;
+    bool        reading;        /* peripheral presents queued words */
+    u16         data;
+    u16         fifo[StandinFifoSize];
+    u32         head;
+    u32         tail;
+    } Standin;
+
 /*
 **  ---------------------------
 **  Private Function Prototypes
@@ -103,6 +140,13 @@ static void pciActivate(void);
 static void pciDisconnect(void);
 static u16 pciFlags(void);
 static void pciCmd(u16 data);
+static void pciFlush(void);
+static void pciFlushEvent(void *param);
+static int pciDriverRequest(int fd, unsigned long req, void *arg);
+static int pciStandinRequest(int fd, unsigned long req, void *arg);
+static void pciStandinCmd(u16 cmd);
+static u16 pciStandinStatus(void);
+static void pciWrite(u16 data);
 static u16 pciStatus(void);
 static u16 pciParity(PpWord val);
 
@@ -118,13 +162,9 @@ static u16 pciParity(PpWord val);
 **  -----------------
 */
 static PciParam *pci;
+static Standin *standin;
 static IoCB io;
 
-#if DEBUG
-static FILE *pciLog = NULL;
-static bool active = FALSE;
-#endif
-
 /*
 **--------------------------------------------------------------------------
 **
@@ -139,7 +179,7 @@ static bool active = FALSE;
 **                  eqNo        equipment number
 **                  unitNo      unit number
 **                  channelNo   channel number the device is attached to
-**                  deviceName  optional device file name
+**                  deviceName  optional device node (default DEVICE_NODE)
 **
 **  Returns:        Nothing.
 **
@@ -147,16 +187,9 @@ static bool active = FALSE;
 void pciInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
     {
     DevSlot *dp;
+    char *node = DEVICE_NODE;
 
     (void)unitNo;
-    (void)deviceName;
-
-#if DEBUG
-    if (pciLog == NULL)
-        {
-        pciLog = fopen("pcilog.txt", "wt");
-        }
-#endif
 
     /*
     **  Attach device to channel and initialise device control block.
@@ -182,19 +215,52 @@ void pciInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
         exit(1);
         }
 
-    pci->fdPci = open(DEVICE_NODE, 0);
-    if (pci->fdPci < 0)
+    pci->dp = dp;
+
+    if (deviceName != NULL && *deviceName != 0)
         {
-        fprintf(stderr, "Can't open %s - error %s\n", DEVICE_NODE, strerror(errno));
-        exit(1);
+        node = deviceName;
+        }
+
+    if (strcmp(node, StandinName) == 0)
+        {
+        standin = calloc(1, sizeof(Standin));
+        if (standin == NULL)
+            {
+            fprintf(stderr, "Failed to allocate PCI channel stand-in\n");
+            exit(1);
+            }
+
+        pci->fdPci = -1;
+        pci->request = pciStandinRequest;
+        }
+    else
+        {
+        pci->fdPci = open(node, 0);
+        if (pci->fdPci < 0)
+            {
+            fprintf(stderr, "Can't open %s - error %s\n", node, strerror(errno));
+            exit(1);
+            }
+
+        pci->request = pciDriverRequest;
         }
 
+    /*
+    **  Probe for batch support with an empty batch. Older drivers only
+    **  provide single register reads and writes.
+    */
+    pci->batch.count = 0;
+    pci->batched = pci->request(pci->fdPci, IOCTL_FPGA_BATCH, &pci->batch) == 0;
+
     pciCmd(PciCmdMasterClear);
+    pciFlush();
 
     /*
     **  Print a friendly message.
     */
-    printf("PCI channel interface initialised on channel %o unit %o\n", channelNo, unitNo);
+    printf("PCI channel interface initialised on channel %o unit %o%s%s\n",
+        channelNo, unitNo, pci->batched ? " (batched)" : "", standin != NULL ? " (stand-in)" : "");
     }
 
 /*
@@ -216,15 +282,17 @@ void pciInit(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName)
 **------------------------------------------------------------------------*/
 static FcStatus pciFunc(PpWord funcCode)
     {
-#if DEBUG
-    fprintf(pciLog, "\n%06d PP:%02o CH:%02o f:%04o >   ",
-            traceSequenceNo,
-            activePpu->id,
-            activeChannel->id,
-            funcCode);
-#endif
+    if (LogOn(LogPci))
+        {
+        logPrintf(LogPci, "\n%06d PP:%02o CH:%02o f:%04o >   ",
+                traceSequenceNo,
+                activePpu->id,
+                activeChannel->id,
+                funcCode);
+        }
 
     pciCmd(PciCmdFunction | funcCode | (pciParity(funcCode) << PciShiftParity));
+    pciFlush();
 
     return(FcAccepted);
     }
@@ -253,9 +321,10 @@ static PpWord pciIn(void)
     {
     PpWord data = pciStatus() & Mask12;
 
-#if DEBUG
-    fprintf(pciLog, " I(%03X)", data);
-#endif
+    if (LogOn(LogPci))
+        {
+        logPrintf(LogPci, " I(%03X)", data);
+        }
 
     return(data);
     }
@@ -283,9 +352,11 @@ static void pciOut(PpWord data)
 **------------------------------------------------------------------------*/
 static void pciFull(void)
     {
-#if DEBUG
-    fprintf(pciLog, " O(%03X)", pci->data);
-#endif
+    if (LogOn(LogPci))
+        {
+        logPrintf(LogPci, " O(%03X)", pci->data);
+        }
+
     pciCmd(PciCmdFull | pci->data | (pciParity(pci->data) << PciShiftParity));
     }
 
@@ -299,9 +370,11 @@ static void pciFull(void)
 **------------------------------------------------------------------------*/
 static void pciEmpty(void)
     {
-#if DEBUG
-    fprintf(pciLog, " E");
-#endif
+    if (LogOn(LogPci))
+        {
+        logPrintf(LogPci, " E");
+        }
+
     pciCmd(PciCmdEmpty);
     }
 
@@ -315,10 +388,11 @@ static void pciEmpty(void)
 **------------------------------------------------------------------------*/
 static void pciActivate(void)
     {
-#if DEBUG
-    fprintf(pciLog, " A");
-    active = TRUE;
-#endif
+    if (LogOn(LogPci))
+        {
+        logPrintf(LogPci, " A");
+        }
+
     pciCmd(PciCmdActive);
     }
 
@@ -332,11 +406,13 @@ static void pciActivate(void)
 **------------------------------------------------------------------------*/
 static void pciDisconnect(void)
     {
-#if DEBUG
-    fprintf(pciLog, " D");
-    active = FALSE;
-#endif
+    if (LogOn(LogPci))
+        {
+        logPrintf(LogPci, " D");
+        }
+
     pciCmd(PciCmdInactive);
+    pciFlush();
     }
 
 /*--------------------------------------------------------------------------
@@ -349,20 +425,15 @@ static void pciDisconnect(void)
 **------------------------------------------------------------------------*/
 static u16 pciFlags(void)
     {
-#if DEBUG
-    u16 s = pciStatus();
-    if (active)
-        {
-//        fprintf(pciLog, " S(%04X)", s);
-        }
-    return(s);
-#else
     return(pciStatus());
-#endif
     }
 
 /*--------------------------------------------------------------------------
-**  Purpose:        Send a PCI command
+**  Purpose:        Queue a PCI command. Queued commands are submitted
+**                  before the next status read which needs the device's
+**                  answer, or at the end of the current major cycle at
+**                  the latest. Output data words on an active channel
+**                  are held for up to PciStreamCycles major cycles.
 **
 **  Parameters:     Name        Description.
 **                  data        command data
@@ -371,21 +442,159 @@ static u16 pciFlags(void)
 **
 **------------------------------------------------------------------------*/
 static void pciCmd(u16 data)
+    {
+    IoCB *op;
+    bool output;
+
+    output =    (data & 0xE000) == PciCmdFull
+             && (pci->statusValid || pci->streaming)
+             && (pci->status & PciStaActive) != 0;
+
+    if (pci->batch.count >= IoBatchMax)
+        {
+        pciFlush();
+        }
+
+    op = pci->batch.op + pci->batch.count++;
+    op->address = 0;
+    op->data = data;
+
+    if (output)
+        {
+        /*
+        **  The adapter passes the word on as soon as the device takes
+        **  it, so to the PP the channel is empty again.
+        */
+        pci->status = PciStaActive;
+        pci->streaming = TRUE;
+        }
+    else
+        {
+        /*
+        **  The command may change the status.
+        */
+        pci->statusValid = FALSE;
+        pci->streaming = FALSE;
+        }
+
+    if (!pci->flushEvent.pending)
+        {
+        channelSchedule(&pci->flushEvent, output ? PciStreamCycles : 1, pciFlushEvent, NULL);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Submit queued PCI commands and read the status.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        nothing
+**
+**------------------------------------------------------------------------*/
+static void pciFlush(void)
+    {
+    IoCB io;
+    int i;
+
+    if (pci->batched)
+        {
+        /*
+        **  One system call for all commands and the status read.
+        */
+        if (pci->request(pci->fdPci, IOCTL_FPGA_BATCH, &pci->batch) != 0)
+            {
+            logError(LogErrorLocation, "PCI batch of %d commands failed: %s", pci->batch.count, strerror(errno));
+            pci->batch.count = 0;
+            pci->statusValid = FALSE;
+            pci->streaming = FALSE;
+            return;
+            }
+
+        pci->status = pci->batch.status;
+        }
+    else
+        {
+        for (i = 0; i < pci->batch.count; i++)
+            {
+            pciWrite(pci->batch.op[i].data);
+            }
+
+        io.address = 0;
+        if (pci->request(pci->fdPci, IOCTL_FPGA_READ, &io) != 0)
+            {
+            logError(LogErrorLocation, "PCI status read failed: %s", strerror(errno));
+            pci->batch.count = 0;
+            pci->statusValid = FALSE;
+            pci->streaming = FALSE;
+            return;
+            }
+
+        pci->status = io.data;
+        }
+
+    pci->batch.count = 0;
+    pci->statusCycle = cycles;
+    pci->statusValid = TRUE;
+    pci->streaming = FALSE;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Submit commands still queued at the end of a major
+**                  cycle.
+**
+**  Parameters:     Name        Description.
+**                  param       unused
+**
+**  Returns:        nothing
+**
+**------------------------------------------------------------------------*/
+static void pciFlushEvent(void *param)
+    {
+    (void)param;
+
+    if (pci->batch.count != 0)
+        {
+        pciFlush();
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write a single PCI command (driver without batch
+**                  support).
+**
+**  Parameters:     Name        Description.
+**                  data        command data
+**
+**  Returns:        nothing
+**
+**------------------------------------------------------------------------*/
+static void pciWrite(u16 data)
     {
     IoCB io;
 
     io.address = 0;
     do
         {
-        ioctl(pci->fdPci, IOCTL_FPGA_READ, &io);
+        if (pci->request(pci->fdPci, IOCTL_FPGA_READ, &io) != 0)
+            {
+            logError(LogErrorLocation, "PCI status read failed: %s", strerror(errno));
+            return;
+            }
         } while ((io.data & PciStaBusy) != 0);
 
     io.data = data;
-    ioctl(pci->fdPci, IOCTL_FPGA_WRITE, &io);
+    if (pci->request(pci->fdPci, IOCTL_FPGA_WRITE, &io) != 0)
+        {
+        logError(LogErrorLocation, "PCI write of %04o failed: %s", data, strerror(errno));
+        }
     }
 
 /*--------------------------------------------------------------------------
-**  Purpose:        Get PCI status.
+**  Purpose:        Get PCI status. The status is read once per major
+**                  cycle unless a command has been issued since, so the
+**                  active, full and data checks of one PP instruction
+**                  share a single read. While output is streaming the
+**                  assumed status is returned without a read.
 **
 **  Parameters:     Name        Description.
 **
@@ -394,11 +603,169 @@ static void pciCmd(u16 data)
 **------------------------------------------------------------------------*/
 static u16 pciStatus(void)
     {
-    IoCB io;
+    if (pci->streaming)
+        {
+        return(pci->status);
+        }
 
-    io.address = 0;
-    ioctl(pci->fdPci, IOCTL_FPGA_READ, &io);
-    return(io.data);
+    if (!pci->statusValid || pci->statusCycle != cycles)
+        {
+        pciFlush();
+        }
+
+    return(pci->status);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Issue a request to the channel adapter driver.
+**
+**  Parameters:     Name        Description.
+**                  fd          driver file descriptor
+**                  req         ioctl request
+**                  arg         request argument
+**
+**  Returns:        0 if successful, -1 with errno set otherwise.
+**
+**------------------------------------------------------------------------*/
+static int pciDriverRequest(int fd, unsigned long req, void *arg)
+    {
+    pci->dp->stats.hostOps += 1;
+    return(ioctl(fd, req, arg));
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Issue a request to the software stand-in, which
+**                  implements the driver interface on a model of the
+**                  adapter's command and status registers.
+**
+**  Parameters:     Name        Description.
+**                  fd          unused
+**                  req         ioctl request
+**                  arg         request argument
+**
+**  Returns:        0 if successful, -1 with errno set otherwise.
+**
+**------------------------------------------------------------------------*/
+static int pciStandinRequest(int fd, unsigned long req, void *arg)
+    {
+    IoBatch *bp;
+    IoCB *iop;
+    int i;
+
+    (void)fd;
+    pci->dp->stats.hostOps += 1;
+
+    switch (req)
+        {
+    case IOCTL_FPGA_BATCH:
+        bp = (IoBatch *)arg;
+        if (bp->count < 0 || bp->count > IoBatchMax)
+            {
+            errno = EINVAL;
+            return(-1);
+            }
+
+        for (i = 0; i < bp->count; i++)
+            {
+            pciStandinCmd(bp->op[i].data);
+            }
+
+        bp->status = pciStandinStatus();
+        return(0);
+
+    case IOCTL_FPGA_READ:
+        iop = (IoCB *)arg;
+        iop->data = pciStandinStatus();
+        return(0);
+
+    case IOCTL_FPGA_WRITE:
+        iop = (IoCB *)arg;
+        pciStandinCmd(iop->data);
+        return(0);
+        }
+
+    errno = EINVAL;
+    return(-1);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Execute an adapter command on the stand-in. The
+**                  peripheral takes every function and output word at
+**                  once and keeps output words. After function
+**                  StandinFcRead it presents them again as input.
+**
+**  Parameters:     Name        Description.
+**                  cmd         command data
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void pciStandinCmd(u16 cmd)
+    {
+    Standin *sp = standin;
+
+    switch (cmd & 0xE000)
+        {
+    case PciCmdFunction:
+        sp->reading = (cmd & PciMaskData) == StandinFcRead;
+        sp->full = FALSE;
+        break;
+
+    case PciCmdFull:
+        if (sp->head - sp->tail < StandinFifoSize)
+            {
+            sp->fifo[sp->head++ & (StandinFifoSize - 1)] = cmd & PciMaskData;
+            }
+
+        sp->full = FALSE;
+        break;
+
+    case PciCmdEmpty:
+        sp->full = FALSE;
+        break;
+
+    case PciCmdActive:
+        sp->active = TRUE;
+        break;
+
+    case PciCmdInactive:
+        sp->active = FALSE;
+        sp->full = FALSE;
+        sp->reading = FALSE;
+        break;
+
+    case PciCmdClear:
+        sp->full = FALSE;
+        break;
+
+    case PciCmdMasterClear:
+        memset(sp, 0, sizeof(Standin));
+        break;
+        }
+
+    /*
+    **  While reading, the peripheral refills the empty channel.
+    */
+    if (sp->reading && sp->active && !sp->full && sp->tail != sp->head)
+        {
+        sp->data = sp->fifo[sp->tail++ & (StandinFifoSize - 1)];
+        sp->full = TRUE;
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read the status of the stand-in.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Status word.
+**
+**------------------------------------------------------------------------*/
+static u16 pciStandinStatus(void)
+    {
+    return(  (standin->active ? PciStaActive : 0)
+           | (standin->full ? PciStaFull : 0)
+           | (standin->full ? standin->data : 0));
     }
 
 /*--------------------------------------------------------------------------
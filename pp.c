@@ -41,6 +41,15 @@
 **  -----------------
 */
 
+/*
+**  Use threaded dispatch (computed goto) where the compiler supports it.
+*/
+#if defined(__GNUC__)
+#define CcPpThreaded            1
+#else
+#define CcPpThreaded            0
+#endif
+
 /*
 **  -----------------------
 **  Private Macro Functions
@@ -92,6 +101,11 @@
 **  Private Function Prototypes
 **  ---------------------------
 */
+static ForceInline u8 ppFetch(void);
+#if CcDebug == 1
+static void ppTraceResult(void);
+#endif
+
 static void ppOpPSN(void);    // 00
 static void ppOpLJM(void);    // 01
 static void ppOpRJM(void);    // 02
@@ -157,6 +171,15 @@ static void ppOpDCN(void);    // 75
 static void ppOpFAN(void);    // 76
 static void ppOpFNC(void);    // 77
 
+static void ppOpCRDNoRel(void);
+static void ppOpCRMNoRel(void);
+static void ppOpCWDNoRel(void);
+static void ppOpCWMNoRel(void);
+static ForceInline void ppOpCRDModel(ModelFeatures modelFeatures);
+static ForceInline void ppOpCRMModel(ModelFeatures modelFeatures);
+static ForceInline void ppOpCWDModel(ModelFeatures modelFeatures);
+static ForceInline void ppOpCWMModel(ModelFeatures modelFeatures);
+
 static u32 ppAdd18(u32 op1, u32 op2);
 static u32 ppSubtract18(u32 op1, u32 op2);
 static void ppInterlock(PpWord func);
@@ -329,6 +352,20 @@ void ppInit(u8 count)
 
     pp = 0;
 
+    /*
+    **  Models without relocation register get central memory access and
+    **  LRD/SRD opcodes which don't test for it on every word.
+    */
+    if ((features & HasRelocationReg) == 0)
+        {
+        decodePpuOpcode[024] = ppOpPSN;
+        decodePpuOpcode[025] = ppOpPSN;
+        decodePpuOpcode[060] = ppOpCRDNoRel;
+        decodePpuOpcode[061] = ppOpCRMNoRel;
+        decodePpuOpcode[062] = ppOpCWDNoRel;
+        decodePpuOpcode[063] = ppOpCWMNoRel;
+        }
+
     /*
     **  Print a friendly message.
     */
@@ -366,7 +403,7 @@ void ppTerminate(void)
     }
 
 /*--------------------------------------------------------------------------
-**  Purpose:        Execute one instruction in an active PPU.
+**  Purpose:        Execute one instruction in each active PPU.
 **
 **  Parameters:     Name        Description.
 **
@@ -375,83 +412,138 @@ void ppTerminate(void)
 **------------------------------------------------------------------------*/
 void ppStep(void)
     {
-    u8 i;
-    PpWord opCode;
+    u8 i = 0;
 
+#if CcPpThreaded
     /*
-    **  Exercise each PP in the barrel.
+    **  Threaded dispatch: every handler is followed by its own fetch and
+    **  indirect jump to the next PP's handler, instead of a return to a
+    **  common call site. Opcodes with model specific handlers (see ppInit)
+    **  still go through the decode table.
     */
-    for (i = 0; i < ppuCount; i++)
-        {
-        /*
-        **  Advance to next PPU.
-        */
-        activePpu = ppu + i;
-
-        if (!activePpu->busy)
-            {
-            /*
-            **  Extract next PPU instruction.
-            */
-            opCode = activePpu->mem[activePpu->regP];
-            opF = (opCode >> 6) & 077;
-            opD = opCode & 077;
+    static void *threaded[0100] =
+        {
+        &&ppLabel00, &&ppLabel01, &&ppLabel02, &&ppLabel03,
+        &&ppLabel04, &&ppLabel05, &&ppLabel06, &&ppLabel07,
+        &&ppLabel10, &&ppLabel11, &&ppLabel12, &&ppLabel13,
+        &&ppLabel14, &&ppLabel15, &&ppLabel16, &&ppLabel17,
+        &&ppLabel20, &&ppLabel21, &&ppLabel22, &&ppLabel23,
+        &&ppLabel24, &&ppLabel25, &&ppLabel26, &&ppLabel27,
+        &&ppLabel30, &&ppLabel31, &&ppLabel32, &&ppLabel33,
+        &&ppLabel34, &&ppLabel35, &&ppLabel36, &&ppLabel37,
+        &&ppLabel40, &&ppLabel41, &&ppLabel42, &&ppLabel43,
+        &&ppLabel44, &&ppLabel45, &&ppLabel46, &&ppLabel47,
+        &&ppLabel50, &&ppLabel51, &&ppLabel52, &&ppLabel53,
+        &&ppLabel54, &&ppLabel55, &&ppLabel56, &&ppLabel57,
+        &&ppLabel60, &&ppLabel61, &&ppLabel62, &&ppLabel63,
+        &&ppLabel64, &&ppLabel65, &&ppLabel66, &&ppLabel67,
+        &&ppLabel70, &&ppLabel71, &&ppLabel72, &&ppLabel73,
+        &&ppLabel74, &&ppLabel75, &&ppLabel76, &&ppLabel77
+        };
 
 #if CcDebug == 1
-            /*
-            **  Save opF and opD for post-instruction trace.
-            */
-            activePpu->opF = opF;
-            activePpu->opD = opD;
-
-            /*
-            **  Trace instructions.
-            */
-            traceSequence();
-            traceRegisters();
-            traceOpcode();
+#define PpTraceResult ppTraceResult()
 #else
-traceSequenceNo += 1;
+#define PpTraceResult
 #endif
 
-            /*
-            **  Increment register P.
-            */
-            PpIncrement(activePpu->regP);
+#define PpDispatchNext                                                      \
+    PpTraceResult;                                                          \
+    if (++i >= ppuCount)                                                    \
+        {                                                                   \
+        return;                                                             \
+        }                                                                   \
+    activePpu = ppu + i;                                                    \
+    goto *threaded[ppFetch()]
 
-            /*
-            **  Execute PPU instruction.
-            */
-            decodePpuOpcode[opF]();
-            }
-        else
-            {
-            /*
-            **  Resume PPU instruction.
-            */
-            decodePpuOpcode[activePpu->opF]();
-            }
+    if (ppuCount == 0)
+        {
+        return;
+        }
 
+    activePpu = ppu;
+    goto *threaded[ppFetch()];
+
+    ppLabel00: ppOpPSN();                 PpDispatchNext;
+    ppLabel01: ppOpLJM();                 PpDispatchNext;
+    ppLabel02: ppOpRJM();                 PpDispatchNext;
+    ppLabel03: ppOpUJN();                 PpDispatchNext;
+    ppLabel04: ppOpZJN();                 PpDispatchNext;
+    ppLabel05: ppOpNJN();                 PpDispatchNext;
+    ppLabel06: ppOpPJN();                 PpDispatchNext;
+    ppLabel07: ppOpMJN();                 PpDispatchNext;
+    ppLabel10: ppOpSHN();                 PpDispatchNext;
+    ppLabel11: ppOpLMN();                 PpDispatchNext;
+    ppLabel12: ppOpLPN();                 PpDispatchNext;
+    ppLabel13: ppOpSCN();                 PpDispatchNext;
+    ppLabel14: ppOpLDN();                 PpDispatchNext;
+    ppLabel15: ppOpLCN();                 PpDispatchNext;
+    ppLabel16: ppOpADN();                 PpDispatchNext;
+    ppLabel17: ppOpSBN();                 PpDispatchNext;
+    ppLabel20: ppOpLDC();                 PpDispatchNext;
+    ppLabel21: ppOpADC();                 PpDispatchNext;
+    ppLabel22: ppOpLPC();                 PpDispatchNext;
+    ppLabel23: ppOpLMC();                 PpDispatchNext;
+    ppLabel24: decodePpuOpcode[024]();    PpDispatchNext;
+    ppLabel25: decodePpuOpcode[025]();    PpDispatchNext;
+    ppLabel26: ppOpEXN();                 PpDispatchNext;
+    ppLabel27: ppOpRPN();                 PpDispatchNext;
+    ppLabel30: ppOpLDD();                 PpDispatchNext;
+    ppLabel31: ppOpADD();                 PpDispatchNext;
+    ppLabel32: ppOpSBD();                 PpDispatchNext;
+    ppLabel33: ppOpLMD();                 PpDispatchNext;
+    ppLabel34: ppOpSTD();                 PpDispatchNext;
+    ppLabel35: ppOpRAD();                 PpDispatchNext;
+    ppLabel36: ppOpAOD();                 PpDispatchNext;
+    ppLabel37: ppOpSOD();                 PpDispatchNext;
+    ppLabel40: ppOpLDI();                 PpDispatchNext;
+    ppLabel41: ppOpADI();                 PpDispatchNext;
+    ppLabel42: ppOpSBI();                 PpDispatchNext;
+    ppLabel43: ppOpLMI();                 PpDispatchNext;
+    ppLabel44: ppOpSTI();                 PpDispatchNext;
+    ppLabel45: ppOpRAI();                 PpDispatchNext;
+    ppLabel46: ppOpAOI();                 PpDispatchNext;
+    ppLabel47: ppOpSOI();                 PpDispatchNext;
+    ppLabel50: ppOpLDM();                 PpDispatchNext;
+    ppLabel51: ppOpADM();                 PpDispatchNext;
+    ppLabel52: ppOpSBM();                 PpDispatchNext;
+    ppLabel53: ppOpLMM();                 PpDispatchNext;
+    ppLabel54: ppOpSTM();                 PpDispatchNext;
+    ppLabel55: ppOpRAM();                 PpDispatchNext;
+    ppLabel56: ppOpAOM();                 PpDispatchNext;
+    ppLabel57: ppOpSOM();                 PpDispatchNext;
+    ppLabel60: decodePpuOpcode[060]();    PpDispatchNext;
+    ppLabel61: decodePpuOpcode[061]();    PpDispatchNext;
+    ppLabel62: decodePpuOpcode[062]();    PpDispatchNext;
+    ppLabel63: decodePpuOpcode[063]();    PpDispatchNext;
+    ppLabel64: ppOpAJM();                 PpDispatchNext;
+    ppLabel65: ppOpIJM();                 PpDispatchNext;
+    ppLabel66: ppOpFJM();                 PpDispatchNext;
+    ppLabel67: ppOpEJM();                 PpDispatchNext;
+    ppLabel70: ppOpIAN();                 PpDispatchNext;
+    ppLabel71: ppOpIAM();                 PpDispatchNext;
+    ppLabel72: ppOpOAN();                 PpDispatchNext;
+    ppLabel73: ppOpOAM();                 PpDispatchNext;
+    ppLabel74: ppOpACN();                 PpDispatchNext;
+    ppLabel75: ppOpDCN();                 PpDispatchNext;
+    ppLabel76: ppOpFAN();                 PpDispatchNext;
+    ppLabel77: ppOpFNC();                 PpDispatchNext;
+
+#undef PpDispatchNext
+#undef PpTraceResult
+#else
+    /*
+    **  Exercise each PP in the barrel.
+    */
+    for (i = 0; i < ppuCount; i++)
+        {
+        activePpu = ppu + i;
+        decodePpuOpcode[ppFetch()]();
 #if CcDebug == 1
-        if (!activePpu->busy)
-            {
-            /*
-            **  Trace result.
-            */
-            traceRegisters();
-
-            /*
-            **  Trace new channel status.
-            */
-            if (activePpu->opF >= 064)
-                {
-                traceChannel((u8)(activePpu->opD & 037));
-                }
-
-            traceEnd();
-            }
+        ppTraceResult();
 #endif
         }
+#endif
     }
 
 /*
@@ -462,6 +554,93 @@ traceSequenceNo += 1;
 **--------------------------------------------------------------------------
 */
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Fetch and decode the next instruction of the active PPU,
+**                  or continue the one it is busy with.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Opcode to execute.
+**
+**------------------------------------------------------------------------*/
+static ForceInline u8 ppFetch(void)
+    {
+    PpWord opCode;
+
+    if (!activePpu->busy)
+        {
+        /*
+        **  Extract next PPU instruction. There is deliberately no
+        **  pre-decoded copy of PP memory: splitting a word is a shift and
+        **  a mask, while a copy would need invalidating on every store
+        **  into mem[] (instructions, channel input, CM reads, deadstart).
+        */
+        opCode = activePpu->mem[activePpu->regP];
+        opF = (opCode >> 6) & 077;
+        opD = opCode & 077;
+
+#if CcDebug == 1
+        /*
+        **  Save opF and opD for post-instruction trace.
+        */
+        activePpu->opF = opF;
+        activePpu->opD = opD;
+
+        /*
+        **  Trace instructions.
+        */
+        traceSequence();
+        traceRegisters();
+        traceOpcode();
+#else
+traceSequenceNo += 1;
+#endif
+
+        /*
+        **  Increment register P.
+        */
+        PpIncrement(activePpu->regP);
+
+        return(opF);
+        }
+
+    /*
+    **  Resume PPU instruction.
+    */
+    return(activePpu->opF);
+    }
+
+#if CcDebug == 1
+/*--------------------------------------------------------------------------
+**  Purpose:        Trace result of PPU instruction.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void ppTraceResult(void)
+    {
+    if (!activePpu->busy)
+        {
+        /*
+        **  Trace result.
+        */
+        traceRegisters();
+
+        /*
+        **  Trace new channel status.
+        */
+        if (activePpu->opF >= 064)
+            {
+            traceChannel((u8)(activePpu->opD & 037));
+            }
+
+        traceEnd();
+        }
+    }
+#endif
+
 /*--------------------------------------------------------------------------
 **  Purpose:        18 bit ones-complement addition with subtractive adder
 **
@@ -943,10 +1122,20 @@ static void ppOpSOM(void)     // 57
     }
 
 static void ppOpCRD(void)     // 60
+    {
+    ppOpCRDModel(features);
+    }
+
+static void ppOpCRDNoRel(void)
+    {
+    ppOpCRDModel((ModelFeatures)0);
+    }
+
+static ForceInline void ppOpCRDModel(ModelFeatures modelFeatures)
     {
     CpWord data;
 
-    if ((activePpu->regA & Sign18) != 0 && (features & HasRelocationReg) != 0)
+    if ((activePpu->regA & Sign18) != 0 && (modelFeatures & HasRelocationReg) != 0)
         {
         cpuPpReadMem(activePpu->regR + (activePpu->regA & Mask17), &data);
         }
@@ -963,6 +1152,16 @@ static void ppOpCRD(void)     // 60
     }
 
 static void ppOpCRM(void)     // 61
+    {
+    ppOpCRMModel(features);
+    }
+
+static void ppOpCRMNoRel(void)
+    {
+    ppOpCRMModel((ModelFeatures)0);
+    }
+
+static ForceInline void ppOpCRMModel(ModelFeatures modelFeatures)
     {
     CpWord data;
 
@@ -979,7 +1178,7 @@ static void ppOpCRM(void)     // 61
 
     if (activePpu->regQ--)
         {
-        if ((activePpu->regA & Sign18) != 0 && (features & HasRelocationReg) != 0)
+        if ((activePpu->regA & Sign18) != 0 && (modelFeatures & HasRelocationReg) != 0)
             {
             cpuPpReadMem(activePpu->regR + (activePpu->regA & Mask17), &data);
             }
@@ -1007,6 +1206,16 @@ static void ppOpCRM(void)     // 61
     }
 
 static void ppOpCWD(void)     // 62
+    {
+    ppOpCWDModel(features);
+    }
+
+static void ppOpCWDNoRel(void)
+    {
+    ppOpCWDModel((ModelFeatures)0);
+    }
+
+static ForceInline void ppOpCWDModel(ModelFeatures modelFeatures)
     {
     CpWord data;
 
@@ -1024,7 +1233,7 @@ static void ppOpCWD(void)     // 62
 
     data |= activePpu->mem[opD   & Mask12] & Mask12;
 
-    if ((activePpu->regA & Sign18) != 0 && (features & HasRelocationReg) != 0)
+    if ((activePpu->regA & Sign18) != 0 && (modelFeatures & HasRelocationReg) != 0)
         {
         cpuPpWriteMem(activePpu->regR + (activePpu->regA & Mask17), data);
         }
@@ -1035,6 +1244,16 @@ static void ppOpCWD(void)     // 62
     }
 
 static void ppOpCWM(void)     // 63
+    {
+    ppOpCWMModel(features);
+    }
+
+static void ppOpCWMNoRel(void)
+    {
+    ppOpCWMModel((ModelFeatures)0);
+    }
+
+static ForceInline void ppOpCWMModel(ModelFeatures modelFeatures)
     {
     CpWord data;
 
@@ -1065,7 +1284,7 @@ static void ppOpCWM(void)     // 63
 
         data |= activePpu->mem[activePpu->regP++ & Mask12] & Mask12;
 
-        if ((activePpu->regA & Sign18) != 0 && (features & HasRelocationReg) != 0)
+        if ((activePpu->regA & Sign18) != 0 && (modelFeatures & HasRelocationReg) != 0)
             {
             cpuPpWriteMem(activePpu->regR + (activePpu->regA & Mask17), data);
             }
@@ -1236,7 +1455,7 @@ static void ppOpIAN(void)     // 70
         {
         activePpu->opF = opF;
         activePpu->opD = opD;
-        activeChannel->delayStatus = 0;
+        channelDelayStatus(0);
         }
 
     noHang = (activePpu->opD & 040) != 0;
@@ -1277,7 +1496,7 @@ static void ppOpIAN(void)     // 70
         if (activeChannel->discAfterInput)
             {
             activeChannel->discAfterInput = FALSE;
-            activeChannel->delayDisconnect = 0;
+            channelDelayDisconnect(0);
             activeChannel->active = FALSE;
             activeChannel->ioDevice = NULL;
             }
@@ -1298,7 +1517,7 @@ static void ppOpIAM(void)     // 71
 
         activePpu->mem[0] = activePpu->regP;
         activePpu->regP = activePpu->mem[activePpu->regP] & Mask12;
-        activeChannel->delayStatus = 0;
+        channelDelayStatus(0);
         }
     else
         {
@@ -1357,7 +1576,7 @@ static void ppOpIAM(void)     // 71
         if (activeChannel->discAfterInput)
             {
             activeChannel->discAfterInput = FALSE;
-            activeChannel->delayDisconnect = 0;
+            channelDelayDisconnect(0);
             activeChannel->active = FALSE;
             activeChannel->ioDevice = NULL;
             if (activePpu->regA != 0)
@@ -1383,7 +1602,7 @@ static void ppOpOAN(void)     // 72
         {
         activePpu->opF = opF;
         activePpu->opD = opD;
-        activeChannel->delayStatus = 0;
+        channelDelayStatus(0);
         }
 
     noHang = (activePpu->opD & 040) != 0;
@@ -1427,7 +1646,7 @@ static void ppOpOAM(void)     // 73
 
         activePpu->mem[0] = activePpu->regP;
         activePpu->regP = activePpu->mem[activePpu->regP] & Mask12;
-        activeChannel->delayStatus = 0;
+        channelDelayStatus(0);
         }
     else
         {
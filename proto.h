@@ -51,6 +51,14 @@ void rtcStartTimer(void);
 double rtcStopTimer(void);
 void rtcReadUsCounter(void);
 
+/*
+**  timer.c
+*/
+void timerStart(TimerSlot *tp, u32 delayUs, void (*callback)(void *param), void *param);
+void timerCancel(TimerSlot *tp);
+bool timerPending(TimerSlot *tp);
+void timerStep(void);
+
 /*
 **  channel.c
 */
@@ -69,6 +77,11 @@ void channelIn(void);
 void channelSetFull(void);
 void channelSetEmpty(void);
 void channelStep(void);
+void channelSchedule(ChEvent *ep, u32 delay, void (*handler)(void *param), void *param);
+void channelCancel(ChEvent *ep);
+void channelDelayStatus(u8 delay);
+void channelDelayDisconnect(u8 delay);
+void channelCapture(char *params);
 
 /*
 **  pp.c
@@ -84,11 +97,12 @@ void cpuInit(char *model, u32 memory, u32 emBanks, ExtMemory emType);
 void cpuTerminate(void);
 u32 cpuGetP(void);
 bool cpuExchangeJump(u32 addr);
-void cpuStep(void);
 bool cpuEcsFlagRegister(u32 ecsAddress);
 bool cpuDdpTransfer(u32 ecsAddress, CpWord *data, bool writeToEcs);
 void cpuPpReadMem(u32 address, CpWord *data);
 void cpuPpWriteMem(u32 address, CpWord data);
+void cpuProfile(bool enable);
+u64 cpuProfileTicks(void);
 
 /*
 **  mt362x.c
@@ -144,6 +158,7 @@ void cr3447LoadCards(char *params);
 **  lp1612.c
 */
 void lp1612Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName);
+void lp1612Terminate(DevSlot *dp);
 void lp1612RemovePaper(char *params);
 
 /*
@@ -151,8 +166,60 @@ void lp1612RemovePaper(char *params);
 */
 void lp501Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName);
 void lp512Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName);
+void lp3000Terminate(DevSlot *dp);
 void lp3000RemovePaper(char *params);
 
+/*
+**  deck.c
+*/
+void deckInit(DeckQueue *dq, u8 syntax, const u16 *table, char *watchDir);
+void deckLoad(DeckQueue *dq, char *fileName);
+Card *deckNextCard(DeckQueue *dq);
+bool deckReady(DeckQueue *dq);
+int deckCount(DeckQueue *dq);
+
+/*
+**  spool.c
+*/
+Spool *spoolOpen(char *fileName, char *prefix);
+void spoolClose(Spool *sp);
+void spoolPutChar(Spool *sp, u8 ch);
+void spoolPutString(Spool *sp, char *str);
+void spoolEndJob(Spool *sp);
+bool spoolRemovePaper(Spool *sp, char *doneMsg);
+
+/*
+**  charset.c
+*/
+void charsetToAscii(const u8 *in, u32 count, char *out, const char *table);
+u32 charsetPpToAscii(const PpWord *in, u32 wordCount, char *out, const char *table);
+u32 charsetCmToAscii(const CpWord *in, u32 wordCount, char *out, const char *table);
+
+/*
+**  pack.c
+*/
+u32 packBytesToWords(u8 *in, u32 byteCount, PpWord *out);
+u32 packWordsToBytes(PpWord *in, u32 wordCount, u8 *out);
+u32 packConvBytesToWords(u8 *in, u32 byteCount, PpWord *out, const u8 *table, bool *flagged);
+u32 packConvWordsToBytes(PpWord *in, u32 wordCount, u8 *out, const u8 *table);
+
+/*
+**  tape.c
+*/
+FILE *tapeOpen(char *fileName, char *mode);
+bool tapeMount(TapeMount *mp);
+bool tapeMountPending(DevSlot *dp, u8 unitNo);
+void tapeClose(FILE *fcb);
+void tapeTerminate(void);
+
+/*
+**  stats.c
+*/
+void statsInit(void);
+u64 statsClock(void);
+void statsHostIo(DevStats *sp, u32 bytes, u64 startUs);
+void statsShow(void);
+
 /*
 **  console.c
 */
@@ -169,6 +236,7 @@ void dd6603Init(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName);
 void dd844Init_2(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName);
 void dd844Init_4(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName);
 void dd885Init_1(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName);
+void dd8xxSnapshot(char *params);
 
 /*
 **  dcc6681.c
@@ -269,7 +337,7 @@ CpWord shiftNormalize(CpWord number, u32 *shift, bool round);
 CpWord shiftMask(u8 count);
 
 /*
-**  window_{win32,x11}.c
+**  window_{win32,x11,net}.c
 */
 void windowInit(void);
 void windowSetFont(u8 font);
@@ -291,6 +359,12 @@ void opRequest(void);
 */
 void logInit(void);
 void logError(char *file, int line, char *fmt, ...);
+void logPrintf(u8 cat, char *fmt, ...);
+#if defined(va_start)
+void logVPrintf(u8 cat, char *fmt, va_list args);
+#endif
+bool logSelect(char *list);
+void logShow(void);
 
 /*
 **  -----------------
@@ -299,6 +373,7 @@ void logError(char *file, int line, char *fmt, ...);
 */
 
 extern bool emulationActive;
+extern volatile u32 logCategories;
 extern PpSlot *ppu;
 extern ChSlot *channel;
 extern u8 ppuCount;
@@ -309,9 +384,11 @@ extern DevSlot *activeDevice;
 extern DevSlot *active3000Device;
 extern CpuContext cpu;
 extern bool cpuStopped;
+extern void (*cpuStep)(void);
 extern CpWord *cpMem;
 extern u32 cpuMaxMemory;
 extern u32 extMaxMemory;
+extern CpuOpStats cpuOpStats[01000];
 extern char ppKeyIn;
 extern const u8 asciiToCdc[256];
 extern const char cdcToAscii[64];
@@ -337,8 +414,15 @@ extern u32 rtcClock;
 extern ModelFeatures features;
 extern ModelType modelType;
 extern char persistDir[];
+extern char ecsSharedName[];
 extern u16 npuNetTelnetPort;
 extern u16 npuNetTcpConns;
+extern u16 consoleNetPort;
+extern u16 consoleNetConns;
+extern u32 spoolRolloverSize;
+extern bool spoolJobSplit;
+extern bool spoolAsaFormat;
+extern u16 statsPort;
 
 #endif /* PROTO_H */
 /*---------------------------  End Of File  ------------------------------*/
@@ -0,0 +1,501 @@
+/*--------------------------------------------------------------------------
+**
+**  Copyright (c) 2003-2011, Tom Hunter
+**
+**  Name: replay.c
+**
+**  Description:
+**      Replay a channel capture (see channelCapture) against the device
+**      emulation without PPs, CPU or operating system and report the
+**      time spent in the device code per function and per word.
+**
+**      Usage: dtreplay [-p <passes>] <capture file> <equipment> ...
+**
+**      Each <equipment> argument has the format of an equipment line
+**      in cyber.ini, e.g. DD885,0,0,04,disk.dd885.
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License version 3 as
+**  published by the Free Software Foundation.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License version 3 for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  version 3 along with this program in file "license-gpl-3.0.txt".
+**  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+**
+**--------------------------------------------------------------------------
+*/
+
+/*
+**  -------------
+**  Include Files
+**  -------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "const.h"
+#include "types.h"
+#include "proto.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/*
+**  -----------------
+**  Private Constants
+**  -----------------
+*/
+#define ReplayWaitCycles        100000
+
+/*
+**  -----------------------
+**  Private Macro Functions
+**  -----------------------
+*/
+
+/*
+**  -----------------------------------------
+**  Private Typedef and Structure Definitions
+**  -----------------------------------------
+*/
+
+/*
+**  ---------------------------
+**  Private Function Prototypes
+**  ---------------------------
+*/
+static u8 *replayLoad(char *fileName, long *size);
+static void replayAttach(char *equipment);
+static void replayRun(u8 *rec, u8 *end);
+static bool replayWait(bool full);
+static u64 replayClock(void);
+
+/*
+**  ----------------
+**  Public Variables
+**  ----------------
+*/
+char ppKeyIn;
+bool emulationActive = TRUE;
+u32 cycles;
+#if CcCycleTime
+double cycleTime;
+#endif
+
+/*
+**  -----------------
+**  Private Variables
+**  -----------------
+*/
+static u8 replayChannel;
+static u64 functionNs;
+static u64 outputNs;
+static u64 inputNs;
+static long functionCount;
+static long outputCount;
+static long inputCount;
+static long waitCycles;
+static long stallCount;
+static long mismatchCount;
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Public Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Replay harness main program.
+**
+**  Parameters:     Name        Description.
+**                  argc        Argument count.
+**                  argv        Array of argument strings.
+**
+**  Returns:        Zero on success.
+**
+**------------------------------------------------------------------------*/
+int main(int argc, char **argv)
+    {
+    int passes = 1;
+    int i;
+    u8 *buf;
+    long size;
+    u64 start;
+    u64 total;
+
+    if (argc >= 3 && strcmp(argv[1], "-p") == 0)
+        {
+        passes = atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+        }
+
+    if (argc < 3 || passes < 1)
+        {
+        fprintf(stderr, "Usage: dtreplay [-p <passes>] <capture file> <equipment> ...\n");
+        fprintf(stderr, "       <equipment> as in cyber.ini, e.g. DD885,0,0,04,disk.dd885\n");
+        exit(1);
+        }
+
+    logInit();
+
+    buf = replayLoad(argv[1], &size);
+    replayChannel = buf[CapMagicSize];
+
+    /*
+    **  Build the same channel and device configuration as the captured
+    **  system. The clock advances by one per major cycle so that device
+    **  timers fire after a reproducible number of cycles.
+    */
+    channelInit(MaxChannels);
+    rtcInit(1, 0);
+    for (i = 2; i < argc; i++)
+        {
+        replayAttach(argv[i]);
+        }
+
+    if (channel[replayChannel].firstDevice == NULL)
+        {
+        fprintf(stderr, "No equipment attached to captured channel %o\n", replayChannel);
+        exit(1);
+        }
+
+    /*
+    **  Drive the devices.
+    */
+    start = replayClock();
+    for (i = 0; i < passes; i++)
+        {
+        replayRun(buf + CapMagicSize + 1, buf + size);
+        }
+
+    total = replayClock() - start;
+
+    /*
+    **  Report.
+    */
+    printf("Replayed channel %o, %d pass(es) in %.3f ms\n", replayChannel, passes, (double)(long long)total / 1000000.0);
+    printf("    functions    %10ld  %10.1f ns/function\n", functionCount,
+        functionCount == 0 ? 0.0 : (double)(long long)functionNs / functionCount);
+    printf("    words out    %10ld  %10.1f ns/word\n", outputCount,
+        outputCount == 0 ? 0.0 : (double)(long long)outputNs / outputCount);
+    printf("    words in     %10ld  %10.1f ns/word\n", inputCount,
+        inputCount == 0 ? 0.0 : (double)(long long)inputNs / inputCount);
+    printf("    wait cycles  %10ld\n", waitCycles);
+    printf("    stalls       %10ld\n", stallCount);
+    printf("    mismatches   %10ld\n", mismatchCount);
+
+    free(buf);
+    channelTerminate();
+    tapeTerminate();
+
+    return(stallCount == 0 && mismatchCount == 0 ? 0 : 2);
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read the whole capture file so that no file I/O is
+**                  timed.
+**
+**  Parameters:     Name        Description.
+**                  fileName    capture file name
+**                  size        returns size of file
+**
+**  Returns:        Pointer to buffer holding the file.
+**
+**------------------------------------------------------------------------*/
+static u8 *replayLoad(char *fileName, long *size)
+    {
+    FILE *fcb;
+    u8 *buf;
+
+    fcb = fopen(fileName, "rb");
+    if (fcb == NULL)
+        {
+        fprintf(stderr, "Failed to open %s\n", fileName);
+        exit(1);
+        }
+
+    fseek(fcb, 0, SEEK_END);
+    *size = ftell(fcb);
+    fseek(fcb, 0, SEEK_SET);
+
+    buf = malloc(*size + 1);
+    if (buf == NULL)
+        {
+        fprintf(stderr, "Failed to allocate capture buffer\n");
+        exit(1);
+        }
+
+    if (   *size < CapMagicSize + 1
+        || fread(buf, 1, *size, fcb) != (size_t)*size
+        || memcmp(buf, CapMagic, CapMagicSize) != 0
+        || buf[CapMagicSize] >= MaxChannels)
+        {
+        fprintf(stderr, "%s is not a channel capture file\n", fileName);
+        exit(1);
+        }
+
+    fclose(fcb);
+    return(buf);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Attach a device described like an equipment line in
+**                  cyber.ini.
+**
+**  Parameters:     Name        Description.
+**                  equipment   "<type>,<eq>,<unit>,<channel>[,<name>]"
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void replayAttach(char *equipment)
+    {
+    char *token;
+    char *deviceName;
+    int eqNo;
+    int unitNo;
+    int channelNo;
+    u8 deviceIndex;
+
+    token = strtok(equipment, ",");
+    for (deviceIndex = 0; token != NULL && deviceIndex < deviceCount; deviceIndex++)
+        {
+        if (strcmp(token, deviceDesc[deviceIndex].id) == 0)
+            {
+            break;
+            }
+        }
+
+    if (token == NULL || deviceIndex == deviceCount)
+        {
+        fprintf(stderr, "Unknown device %s\n", token == NULL ? "NULL" : token);
+        exit(1);
+        }
+
+    token = strtok(NULL, ",");
+    eqNo = token == NULL ? -1 : (int)strtol(token, NULL, 8);
+    token = strtok(NULL, ",");
+    unitNo = token == NULL ? -1 : (int)strtol(token, NULL, 8);
+    token = strtok(NULL, ",");
+    channelNo = token == NULL ? -1 : (int)strtol(token, NULL, 8);
+    deviceName = strtok(NULL, " ");
+
+    if (   eqNo < 0 || eqNo >= MaxEquipment
+        || unitNo < 0 || unitNo >= MaxUnits2
+        || channelNo < 0 || channelNo >= MaxChannels)
+        {
+        fprintf(stderr, "Invalid equipment, unit or channel no for %s\n", deviceDesc[deviceIndex].id);
+        exit(1);
+        }
+
+    if (channelNo != replayChannel)
+        {
+        printf("Note: %s is on channel %o, capture is of channel %o\n", deviceDesc[deviceIndex].id, channelNo, replayChannel);
+        }
+
+    deviceDesc[deviceIndex].init((u8)eqNo, (u8)unitNo, (u8)channelNo, deviceName);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Replay all records of a capture once. The PP side of
+**                  each transfer is done the way pp.c does it, the device
+**                  is polled until it has moved the recorded word.
+**
+**  Parameters:     Name        Description.
+**                  rec         first record
+**                  end         end of records
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void replayRun(u8 *rec, u8 *end)
+    {
+    ChSlot *cc = channel + replayChannel;
+    PpWord word;
+    FcStatus status;
+    u64 start;
+    u8 type;
+
+    while (rec < end)
+        {
+        type = *rec++;
+        word = 0;
+        if (type != CapActivate && type != CapDisconnect)
+            {
+            if (end - rec < 2)
+                {
+                break;
+                }
+
+            word = (PpWord)(rec[0] | (rec[1] << 8));
+            rec += 2;
+            }
+
+        activeChannel = cc;
+        switch (type)
+            {
+        case CapFunction:
+            if (rec >= end)
+                {
+                return;
+                }
+
+            status = (FcStatus)*rec++;
+            start = replayClock();
+            channelFunction(word);
+            functionNs += replayClock() - start;
+            functionCount += 1;
+
+            if (cc->ioDevice != NULL)
+                {
+                mismatchCount += status != FcAccepted;
+                }
+            else
+                {
+                mismatchCount += status != (cc->full ? FcDeclined : FcProcessed);
+                }
+            break;
+
+        case CapActivate:
+            channelActivate();
+            break;
+
+        case CapDisconnect:
+            channelDisconnect();
+            break;
+
+        case CapOutput:
+            /*
+            **  A recorded word proves the channel was active, even if a
+            **  delayed disconnect has since dropped it here.
+            */
+            cc->active = TRUE;
+            cc->data = word;
+            channelSetFull();
+            start = replayClock();
+            if (!replayWait(FALSE))
+                {
+                cc->full = FALSE;
+                }
+
+            outputNs += replayClock() - start;
+            outputCount += 1;
+            break;
+
+        case CapInput:
+            cc->active = TRUE;
+            start = replayClock();
+            if (replayWait(TRUE))
+                {
+                mismatchCount += (cc->data & Mask12) != word;
+                }
+
+            inputNs += replayClock() - start;
+            inputCount += 1;
+
+            channelSetEmpty();
+            if (cc->discAfterInput)
+                {
+                cc->discAfterInput = FALSE;
+                channelDelayDisconnect(0);
+                cc->active = FALSE;
+                cc->ioDevice = NULL;
+                }
+            break;
+
+        default:
+            fprintf(stderr, "Invalid capture record type %02x\n", type);
+            exit(1);
+            }
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Let the device run until the channel reaches the
+**                  requested state, advancing emulated time as needed.
+**
+**  Parameters:     Name        Description.
+**                  full        wait for channel full (input) or empty
+**                              (output)
+**
+**  Returns:        TRUE if reached, FALSE if the device stalled.
+**
+**------------------------------------------------------------------------*/
+static bool replayWait(bool full)
+    {
+    ChSlot *cc = channel + replayChannel;
+    int i;
+
+    for (i = 0; i < ReplayWaitCycles; i++)
+        {
+        if (cc->ioDevice == NULL)
+            {
+            break;
+            }
+
+        activeChannel = cc;
+        channelIo();
+        if (cc->full == full)
+            {
+            return(TRUE);
+            }
+
+        cycles++;
+        channelStep();
+        rtcTick();
+        timerStep();
+        waitCycles += 1;
+        }
+
+    stallCount += 1;
+    return(FALSE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read a monotonic nanosecond clock.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Time in nanoseconds.
+**
+**------------------------------------------------------------------------*/
+static u64 replayClock(void)
+    {
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+
+    if (frequency.QuadPart == 0)
+        {
+        QueryPerformanceFrequency(&frequency);
+        }
+
+    QueryPerformanceCounter(&now);
+    return((u64)((double)now.QuadPart * 1000000000.0 / (double)frequency.QuadPart));
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((u64)ts.tv_sec * 1000000000 + (u64)ts.tv_nsec);
+#endif
+    }
+
+/*---------------------------  End Of File  ------------------------------*/
@@ -0,0 +1,811 @@
+/*--------------------------------------------------------------------------
+**
+**  Copyright (c) 2003-2011, Tom Hunter
+**
+**  Name: spool.c
+**
+**  Description:
+**      Printer spool engine. Printed characters are assembled in memory
+**      chunks by the emulation thread and written to the print file by a
+**      background writer thread per printer. The writer also rolls the
+**      print file over when it gets too large, at job separators or on
+**      operator request, and optionally converts the output to lines
+**      with ASA carriage control for text-to-PDF converters.
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License version 3 as
+**  published by the Free Software Foundation.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License version 3 for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  version 3 along with this program in file "license-gpl-3.0.txt".
+**  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+**
+**--------------------------------------------------------------------------
+*/
+
+/*
+**  -------------
+**  Include Files
+**  -------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "const.h"
+#include "types.h"
+#include "proto.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/*
+**  -----------------
+**  Private Constants
+**  -----------------
+*/
+#define SpoolChunkSize          65536
+#define SpoolRingSize           16          /* must be a power of 2 */
+#define SpoolFlushUs            500000      /* max time output stays in memory */
+#define SpoolIdleMs             10
+#define SpoolMaxLine            1024
+
+/*
+**  Chunk types.
+*/
+#define SpoolData               0
+#define SpoolJobEnd             1
+
+/*
+**  -----------------------
+**  Private Macro Functions
+**  -----------------------
+*/
+#if defined(_WIN32)
+#define SpoolBarrier()          MemoryBarrier()
+#else
+#define SpoolBarrier()          __sync_synchronize()
+#endif
+
+/*
+**  -----------------------------------------
+**  Private Typedef and Structure Definitions
+**  -----------------------------------------
+*/
+typedef struct spoolChunk
+    {
+    u32             len;                /* bytes used in data */
+    u8              type;               /* SpoolData or SpoolJobEnd */
+    u8              data[1];            /* SpoolChunkSize bytes for SpoolData */
+    } SpoolChunk;
+
+struct spool
+    {
+    /*
+    **  Owned by the emulation thread.
+    */
+    SpoolChunk      *fill;              /* chunk being filled */
+    TimerSlot       flushTimer;         /* hands over a partly filled chunk */
+
+    /*
+    **  Hand-over ring, head is advanced by the emulation thread, tail by
+    **  the writer thread.
+    */
+    SpoolChunk      *ring[SpoolRingSize];
+    volatile u32    head;
+    volatile u32    tail;
+
+    /*
+    **  Requests to the writer thread.
+    */
+    volatile bool   removePaper;        /* operator requested new print file */
+    char            *removeMsg;         /* printed when the paper has been removed */
+    volatile bool   closing;            /* drain ring and terminate */
+    volatile bool   closed;             /* writer thread has terminated */
+
+    /*
+    **  Owned by the writer thread.
+    */
+    FILE            *fcb;               /* current print file */
+    char            fileName[80];       /* name of current print file */
+    char            prefix[40];         /* prefix of archived print files */
+    u32             written;            /* bytes in current print file */
+    u32             advance;            /* ASA: lines advanced since last line printed */
+    bool            eject;              /* ASA: page eject pending */
+    u32             lineLen;            /* ASA: characters in line */
+    char            line[SpoolMaxLine]; /* ASA: line being assembled */
+    };
+
+/*
+**  ---------------------------
+**  Private Function Prototypes
+**  ---------------------------
+*/
+static void spoolNewChunk(Spool *sp, u8 type);
+static void spoolHandOver(Spool *sp);
+static void spoolFlushTimeout(void *param);
+static void spoolCreateThread(Spool *sp);
+#if defined(_WIN32)
+static void spoolThread(void *param);
+#else
+static void *spoolThread(void *param);
+#endif
+static void spoolWrite(Spool *sp, u8 *data, u32 len);
+static void spoolWriteAsa(Spool *sp, u8 *data, u32 len);
+static void spoolPutLine(Spool *sp);
+static bool spoolRollover(Spool *sp, bool always);
+static void spoolSleep(u32 ms);
+
+/*
+**  ----------------
+**  Public Variables
+**  ----------------
+*/
+u32 spoolRolloverSize = 0;
+bool spoolJobSplit = FALSE;
+bool spoolAsaFormat = FALSE;
+
+/*
+**  -----------------
+**  Private Variables
+**  -----------------
+*/
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Public Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Open a printer spool.
+**
+**  Parameters:     Name        Description.
+**                  fileName    name of the print file
+**                  prefix      prefix of archived print files
+**
+**  Returns:        Pointer to spool.
+**
+**------------------------------------------------------------------------*/
+Spool *spoolOpen(char *fileName, char *prefix)
+    {
+    Spool *sp;
+
+    sp = calloc(1, sizeof(Spool));
+    if (sp == NULL)
+        {
+        fprintf(stderr, "Failed to allocate spool for %s\n", fileName);
+        exit(1);
+        }
+
+    strncpy(sp->fileName, fileName, sizeof(sp->fileName) - 1);
+    strncpy(sp->prefix, prefix, sizeof(sp->prefix) - 1);
+    sp->advance = 1;
+
+    sp->fcb = fopen(sp->fileName, "w");
+    if (sp->fcb == NULL)
+        {
+        fprintf(stderr, "Failed to open %s\n", sp->fileName);
+        exit(1);
+        }
+
+    spoolCreateThread(sp);
+    return(sp);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Flush and close a printer spool.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void spoolClose(Spool *sp)
+    {
+    if (sp->fill != NULL)
+        {
+        spoolHandOver(sp);
+        }
+
+    sp->closing = TRUE;
+    while (!sp->closed)
+        {
+        spoolSleep(SpoolIdleMs);
+        }
+
+    free(sp);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Append one character to the print output.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**                  ch          character
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void spoolPutChar(Spool *sp, u8 ch)
+    {
+    SpoolChunk *cp = sp->fill;
+
+    if (cp == NULL)
+        {
+        spoolNewChunk(sp, SpoolData);
+        cp = sp->fill;
+        }
+
+    cp->data[cp->len++] = ch;
+    if (cp->len == SpoolChunkSize)
+        {
+        spoolHandOver(sp);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Append a string to the print output.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**                  str         string
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void spoolPutString(Spool *sp, char *str)
+    {
+    while (*str != 0)
+        {
+        spoolPutChar(sp, (u8)*str++);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Mark the end of a print job. Output so far is passed
+**                  to the writer which flushes the print file and rolls
+**                  it over if so configured.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void spoolEndJob(Spool *sp)
+    {
+    if (sp->fill != NULL)
+        {
+        spoolHandOver(sp);
+        }
+
+    spoolNewChunk(sp, SpoolJobEnd);
+    spoolHandOver(sp);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Request a new print file (operator interface, called
+**                  on the emulation thread). The rollover is done by the
+**                  writer thread once it has written everything printed
+**                  so far; it then prints the given message, or an error.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**                  doneMsg     message printed when done
+**
+**  Returns:        FALSE if a previous request is still in progress.
+**
+**------------------------------------------------------------------------*/
+bool spoolRemovePaper(Spool *sp, char *doneMsg)
+    {
+    if (sp->removePaper)
+        {
+        return(FALSE);
+        }
+
+    if (sp->fill != NULL)
+        {
+        spoolHandOver(sp);
+        }
+
+    sp->removeMsg = doneMsg;
+    SpoolBarrier();
+    sp->removePaper = TRUE;
+
+    return(TRUE);
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Allocate a new chunk to be filled.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**                  type        chunk type
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void spoolNewChunk(Spool *sp, u8 type)
+    {
+    SpoolChunk *cp;
+
+    cp = malloc(sizeof(SpoolChunk) + (type == SpoolData ? SpoolChunkSize : 0));
+    if (cp == NULL)
+        {
+        fprintf(stderr, "Failed to allocate spool chunk for %s\n", sp->fileName);
+        exit(1);
+        }
+
+    cp->len = 0;
+    cp->type = type;
+    sp->fill = cp;
+
+    /*
+    **  Don't keep a partly filled chunk in memory for too long.
+    */
+    if (type == SpoolData)
+        {
+        timerStart(&sp->flushTimer, SpoolFlushUs, spoolFlushTimeout, sp);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Pass the chunk being filled on to the writer thread.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void spoolHandOver(Spool *sp)
+    {
+    timerCancel(&sp->flushTimer);
+
+    /*
+    **  Wait for the writer if it has fallen behind.
+    */
+    while (sp->head - sp->tail >= SpoolRingSize)
+        {
+        spoolSleep(1);
+        }
+
+    sp->ring[sp->head & (SpoolRingSize - 1)] = sp->fill;
+    SpoolBarrier();
+    sp->head += 1;
+    sp->fill = NULL;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Flush timer expired - hand over the partly filled
+**                  chunk.
+**
+**  Parameters:     Name        Description.
+**                  param       pointer to spool
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void spoolFlushTimeout(void *param)
+    {
+    Spool *sp = (Spool *)param;
+
+    if (sp->fill != NULL)
+        {
+        spoolHandOver(sp);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Create the writer thread of a spool.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void spoolCreateThread(Spool *sp)
+    {
+#if defined(_WIN32)
+    DWORD dwThreadId;
+    HANDLE hThread;
+
+    /*
+    **  Create spool writer thread.
+    */
+    hThread = CreateThread(
+        NULL,                                       // no security attribute
+        0,                                          // default stack size
+        (LPTHREAD_START_ROUTINE)spoolThread,
+        (LPVOID)sp,                                 // thread parameter
+        0,                                          // not suspended
+        &dwThreadId);                               // returns thread ID
+
+    if (hThread == NULL)
+        {
+        fprintf(stderr, "Failed to create spool thread for %s\n", sp->fileName);
+        exit(1);
+        }
+#else
+    int rc;
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    /*
+    **  Create POSIX thread with default attributes.
+    */
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&thread, &attr, spoolThread, sp);
+    if (rc != 0)
+        {
+        fprintf(stderr, "Failed to create spool thread for %s\n", sp->fileName);
+        exit(1);
+        }
+#endif
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Spool writer thread.
+**
+**  Parameters:     Name        Description.
+**                  param       pointer to spool
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+#if defined(_WIN32)
+static void spoolThread(void *param)
+#else
+static void *spoolThread(void *param)
+#endif
+    {
+    Spool *sp = (Spool *)param;
+    SpoolChunk *cp;
+
+    for (;;)
+        {
+        if (sp->removePaper && sp->tail == sp->head)
+            {
+            if (spoolRollover(sp, TRUE))
+                {
+                fputs(sp->removeMsg, stdout);
+                fflush(stdout);
+                }
+
+            sp->removePaper = FALSE;
+            }
+
+        if (sp->tail == sp->head)
+            {
+            if (sp->closing)
+                {
+                break;
+                }
+
+            spoolSleep(SpoolIdleMs);
+            continue;
+            }
+
+        SpoolBarrier();
+        cp = sp->ring[sp->tail & (SpoolRingSize - 1)];
+
+        if (cp->type == SpoolData)
+            {
+            spoolWrite(sp, cp->data, cp->len);
+            }
+        else
+            {
+            fflush(sp->fcb);
+            if (spoolJobSplit)
+                {
+                (void)spoolRollover(sp, FALSE);
+                }
+            }
+
+        free(cp);
+        SpoolBarrier();
+        sp->tail += 1;
+        }
+
+    if (sp->lineLen != 0)
+        {
+        spoolPutLine(sp);
+        }
+
+    if (sp->fcb != NULL)
+        {
+        fclose(sp->fcb);
+        sp->fcb = NULL;
+        }
+
+    sp->closed = TRUE;
+
+#if !defined(_WIN32)
+    return(NULL);
+#endif
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write spooled data to the print file, rolling it over
+**                  at the end of the first line past the size limit.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**                  data        data
+**                  len         length of data
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void spoolWrite(Spool *sp, u8 *data, u32 len)
+    {
+    u8 *eol;
+    u32 part;
+
+    while (len != 0)
+        {
+        part = len;
+        if (spoolRolloverSize != 0 && sp->written + len > spoolRolloverSize)
+            {
+            /*
+            **  Split after the line which crosses the limit.
+            */
+            part = sp->written < spoolRolloverSize ? spoolRolloverSize - sp->written : 0;
+            eol = memchr(data + part, '\n', len - part);
+            part = eol == NULL ? len : (u32)(eol - data) + 1;
+            }
+
+        if (sp->fcb != NULL)
+            {
+            if (spoolAsaFormat)
+                {
+                spoolWriteAsa(sp, data, part);
+                }
+            else
+                {
+                fwrite(data, 1, part, sp->fcb);
+                }
+            }
+
+        sp->written += part;
+        data += part;
+        len -= part;
+
+        if (spoolRolloverSize != 0 && sp->written >= spoolRolloverSize && part != 0 && data[-1] == '\n')
+            {
+            (void)spoolRollover(sp, FALSE);
+            }
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Convert line spacing to ASA carriage control, i.e. the
+**                  first character of each line says how far to advance
+**                  before printing it: '+' not at all (overprint), ' '
+**                  one line, '0' two lines, '-' three lines and '1' top
+**                  of next page.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**                  data        data
+**                  len         length of data
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void spoolWriteAsa(Spool *sp, u8 *data, u32 len)
+    {
+    u8 ch;
+
+    while (len--)
+        {
+        ch = *data++;
+        switch (ch)
+            {
+        case '\n':
+            if (sp->lineLen != 0)
+                {
+                spoolPutLine(sp);
+                }
+
+            sp->advance += 1;
+            break;
+
+        case '\f':
+            if (sp->lineLen != 0)
+                {
+                spoolPutLine(sp);
+                }
+
+            sp->eject = TRUE;
+            sp->advance = 0;
+            break;
+
+        case '\r':
+            break;
+
+        default:
+            if (sp->lineLen >= SpoolMaxLine)
+                {
+                /*
+                **  Continue an overlong line on the next line.
+                */
+                spoolPutLine(sp);
+                sp->advance = 1;
+                }
+
+            sp->line[sp->lineLen++] = ch;
+            break;
+            }
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write the assembled line with its ASA control.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void spoolPutLine(Spool *sp)
+    {
+    char control;
+
+    if (sp->eject)
+        {
+        control = '1';
+        }
+    else
+        {
+        /*
+        **  More than triple spacing is done with blank lines.
+        */
+        while (sp->advance > 3)
+            {
+            fputs("-\n", sp->fcb);
+            sp->advance -= 3;
+            }
+
+        control = sp->advance == 0 ? '+' : sp->advance == 1 ? ' ' : sp->advance == 2 ? '0' : '-';
+        }
+
+    fputc(control, sp->fcb);
+    fwrite(sp->line, 1, sp->lineLen, sp->fcb);
+    fputc('\n', sp->fcb);
+
+    sp->lineLen = 0;
+    sp->advance = 0;
+    sp->eject = FALSE;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Archive the current print file and start a new one.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to spool
+**                  always      also archive an empty print file
+**
+**  Returns:        TRUE if successful, FALSE otherwise.
+**
+**------------------------------------------------------------------------*/
+static bool spoolRollover(Spool *sp, bool always)
+    {
+    time_t currentTime;
+    struct tm t;
+    char fnameNew[120];
+    size_t len;
+    FILE *fcb;
+    int seq;
+
+    if (!always && sp->written == 0)
+        {
+        return(TRUE);
+        }
+
+    /*
+    **  Close the old print file.
+    */
+    if (sp->fcb != NULL)
+        {
+        if (sp->lineLen != 0)
+            {
+            spoolPutLine(sp);
+            }
+
+        fclose(sp->fcb);
+        sp->fcb = NULL;
+        }
+
+    /*
+    **  Rename the print file to the format "<prefix>_yyyymmdd_hhmmss". Files
+    **  rolled over within the same second get a sequence number appended.
+    */
+    time(&currentTime);
+    t = *localtime(&currentTime);
+    sprintf(fnameNew, "%s_%04d%02d%02d_%02d%02d%02d",
+        sp->prefix,
+        t.tm_year + 1900,
+        t.tm_mon + 1,
+        t.tm_mday,
+        t.tm_hour,
+        t.tm_min,
+        t.tm_sec);
+
+    len = strlen(fnameNew);
+    for (seq = 1; (fcb = fopen(fnameNew, "r")) != NULL; seq++)
+        {
+        fclose(fcb);
+        sprintf(fnameNew + len, "_%d", seq);
+        }
+
+    if (rename(sp->fileName, fnameNew) != 0)
+        {
+        /*
+        **  Keep printing to the old file.
+        */
+        printf("Could not rename %s to %s - %s\n", sp->fileName, fnameNew, strerror(errno));
+        sp->fcb = fopen(sp->fileName, "a");
+        return(FALSE);
+        }
+
+    /*
+    **  Open the new print file.
+    */
+    sp->fcb = fopen(sp->fileName, "w");
+    sp->written = 0;
+    sp->advance = 1;
+    sp->eject = FALSE;
+
+    if (sp->fcb == NULL)
+        {
+        printf("Failed to open %s\n", sp->fileName);
+        return(FALSE);
+        }
+
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Sleep for a number of milliseconds.
+**
+**  Parameters:     Name        Description.
+**                  ms          milliseconds
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void spoolSleep(u32 ms)
+    {
+#if defined(_WIN32)
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+    }
+
+/*---------------------------  End Of File  ------------------------------*/
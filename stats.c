@@ -0,0 +1,553 @@
+/*--------------------------------------------------------------------------
+**
+**  Copyright (c) 2003-2011, Tom Hunter
+**
+**  Name: stats.c
+**
+**  Description:
+**      Device performance counters. Every device control block carries a
+**      set of counters (function codes, words transferred, busy time, host
+**      I/O operations, bytes and latency, NPU blocks). They are reported
+**      per channel and equipment by the 'show_stats' operator command and,
+**      when a statistics port is configured, served as plain text on a
+**      local HTTP port which monitoring tools can scrape.
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License version 3 as
+**  published by the Free Software Foundation.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License version 3 for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  version 3 along with this program in file "license-gpl-3.0.txt".
+**  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+**
+**--------------------------------------------------------------------------
+*/
+
+/*
+**  -------------
+**  Include Files
+**  -------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "const.h"
+#include "types.h"
+#include "proto.h"
+#include "npu.h"
+#if defined(_WIN32)
+#include <winsock.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+/*
+**  -----------------
+**  Private Constants
+**  -----------------
+*/
+#define SampleUs                1000        /* busy time sampling interval */
+#define ReportSize              65536
+#define ReportLineMax           512
+
+/*
+**  -----------------------
+**  Private Macro Functions
+**  -----------------------
+*/
+
+/*
+**  -----------------------------------------
+**  Private Typedef and Structure Definitions
+**  -----------------------------------------
+*/
+
+/*
+**  ---------------------------
+**  Private Function Prototypes
+**  ---------------------------
+*/
+static void statsStartSampling(void);
+static void statsSample(void *param);
+static int statsFormat(char *buf, int size);
+static int statsFormatDevice(char *buf, DevSlot *dp);
+static void statsCreateThread(void);
+#if defined(_WIN32)
+static void statsThread(void *param);
+#else
+static void *statsThread(void *param);
+#endif
+
+/*
+**  ----------------
+**  Public Variables
+**  ----------------
+*/
+u16 statsPort = 0;
+
+/*
+**  -----------------
+**  Private Variables
+**  -----------------
+*/
+static TimerSlot sampleTimer;
+static bool sampling = FALSE;
+
+static char *devTypeName[] =
+    {
+    "none",         /* DtNone */
+    "deadstart",    /* DtDeadStartPanel */
+    "mt607",        /* DtMt607 */
+    "mt669",        /* DtMt669 */
+    "dd6603",       /* DtDd6603 */
+    "dd8xx",        /* DtDd8xx */
+    "cr405",        /* DtCr405 */
+    "lp1612",       /* DtLp1612 */
+    "lp5xx",        /* DtLp5xx */
+    "rtc",          /* DtRtc */
+    "console",      /* DtConsole */
+    "mux6676",      /* DtMux6676 */
+    "cp3446",       /* DtCp3446 */
+    "cr3447",       /* DtCr3447 */
+    "dcc6681",      /* DtDcc6681 */
+    "tpm",          /* DtTpm */
+    "ddp",          /* DtDdp */
+    "niu",          /* DtNiu */
+    "mt679",        /* DtMt679 */
+    "npu",          /* DtNpu */
+    "mch",          /* DtMch */
+    "scr",          /* DtStatusControlRegister */
+    "ilr",          /* DtInterlockRegister */
+    "pci",          /* DtPciChannel */
+    "mt362x",       /* DtMt362x */
+    };
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Public Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Start collecting statistics.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void statsInit(void)
+    {
+    if (statsPort != 0)
+        {
+        statsStartSampling();
+        statsCreateThread();
+        printf("Device statistics served on port %d\n", statsPort);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read the host clock for measuring I/O latency.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Microseconds since an arbitrary epoch.
+**
+**------------------------------------------------------------------------*/
+u64 statsClock(void)
+    {
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+
+    if (frequency.QuadPart == 0)
+        {
+        QueryPerformanceFrequency(&frequency);
+        }
+
+    QueryPerformanceCounter(&now);
+    return((u64)(now.QuadPart * 1000000 / frequency.QuadPart));
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return((u64)tv.tv_sec * 1000000 + tv.tv_usec);
+#endif
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Account for a completed host I/O operation.
+**
+**  Parameters:     Name        Description.
+**                  sp          pointer to device counters
+**                  bytes       number of bytes transferred
+**                  startUs     statsClock() when the operation started
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void statsHostIo(DevStats *sp, u32 bytes, u64 startUs)
+    {
+    u64 elapsed = statsClock() - startUs;
+    int bucket = 0;
+
+    while (elapsed != 0 && bucket < StatsLatencyBuckets - 1)
+        {
+        elapsed >>= 1;
+        bucket += 1;
+        }
+
+    sp->hostOps += 1;
+    sp->hostBytes += bytes;
+    sp->latency[bucket] += 1;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Print statistics (operator interface). Without a
+**                  statistics port, busy time is only sampled from the
+**                  first request on.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void statsShow(void)
+    {
+    char *buf;
+
+    statsStartSampling();
+
+    buf = malloc(ReportSize);
+    if (buf == NULL)
+        {
+        printf("Failed to allocate statistics report\n");
+        return;
+        }
+
+    statsFormat(buf, ReportSize);
+    fputs(buf, stdout);
+    free(buf);
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Start sampling busy time. The sample timer is only
+**                  armed while statistics are in use, as any pending
+**                  timer makes the main loop read the host clock.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void statsStartSampling(void)
+    {
+    if (!sampling)
+        {
+        sampling = TRUE;
+        timerStart(&sampleTimer, SampleUs, statsSample, NULL);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Sample which devices are connected to an active
+**                  channel.
+**
+**  Parameters:     Name        Description.
+**                  param       unused
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void statsSample(void *param)
+    {
+    ChSlot *cp;
+
+    (void)param;
+
+    for (cp = channel; cp < channel + channelCount; cp++)
+        {
+        if (cp->active && cp->ioDevice != NULL)
+            {
+            cp->ioDevice->stats.busyMs += 1;
+            }
+        }
+
+    timerStart(&sampleTimer, SampleUs, statsSample, NULL);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Format statistics of all used devices and connections
+**                  as plain text, one counter per line.
+**
+**  Parameters:     Name        Description.
+**                  buf         output buffer
+**                  size        size of buffer
+**
+**  Returns:        Length of text.
+**
+**------------------------------------------------------------------------*/
+static int statsFormat(char *buf, int size)
+    {
+    DevSlot *dp;
+    Tcb *tp;
+    int len = 0;
+    int i;
+
+    len += sprintf(buf + len, "# DtCyber device statistics\n");
+
+    for (i = 0; i < channelCount; i++)
+        {
+        for (dp = channel[i].firstDevice; dp != NULL; dp = dp->next)
+            {
+            if (dp->stats.functions == 0 && dp->stats.hostOps == 0)
+                {
+                continue;
+                }
+
+            if (len + ReportLineMax * (StatsLatencyBuckets + 10) > size)
+                {
+                return(len);
+                }
+
+            len += statsFormatDevice(buf + len, dp);
+            }
+        }
+
+    for (i = 0, tp = npuTcbs; tp != NULL && i < npuTcbCount; i++, tp++)
+        {
+        if (tp->bytesIn == 0 && tp->bytesOut == 0)
+            {
+            continue;
+            }
+
+        if (len + ReportLineMax * 2 > size)
+            {
+            break;
+            }
+
+        len += sprintf(buf + len, "dtcyber_tcb_bytes_in_total{tcb=\"%d\",term=\"%.7s\"} %lu\n",
+            i, tp->termName, (unsigned long)tp->bytesIn);
+        len += sprintf(buf + len, "dtcyber_tcb_bytes_out_total{tcb=\"%d\",term=\"%.7s\"} %lu\n",
+            i, tp->termName, (unsigned long)tp->bytesOut);
+        }
+
+    return(len);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Format the counters of one device.
+**
+**  Parameters:     Name        Description.
+**                  buf         output buffer
+**                  dp          device control block
+**
+**  Returns:        Length of text.
+**
+**------------------------------------------------------------------------*/
+static int statsFormatDevice(char *buf, DevSlot *dp)
+    {
+    DevStats *sp = &dp->stats;
+    char labels[64];
+    u32 cumulative = 0;
+    int len = 0;
+    int i;
+
+    sprintf(labels, "ch=\"%02o\",eq=\"%o\",dev=\"%s\"",
+        dp->channel->id, dp->eqNo,
+        dp->devType < sizeof(devTypeName) / sizeof(devTypeName[0]) ? devTypeName[dp->devType] : "unknown");
+
+    len += sprintf(buf + len, "dtcyber_functions_total{%s} %lu\n", labels, (unsigned long)sp->functions);
+    len += sprintf(buf + len, "dtcyber_words_in_total{%s} %lu\n", labels, (unsigned long)sp->wordsIn);
+    len += sprintf(buf + len, "dtcyber_words_out_total{%s} %lu\n", labels, (unsigned long)sp->wordsOut);
+    len += sprintf(buf + len, "dtcyber_busy_ms_total{%s} %lu\n", labels, (unsigned long)sp->busyMs);
+
+    if (sp->hostOps != 0)
+        {
+        len += sprintf(buf + len, "dtcyber_host_io_total{%s} %lu\n", labels, (unsigned long)sp->hostOps);
+        len += sprintf(buf + len, "dtcyber_host_bytes_total{%s} %.0f\n", labels, (double)sp->hostBytes);
+        for (i = 0; i < StatsLatencyBuckets - 1; i++)
+            {
+            cumulative += sp->latency[i];
+            len += sprintf(buf + len, "dtcyber_host_latency_us_bucket{%s,le=\"%lu\"} %lu\n",
+                labels, 1UL << i, (unsigned long)cumulative);
+            }
+
+        len += sprintf(buf + len, "dtcyber_host_latency_us_bucket{%s,le=\"+Inf\"} %lu\n",
+            labels, (unsigned long)sp->hostOps);
+        }
+
+    if (sp->blocksUp != 0 || sp->blocksDown != 0)
+        {
+        len += sprintf(buf + len, "dtcyber_npu_blocks_up_total{%s} %lu\n", labels, (unsigned long)sp->blocksUp);
+        len += sprintf(buf + len, "dtcyber_npu_blocks_down_total{%s} %lu\n", labels, (unsigned long)sp->blocksDown);
+        }
+
+    return(len);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Create thread serving statistics over HTTP.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void statsCreateThread(void)
+    {
+#if defined(_WIN32)
+    WORD versionRequested;
+    WSADATA wsaData;
+    DWORD dwThreadId;
+    HANDLE hThread;
+
+    /*
+    **  Select WINSOCK 1.1.
+    */
+    versionRequested = MAKEWORD(1, 1);
+    if (WSAStartup(versionRequested, &wsaData) != 0)
+        {
+        fprintf(stderr, "\r\nError in WSAStartup: %d\r\n", WSAGetLastError());
+        exit(1);
+        }
+
+    /*
+    **  Create statistics thread.
+    */
+    hThread = CreateThread(
+        NULL,                                       // no security attribute
+        0,                                          // default stack size
+        (LPTHREAD_START_ROUTINE)statsThread,
+        (LPVOID)NULL,                               // thread parameter
+        0,                                          // not suspended
+        &dwThreadId);                               // returns thread ID
+
+    if (hThread == NULL)
+        {
+        fprintf(stderr, "Failed to create statistics thread\n");
+        exit(1);
+        }
+#else
+    int rc;
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    /*
+    **  Create POSIX thread with default attributes.
+    */
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&thread, &attr, statsThread, NULL);
+    if (rc != 0)
+        {
+        fprintf(stderr, "Failed to create statistics thread\n");
+        exit(1);
+        }
+#endif
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Serve statistics to local HTTP clients. Any request
+**                  is answered with the full report.
+**
+**  Parameters:     Name        Description.
+**                  param       unused
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+#if defined(_WIN32)
+static void statsThread(void *param)
+#else
+static void *statsThread(void *param)
+#endif
+    {
+    static char header[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n";
+    struct sockaddr_in server;
+    char request[1024];
+    char *buf;
+    int listenFd;
+    int connFd;
+    int optEnable = 1;
+    int len;
+
+    (void)param;
+
+    buf = malloc(ReportSize);
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (buf == NULL || listenFd < 0)
+        {
+        fprintf(stderr, "Statistics: Can't create socket\n");
+#if defined(_WIN32)
+        return;
+#else
+        return(NULL);
+#endif
+        }
+
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, (void *)&optEnable, sizeof(optEnable));
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server.sin_port = htons(statsPort);
+
+    if (   bind(listenFd, (struct sockaddr *)&server, sizeof(server)) < 0
+        || listen(listenFd, 5) < 0)
+        {
+        fprintf(stderr, "Statistics: Can't listen on port %d\n", statsPort);
+#if defined(_WIN32)
+        return;
+#else
+        return(NULL);
+#endif
+        }
+
+    for (;;)
+        {
+        connFd = accept(listenFd, NULL, NULL);
+        if (connFd < 0)
+            {
+            continue;
+            }
+
+        /*
+        **  The counters are read while the emulation keeps updating them,
+        **  which is good enough for monitoring.
+        */
+        recv(connFd, request, sizeof(request), 0);
+        len = statsFormat(buf, ReportSize);
+        send(connFd, header, sizeof(header) - 1, 0);
+        send(connFd, buf, len, 0);
+
+#if defined(_WIN32)
+        closesocket(connFd);
+#else
+        close(connFd);
+#endif
+        }
+    }
+
+/*---------------------------  End Of File  ------------------------------*/
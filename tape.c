@@ -0,0 +1,1769 @@
+/*--------------------------------------------------------------------------
+**
+**  Copyright (c) 2003-2011, Tom Hunter
+**
+**  Name: tape.c
+**
+**  Description:
+**      Open tape images for the tape drivers. Besides plain TAP files
+**      this supports block compressed images with a seek index. They are
+**      presented to the drivers as ordinary stdio streams, so records are
+**      read, written and positioned exactly as in a plain TAP file.
+**
+**      Layout of a compressed image:
+**
+**          header      magic, block size, block count, size, index offset
+**          blocks      64 KB blocks of the TAP data, each compressed
+**          index       offset and length of each block
+**
+**      A block with length 0 is all zeros, a block with the full block
+**      size is stored uncompressed. Changed blocks are appended (or
+**      overwrite a block appended since the tape was mounted) and the
+**      index and header are rewritten when the tape is unloaded, so a
+**      crash leaves the image as it was when it was last unloaded.
+**
+**      Operator mounts and unloads are carried out by a mount thread, so
+**      opening, checking and closing a large image (possibly on network
+**      storage) doesn't stall the emulation. A mounted image is passed
+**      back and attached to its unit on the emulation thread, and only
+**      then does the unit go ready.
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License version 3 as
+**  published by the Free Software Foundation.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License version 3 for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  version 3 along with this program in file "license-gpl-3.0.txt".
+**  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+**
+**--------------------------------------------------------------------------
+*/
+
+/*
+**  Compressed images are exposed through fopencookie (glibc) or funopen
+**  (BSD, Mac OS X).
+*/
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+/*
+**  -------------
+**  Include Files
+**  -------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "const.h"
+#include "types.h"
+#include "proto.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GLIBC__) || defined(__FreeBSD__) || defined(__APPLE__)
+#define TzStream                1
+#else
+#define TzStream                0
+#endif
+
+/*
+**  -----------------
+**  Private Constants
+**  -----------------
+*/
+#define TzMagic                 "DTCYTPZ1"
+#define TzSuffix                ".tpz"
+#define TzHeaderSize            32
+#define TzBlockSize             65536
+#define TzWorkSize              (TzBlockSize + TzBlockSize / 64 + 16)
+#define TzHashBits              13
+#define TzMinMatch              4
+#define TzMaxOffset             65535
+
+#define TzOffBlockSize          8
+#define TzOffBlockCount         12
+#define TzOffSize               16
+#define TzOffIndex              20
+
+#define TapeRequests            16          /* pending mounts and unloads, power of two */
+#define TapePollMs              10          /* mount thread idle poll */
+#define TapePollUs              10000       /* emulation thread poll for mounted tapes */
+#define TapeWarmChunk           65536
+#define TapeWarmSize            (4 * TapeWarmChunk)
+
+/*
+**  -----------------------
+**  Private Macro Functions
+**  -----------------------
+*/
+#if defined(_WIN32)
+#define TapeBarrier()           MemoryBarrier()
+#else
+#define TapeBarrier()           __sync_synchronize()
+#endif
+
+#define TzHash(p)   ((((p)[0] | ((p)[1] << 8) | ((p)[2] << 16) | ((u32)(p)[3] << 24)) * 2654435761U) >> (32 - TzHashBits))
+
+/*
+**  -----------------------------------------
+**  Private Typedef and Structure Definitions
+**  -----------------------------------------
+*/
+#if TzStream
+typedef struct tzBlock
+    {
+    u32         offset;
+    u32         length;
+    } TzBlock;
+
+typedef struct tzImage
+    {
+    FILE        *fcb;           /* container */
+    char        fileName[_MAX_PATH];
+    bool        writable;
+    bool        changed;        /* index and header need to be written */
+    TzBlock     *index;
+    u32         blockCount;
+    u32         indexSize;      /* allocated index entries */
+    u32         size;           /* uncompressed size */
+    u32         dataEnd;        /* where the next changed block goes */
+    u32         sessionStart;   /* blocks after this may be overwritten */
+    u32         position;       /* stream position */
+
+    u8          *cur;           /* block being read or written */
+    i32         curBlock;
+    bool        dirty;
+    u8          *work;          /* compressed data of cur */
+
+    /*
+    **  Read ahead thread, which decompresses the block following cur.
+    */
+    FILE        *aheadFcb;      /* its own handle for the container */
+    u8          *next;
+    u8          *aheadWork;
+    i32         nextBlock;      /* block in next, -1 if none */
+    i32         reqBlock;       /* block requested, -1 if none */
+    TzBlock     reqEntry;
+    bool        busy;
+    bool        stop;
+    pthread_t   thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    } TzImage;
+#endif
+
+/*
+**  ---------------------------
+**  Private Function Prototypes
+**  ---------------------------
+*/
+static bool tapeQueue(TapeMount *mp);
+static void tapeReadyPoll(void *param);
+static void tapeCreateThread(void);
+#if defined(_WIN32)
+static void tapeThread(void *param);
+#else
+static void *tapeThread(void *param);
+#endif
+static bool tapeLoad(TapeMount *mp);
+static bool tapeValidate(FILE *fcb);
+static void tapeWarm(FILE *fcb);
+static void tapeSleep(u32 ms);
+#if TzStream
+static FILE *tapeStreamOpen(FILE *fcb, char *fileName, bool writable, bool create);
+static int tapeStreamRead(TzImage *tz, char *buf, int count);
+static int tapeStreamWrite(TzImage *tz, const char *buf, int count);
+static int tapeStreamSeek(TzImage *tz, long long *offset, int whence);
+static int tapeStreamClose(TzImage *tz);
+static bool tapeWriteIndex(TzImage *tz);
+static void tapeCompact(TzImage *tz);
+static bool tapeLoadBlock(TzImage *tz, u32 block);
+static bool tapeFlushBlock(TzImage *tz);
+static bool tapeDecodeBlock(FILE *fcb, TzBlock *entry, u8 *work, u8 *out);
+static void *tapeAheadThread(void *param);
+static u32 tapeCompress(const u8 *in, u32 len, u8 *out, u32 outMax);
+static bool tapeDecompress(const u8 *in, u32 inLen, u8 *out, u32 outLen);
+static u32 tapeGetU32(u8 *p);
+static void tapePutU32(u8 *p, u32 value);
+#if defined(__GLIBC__)
+static ssize_t tapeCookieRead(void *cookie, char *buf, size_t size);
+static ssize_t tapeCookieWrite(void *cookie, const char *buf, size_t size);
+static int tapeCookieSeek(void *cookie, off64_t *offset, int whence);
+static int tapeCookieClose(void *cookie);
+#else
+static int tapeFunRead(void *cookie, char *buf, int size);
+static int tapeFunWrite(void *cookie, const char *buf, int size);
+static fpos_t tapeFunSeek(void *cookie, fpos_t offset, int whence);
+static int tapeFunClose(void *cookie);
+#endif
+#endif
+
+/*
+**  ----------------
+**  Public Variables
+**  ----------------
+*/
+
+/*
+**  -----------------
+**  Private Variables
+**  -----------------
+*/
+static bool tapeThreadStarted = FALSE;
+static volatile bool tapeStopping = FALSE;
+
+/*
+**  Mounts and unloads from the emulation thread to the mount thread.
+*/
+static TapeMount requestRing[TapeRequests];
+static volatile u32 requestHead = 0;
+static volatile u32 requestTail = 0;
+
+/*
+**  Mounted tapes waiting to be attached by the emulation thread.
+*/
+static TapeMount readyRing[TapeRequests];
+static volatile u32 readyHead = 0;
+static volatile u32 readyTail = 0;
+static TimerSlot readyPoll;
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Public Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Open a tape image. Compressed images are recognised by
+**                  their header; a new image is created compressed if its
+**                  name ends in ".tpz".
+**
+**  Parameters:     Name        Description.
+**                  fileName    tape image file name
+**                  mode        fopen mode ("rb", "r+b" or "w+b")
+**
+**  Returns:        Stream or NULL if the image can't be opened.
+**
+**------------------------------------------------------------------------*/
+FILE *tapeOpen(char *fileName, char *mode)
+    {
+    FILE *fcb;
+    char magic[8];
+    bool compressed;
+    bool create;
+    size_t len;
+
+    fcb = fopen(fileName, mode);
+    if (fcb == NULL)
+        {
+        return(NULL);
+        }
+
+    create = mode[0] == 'w';
+    if (create)
+        {
+        len = strlen(fileName);
+        compressed = len > strlen(TzSuffix) && strcmp(fileName + len - strlen(TzSuffix), TzSuffix) == 0;
+        }
+    else
+        {
+        compressed = fread(magic, 1, sizeof(magic), fcb) == sizeof(magic) && memcmp(magic, TzMagic, sizeof(magic)) == 0;
+        fseek(fcb, 0, SEEK_SET);
+        }
+
+    if (!compressed)
+        {
+        return(fcb);
+        }
+
+#if TzStream
+    return(tapeStreamOpen(fcb, fileName, strchr(mode, '+') != NULL, create));
+#else
+    fclose(fcb);
+    printf("Compressed tape images are not supported on this host\n");
+    return(NULL);
+#endif
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Mount a tape (operator interface). The image is opened
+**                  by the mount thread, and mp->attach is called on the
+**                  emulation thread with mp->fcb set once it is ready.
+**                  Nothing is attached if the image can't be opened.
+**
+**  Parameters:     Name        Description.
+**                  mp          pointer to mount request (copied)
+**
+**  Returns:        TRUE if the mount has been queued.
+**
+**------------------------------------------------------------------------*/
+bool tapeMount(TapeMount *mp)
+    {
+    if (!tapeQueue(mp))
+        {
+        printf("Tape mount thread busy - please try again later\n");
+        return(FALSE);
+        }
+
+    if (!timerPending(&readyPoll))
+        {
+        timerStart(&readyPoll, TapePollUs, tapeReadyPoll, NULL);
+        }
+
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Check if a mount for a unit is still in progress.
+**
+**  Parameters:     Name        Description.
+**                  dp          pointer to device
+**                  unitNo      unit number
+**
+**  Returns:        TRUE if a mount is queued or not yet attached.
+**
+**------------------------------------------------------------------------*/
+bool tapeMountPending(DevSlot *dp, u8 unitNo)
+    {
+    TapeMount *mp;
+    u32 i;
+
+    /*
+    **  The mount thread adds a request to the ready ring before removing
+    **  it from the request ring, so it can't be missed in between.
+    */
+    for (i = requestTail; i != requestHead; i++)
+        {
+        mp = requestRing + (i & (TapeRequests - 1));
+        if (mp->dp == dp && mp->unitNo == unitNo)
+            {
+            return(TRUE);
+            }
+        }
+
+    TapeBarrier();
+    for (i = readyTail; i != readyHead; i++)
+        {
+        mp = readyRing + (i & (TapeRequests - 1));
+        if (mp->dp == dp && mp->unitNo == unitNo)
+            {
+            return(TRUE);
+            }
+        }
+
+    return(FALSE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Close an unloaded tape image on the mount thread.
+**                  Requests are handled in order, so a later mount of the
+**                  same image sees it fully written.
+**
+**  Parameters:     Name        Description.
+**                  fcb         tape image
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void tapeClose(FILE *fcb)
+    {
+    TapeMount unload;
+
+    memset(&unload, 0, sizeof(unload));
+    unload.fcb = fcb;
+    if (!tapeQueue(&unload))
+        {
+        fclose(fcb);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Finish outstanding unloads before the emulator exits.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void tapeTerminate(void)
+    {
+    if (!tapeThreadStarted)
+        {
+        return;
+        }
+
+    /*
+    **  Pending mounts are dropped, unloads are completed.
+    */
+    tapeStopping = TRUE;
+    while (requestTail != requestHead)
+        {
+        tapeSleep(TapePollMs);
+        }
+
+    TapeBarrier();
+    while (readyTail != readyHead)
+        {
+        fclose(readyRing[readyTail & (TapeRequests - 1)].fcb);
+        readyTail += 1;
+        }
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Pass a mount or unload to the mount thread.
+**
+**  Parameters:     Name        Description.
+**                  mp          pointer to request (copied)
+**
+**  Returns:        FALSE if the request ring is full.
+**
+**------------------------------------------------------------------------*/
+static bool tapeQueue(TapeMount *mp)
+    {
+    if (requestHead - requestTail >= TapeRequests)
+        {
+        return(FALSE);
+        }
+
+    if (!tapeThreadStarted)
+        {
+        tapeThreadStarted = TRUE;
+        tapeCreateThread();
+        }
+
+    requestRing[requestHead & (TapeRequests - 1)] = *mp;
+    TapeBarrier();
+    requestHead += 1;
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Attach mounted tapes to their units. Runs on the timer
+**                  wheel while mounts are outstanding.
+**
+**  Parameters:     Name        Description.
+**                  param       unused
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void tapeReadyPoll(void *param)
+    {
+    TapeMount *mp;
+    bool busy;
+
+    (void)param;
+
+    while (readyTail != readyHead)
+        {
+        TapeBarrier();
+        mp = readyRing + (readyTail & (TapeRequests - 1));
+        mp->attach(mp);
+        TapeBarrier();
+        readyTail += 1;
+        }
+
+    /*
+    **  A mount finished after the loop above is in the ready ring by the
+    **  time it has left the request ring.
+    */
+    busy = requestTail != requestHead;
+    TapeBarrier();
+    if (busy || readyTail != readyHead)
+        {
+        timerStart(&readyPoll, TapePollUs, tapeReadyPoll, NULL);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Create the tape mount thread.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void tapeCreateThread(void)
+    {
+#if defined(_WIN32)
+    DWORD dwThreadId;
+    HANDLE hThread;
+
+    /*
+    **  Create tape mount thread.
+    */
+    hThread = CreateThread(
+        NULL,                                       // no security attribute
+        0,                                          // default stack size
+        (LPTHREAD_START_ROUTINE)tapeThread,
+        (LPVOID)NULL,                               // thread parameter
+        0,                                          // not suspended
+        &dwThreadId);                               // returns thread ID
+
+    if (hThread == NULL)
+        {
+        fprintf(stderr, "Failed to create tape mount thread\n");
+        exit(1);
+        }
+#else
+    int rc;
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    /*
+    **  Create POSIX thread with default attributes.
+    */
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&thread, &attr, tapeThread, NULL);
+    if (rc != 0)
+        {
+        fprintf(stderr, "Failed to create tape mount thread\n");
+        exit(1);
+        }
+#endif
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Tape mount thread.
+**
+**  Parameters:     Name        Description.
+**                  param       unused
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+#if defined(_WIN32)
+static void tapeThread(void *param)
+#else
+static void *tapeThread(void *param)
+#endif
+    {
+    TapeMount *rp;
+    TapeMount *mp;
+
+    (void)param;
+
+    for (;;)
+        {
+        while (requestTail != requestHead)
+            {
+            TapeBarrier();
+            rp = requestRing + (requestTail & (TapeRequests - 1));
+            if (rp->dp == NULL)
+                {
+                fclose(rp->fcb);
+                }
+            else if (!tapeStopping)
+                {
+                /*
+                **  Wait for the emulation thread to attach earlier mounts.
+                */
+                if (readyHead - readyTail >= TapeRequests)
+                    {
+                    break;
+                    }
+
+                mp = readyRing + (readyHead & (TapeRequests - 1));
+                *mp = *rp;
+                if (tapeLoad(mp))
+                    {
+                    TapeBarrier();
+                    readyHead += 1;
+                    }
+                }
+
+            TapeBarrier();
+            requestTail += 1;
+            }
+
+        tapeSleep(TapePollMs);
+        }
+
+#if !defined(_WIN32)
+    return(NULL);
+#endif
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Open, check and warm up a tape image for mounting.
+**
+**  Parameters:     Name        Description.
+**                  mp          pointer to mount request
+**
+**  Returns:        TRUE if mp->fcb is ready to be attached.
+**
+**------------------------------------------------------------------------*/
+static bool tapeLoad(TapeMount *mp)
+    {
+    FILE *fcb;
+
+    if (mp->ringIn)
+        {
+        fcb = tapeOpen(mp->fileName, "r+b");
+        if (fcb == NULL)
+            {
+            fcb = tapeOpen(mp->fileName, "w+b");
+            }
+        }
+    else
+        {
+        fcb = tapeOpen(mp->fileName, "rb");
+        }
+
+    if (fcb == NULL)
+        {
+        printf("Failed to open %s\n", mp->fileName);
+        return(FALSE);
+        }
+
+    if (!tapeValidate(fcb))
+        {
+        printf("%s is not a valid tape image\n", mp->fileName);
+        fclose(fcb);
+        return(FALSE);
+        }
+
+    tapeWarm(fcb);
+    mp->fcb = fcb;
+    return(TRUE);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Check that the first record of a tape image has
+**                  matching TAP length header and trailer.
+**
+**  Parameters:     Name        Description.
+**                  fcb         tape image
+**
+**  Returns:        TRUE if the image is blank or its first record is
+**                  well formed. The image is rewound.
+**
+**------------------------------------------------------------------------*/
+static bool tapeValidate(FILE *fcb)
+    {
+    u8 header[4];
+    u8 trailer[4];
+    u32 recLen;
+    bool ok = TRUE;
+
+    if (fread(header, 1, sizeof(header), fcb) == sizeof(header))
+        {
+        recLen = header[0] | (header[1] << 8) | (header[2] << 16) | ((u32)header[3] << 24);
+        if (recLen != 0)
+            {
+            ok =    fseek(fcb, (long)recLen, SEEK_CUR) == 0
+                 && fread(trailer, 1, sizeof(trailer), fcb) == sizeof(trailer)
+                 && memcmp(header, trailer, sizeof(header)) == 0;
+            }
+        }
+
+    fseek(fcb, 0, SEEK_SET);
+    return(ok);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read the start of a tape image so the first records
+**                  come from the host's cache.
+**
+**  Parameters:     Name        Description.
+**                  fcb         tape image
+**
+**  Returns:        Nothing. The image is rewound.
+**
+**------------------------------------------------------------------------*/
+static void tapeWarm(FILE *fcb)
+    {
+    static char buffer[TapeWarmChunk];
+    u32 done = 0;
+
+    while (done < TapeWarmSize && fread(buffer, 1, sizeof(buffer), fcb) == sizeof(buffer))
+        {
+        done += sizeof(buffer);
+        }
+
+    fseek(fcb, 0, SEEK_SET);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Sleep for a number of milliseconds.
+**
+**  Parameters:     Name        Description.
+**                  ms          milliseconds
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void tapeSleep(u32 ms)
+    {
+#if defined(_WIN32)
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+    }
+
+#if TzStream
+/*--------------------------------------------------------------------------
+**  Purpose:        Wrap a compressed image in a stdio stream.
+**
+**  Parameters:     Name        Description.
+**                  fcb         open container
+**                  fileName    container file name
+**                  writable    TRUE if opened for update
+**                  create      TRUE to write an empty image
+**
+**  Returns:        Stream or NULL if the image is unusable.
+**
+**------------------------------------------------------------------------*/
+static FILE *tapeStreamOpen(FILE *fcb, char *fileName, bool writable, bool create)
+    {
+    TzImage *tz;
+    u8 header[TzHeaderSize];
+    u32 indexOffset;
+    u32 i;
+    FILE *stream;
+
+    tz = (TzImage *)calloc(1, sizeof(TzImage));
+    if (tz == NULL)
+        {
+        fprintf(stderr, "Failed to allocate compressed tape context\n");
+        exit(1);
+        }
+
+    tz->fcb = fcb;
+    strncpy(tz->fileName, fileName, _MAX_PATH - 1);
+    tz->writable = writable;
+    tz->curBlock = -1;
+    tz->nextBlock = -1;
+    tz->reqBlock = -1;
+    tz->cur = (u8 *)malloc(TzBlockSize);
+    tz->next = (u8 *)malloc(TzBlockSize);
+    tz->work = (u8 *)malloc(TzWorkSize);
+    tz->aheadWork = (u8 *)malloc(TzWorkSize);
+    if (tz->cur == NULL || tz->next == NULL || tz->work == NULL || tz->aheadWork == NULL)
+        {
+        fprintf(stderr, "Failed to allocate compressed tape buffers\n");
+        exit(1);
+        }
+
+    if (create)
+        {
+        /*
+        **  Write an empty index right away, so the image is valid even
+        **  if it is never unloaded.
+        */
+        tz->dataEnd = TzHeaderSize;
+        tz->changed = TRUE;
+        if (!tapeWriteIndex(tz))
+            {
+            printf("%s: failed to write compressed tape header\n", fileName);
+            goto failed;
+            }
+        }
+    else
+        {
+        /*
+        **  Load the block index.
+        */
+        if (   fread(header, 1, TzHeaderSize, fcb) != TzHeaderSize
+            || tapeGetU32(header + TzOffBlockSize) != TzBlockSize)
+            {
+            printf("%s: unsupported compressed tape image\n", fileName);
+            goto failed;
+            }
+
+        tz->blockCount = tapeGetU32(header + TzOffBlockCount);
+        tz->size = tapeGetU32(header + TzOffSize);
+        indexOffset = tapeGetU32(header + TzOffIndex);
+        tz->indexSize = tz->blockCount;
+        tz->index = (TzBlock *)calloc(tz->indexSize + 1, sizeof(TzBlock));
+        if (tz->index == NULL)
+            {
+            printf("%s: failed to allocate tape index\n", fileName);
+            goto failed;
+            }
+
+        fseek(fcb, indexOffset, SEEK_SET);
+        for (i = 0; i < tz->blockCount; i++)
+            {
+            if (fread(header, 1, 8, fcb) != 8)
+                {
+                printf("%s: tape index is truncated\n", fileName);
+                goto failed;
+                }
+
+            tz->index[i].offset = tapeGetU32(header + 0);
+            tz->index[i].length = tapeGetU32(header + 4);
+            }
+
+        /*
+        **  Changed blocks go after the current index, which stays valid
+        **  until the new one has been written.
+        */
+        tz->dataEnd = indexOffset + tz->blockCount * 8;
+        }
+
+    tz->sessionStart = tz->dataEnd;
+
+    /*
+    **  Start the read ahead thread.
+    */
+    tz->aheadFcb = fopen(fileName, "rb");
+    if (tz->aheadFcb == NULL)
+        {
+        printf("%s: failed to open for read ahead\n", fileName);
+        goto failed;
+        }
+
+    setvbuf(tz->aheadFcb, NULL, _IONBF, 0);
+    pthread_mutex_init(&tz->mutex, NULL);
+    pthread_cond_init(&tz->cond, NULL);
+    if (pthread_create(&tz->thread, NULL, tapeAheadThread, tz) != 0)
+        {
+        printf("%s: failed to create read ahead thread\n", fileName);
+        fclose(tz->aheadFcb);
+        goto failed;
+        }
+
+#if defined(__GLIBC__)
+        {
+        cookie_io_functions_t funcs;
+
+        funcs.read = tapeCookieRead;
+        funcs.write = tapeCookieWrite;
+        funcs.seek = tapeCookieSeek;
+        funcs.close = tapeCookieClose;
+        stream = fopencookie(tz, writable ? "r+" : "r", funcs);
+        }
+#else
+    stream = funopen(tz, tapeFunRead, tapeFunWrite, tapeFunSeek, tapeFunClose);
+#endif
+
+    if (stream == NULL)
+        {
+        tapeStreamClose(tz);
+        return(NULL);
+        }
+
+    return(stream);
+
+failed:
+    fclose(fcb);
+    free(tz->index);
+    free(tz->cur);
+    free(tz->next);
+    free(tz->work);
+    free(tz->aheadWork);
+    free(tz);
+    return(NULL);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read from a compressed image.
+**
+**  Parameters:     Name        Description.
+**                  tz          image
+**                  buf         buffer
+**                  count       bytes requested
+**
+**  Returns:        Bytes read (0 at end of tape), -1 on error.
+**
+**------------------------------------------------------------------------*/
+static int tapeStreamRead(TzImage *tz, char *buf, int count)
+    {
+    int done = 0;
+    u32 offset;
+    u32 chunk;
+
+    if (tz->position >= tz->size)
+        {
+        return(0);
+        }
+
+    if ((u32)count > tz->size - tz->position)
+        {
+        count = tz->size - tz->position;
+        }
+
+    while (done < count)
+        {
+        if (!tapeLoadBlock(tz, tz->position / TzBlockSize))
+            {
+            errno = EIO;
+            return(done > 0 ? done : -1);
+            }
+
+        offset = tz->position % TzBlockSize;
+        chunk = TzBlockSize - offset;
+        if (chunk > (u32)(count - done))
+            {
+            chunk = count - done;
+            }
+
+        memcpy(buf + done, tz->cur + offset, chunk);
+        done += chunk;
+        tz->position += chunk;
+        }
+
+    return(done);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write to a compressed image.
+**
+**  Parameters:     Name        Description.
+**                  tz          image
+**                  buf         data
+**                  count       bytes to write
+**
+**  Returns:        Bytes written, -1 on error.
+**
+**------------------------------------------------------------------------*/
+static int tapeStreamWrite(TzImage *tz, const char *buf, int count)
+    {
+    int done = 0;
+    u32 offset;
+    u32 chunk;
+
+    if (!tz->writable)
+        {
+        errno = EBADF;
+        return(-1);
+        }
+
+    while (done < count)
+        {
+        if (!tapeLoadBlock(tz, tz->position / TzBlockSize))
+            {
+            errno = EIO;
+            return(done > 0 ? done : -1);
+            }
+
+        offset = tz->position % TzBlockSize;
+        chunk = TzBlockSize - offset;
+        if (chunk > (u32)(count - done))
+            {
+            chunk = count - done;
+            }
+
+        memcpy(tz->cur + offset, buf + done, chunk);
+        tz->dirty = TRUE;
+        done += chunk;
+        tz->position += chunk;
+        if (tz->position > tz->size)
+            {
+            tz->size = tz->position;
+            }
+        }
+
+    return(done);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Position a compressed image.
+**
+**  Parameters:     Name        Description.
+**                  tz          image
+**                  offset      offset (updated with the new position)
+**                  whence      SEEK_SET, SEEK_CUR or SEEK_END
+**
+**  Returns:        0 if successful, -1 otherwise.
+**
+**------------------------------------------------------------------------*/
+static int tapeStreamSeek(TzImage *tz, long long *offset, int whence)
+    {
+    long long pos;
+
+    switch (whence)
+        {
+    case SEEK_SET:
+        pos = *offset;
+        break;
+
+    case SEEK_CUR:
+        pos = (long long)tz->position + *offset;
+        break;
+
+    case SEEK_END:
+        pos = (long long)tz->size + *offset;
+        break;
+
+    default:
+        errno = EINVAL;
+        return(-1);
+        }
+
+    if (pos < 0 || pos > 0xffffffffLL - TzBlockSize)
+        {
+        errno = EINVAL;
+        return(-1);
+        }
+
+    tz->position = (u32)pos;
+    *offset = pos;
+    return(0);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Close a compressed image, writing back changed blocks,
+**                  the index and the header.
+**
+**  Parameters:     Name        Description.
+**                  tz          image
+**
+**  Returns:        0 if successful, EOF otherwise.
+**
+**------------------------------------------------------------------------*/
+static int tapeStreamClose(TzImage *tz)
+    {
+    bool ok;
+    u32 live;
+    u32 i;
+
+    ok = tapeFlushBlock(tz);
+
+    pthread_mutex_lock(&tz->mutex);
+    tz->stop = TRUE;
+    pthread_cond_broadcast(&tz->cond);
+    pthread_mutex_unlock(&tz->mutex);
+    pthread_join(tz->thread, NULL);
+    pthread_mutex_destroy(&tz->mutex);
+    pthread_cond_destroy(&tz->cond);
+    fclose(tz->aheadFcb);
+
+    if (ok && tz->changed)
+        {
+        ok = tapeWriteIndex(tz);
+
+        /*
+        **  Blocks rewritten after earlier mounts leave unused space
+        **  behind; copy the image once more than half of it is unused.
+        */
+        live = 0;
+        for (i = 0; i < tz->blockCount; i++)
+            {
+            live += tz->index[i].length;
+            }
+
+        if (ok && tz->dataEnd - TzHeaderSize > 2 * live + TzBlockSize)
+            {
+            tapeCompact(tz);
+            }
+        }
+
+    if (fclose(tz->fcb) != 0)
+        {
+        ok = FALSE;
+        }
+
+    if (!ok)
+        {
+        logError(LogErrorLocation, "failed to update compressed tape image");
+        }
+
+    free(tz->index);
+    free(tz->cur);
+    free(tz->next);
+    free(tz->work);
+    free(tz->aheadWork);
+    free(tz);
+
+    return(ok ? 0 : EOF);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write the index after the data and then the header,
+**                  which switches over to the new index.
+**
+**  Parameters:     Name        Description.
+**                  tz          image
+**
+**  Returns:        FALSE on a host I/O error.
+**
+**------------------------------------------------------------------------*/
+static bool tapeWriteIndex(TzImage *tz)
+    {
+    u8 header[TzHeaderSize];
+    u8 entry[8];
+    bool ok = TRUE;
+    u32 i;
+
+    fseek(tz->fcb, tz->dataEnd, SEEK_SET);
+    for (i = 0; i < tz->blockCount && ok; i++)
+        {
+        tapePutU32(entry + 0, tz->index[i].offset);
+        tapePutU32(entry + 4, tz->index[i].length);
+        ok = fwrite(entry, 1, 8, tz->fcb) == 8;
+        }
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, TzMagic, 8);
+    tapePutU32(header + TzOffBlockSize, TzBlockSize);
+    tapePutU32(header + TzOffBlockCount, tz->blockCount);
+    tapePutU32(header + TzOffSize, tz->size);
+    tapePutU32(header + TzOffIndex, tz->dataEnd);
+    ok = ok && fflush(tz->fcb) == 0;
+    fseek(tz->fcb, 0, SEEK_SET);
+    ok = ok && fwrite(header, 1, TzHeaderSize, tz->fcb) == TzHeaderSize;
+
+    return(ok && fflush(tz->fcb) == 0);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Copy the used blocks of an image to a new file which
+**                  then replaces it. The image is left unchanged if this
+**                  fails.
+**
+**  Parameters:     Name        Description.
+**                  tz          image
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void tapeCompact(TzImage *tz)
+    {
+    char tmpName[_MAX_PATH + 8];
+    u8 header[TzHeaderSize];
+    TzBlock *entry;
+    FILE *old;
+    FILE *fcb;
+    bool ok;
+    u32 pos;
+    u32 i;
+
+    sprintf(tmpName, "%s.tmp", tz->fileName);
+    fcb = fopen(tmpName, "w+b");
+    if (fcb == NULL)
+        {
+        return;
+        }
+
+    memset(header, 0, sizeof(header));
+    ok = fwrite(header, 1, TzHeaderSize, fcb) == TzHeaderSize;
+    pos = TzHeaderSize;
+    for (i = 0; i < tz->blockCount && ok; i++)
+        {
+        entry = &tz->index[i];
+        if (entry->length == 0)
+            {
+            continue;
+            }
+
+        ok =    fseek(tz->fcb, entry->offset, SEEK_SET) == 0
+             && fread(tz->work, 1, entry->length, tz->fcb) == entry->length
+             && fwrite(tz->work, 1, entry->length, fcb) == entry->length;
+        entry->offset = pos;
+        pos += entry->length;
+        }
+
+    old = tz->fcb;
+    tz->fcb = fcb;
+    tz->dataEnd = pos;
+    ok = ok && tapeWriteIndex(tz);
+    if (fclose(fcb) != 0)
+        {
+        ok = FALSE;
+        }
+
+    if (!ok || rename(tmpName, tz->fileName) != 0)
+        {
+        /*
+        **  The offsets in memory are no longer valid but the image on
+        **  disk still is; it is about to be closed anyway.
+        */
+        remove(tmpName);
+        }
+
+    tz->fcb = old;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Make a block the current block. The block following it
+**                  is decompressed ahead on the read ahead thread.
+**
+**  Parameters:     Name        Description.
+**                  tz          image
+**                  block       block number
+**
+**  Returns:        FALSE on a host I/O or format error.
+**
+**------------------------------------------------------------------------*/
+static bool tapeLoadBlock(TzImage *tz, u32 block)
+    {
+    static TzBlock zeroBlock = {0, 0};
+    u8 *swap;
+    bool swapped;
+    bool ok = TRUE;
+
+    if (tz->curBlock == (i32)block)
+        {
+        return(TRUE);
+        }
+
+    if (!tapeFlushBlock(tz))
+        {
+        return(FALSE);
+        }
+
+    pthread_mutex_lock(&tz->mutex);
+    while (tz->busy)
+        {
+        pthread_cond_wait(&tz->cond, &tz->mutex);
+        }
+
+    swapped = tz->nextBlock == (i32)block;
+    if (swapped)
+        {
+        swap = tz->cur;
+        tz->cur = tz->next;
+        tz->next = swap;
+        }
+
+    /*
+    **  Anything else read ahead is of no use now.
+    */
+    tz->nextBlock = -1;
+    tz->reqBlock = -1;
+    pthread_mutex_unlock(&tz->mutex);
+
+    if (!swapped)
+        {
+        ok = tapeDecodeBlock(tz->fcb, block < tz->blockCount ? &tz->index[block] : &zeroBlock, tz->work, tz->cur);
+        }
+
+    tz->curBlock = ok ? (i32)block : -1;
+
+    /*
+    **  Start on the following block.
+    */
+    if (ok && block + 1 < tz->blockCount)
+        {
+        pthread_mutex_lock(&tz->mutex);
+        tz->reqBlock = block + 1;
+        tz->reqEntry = tz->index[block + 1];
+        pthread_cond_broadcast(&tz->cond);
+        pthread_mutex_unlock(&tz->mutex);
+        }
+
+    return(ok);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Compress and append the current block if it changed.
+**
+**  Parameters:     Name        Description.
+**                  tz          image
+**
+**  Returns:        FALSE on a host I/O error.
+**
+**------------------------------------------------------------------------*/
+static bool tapeFlushBlock(TzImage *tz)
+    {
+    TzBlock *newIndex;
+    u32 newSize;
+    u32 block;
+    u32 len;
+    u32 i;
+    u8 *data;
+
+    if (!tz->dirty)
+        {
+        return(TRUE);
+        }
+
+    tz->dirty = FALSE;
+    block = tz->curBlock;
+
+    /*
+    **  Grow the index; new entries are zero blocks.
+    */
+    if (block >= tz->indexSize)
+        {
+        newSize = tz->indexSize * 2 > block + 1 ? tz->indexSize * 2 : block + 64;
+        newIndex = (TzBlock *)realloc(tz->index, newSize * sizeof(TzBlock));
+        if (newIndex == NULL)
+            {
+            return(FALSE);
+            }
+
+        memset(newIndex + tz->indexSize, 0, (newSize - tz->indexSize) * sizeof(TzBlock));
+        tz->index = newIndex;
+        tz->indexSize = newSize;
+        }
+
+    if (block >= tz->blockCount)
+        {
+        tz->blockCount = block + 1;
+        }
+
+    /*
+    **  The read ahead copy of this block is now stale.
+    */
+    pthread_mutex_lock(&tz->mutex);
+    while (tz->busy)
+        {
+        pthread_cond_wait(&tz->cond, &tz->mutex);
+        }
+
+    if (tz->nextBlock == (i32)block)
+        {
+        tz->nextBlock = -1;
+        }
+
+    if (tz->reqBlock == (i32)block)
+        {
+        tz->reqBlock = -1;
+        }
+
+    pthread_mutex_unlock(&tz->mutex);
+
+    tz->changed = TRUE;
+    for (i = 0; i < TzBlockSize && tz->cur[i] == 0; i++)
+        {
+        }
+
+    if (i == TzBlockSize)
+        {
+        tz->index[block].offset = 0;
+        tz->index[block].length = 0;
+        return(TRUE);
+        }
+
+    len = tapeCompress(tz->cur, TzBlockSize, tz->work, TzBlockSize - 1);
+    if (len == 0)
+        {
+        len = TzBlockSize;
+        data = tz->cur;
+        }
+    else
+        {
+        data = tz->work;
+        }
+
+    /*
+    **  Reuse the space of a block written since the tape was mounted if
+    **  the new data fits, otherwise append.
+    */
+    if (tz->index[block].offset >= tz->sessionStart && len <= tz->index[block].length)
+        {
+        fseek(tz->fcb, tz->index[block].offset, SEEK_SET);
+        }
+    else
+        {
+        tz->index[block].offset = tz->dataEnd;
+        tz->dataEnd += len;
+        fseek(tz->fcb, tz->index[block].offset, SEEK_SET);
+        }
+
+    tz->index[block].length = len;
+
+    return(fwrite(data, 1, len, tz->fcb) == len && fflush(tz->fcb) == 0);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read and decompress a block.
+**
+**  Parameters:     Name        Description.
+**                  fcb         container
+**                  entry       index entry of the block
+**                  work        buffer for the compressed data
+**                  out         TzBlockSize bytes of output
+**
+**  Returns:        FALSE on a host I/O or format error.
+**
+**------------------------------------------------------------------------*/
+static bool tapeDecodeBlock(FILE *fcb, TzBlock *entry, u8 *work, u8 *out)
+    {
+    if (entry->length == 0)
+        {
+        memset(out, 0, TzBlockSize);
+        return(TRUE);
+        }
+
+    if (entry->length > TzBlockSize || fseek(fcb, entry->offset, SEEK_SET) != 0)
+        {
+        return(FALSE);
+        }
+
+    if (entry->length == TzBlockSize)
+        {
+        return(fread(out, 1, TzBlockSize, fcb) == TzBlockSize);
+        }
+
+    if (fread(work, 1, entry->length, fcb) != entry->length)
+        {
+        return(FALSE);
+        }
+
+    return(tapeDecompress(work, entry->length, out, TzBlockSize));
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read ahead thread.
+**
+**  Parameters:     Name        Description.
+**                  param       image
+**
+**  Returns:        NULL.
+**
+**------------------------------------------------------------------------*/
+static void *tapeAheadThread(void *param)
+    {
+    TzImage *tz = (TzImage *)param;
+    TzBlock entry;
+    i32 block;
+    bool ok;
+
+    pthread_mutex_lock(&tz->mutex);
+    for (;;)
+        {
+        while (!tz->stop && tz->reqBlock < 0)
+            {
+            pthread_cond_wait(&tz->cond, &tz->mutex);
+            }
+
+        if (tz->stop)
+            {
+            break;
+            }
+
+        block = tz->reqBlock;
+        entry = tz->reqEntry;
+        tz->reqBlock = -1;
+        tz->busy = TRUE;
+        pthread_mutex_unlock(&tz->mutex);
+
+        ok = tapeDecodeBlock(tz->aheadFcb, &entry, tz->aheadWork, tz->next);
+
+        pthread_mutex_lock(&tz->mutex);
+        tz->busy = FALSE;
+        tz->nextBlock = ok ? block : -1;
+        pthread_cond_broadcast(&tz->cond);
+        }
+
+    pthread_mutex_unlock(&tz->mutex);
+
+    return(NULL);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Compress a block (LZ77 with byte aligned tokens).
+**
+**                  0x00-0x7f   literal run of 1-128 bytes follows
+**                  0x80-0xfe   match of 4-130 bytes, 16 bit offset follows
+**                  0xff        match of 131+ bytes, the extra length
+**                              follows as bytes of 255 ended by a byte
+**                              below 255, then the 16 bit offset
+**
+**  Parameters:     Name        Description.
+**                  in          data
+**                  len         data length
+**                  out         compressed data
+**                  outMax      maximum compressed length
+**
+**  Returns:        Compressed length or 0 if it would exceed outMax.
+**
+**------------------------------------------------------------------------*/
+static u32 tapeCompress(const u8 *in, u32 len, u8 *out, u32 outMax)
+    {
+    u32 table[1 << TzHashBits];     /* per call, blocks are compressed on several threads */
+    u32 ip = 0;
+    u32 op = 0;
+    u32 anchor = 0;
+    u32 cand;
+    u32 ref = 0;
+    u32 mlen;
+    u32 run;
+    u32 extra;
+    u32 h;
+
+    memset(table, 0, sizeof(table));
+
+    for (;;)
+        {
+        /*
+        **  Look for a match at ip.
+        */
+        mlen = 0;
+        if (ip + TzMinMatch <= len)
+            {
+            h = TzHash(in + ip);
+            cand = table[h];
+            table[h] = ip + 1;
+            if (cand != 0)
+                {
+                ref = cand - 1;
+                if (ip - ref <= TzMaxOffset && memcmp(in + ref, in + ip, TzMinMatch) == 0)
+                    {
+                    mlen = TzMinMatch;
+                    while (ip + mlen < len && in[ref + mlen] == in[ip + mlen])
+                        {
+                        mlen += 1;
+                        }
+                    }
+                }
+            }
+
+        if (mlen == 0 && ip < len)
+            {
+            ip += 1;
+            continue;
+            }
+
+        /*
+        **  Literals up to ip.
+        */
+        while (anchor < ip)
+            {
+            run = ip - anchor > 128 ? 128 : ip - anchor;
+            if (op + 1 + run > outMax)
+                {
+                return(0);
+                }
+
+            out[op++] = (u8)(run - 1);
+            memcpy(out + op, in + anchor, run);
+            op += run;
+            anchor += run;
+            }
+
+        if (mlen == 0)
+            {
+            break;
+            }
+
+        /*
+        **  The match.
+        */
+        extra = mlen - TzMinMatch;
+        if (op + 3 + extra / 255 + 1 > outMax)
+            {
+            return(0);
+            }
+
+        if (extra < 127)
+            {
+            out[op++] = (u8)(0x80 | extra);
+            }
+        else
+            {
+            out[op++] = 0xff;
+            extra -= 127;
+            while (extra >= 255)
+                {
+                out[op++] = 255;
+                extra -= 255;
+                }
+
+            out[op++] = (u8)extra;
+            }
+
+        out[op++] = (u8)((ip - ref) >> 0);
+        out[op++] = (u8)((ip - ref) >> 8);
+        ip += mlen;
+        anchor = ip;
+        }
+
+    return(op);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decompress a block.
+**
+**  Parameters:     Name        Description.
+**                  in          compressed data
+**                  inLen       compressed length
+**                  out         output
+**                  outLen      expected output length
+**
+**  Returns:        FALSE if the data is corrupt.
+**
+**------------------------------------------------------------------------*/
+static bool tapeDecompress(const u8 *in, u32 inLen, u8 *out, u32 outLen)
+    {
+    u32 ip = 0;
+    u32 op = 0;
+    u32 len;
+    u32 offset;
+    u8 c;
+
+    while (ip < inLen)
+        {
+        c = in[ip++];
+        if (c < 0x80)
+            {
+            len = c + 1;
+            if (ip + len > inLen || op + len > outLen)
+                {
+                return(FALSE);
+                }
+
+            memcpy(out + op, in + ip, len);
+            ip += len;
+            op += len;
+            continue;
+            }
+
+        len = c & 0x7f;
+        if (len == 127)
+            {
+            do
+                {
+                if (ip >= inLen)
+                    {
+                    return(FALSE);
+                    }
+
+                c = in[ip++];
+                len += c;
+                } while (c == 255);
+            }
+
+        len += TzMinMatch;
+        if (ip + 2 > inLen)
+            {
+            return(FALSE);
+            }
+
+        offset = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op || op + len > outLen)
+            {
+            return(FALSE);
+            }
+
+        /*
+        **  Byte by byte, the source may overlap the destination.
+        */
+        while (len-- > 0)
+            {
+            out[op] = out[op - offset];
+            op += 1;
+            }
+        }
+
+    return(op == outLen);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Get a 32 bit little endian value.
+**
+**  Parameters:     Name        Description.
+**                  p           Pointer to the value.
+**
+**  Returns:        Value.
+**
+**------------------------------------------------------------------------*/
+static u32 tapeGetU32(u8 *p)
+    {
+    return(p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24));
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Store a 32 bit little endian value.
+**
+**  Parameters:     Name        Description.
+**                  p           Pointer to the value.
+**                  value       Value to store.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void tapePutU32(u8 *p, u32 value)
+    {
+    p[0] = (u8)(value >>  0);
+    p[1] = (u8)(value >>  8);
+    p[2] = (u8)(value >> 16);
+    p[3] = (u8)(value >> 24);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        stdio stream adapters.
+**
+**------------------------------------------------------------------------*/
+#if defined(__GLIBC__)
+static ssize_t tapeCookieRead(void *cookie, char *buf, size_t size)
+    {
+    return(tapeStreamRead((TzImage *)cookie, buf, size > 0x40000000 ? 0x40000000 : (int)size));
+    }
+
+static ssize_t tapeCookieWrite(void *cookie, const char *buf, size_t size)
+    {
+    int done = tapeStreamWrite((TzImage *)cookie, buf, size > 0x40000000 ? 0x40000000 : (int)size);
+
+    /*
+    **  A cookie write function reports errors by returning 0.
+    */
+    return(done < 0 ? 0 : done);
+    }
+
+static int tapeCookieSeek(void *cookie, off64_t *offset, int whence)
+    {
+    long long pos = *offset;
+
+    if (tapeStreamSeek((TzImage *)cookie, &pos, whence) != 0)
+        {
+        return(-1);
+        }
+
+    *offset = pos;
+    return(0);
+    }
+
+static int tapeCookieClose(void *cookie)
+    {
+    return(tapeStreamClose((TzImage *)cookie));
+    }
+#else
+static int tapeFunRead(void *cookie, char *buf, int size)
+    {
+    return(tapeStreamRead((TzImage *)cookie, buf, size));
+    }
+
+static int tapeFunWrite(void *cookie, const char *buf, int size)
+    {
+    return(tapeStreamWrite((TzImage *)cookie, buf, size));
+    }
+
+static fpos_t tapeFunSeek(void *cookie, fpos_t offset, int whence)
+    {
+    long long pos = offset;
+
+    if (tapeStreamSeek((TzImage *)cookie, &pos, whence) != 0)
+        {
+        return(-1);
+        }
+
+    return((fpos_t)pos);
+    }
+
+static int tapeFunClose(void *cookie)
+    {
+    return(tapeStreamClose((TzImage *)cookie));
+    }
+#endif
+#endif
+
+/*---------------------------  End Of File  ------------------------------*/
@@ -0,0 +1,309 @@
+/*--------------------------------------------------------------------------
+**
+**  Copyright (c) 2003-2011, Tom Hunter
+**
+**  Name: timer.c
+**
+**  Description:
+**      Central timer service for device delays. Timers are kept in a
+**      hashed timer wheel indexed by the RTC microsecond clock, so device
+**      timing is independent of the speed of the emulation loop.
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License version 3 as
+**  published by the Free Software Foundation.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License version 3 for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  version 3 along with this program in file "license-gpl-3.0.txt".
+**  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+**
+**--------------------------------------------------------------------------
+*/
+
+/*
+**  -------------
+**  Include Files
+**  -------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "const.h"
+#include "types.h"
+#include "proto.h"
+
+/*
+**  -----------------
+**  Private Constants
+**  -----------------
+*/
+
+/*
+**  Each wheel slot covers 16 microseconds, the whole wheel 4096 microseconds.
+**  Timers further out simply stay in their slot for more than one revolution.
+*/
+#define TimerSlotShift          4
+#define TimerWheelSlots         256
+#define TimerWheelMask          (TimerWheelSlots - 1)
+
+/*
+**  -----------------------
+**  Private Macro Functions
+**  -----------------------
+*/
+#define TimerTick(us)           ((us) >> TimerSlotShift)
+
+/*
+**  -----------------------------------------
+**  Private Typedef and Structure Definitions
+**  -----------------------------------------
+*/
+
+/*
+**  ---------------------------
+**  Private Function Prototypes
+**  ---------------------------
+*/
+static void timerLink(TimerSlot *tp);
+static void timerUnlink(TimerSlot *tp);
+static void timerExpireSlot(u32 tick);
+
+/*
+**  ----------------
+**  Public Variables
+**  ----------------
+*/
+
+/*
+**  -----------------
+**  Private Variables
+**  -----------------
+*/
+static TimerSlot *timerWheel[TimerWheelSlots];
+static u32 timerCount = 0;
+static u32 timerLastTick;
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Public Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Start (or restart) a timer.
+**
+**  Parameters:     Name        Description.
+**                  tp          pointer to timer
+**                  delayUs     delay in microseconds
+**                  callback    expiry handler (may be NULL)
+**                  param       parameter passed to expiry handler
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void timerStart(TimerSlot *tp, u32 delayUs, void (*callback)(void *param), void *param)
+    {
+    if (tp->pending)
+        {
+        timerUnlink(tp);
+        }
+
+    if (timerCount == 0)
+        {
+        /*
+        **  The clock is not sampled while no timers are running, so bring
+        **  it up to date before using it as the base for this timer.
+        */
+        rtcReadUsCounter();
+        timerLastTick = TimerTick(rtcClock);
+        }
+
+    tp->callback = callback;
+    tp->param = param;
+    tp->expiry = rtcClock + delayUs;
+    timerLink(tp);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Cancel a timer.
+**
+**  Parameters:     Name        Description.
+**                  tp          pointer to timer
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void timerCancel(TimerSlot *tp)
+    {
+    if (tp->pending)
+        {
+        timerUnlink(tp);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Check if a timer is still running.
+**
+**  Parameters:     Name        Description.
+**                  tp          pointer to timer
+**
+**  Returns:        TRUE if timer has not yet expired, FALSE otherwise.
+**
+**------------------------------------------------------------------------*/
+bool timerPending(TimerSlot *tp)
+    {
+    return(tp->pending);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Advance the timer wheel to the current RTC time and
+**                  call the handlers of all expired timers.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void timerStep(void)
+    {
+    u32 nowTick;
+    u32 ticks;
+
+    if (timerCount == 0)
+        {
+        return;
+        }
+
+    rtcReadUsCounter();
+
+    /*
+    **  Visit every slot passed since the last step, but never more than
+    **  one full revolution. The current slot is always visited because
+    **  it may hold timers expiring within this tick.
+    */
+    nowTick = TimerTick(rtcClock);
+    ticks = nowTick - timerLastTick;
+    if (ticks >= TimerWheelSlots)
+        {
+        ticks = TimerWheelSlots - 1;
+        }
+
+    do
+        {
+        timerExpireSlot(nowTick - ticks);
+        } while (ticks-- != 0 && timerCount != 0);
+
+    timerLastTick = nowTick;
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Link timer into its wheel slot.
+**
+**  Parameters:     Name        Description.
+**                  tp          pointer to timer
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void timerLink(TimerSlot *tp)
+    {
+    TimerSlot **head = timerWheel + (TimerTick(tp->expiry) & TimerWheelMask);
+
+    tp->prev = NULL;
+    tp->next = *head;
+    if (*head != NULL)
+        {
+        (*head)->prev = tp;
+        }
+
+    *head = tp;
+    tp->pending = TRUE;
+    timerCount += 1;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Unlink timer from its wheel slot.
+**
+**  Parameters:     Name        Description.
+**                  tp          pointer to timer
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void timerUnlink(TimerSlot *tp)
+    {
+    if (tp->prev != NULL)
+        {
+        tp->prev->next = tp->next;
+        }
+    else
+        {
+        timerWheel[TimerTick(tp->expiry) & TimerWheelMask] = tp->next;
+        }
+
+    if (tp->next != NULL)
+        {
+        tp->next->prev = tp->prev;
+        }
+
+    tp->next = NULL;
+    tp->prev = NULL;
+    tp->pending = FALSE;
+    timerCount -= 1;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Expire all due timers in one wheel slot.
+**
+**  Parameters:     Name        Description.
+**                  tick        wheel tick to process
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void timerExpireSlot(u32 tick)
+    {
+    TimerSlot *tp;
+
+    tp = timerWheel[tick & TimerWheelMask];
+    while (tp != NULL)
+        {
+        if ((i32)(rtcClock - tp->expiry) < 0)
+            {
+            /*
+            **  Not yet due - belongs to a later revolution or later in this tick.
+            */
+            tp = tp->next;
+            continue;
+            }
+
+        timerUnlink(tp);
+        if (tp->callback != NULL)
+            {
+            tp->callback(tp->param);
+            }
+
+        /*
+        **  The handler may have started or cancelled other timers in this
+        **  slot, so rescan it from the start.
+        */
+        tp = timerWheel[tick & TimerWheelMask];
+        }
+    }
+
+/*---------------------------  End Of File  ------------------------------*/
@@ -109,6 +109,31 @@ typedef struct
     void            (*init)(u8 eqNo, u8 unitNo, u8 channelNo, char *deviceName);
     } DevDesc;
 
+/*
+**  Device performance counters.
+*/
+typedef struct devStats
+    {
+    u32             functions;          /* function codes accepted or processed */
+    u32             wordsIn;            /* words input from device */
+    u32             wordsOut;           /* words output to device */
+    u32             busyMs;             /* time connected to an active channel */
+    u32             hostOps;            /* host I/O operations */
+    u64             hostBytes;          /* host I/O bytes */
+    u32             latency[StatsLatencyBuckets]; /* host I/O latency, bucket n is below 2^n us */
+    u32             blocksUp;           /* NPU blocks sent upline */
+    u32             blocksDown;         /* NPU blocks received downline */
+    } DevStats;
+
+/*
+**  CPU opcode profile counters (see cpuProfile).
+*/
+typedef struct cpuOpStats
+    {
+    u64             count;              /* instructions executed */
+    u64             ticks;              /* host clock ticks spent executing them */
+    } CpuOpStats;
+
 /*
 **  Device control block.
 */                                        
@@ -134,8 +159,74 @@ typedef struct devSlot
     u8              devType;            /* attached device type */
     u8              eqNo;               /* equipment number */
     i8              selectedUnit;       /* selected unit */
+    DevStats        stats;              /* performance counters */
     } DevSlot;                          
                                         
+/*
+**  Timer control block.
+*/
+typedef struct timerSlot
+    {
+    struct timerSlot *next;             /* next timer in same wheel slot */
+    struct timerSlot *prev;             /* previous timer in same wheel slot */
+    void            (*callback)(void *param); /* expiry handler (optional) */
+    void            *param;             /* expiry handler parameter */
+    u32             expiry;             /* RTC microsecond time of expiry */
+    bool            pending;            /* timer is running */
+    } TimerSlot;
+
+/*
+**  Card image and per-reader queue of loaded decks (see deck.c).
+*/
+typedef struct card
+    {
+    PpWord          col[80];            /* ASCII characters or punch images */
+    u8              type;               /* CardAscii or CardRaw */
+    u8              flags;              /* CardFlagXxx */
+    } Card;
+
+typedef struct deckQueue
+    {
+    struct deck     *ring[DeckQueueSize];/* decks loaded but not yet read */
+    volatile u32    head;               /* advanced by loader thread */
+    volatile u32    tail;               /* advanced by emulation thread */
+    struct deck     *current;           /* deck being read */
+    u32             next;               /* next card in current deck */
+    const u16       *table;             /* ASCII to punch table, NULL keeps ASCII */
+    u8              syntax;             /* DeckCr405 or DeckCr3447 */
+    char            watchDir[_MAX_PATH];/* spool directory, empty if none */
+    } DeckQueue;
+
+/*
+**  Tape mount or unload handed to the tape mount thread (see tape.c).
+*/
+typedef struct tapeMount
+    {
+    DevSlot         *dp;                /* device, NULL for an unload */
+    u8              unitNo;             /* unit to load */
+    bool            ringIn;             /* mount with write ring */
+    FILE            *fcb;               /* image opened by the mount thread */
+    char            fileName[_MAX_PATH];/* tape image */
+    void            (*attach)(struct tapeMount *mp); /* called by emulation thread */
+    } TapeMount;
+
+/*
+**  Printer spool (see spool.c).
+*/
+typedef struct spool Spool;
+
+/*
+**  Channel event, due after a number of major cycles.
+*/
+typedef struct chEvent
+    {
+    struct chEvent  *next;              /* next event in order of due cycle */
+    void            (*handler)(void *param); /* handler called when due (optional) */
+    void            *param;             /* handler parameter */
+    u32             due;                /* major cycle at which event is due */
+    bool            pending;            /* event is scheduled */
+    } ChEvent;
+
 /*
 **  Channel control block.
 */                                        
@@ -152,8 +243,8 @@ typedef struct chSlot
     bool            inputPending;       /* input pending flag */
     bool            hardwired;          /* hardwired devices */
     u8              id;                 /* channel number */
-    u8              delayStatus;        /* time to delay change of empty/full status */
-    u8              delayDisconnect;    /* time to delay disconnect */
+    ChEvent         delayStatus;        /* delays change of empty/full status while pending */
+    ChEvent         delayDisconnect;    /* delayed disconnect */
     } ChSlot;                           
                                         
 /*
@@ -196,7 +287,9 @@ typedef struct
     */
     CpWord          iwStack[MaxIwStack];
     u32             iwAddress[MaxIwStack];
-    bool            iwValid[MaxIwStack];
+    u16             iwValid;            /* mask of valid stack entries */
+    u16             iwIndexed;          /* mask of entries found via iwSlot */
+    u8              iwSlot[IwHashSize]; /* stack entry indexed by address hash */
     u8              iwRank;
     } CpuContext;
 
@@ -229,6 +322,18 @@ typedef enum
     IsSeries800             = 0x08000000,
     } ModelFeatures;
 
+/*
+**  Feature sets of the supported models.
+*/
+#define Features6400            (IsSeries6x00)
+#define FeaturesCyber73         (IsSeries70 | HasInterlockReg | HasCMU)
+#define FeaturesCyber173        (IsSeries170 | HasStatusAndControlReg | HasCMU)
+#define FeaturesCyber175        (IsSeries170 | HasStatusAndControlReg | HasInstructionStack | HasIStackPrefetch | Has175Float)
+#define FeaturesCyber840A       (  IsSeries800 | HasNoCmWrap | HasFullRTC | HasTwoPortMux | HasMaintenanceChannel | HasCMU | HasChannelFlag \
+                                 | HasErrorFlag | HasRelocationRegLong | HasMicrosecondClock | HasInstructionStack | HasIStackPrefetch)
+#define FeaturesCyber865        (  IsSeries800 | HasNoCmWrap | HasFullRTC | HasTwoPortMux | HasStatusAndControlReg \
+                                 | HasRelocationRegShort | HasMicrosecondClock | HasInstructionStack | HasIStackPrefetch | Has175Float)
+
 typedef enum
     {
     Model6400,
@@ -0,0 +1,978 @@
+/*--------------------------------------------------------------------------
+**
+**  Copyright (c) 2003-2011, Tom Hunter
+**
+**  Name: window_net.c
+**
+**  Description:
+**      Headless CDC 6612 or CC545 console display. The display list is
+**      served to viewers on a local TCP port instead of being drawn. A
+**      viewer receives a keyframe when it attaches and then only the
+**      changes of each refresh. Characters typed by a viewer are passed
+**      on to the console keyboard.
+**
+**      Every message starts with a 6 byte header followed by a number of
+**      runs of display list entries:
+**
+**          header  type ('K' keyframe or 'D' delta), flags, u16 number
+**                  of entries in the new display list, u16 number of runs
+**          run     u16 index of first entry, u16 number of entries,
+**                  followed by the entries
+**          entry   u16 x, u16 y, u8 font size, u8 character
+**
+**      All u16 values are in network byte order and y counts downward
+**      from the top of the screen. A viewer applies the runs to its copy
+**      of the display list and then truncates it to the new length. A
+**      keyframe is simply a message whose runs cover the whole list.
+**
+**      The port only listens on the loopback interface; remote viewers
+**      should use an SSH tunnel.
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License version 3 as
+**  published by the Free Software Foundation.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License version 3 for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  version 3 along with this program in file "license-gpl-3.0.txt".
+**  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+**
+**--------------------------------------------------------------------------
+*/
+
+/*
+**  -------------
+**  Include Files
+**  -------------
+*/
+#include <pthread.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "const.h"
+#include "types.h"
+#include "proto.h"
+
+/*
+**  -----------------
+**  Private Constants
+**  -----------------
+*/
+#define ListSize        5000
+#define DispBufCount    3
+#define DispBufFresh    4           /* flag in readyBuf: not yet sent */
+#define FrameTime       100000
+#define PollTime        10000
+#define KeyBufSize      1024
+#define KeyCrDelay      300000      /* time for PP program to process a line */
+#define NetHeaderSize   6
+#define NetRunSize      4
+#define NetEntrySize    6
+#define NetFlagPaused   0x01
+#define MaxMsgSize      (NetHeaderSize + NetRunSize + ListSize * NetEntrySize)
+
+/*
+**  -----------------------
+**  Private Macro Functions
+**  -----------------------
+*/
+#define SameEntry(a, b) (   (a)->xPos == (b)->xPos          \
+                         && (a)->yPos == (b)->yPos          \
+                         && (a)->fontSize == (b)->fontSize  \
+                         && (a)->ch == (b)->ch)
+
+/*
+**  -----------------------------------------
+**  Private Typedef and Structure Definitions
+**  -----------------------------------------
+*/
+typedef struct dispList
+    {
+    u16             xPos;           /* horizontal position */
+    u16             yPos;           /* vertical position */
+    u8              fontSize;       /* size of font */
+    u8              ch;             /* character to be displayed */
+    } DispList;
+
+typedef struct dispBuf
+    {
+    DispList        list[ListSize]; /* display list of one frame */
+    u32             listEnd;        /* number of entries used */
+    } DispBuf;
+
+typedef struct netViewer
+    {
+    int             connFd;         /* socket, -1 if slot is free */
+    bool            needKey;        /* next message must be a keyframe */
+    u32             outLen;         /* bytes in output buffer */
+    u32             outPos;         /* bytes already sent */
+    u8              outBuf[MaxMsgSize];
+    } NetViewer;
+
+/*
+**  ---------------------------
+**  Private Function Prototypes
+**  ---------------------------
+*/
+static void *windowThread(void *param);
+static void windowPublish(void);
+static int windowNetListen(void);
+static void windowNetAccept(int listenFd);
+static void windowNetClose(NetViewer *vp);
+static void windowNetReceive(NetViewer *vp);
+static void windowNetFlush(NetViewer *vp);
+static void windowNetFeedKey(u32 now);
+static void windowNetFrame(void);
+static void windowNetQueue(NetViewer *vp, u8 *msg, u32 len);
+static u32 windowNetEncode(u8 *msg, DispList *old, u32 oldEnd, DispList *cur, u32 curEnd, u8 flags);
+static u8 *windowNetPutRun(u8 *mp, u32 start, DispList *list, u32 count);
+static u32 windowNetTime(void);
+
+/*
+**  ----------------
+**  Public Variables
+**  ----------------
+*/
+
+/*
+**  -----------------
+**  Private Variables
+**  -----------------
+*/
+static volatile bool displayActive = FALSE;
+static u8 currentFont;
+static i16 currentX;
+static i16 currentY;
+static u16 oldCurrentY;
+
+/*
+**  Triple buffered display list. The emulation thread fills dispBuf[backBuf],
+**  the network thread sends dispBuf[frontBuf] and completed frames are
+**  handed over through readyBuf with an atomic exchange.
+*/
+static DispBuf dispBuf[DispBufCount];
+static int backBuf = 0;
+static int frontBuf = 1;
+static volatile int readyBuf = 2;
+static bool updateSeen = FALSE;
+
+/*
+**  State owned by the network thread.
+*/
+static NetViewer *viewers;
+static DispList shownList[ListSize];
+static u32 shownEnd = 0;
+static u8 shownFlags = 0;
+static u8 deltaMsg[MaxMsgSize];
+static u8 keyMsg[MaxMsgSize];
+static u8 keyBuf[KeyBufSize];
+static u32 keyIn = 0;
+static u32 keyOut = 0;
+static u8 lastKey = 0;
+static u32 keyHold;
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Public Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Create POSIX thread which will serve the display to
+**                  network viewers.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void windowInit(void)
+    {
+    int rc;
+    int i;
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    /*
+    **  Create display list pool.
+    */
+    dispBuf[backBuf].listEnd = 0;
+
+    /*
+    **  Allocate viewer slots.
+    */
+    viewers = calloc(consoleNetConns, sizeof(NetViewer));
+    if (viewers == NULL)
+        {
+        fprintf(stderr, "Failed to allocate console viewer slots\n");
+        exit(1);
+        }
+
+    for (i = 0; i < consoleNetConns; i++)
+        {
+        viewers[i].connFd = -1;
+        }
+
+    /*
+    **  Disable SIGPIPE which is raised when a viewer disconnects.
+    */
+    signal(SIGPIPE, SIG_IGN);
+
+    /*
+    **  Create POSIX thread with default attributes.
+    */
+    displayActive = TRUE;
+    pthread_attr_init(&attr);
+    rc = pthread_create(&thread, &attr, windowThread, (void *)(long)windowNetListen());
+    if (rc != 0)
+        {
+        fprintf(stderr, "Failed to create console network thread\n");
+        exit(1);
+        }
+
+    printf("Console display served on port %d\n", consoleNetPort);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Set font size.
+**
+**  Parameters:     Name        Description.
+**                  size        font size in points.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void windowSetFont(u8 font)
+    {
+    currentFont = font;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Set X coordinate.
+**
+**  Parameters:     Name        Description.
+**                  x           horinzontal coordinate (0 - 0777)
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void windowSetX(u16 x)
+    {
+    currentX = x;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Set Y coordinate.
+**
+**  Parameters:     Name        Description.
+**                  y           vertical coordinate (0 - 0777)
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void windowSetY(u16 y)
+    {
+    currentY = 0777 - y;
+    if (oldCurrentY > currentY && !updateSeen)
+        {
+        /*
+        **  Without explicit updates from the console driver a frame ends
+        **  when the beam returns to the top.
+        */
+        windowPublish();
+        }
+
+    oldCurrentY = currentY;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Queue characters.
+**
+**  Parameters:     Name        Description.
+**                  ch          character to be queued.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void windowQueue(u8 ch)
+    {
+    DispBuf *bp = dispBuf + backBuf;
+    DispList *elem;
+
+    if (   bp->listEnd >= ListSize
+        || currentX == -1
+        || currentY == -1)
+        {
+        return;
+        }
+
+    if (ch != 0)
+        {
+        elem = bp->list + bp->listEnd++;
+        elem->ch = ch;
+        elem->fontSize = currentFont;
+        elem->xPos = currentX;
+        elem->yPos = currentY;
+        }
+
+    currentX += currentFont;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Update window.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void windowUpdate(void)
+    {
+    updateSeen = TRUE;
+    windowPublish();
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Poll the keyboard (dummy, keys are fed by the network
+**                  thread).
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing
+**
+**------------------------------------------------------------------------*/
+void windowGetChar(void)
+    {
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Terminate console display server.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+void windowTerminate(void)
+    {
+    printf("Shutting down console network thread\n");
+    displayActive = FALSE;
+    sleep(1);
+    printf("Shutting down main thread\n");
+    }
+
+/*
+**--------------------------------------------------------------------------
+**
+**  Private Functions
+**
+**--------------------------------------------------------------------------
+*/
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Console network thread.
+**
+**  Parameters:     Name        Description.
+**                  param       listening socket
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void *windowThread(void *param)
+    {
+    int listenFd = (int)(long)param;
+    fd_set readFds;
+    fd_set writeFds;
+    struct timeval timeout;
+    NetViewer *vp;
+    int maxFd;
+    int rc;
+    int i;
+    u32 now;
+    u32 lastFrame;
+
+    lastFrame = windowNetTime();
+    keyHold = lastFrame;
+
+    while (displayActive)
+        {
+        /*
+        **  Wait for new viewers, keystrokes or room to send more output.
+        */
+        FD_ZERO(&readFds);
+        FD_ZERO(&writeFds);
+        FD_SET(listenFd, &readFds);
+        maxFd = listenFd;
+
+        for (i = 0, vp = viewers; i < consoleNetConns; i++, vp++)
+            {
+            if (vp->connFd < 0)
+                {
+                continue;
+                }
+
+            FD_SET(vp->connFd, &readFds);
+            if (vp->outPos < vp->outLen)
+                {
+                FD_SET(vp->connFd, &writeFds);
+                }
+
+            if (vp->connFd > maxFd)
+                {
+                maxFd = vp->connFd;
+                }
+            }
+
+        timeout.tv_sec = 0;
+        timeout.tv_usec = PollTime;
+        rc = select(maxFd + 1, &readFds, &writeFds, NULL, &timeout);
+        if (rc < 0 && errno != EINTR)
+            {
+            logError(LogErrorLocation, "console select failed: %s\n", strerror(errno));
+            break;
+            }
+
+        if (rc > 0)
+            {
+            if (FD_ISSET(listenFd, &readFds))
+                {
+                windowNetAccept(listenFd);
+                }
+
+            for (i = 0, vp = viewers; i < consoleNetConns; i++, vp++)
+                {
+                if (vp->connFd >= 0 && FD_ISSET(vp->connFd, &readFds))
+                    {
+                    windowNetReceive(vp);
+                    }
+
+                if (vp->connFd >= 0 && FD_ISSET(vp->connFd, &writeFds))
+                    {
+                    windowNetFlush(vp);
+                    }
+                }
+            }
+
+        now = windowNetTime();
+        windowNetFeedKey(now);
+
+        if (now - lastFrame >= FrameTime)
+            {
+            lastFrame = now;
+            windowNetFrame();
+            }
+        }
+
+    for (i = 0, vp = viewers; i < consoleNetConns; i++, vp++)
+        {
+        if (vp->connFd >= 0)
+            {
+            windowNetClose(vp);
+            }
+        }
+
+    close(listenFd);
+    pthread_exit(NULL);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Hand the completed back buffer over to the network
+**                  thread and start filling a free one.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void windowPublish(void)
+    {
+    int readyFlags;
+
+    if (dispBuf[backBuf].listEnd == 0)
+        {
+        return;
+        }
+
+    /*
+    **  Make the display list visible before the buffer is handed over.
+    */
+    __sync_synchronize();
+    readyFlags = __sync_lock_test_and_set(&readyBuf, backBuf | DispBufFresh);
+    backBuf = readyFlags & ~DispBufFresh;
+    dispBuf[backBuf].listEnd = 0;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Create the listening socket for console viewers.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Socket descriptor.
+**
+**------------------------------------------------------------------------*/
+static int windowNetListen(void)
+    {
+    struct sockaddr_in server;
+    int listenFd;
+    int optEnable = 1;
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0)
+        {
+        fprintf(stderr, "Console: Can't create socket\n");
+        exit(1);
+        }
+
+    /*
+    **  Accept will block if a viewer drops the connection attempt between
+    **  select and accept, so make the listening socket non-blocking.
+    */
+    fcntl(listenFd, F_SETFL, O_NONBLOCK);
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, (void *)&optEnable, sizeof(optEnable));
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server.sin_port = htons(consoleNetPort);
+
+    if (bind(listenFd, (struct sockaddr *)&server, sizeof(server)) < 0)
+        {
+        fprintf(stderr, "Console: Can't bind to port %d\n", consoleNetPort);
+        exit(1);
+        }
+
+    if (listen(listenFd, 5) < 0)
+        {
+        fprintf(stderr, "Console: Can't listen on port %d\n", consoleNetPort);
+        exit(1);
+        }
+
+    return(listenFd);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Accept a new viewer.
+**
+**  Parameters:     Name        Description.
+**                  listenFd    listening socket
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void windowNetAccept(int listenFd)
+    {
+    static char busyMsg[] = "No free console viewer slots - please try again later.\r\n";
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    NetViewer *vp;
+    int connFd;
+    int i;
+
+    connFd = accept(listenFd, (struct sockaddr *)&from, &fromLen);
+    if (connFd < 0)
+        {
+        return;
+        }
+
+    for (i = 0, vp = viewers; i < consoleNetConns; i++, vp++)
+        {
+        if (vp->connFd < 0)
+            {
+            break;
+            }
+        }
+
+    if (i == consoleNetConns)
+        {
+        send(connFd, busyMsg, strlen(busyMsg), 0);
+        close(connFd);
+        return;
+        }
+
+    /*
+    **  Output is buffered per viewer, so a slow viewer never holds up
+    **  the others.
+    */
+    fcntl(connFd, F_SETFL, O_NONBLOCK);
+    vp->connFd = connFd;
+    vp->needKey = TRUE;
+    vp->outLen = 0;
+    vp->outPos = 0;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Close a viewer connection.
+**
+**  Parameters:     Name        Description.
+**                  vp          pointer to viewer
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void windowNetClose(NetViewer *vp)
+    {
+    close(vp->connFd);
+    vp->connFd = -1;
+    vp->outLen = 0;
+    vp->outPos = 0;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Receive keystrokes from a viewer.
+**
+**  Parameters:     Name        Description.
+**                  vp          pointer to viewer
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void windowNetReceive(NetViewer *vp)
+    {
+    u8 buf[128];
+    int len;
+    int i;
+
+    len = recv(vp->connFd, buf, sizeof(buf), 0);
+    if (len <= 0)
+        {
+        if (len == 0 || (errno != EAGAIN && errno != EINTR))
+            {
+            windowNetClose(vp);
+            }
+
+        return;
+        }
+
+    for (i = 0; i < len; i++)
+        {
+        if (((keyIn + 1) & (KeyBufSize - 1)) == keyOut)
+            {
+            /*
+            **  Type-ahead buffer is full - drop the rest.
+            */
+            break;
+            }
+
+        keyBuf[keyIn] = buf[i];
+        keyIn = (keyIn + 1) & (KeyBufSize - 1);
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Send as much buffered output as the viewer accepts.
+**
+**  Parameters:     Name        Description.
+**                  vp          pointer to viewer
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void windowNetFlush(NetViewer *vp)
+    {
+    int len;
+
+    len = send(vp->connFd, vp->outBuf + vp->outPos, vp->outLen - vp->outPos, 0);
+    if (len < 0)
+        {
+        if (errno != EAGAIN && errno != EINTR)
+            {
+            windowNetClose(vp);
+            }
+
+        return;
+        }
+
+    vp->outPos += len;
+    if (vp->outPos >= vp->outLen)
+        {
+        vp->outLen = 0;
+        vp->outPos = 0;
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Pass the next typed character on to the console once
+**                  the previous one has been picked up.
+**
+**  Parameters:     Name        Description.
+**                  now         current time in microseconds
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void windowNetFeedKey(u32 now)
+    {
+    u8 ch;
+
+    while (ppKeyIn == 0 && keyOut != keyIn && (i32)(now - keyHold) >= 0)
+        {
+        ch = keyBuf[keyOut];
+        keyOut = (keyOut + 1) & (KeyBufSize - 1);
+
+        /*
+        **  Accept DOS/Windows or UNIX style line terminators.
+        */
+        if (ch == '\n' && lastKey == '\r')
+            {
+            lastKey = ch;
+            continue;
+            }
+
+        lastKey = ch;
+        if (ch == '\n')
+            {
+            ch = '\r';
+            }
+
+        if (ch == '\r')
+            {
+            /*
+            **  Short delay to allow PP program to process the line.
+            */
+            keyHold = now + KeyCrDelay;
+            }
+
+        ppKeyIn = ch;
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Send the most recent frame to all viewers.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void windowNetFrame(void)
+    {
+    NetViewer *vp;
+    DispBuf *bp;
+    int readyFlags;
+    u32 deltaLen = 0;
+    u32 keyLen = 0;
+    u8 flags;
+    int i;
+
+    flags = opActive ? NetFlagPaused : 0;
+
+    /*
+    **  Pick up the most recently completed frame and encode the changes
+    **  since the last frame sent.
+    */
+    if ((readyBuf & DispBufFresh) != 0)
+        {
+        readyFlags = __sync_lock_test_and_set(&readyBuf, frontBuf);
+        frontBuf = readyFlags & ~DispBufFresh;
+        bp = dispBuf + frontBuf;
+
+        deltaLen = windowNetEncode(deltaMsg, shownList, shownEnd, bp->list, bp->listEnd, flags);
+        memcpy(shownList, bp->list, bp->listEnd * sizeof(DispList));
+        shownEnd = bp->listEnd;
+        shownFlags = flags;
+        }
+    else if (flags != shownFlags)
+        {
+        deltaLen = windowNetEncode(deltaMsg, shownList, shownEnd, shownList, shownEnd, flags);
+        shownFlags = flags;
+        }
+
+    for (i = 0, vp = viewers; i < consoleNetConns; i++, vp++)
+        {
+        if (vp->connFd < 0)
+            {
+            continue;
+            }
+
+        if (vp->outLen != 0)
+            {
+            /*
+            **  Viewer has not yet taken the previous message. It will get
+            **  a keyframe when it has caught up.
+            */
+            vp->needKey = TRUE;
+            continue;
+            }
+
+        if (vp->needKey)
+            {
+            if (keyLen == 0)
+                {
+                keyLen = windowNetEncode(keyMsg, NULL, 0, shownList, shownEnd, shownFlags);
+                }
+
+            vp->needKey = FALSE;
+            windowNetQueue(vp, keyMsg, keyLen);
+            }
+        else if (deltaLen != 0)
+            {
+            windowNetQueue(vp, deltaMsg, deltaLen);
+            }
+        }
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Queue a message for a viewer and start sending it.
+**
+**  Parameters:     Name        Description.
+**                  vp          pointer to viewer
+**                  msg         message
+**                  len         message length
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void windowNetQueue(NetViewer *vp, u8 *msg, u32 len)
+    {
+    memcpy(vp->outBuf, msg, len);
+    vp->outLen = len;
+    vp->outPos = 0;
+    windowNetFlush(vp);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Encode the differences between two display lists. If
+**                  the differences take more space than the whole list
+**                  a keyframe is encoded instead.
+**
+**  Parameters:     Name        Description.
+**                  msg         message buffer (MaxMsgSize bytes)
+**                  old         previous display list or NULL for keyframe
+**                  oldEnd      number of entries in previous list
+**                  cur         new display list
+**                  curEnd      number of entries in new list
+**                  flags       display flags
+**
+**  Returns:        Message length, 0 if nothing has changed.
+**
+**------------------------------------------------------------------------*/
+static u32 windowNetEncode(u8 *msg, DispList *old, u32 oldEnd, DispList *cur, u32 curEnd, u8 flags)
+    {
+    u8 *mp = msg + NetHeaderSize;
+    u8 *keyEnd = msg + NetHeaderSize + NetRunSize + curEnd * NetEntrySize;
+    u16 runs = 0;
+    u32 start;
+    u32 i;
+
+    if (old != NULL)
+        {
+        i = 0;
+        while (i < curEnd)
+            {
+            if (i < oldEnd && SameEntry(old + i, cur + i))
+                {
+                i += 1;
+                continue;
+                }
+
+            start = i;
+            while (i < curEnd && (i >= oldEnd || !SameEntry(old + i, cur + i)))
+                {
+                i += 1;
+                }
+
+            if (mp + NetRunSize + (i - start) * NetEntrySize >= keyEnd)
+                {
+                /*
+                **  Cheaper to send everything.
+                */
+                old = NULL;
+                break;
+                }
+
+            mp = windowNetPutRun(mp, start, cur + start, i - start);
+            runs += 1;
+            }
+
+        if (old != NULL && runs == 0 && curEnd == oldEnd && flags == shownFlags)
+            {
+            return(0);
+            }
+        }
+
+    if (old == NULL)
+        {
+        mp = msg + NetHeaderSize;
+        runs = 0;
+        if (curEnd != 0)
+            {
+            mp = windowNetPutRun(mp, 0, cur, curEnd);
+            runs = 1;
+            }
+        }
+
+    msg[0] = old == NULL ? 'K' : 'D';
+    msg[1] = flags;
+    msg[2] = (u8)(curEnd >> 8);
+    msg[3] = (u8)(curEnd >> 0);
+    msg[4] = (u8)(runs >> 8);
+    msg[5] = (u8)(runs >> 0);
+
+    return(mp - msg);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Append a run of display list entries to a message.
+**
+**  Parameters:     Name        Description.
+**                  mp          current message position
+**                  start       index of first entry
+**                  list        pointer to first entry
+**                  count       number of entries
+**
+**  Returns:        New message position.
+**
+**------------------------------------------------------------------------*/
+static u8 *windowNetPutRun(u8 *mp, u32 start, DispList *list, u32 count)
+    {
+    *mp++ = (u8)(start >> 8);
+    *mp++ = (u8)(start >> 0);
+    *mp++ = (u8)(count >> 8);
+    *mp++ = (u8)(count >> 0);
+
+    while (count--)
+        {
+        *mp++ = (u8)(list->xPos >> 8);
+        *mp++ = (u8)(list->xPos >> 0);
+        *mp++ = (u8)(list->yPos >> 8);
+        *mp++ = (u8)(list->yPos >> 0);
+        *mp++ = list->fontSize;
+        *mp++ = list->ch;
+        list += 1;
+        }
+
+    return(mp);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Return a free running microsecond clock.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Time in microseconds.
+**
+**------------------------------------------------------------------------*/
+static u32 windowNetTime(void)
+    {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return((u32)tv.tv_sec * 1000000 + (u32)tv.tv_usec);
+    }
+
+/*---------------------------  End Of File  ------------------------------*/
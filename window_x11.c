@@ -47,6 +47,9 @@
 **  -----------------
 */
 #define ListSize        5000
+#define DispBufCount    3
+#define DispBufFresh    4           /* flag in readyBuf: not yet rendered */
+#define MaxRun          128         /* max characters or dots per X request */
 #define FrameTime       100000
 #define FramesPerSecond (1000000 / FrameTime)
 
@@ -69,12 +72,22 @@ typedef struct dispList
     u8              ch;             /* character to be displayed */
     } DispList;
 
+typedef struct dispBuf
+    {
+    DispList        list[ListSize]; /* display list of one frame */
+    u32             listEnd;        /* number of entries used */
+    } DispBuf;
+
 /*
 **  ---------------------------
 **  Private Function Prototypes
 **  ---------------------------
 */
 void *windowThread(void *param);
+static void windowPublish(void);
+static u32 windowHashFrame(DispList *list, u32 count, u32 hash);
+static void windowDrawRun(Drawable d, GC gc, int x, int y, char *text, int count, int gap);
+static int windowFontGap(Font font, u8 fontSize);
 
 /*
 **  ----------------
@@ -92,15 +105,23 @@ static u8 currentFont;
 static i16 currentX;
 static i16 currentY;
 static u16 oldCurrentY;
-static DispList display[ListSize];
-static u32 listEnd;
+
+/*
+**  Triple buffered display list. The emulation thread fills dispBuf[backBuf],
+**  the window thread renders dispBuf[frontBuf] and completed frames are
+**  handed over through readyBuf with an atomic exchange.
+*/
+static DispBuf dispBuf[DispBufCount];
+static int backBuf = 0;
+static int frontBuf = 1;
+static volatile int readyBuf = 2;
+static bool updateSeen = FALSE;
 static Font hSmallFont;
 static Font hMediumFont;
 static Font hLargeFont;
 static int width;
 static int height;
 static bool refresh = FALSE;
-static pthread_mutex_t mutexDisplay;
 static Display *disp;
 static Window window;
 static u8 *lpClipToKeyboard = NULL;
@@ -133,12 +154,7 @@ void windowInit(void)
     /*
     **  Create display list pool.
     */
-    listEnd = 0;
-
-    /*
-    **  Create a mutex to synchronise access to display list.
-    */
-    pthread_mutex_init(&mutexDisplay, NULL);
+    dispBuf[backBuf].listEnd = 0;
 
     /*
     **  Create POSIX thread with default attributes.
@@ -191,6 +207,15 @@ void windowSetY(u16 y)
     if (oldCurrentY > currentY)
         {
         refresh = TRUE;
+
+        /*
+        **  Without explicit updates from the console driver a frame ends
+        **  when the beam returns to the top.
+        */
+        if (!updateSeen)
+            {
+            windowPublish();
+            }
         }
 
     oldCurrentY = currentY;
@@ -207,23 +232,19 @@ void windowSetY(u16 y)
 **------------------------------------------------------------------------*/
 void windowQueue(u8 ch)
     {
+    DispBuf *bp = dispBuf + backBuf;
     DispList *elem;
 
-    if (   listEnd  >= ListSize
+    if (   bp->listEnd >= ListSize
         || currentX == -1
         || currentY == -1)
         {
         return;
         }
 
-    /*
-    **  Protect display list.
-    */
-    pthread_mutex_lock (&mutexDisplay);
-
     if (ch != 0)
         {
-        elem = display + listEnd++;
+        elem = bp->list + bp->listEnd++;
         elem->ch = ch;
         elem->fontSize = currentFont;
         elem->xPos = currentX;
@@ -231,11 +252,6 @@ void windowQueue(u8 ch)
         }
 
     currentX += currentFont;
-
-    /*
-    **  Release display list.
-    */
-    pthread_mutex_unlock (&mutexDisplay);
     }
 
 /*--------------------------------------------------------------------------
@@ -249,6 +265,8 @@ void windowQueue(u8 ch)
 void windowUpdate(void)
     {
     refresh = TRUE;
+    updateSeen = TRUE;
+    windowPublish();
     }
 
 /*--------------------------------------------------------------------------
@@ -310,9 +328,18 @@ void *windowThread(void *param)
     XWindowAttributes a;
     XColor b,c;
     static int refreshCount = 0;
-    char str[2] = " ";
     DispList *curr;
     DispList *end;
+    DispBuf *bp;
+    DispList *next;
+    int readyFlags;
+    char runText[MaxRun];
+    XPoint runPoints[MaxRun];
+    int runCount;
+    int gap[FontLarge + 1];
+    u32 frameHash;
+    u32 lastFrameHash = 0;
+    bool redraw = TRUE;
     u8 oldFont = 0;
     Atom targetProperty;
     Atom retAtom;
@@ -378,6 +405,15 @@ void *windowThread(void *param)
     hMediumFont = XLoadFont(disp, "-*-lucidatypewriter-medium-*-*-*-14-*-*-*-*-*-*-*\0");
     hLargeFont = XLoadFont(disp, "-*-lucidatypewriter-medium-*-*-*-24-*-*-*-*-*-*-*\0");
 
+    /*
+    **  Characters are placed at the Cyber font pitch, which differs from the
+    **  width of the X11 fonts. Runs of characters are drawn with this gap.
+    */
+    memset(gap, 0, sizeof(gap));
+    gap[FontSmall] = windowFontGap(hSmallFont, FontSmall);
+    gap[FontMedium] = windowFontGap(hMediumFont, FontMedium);
+    gap[FontLarge] = windowFontGap(hLargeFont, FontLarge);
+
     /*
     **  Setup fore- and back-ground colors.
     */
@@ -417,7 +453,7 @@ void *windowThread(void *param)
     wmhints.flags = InputHint;
     wmhints.input = True;
     XSetWMHints(disp, window, &wmhints);
-    XSelectInput (disp, window, KeyPressMask | KeyReleaseMask | StructureNotifyMask);
+    XSelectInput (disp, window, KeyPressMask | KeyReleaseMask | StructureNotifyMask | ExposureMask);
 
     /*
     **  We like to be on top.
@@ -512,6 +548,11 @@ void *windowThread(void *param)
             case MappingNotify:
                 XRefreshKeyboardMapping ((XMappingEvent *)&event);
                 refresh = TRUE;
+                redraw = TRUE;
+                break;
+
+            case Expose:
+                redraw = TRUE;
                 break;
 
             case ConfigureNotify:
@@ -528,6 +569,7 @@ void *windowThread(void *param)
 
                 XFillRectangle (disp, pixmap, gc, 0, 0, width, height);
                 refresh = TRUE;
+                redraw = TRUE;
                 break;
 
             case KeyPress:
@@ -647,6 +689,35 @@ void *windowThread(void *param)
                 }
             }
 
+        /*
+        **  Pick up the most recently completed frame, otherwise render the
+        **  previous one again.
+        */
+        if ((readyBuf & DispBufFresh) != 0)
+            {
+            readyFlags = __sync_lock_test_and_set(&readyBuf, frontBuf);
+            frontBuf = readyFlags & ~DispBufFresh;
+            }
+
+        bp = dispBuf + frontBuf;
+        end = bp->list + bp->listEnd;
+
+        /*
+        **  Skip the frame if it looks exactly like the last one drawn.
+        */
+#if CcDebug == 1 || CcCycleTime
+        redraw = TRUE;
+#endif
+        frameHash = windowHashFrame(bp->list, bp->listEnd, (opActive ? 1 : 0) + usageDisplayCount * 2);
+        if (!redraw && frameHash == lastFrameHash)
+            {
+            usleep(FrameTime);
+            continue;
+            }
+
+        lastFrameHash = frameHash;
+        redraw = FALSE;
+
         /*
         **  Process any refresh request.
         */
@@ -707,11 +778,6 @@ void *windowThread(void *param)
             XDrawString(disp, pixmap, gc, 20, 256, opMessage, strlen(opMessage));
             }
 
-        /*
-        **  Protect display list.
-        */
-        pthread_mutex_lock(&mutexDisplay);
-
         if (usageDisplayCount != 0)
             {
             /*
@@ -723,17 +789,14 @@ void *windowThread(void *param)
             oldFont = FontMedium;
             XDrawString(disp, pixmap, gc, 20, 256, usageMessage1, strlen(usageMessage1));
             XDrawString(disp, pixmap, gc, 20, 275, usageMessage2, strlen(usageMessage2));
-            listEnd = 0;
+            end = bp->list;
             usageDisplayCount -= 1;
             }
 
         /*
         **  Draw display list in pixmap.
         */
-        curr = display;
-        end = display + listEnd;
-
-        for (curr = display; curr < end; curr++)
+        for (curr = bp->list; curr < end; curr = next)
             {
             /*
             **  Setup new font if necessary.
@@ -758,30 +821,45 @@ void *windowThread(void *param)
                     }
                 }
 
-            /*
-            **  Draw dot or character.
-            */
             if (curr->fontSize == FontDot)
                 {
-                XDrawPoint(disp, pixmap, gc, curr->xPos, (curr->yPos * 14) / 10 + 20);
+                /*
+                **  Draw consecutive dots with a single request.
+                */
+                runCount = 0;
+                for (next = curr; next < end && next->fontSize == FontDot && runCount < MaxRun; next++)
+                    {
+                    runPoints[runCount].x = next->xPos;
+                    runPoints[runCount].y = (next->yPos * 14) / 10 + 20;
+                    runCount += 1;
+                    }
+
+                XDrawPoints(disp, pixmap, gc, runPoints, runCount, CoordModeOrigin);
                 }
             else
                 {
-                str[0] = curr->ch;
-                XDrawString(disp, pixmap, gc, curr->xPos, (curr->yPos * 14) / 10 + 20, str, 1);
+                /*
+                **  Draw characters which follow each other on the same row
+                **  at the font pitch with a single request.
+                */
+                runCount = 0;
+                next = curr;
+                do
+                    {
+                    runText[runCount++] = next++->ch;
+                    } while (   next < end
+                             && runCount < MaxRun
+                             && next->fontSize == curr->fontSize
+                             && next->yPos == curr->yPos
+                             && next->xPos == curr->xPos + runCount * curr->fontSize);
+
+                windowDrawRun(pixmap, gc, curr->xPos, (curr->yPos * 14) / 10 + 20, runText, runCount,
+                    curr->fontSize <= FontLarge ? gap[curr->fontSize] : 0);
                 }
             }
 
-        listEnd = 0;
-        currentX = -1;
-        currentY = -1;
         refresh = FALSE;
 
-        /*
-        **  Release display list.
-        */
-        pthread_mutex_unlock (&mutexDisplay);
-
         /*
         **  Update display from pixmap.
         */
@@ -812,4 +890,118 @@ void *windowThread(void *param)
     pthread_exit(NULL);
     }
 
+/*--------------------------------------------------------------------------
+**  Purpose:        Hand the completed back buffer over to the window
+**                  thread and start filling a free one. An empty frame
+**                  is handed over too, so a cleared screen is shown.
+**
+**  Parameters:     Name        Description.
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void windowPublish(void)
+    {
+    int readyFlags;
+
+    /*
+    **  Make the display list visible before the buffer is handed over.
+    */
+    __sync_synchronize();
+    readyFlags = __sync_lock_test_and_set(&readyBuf, backBuf | DispBufFresh);
+    backBuf = readyFlags & ~DispBufFresh;
+    dispBuf[backBuf].listEnd = 0;
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Hash a display list (FNV-1a).
+**
+**  Parameters:     Name        Description.
+**                  list        display list
+**                  count       number of entries
+**                  hash        additional state to include in hash
+**
+**  Returns:        Hash value.
+**
+**------------------------------------------------------------------------*/
+static u32 windowHashFrame(DispList *list, u32 count, u32 hash)
+    {
+    u32 h = 2166136261U ^ hash;
+
+    while (count--)
+        {
+        h = (h ^ list->xPos) * 16777619U;
+        h = (h ^ list->yPos) * 16777619U;
+        h = (h ^ ((list->fontSize << 8) | list->ch)) * 16777619U;
+        list += 1;
+        }
+
+    return(h);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Draw a run of characters with one X request.
+**
+**  Parameters:     Name        Description.
+**                  d           drawable
+**                  gc          graphics context
+**                  x           horizontal position of first character
+**                  y           baseline
+**                  text        characters
+**                  count       number of characters
+**                  gap         extra space between characters
+**
+**  Returns:        Nothing.
+**
+**------------------------------------------------------------------------*/
+static void windowDrawRun(Drawable d, GC gc, int x, int y, char *text, int count, int gap)
+    {
+    XTextItem items[MaxRun];
+    int i;
+
+    if (gap == 0)
+        {
+        XDrawString(disp, d, gc, x, y, text, count);
+        return;
+        }
+
+    for (i = 0; i < count; i++)
+        {
+        items[i].chars = text + i;
+        items[i].nchars = 1;
+        items[i].delta = i == 0 ? 0 : gap;
+        items[i].font = None;
+        }
+
+    XDrawText(disp, d, gc, x, y, items, count);
+    }
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Determine gap between characters of an X11 font when
+**                  placed at a Cyber font pitch.
+**
+**  Parameters:     Name        Description.
+**                  font        X11 font
+**                  fontSize    Cyber font pitch
+**
+**  Returns:        Gap in pixels.
+**
+**------------------------------------------------------------------------*/
+static int windowFontGap(Font font, u8 fontSize)
+    {
+    XFontStruct *fs;
+    int gap;
+
+    fs = XQueryFont(disp, font);
+    if (fs == NULL)
+        {
+        return(0);
+        }
+
+    gap = fontSize - fs->max_bounds.width;
+    XFreeFontInfo(NULL, fs, 1);
+
+    return(gap);
+    }
+
 /*---------------------------  End Of File  ------------------------------*/